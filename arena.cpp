@@ -0,0 +1,78 @@
+#include <cstdint>
+#include "arena.hpp"
+
+namespace crona{
+
+static const size_t FIRST_CHUNK = 64 * 1024;
+static const size_t MAX_CHUNK = 4 * 1024 * 1024;
+
+static size_t alignUp(size_t n, size_t align){
+	return (n + align - 1) & ~(align - 1);
+}
+
+Arena::Arena()
+: myCur(nullptr), myEnd(nullptr), myChunks(nullptr), myDtors(nullptr),
+  myUsed(0), myReserved(0){
+}
+
+Arena::~Arena(){
+	for (Dtor * d = myDtors; d != nullptr; d = d->prev){
+		d->fn(d->obj);
+	}
+	while (myChunks != nullptr){
+		Chunk * prev = myChunks->prev;
+		::operator delete(myChunks);
+		myChunks = prev;
+	}
+}
+
+void * Arena::alloc(size_t size, size_t align){
+	uintptr_t cur = reinterpret_cast<uintptr_t>(myCur);
+	size_t pad = alignUp(cur, align) - cur;
+	if (myCur == nullptr || pad + size > static_cast<size_t>(myEnd - myCur)){
+		grow(size, align);
+		cur = reinterpret_cast<uintptr_t>(myCur);
+		pad = alignUp(cur, align) - cur;
+	}
+	char * result = myCur + pad;
+	myCur = result + size;
+	myUsed += pad + size;
+	return result;
+}
+
+void Arena::reserve(size_t bytes){
+	if (myCur == nullptr || bytes > static_cast<size_t>(myEnd - myCur)){
+		grow(bytes, alignof(std::max_align_t));
+	}
+}
+
+void Arena::addDtor(void * obj, void (*fn)(void *)){
+	Dtor * d = static_cast<Dtor *>(alloc(sizeof(Dtor), alignof(Dtor)));
+	d->fn = fn;
+	d->obj = obj;
+	d->prev = myDtors;
+	myDtors = d;
+}
+
+/*
+Chunks double in size (up to MAX_CHUNK) so that small parses stay
+small while big ones only hit the system allocator a handful of times.
+Requests larger than a chunk get a chunk of their own.
+*/
+void Arena::grow(size_t size, size_t align){
+	size_t next = myChunks == nullptr ? FIRST_CHUNK : myChunks->size * 2;
+	if (next > MAX_CHUNK){ next = MAX_CHUNK; }
+	size_t header = alignUp(sizeof(Chunk), alignof(std::max_align_t));
+	if (next < header + size + align){ next = header + size + align; }
+
+	Chunk * chunk = static_cast<Chunk *>(::operator new(next));
+	chunk->prev = myChunks;
+	chunk->size = next;
+	myChunks = chunk;
+	myReserved += next;
+
+	myCur = reinterpret_cast<char *>(chunk) + header;
+	myEnd = reinterpret_cast<char *>(chunk) + next;
+}
+
+} //End namespace crona
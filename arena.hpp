@@ -0,0 +1,73 @@
+#ifndef CRONA_ARENA_H
+#define CRONA_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace crona{
+
+/**
+* \class Arena
+* Bump-pointer allocator that owns the tokens and AST nodes built
+* during a parse. Objects are carved out of large chunks and are all
+* released together when the arena is destroyed. Destructors are only
+* recorded (and run, newest first) for types that actually need them,
+* so plain nodes like IntLitNode cost nothing beyond their bytes.
+**/
+class Arena{
+public:
+	Arena();
+	~Arena();
+	Arena(const Arena&) = delete;
+	Arena& operator=(const Arena&) = delete;
+
+	void * alloc(size_t size, size_t align);
+
+	template <typename T, typename... Args>
+	T * make(Args&&... args){
+		void * mem = alloc(sizeof(T), alignof(T));
+		T * obj = new (mem) T(std::forward<Args>(args)...);
+		if (!std::is_trivially_destructible<T>::value){
+			addDtor(obj, &destroy<T>);
+		}
+		return obj;
+	}
+
+	/// Make sure the next bytes bytes of allocations come out of a
+	/// single chunk (e.g. when rebuilding a tree of known size)
+	void reserve(size_t bytes);
+
+	/// Bytes handed out to objects (including alignment padding)
+	size_t bytesUsed() const { return myUsed; }
+	/// Bytes obtained from the system allocator for chunks
+	size_t bytesReserved() const { return myReserved; }
+private:
+	struct Chunk{
+		Chunk * prev;
+		size_t size;
+	};
+	struct Dtor{
+		void (*fn)(void *);
+		void * obj;
+		Dtor * prev;
+	};
+
+	template <typename T>
+	static void destroy(void * obj){ static_cast<T *>(obj)->~T(); }
+
+	void addDtor(void * obj, void (*fn)(void *));
+	void grow(size_t size, size_t align);
+
+	char * myCur;
+	char * myEnd;
+	Chunk * myChunks;
+	Dtor * myDtors;
+	size_t myUsed;
+	size_t myReserved;
+};
+
+} //End namespace crona
+
+#endif
@@ -2,8 +2,13 @@
 #define CRONAC_AST_HPP
 
 #include <ostream>
-#include <list>
+#include <cstdint>
+#include <cstring>
+#include "arena.hpp"
+#include "outbuf.hpp"
+#include "symbols.hpp"
 #include "tokens.hpp"
+#include "types.hpp"
 
 // **********************************************************************
 // ASTnode class (base class for all other kinds of nodes)
@@ -11,23 +16,141 @@
 
 namespace crona{
 
+/**
+* \class NodeList
+* Contiguous list of child node pointers, grown by doubling inside
+* the parse arena. Iterating a function body (or any other child
+* list) is a linear scan over one array. Storage outgrown by a
+* push_back is simply left behind in the arena, which costs at most
+* as much again as the final list.
+**/
+template <typename T>
+class NodeList{
+public:
+	NodeList() : myItems(nullptr), mySize(0), myCap(0) {}
+
+	void push_back(Arena * arena, T * item){
+		if (mySize == myCap){
+			size_t cap = myCap == 0 ? 4 : myCap * 2;
+			T ** items = static_cast<T **>(
+				arena->alloc(cap * sizeof(T *), alignof(T *)));
+			if (mySize > 0){
+				std::memcpy(items, myItems, mySize * sizeof(T *));
+			}
+			myItems = items;
+			myCap = cap;
+		}
+		myItems[mySize++] = item;
+	}
+
+	/**
+	* Replace the count items starting at pos with the n items at
+	* items (e.g. to splice reparsed declarations into a program).
+	* Items after the replaced ones are moved up or down in place.
+	**/
+	void replace(Arena * arena, size_t pos, size_t count,
+		T * const * items, size_t n){
+		size_t size = mySize - count + n;
+		if (size > myCap){
+			size_t cap = myCap == 0 ? 4 : myCap;
+			while (cap < size){ cap *= 2; }
+			T ** grown = static_cast<T **>(
+				arena->alloc(cap * sizeof(T *), alignof(T *)));
+			if (mySize > 0){
+				std::memcpy(grown, myItems, mySize * sizeof(T *));
+			}
+			myItems = grown;
+			myCap = cap;
+		}
+		size_t tail = mySize - pos - count;
+		if (tail > 0){
+			std::memmove(myItems + pos + n, myItems + pos + count,
+				tail * sizeof(T *));
+		}
+		if (n > 0){ std::memcpy(myItems + pos, items, n * sizeof(T *)); }
+		mySize = size;
+	}
+
+	/// Make room for cap items, so that pushing that many never
+	/// leaves outgrown storage behind
+	void reserve(Arena * arena, size_t cap){
+		if (cap <= myCap){ return; }
+		T ** items = static_cast<T **>(
+			arena->alloc(cap * sizeof(T *), alignof(T *)));
+		if (mySize > 0){
+			std::memcpy(items, myItems, mySize * sizeof(T *));
+		}
+		myItems = items;
+		myCap = cap;
+	}
+
+	T * const * begin() const { return myItems; }
+	T * const * end() const { return myItems + mySize; }
+	T * operator[](size_t i) const { return myItems[i]; }
+	void set(size_t i, T * item){ myItems[i] = item; }
+	size_t size() const { return mySize; }
+	bool empty() const { return mySize == 0; }
+private:
+	T ** myItems;
+	size_t mySize;
+	size_t myCap;
+};
+
+/**
+* Every concrete node class, for code that needs to enumerate them
+* (statistics, dispatch tables, ...). Expand with a macro X(Class).
+**/
+#define CRONA_AST_NODES(X) \
+	X(ProgramNode) \
+	X(VarDeclNode) X(FormalDeclNode) X(FnDeclNode) \
+	X(IDNode) X(IndexNode) \
+	X(AssignExpNode) X(CallExpNode) X(FalseNode) X(HavocNode) \
+	X(IntLitNode) X(StrLitNode) X(TrueNode) \
+	X(AndNode) X(DivideNode) X(EqualsNode) X(GreaterEqNode) \
+	X(GreaterNode) X(LessEqNode) X(LessNode) X(MinusNode) \
+	X(NotEqualsNode) X(OrNode) X(PlusNode) X(TimesNode) \
+	X(NegNode) X(NotNode) \
+	X(AssignStmtNode) X(ReadStmtNode) X(WriteStmtNode) \
+	X(PostDecStmtNode) X(PostIncStmtNode) X(IfStmtNode) \
+	X(IfElseStmtNode) X(WhileStmtNode) X(ReturnStmtNode) \
+	X(CallStmtNode)
+
+enum class NodeKind : unsigned char{
+#define CRONA_NODE_KIND(name) name,
+	CRONA_AST_NODES(CRONA_NODE_KIND)
+#undef CRONA_NODE_KIND
+};
+
+#define CRONA_COUNT_NODE(name) + 1
+const size_t NUM_NODE_KINDS = 0 CRONA_AST_NODES(CRONA_COUNT_NODE);
+#undef CRONA_COUNT_NODE
+
+/// The class name of a node kind, e.g. "IDNode"
+const char * nodeKindString(NodeKind kind);
+
 /* You may find it useful to forward declare AST subclasses
    here so that you can use a class before it's full definition
 */
 class DeclListNode;
 class DeclNode;
-class TypeNode;
 class IDNode;
 class StmtNode;
+class ThreadPool;
 
 class ASTNode{
 public:
-	ASTNode(size_t lineIn, size_t colIn)
-	: l(lineIn), c(colIn) {}
+	ASTNode(NodeKind kindIn, size_t lineIn, size_t colIn)
+	: l(lineIn), c(static_cast<uint32_t>(colIn)), k(kindIn) {}
+
+	/// Write the node out as Crona source (see Unparser)
+	void unparse(OutBuf& out, int indent);
+	/// Adapter for writing to a stream (buffered through an OutBuf)
+	void unparse(std::ostream& out, int indent);
 
-	virtual void unparse(std::ostream& out, int indent) = 0;
 	size_t line(){ return l; }
 	size_t col() { return c; }
+	/// The node's concrete class, for ASTVisitor to dispatch on
+	NodeKind kind() const { return k; }
 
 	/**
 	* Return a string specifying the position this node begins.
@@ -42,7 +165,8 @@ public:
 
 private:
 	size_t l; /// The line at which the node starts in the input file
-	size_t c; /// The column at which the node starts in the input file
+	uint32_t c; /// The column at which the node starts in the input file
+	NodeKind k; /// Beside the (32-bit) column, so it takes no extra room
 };
 
 /**
@@ -50,16 +174,30 @@ private:
 * Class that contains the entire abstract syntax tree for a program.
 * Note the list of declarations encompasses all global declarations
 * which includes (obviously) all global variables and struct declarations
-* and (perhaps less obviously), all function declarations
+* and (perhaps less obviously), all function declarations.
+* The ProgramNode owns the arena that every other node (and token)
+* of the parse was allocated from, so deleting it frees the whole tree.
 **/
-class ProgramNode : public ASTNode{
+class ProgramNode final : public ASTNode{
 public:
-	ProgramNode(std::list<DeclNode *> * globalsIn)
-	: ASTNode(1, 1), myGlobals(globalsIn) {}
+	ProgramNode(Arena * arenaIn, NodeList<DeclNode> * globalsIn)
+	: ASTNode(NodeKind::ProgramNode, 1, 1), myArena(arenaIn), myGlobals(*globalsIn) {}
+	~ProgramNode(){ delete myArena; }
+	ProgramNode(const ProgramNode&) = delete;
+	ProgramNode& operator=(const ProgramNode&) = delete;
+
+	Arena * arena(){ return myArena; }
+	/// The global declarations, in source order
+	NodeList<DeclNode>& globals(){ return myGlobals; }
 
-	void unparse(std::ostream& out, int indent) override;
+	/**
+	* Unparse the program (as unparse(out, 0) does, byte for byte)
+	* with the global declarations spread over pool's workers
+	**/
+	void unparseParallel(OutBuf& out, ThreadPool& pool);
 private:
-	std::list<DeclNode * > * myGlobals;
+	Arena * myArena;
+	NodeList<DeclNode> myGlobals;
 };
 
 
@@ -71,135 +209,88 @@ private:
 
 class StmtNode : public ASTNode{
 public:
-	StmtNode(size_t line, size_t col)
-	: ASTNode(line, col) {}
-
-	virtual void unparse(std::ostream& out, int indent) override = 0;
+	StmtNode(NodeKind kind, size_t line, size_t col)
+	: ASTNode(kind, line, col) {}
 };
 
 class DeclNode : public StmtNode{
 public:
-	DeclNode(size_t line, size_t col)
-	: StmtNode(line, col) {}
-
-	void unparse(std::ostream& out, int indent) override = 0;
+	DeclNode(NodeKind kind, size_t line, size_t col)
+	: StmtNode(kind, line, col) {}
 };
 
 class ExpNode : public ASTNode{
 protected:
-	ExpNode(size_t line, size_t col)
-	: ASTNode(line, col) {}
-public:
-	virtual void unparse(std::ostream& out, int indent) override = 0;
-};
-
-class TypeNode : public ASTNode{
-protected:
-	TypeNode(size_t lineIn, size_t colIn)
-	: ASTNode(lineIn, colIn) {}
-
-public:
-	virtual void unparse(std::ostream& out, int indent) = 0;
-	//TODO: consider adding an isRef to use in unparse to
-	// indicate if this is a reference type
+	ExpNode(NodeKind kind, size_t line, size_t col)
+	: ASTNode(kind, line, col) {}
 };
 
 class LValNode : public ExpNode{
 public:
-	LValNode(size_t line, size_t col)
-	: ExpNode(line, col) {}
-	void unparse(std::ostream& out, int indent) override = 0;
+	LValNode(NodeKind kind, size_t line, size_t col)
+	: ExpNode(kind, line, col) {}
 private:
 
 };
 
 class IDNode : public LValNode{
 public:
-	IDNode(IDToken * token)
-	: LValNode(token->line(), token->col()), myStrVal(token->value()) { myStrVal = token->value(); }
+	IDNode(const Token& token)
+	: LValNode(NodeKind::IDNode, token.line(), token.col()), mySymbol(token.symbol()), myDecl(nullptr) { }
 
-	void unparse(std::ostream& out, int indent);
+	/// The interned name; equal names share one Symbol
+	const Symbol * symbol() const { return mySymbol; }
+	/// The declaration the name refers to, once name analysis has
+	/// run (see names.hpp); nullptr before then or if it's undeclared
+	DeclNode * decl(){ return myDecl; }
+	void setDecl(DeclNode * decl){ myDecl = decl; }
 private:
-	std::string myStrVal;
+	const Symbol * mySymbol;
+	DeclNode * myDecl;
 };
 
+/**
+* Declarations hold their type as the canonical DataType (see
+* types.hpp) rather than as nodes of their own. A declaration's
+* position is its name's, where it starts; where the type was
+* written isn't kept.
+**/
 class VarDeclNode : public DeclNode{
 public:
-	VarDeclNode(size_t l, size_t c, TypeNode * type, IDNode * id)
-	: DeclNode(type->line(), type->col()), myType(type), myId(id){}
+	VarDeclNode(size_t l, size_t c, const DataType * type, IDNode * id)
+	: DeclNode(NodeKind::VarDeclNode, l, c), myType(type), myId(id){}
 
-	void unparse(std::ostream& out, int indent);
+	const DataType * type(){ return myType; }
+	IDNode * id(){ return myId; }
+protected:
+	VarDeclNode(NodeKind kind, size_t l, size_t c, const DataType * type, IDNode * id)
+	: DeclNode(kind, l, c), myType(type), myId(id){}
 private:
-	TypeNode * myType;
+	const DataType * myType;
 	IDNode * myId;
 };
 
 class FormalDeclNode : public VarDeclNode{
 public:
-	FormalDeclNode(size_t l, size_t c, TypeNode* type, IDNode* id)
-	: VarDeclNode(type->line(), type->col(), type, id), myType(type), myId(id){
+	FormalDeclNode(size_t l, size_t c, const DataType * type, IDNode* id)
+	: VarDeclNode(NodeKind::FormalDeclNode, l, c, type, id){
 }
-	void unparse(std::ostream& out, int indent);
-private:
-	TypeNode* myType;
-	IDNode* myId;
 };
 
 class FnDeclNode : public DeclNode{
 public:
-	FnDeclNode(size_t l, size_t c, TypeNode* type, IDNode* id, std::list<FormalDeclNode*>* params, std::list<StmtNode*>* body)
-	:  DeclNode(type->line(), type->col()), myType(type), myId(id), formals(params), bodyVal(body) {}
-	void unparse(std::ostream& out, int indent) override;
+	FnDeclNode(size_t l, size_t c, const DataType * type, IDNode* id, NodeList<FormalDeclNode>* params, NodeList<StmtNode>* body)
+	:  DeclNode(NodeKind::FnDeclNode, l, c), myType(type), myId(id), myFormals(*params), myBody(*body) {}
+	/// The return type
+	const DataType * type(){ return myType; }
+	IDNode* id(){ return myId; }
+	NodeList<FormalDeclNode>& formals(){ return myFormals; }
+	NodeList<StmtNode>& body(){ return myBody; }
 private:
-	TypeNode* myType;
+	const DataType * myType;
 	IDNode* myId;
-	std::list<FormalDeclNode*>* formals;
-	std::list<StmtNode*>* bodyVal;
-};
-
-///////TYPENODE CLASSES////////////
-///////////////////////////////////
-
-class ArrayTypeNode : public TypeNode{
-public:
-	ArrayTypeNode(size_t l, size_t c, TypeNode* type, int size)
-	: TypeNode(type->line(), type->col()), myType(type) { mySize = size; }
-	void unparse(std::ostream& out, int indent) override;
-private:
-	TypeNode* myType;
-	int mySize;
-};
-
-class BoolTypeNode : public TypeNode{
-public:
-	BoolTypeNode(size_t l, size_t c)
-	: TypeNode(l,c){}
-	void unparse(std::ostream& out, int indent) override;
-private:
-};
-
-class ByteTypeNode : public TypeNode{
-public:
-	ByteTypeNode(size_t l, size_t c)
-	: TypeNode(l,c){}
-	void unparse(std::ostream& out, int indent) override;
-private:
-};
-
-class IntTypeNode : public TypeNode{
-public:
-	IntTypeNode(size_t lineIn, size_t colIn)
-	: TypeNode(lineIn, colIn) {}
-	void unparse(std::ostream& out, int indent);
-private:
-};
-
-class VoidTypeNode : public TypeNode{
-public:
-	VoidTypeNode(size_t l, size_t c)
-	: TypeNode(l,c){}
-	void unparse(std::ostream& out, int indent) override;
-private:
+	NodeList<FormalDeclNode> myFormals;
+	NodeList<StmtNode> myBody;
 };
 
 ///////EXPNODE CLASSES//////////////
@@ -208,82 +299,90 @@ private:
 class AssignExpNode : public ExpNode{
 public:
 	AssignExpNode(size_t l, size_t c, LValNode* dst, ExpNode* source)
-	: ExpNode(l,c), dest(dst), src(source) { }
-	void unparse(std::ostream& out, int indent) override;
+	: ExpNode(NodeKind::AssignExpNode, l,c), myDest(dst), mySrc(source) { }
+	LValNode* dest(){ return myDest; }
+	ExpNode* src(){ return mySrc; }
+	void setSrc(ExpNode* src){ mySrc = src; }
 private:
-	LValNode* dest;
-	ExpNode* src;
+	LValNode* myDest;
+	ExpNode* mySrc;
 };
 
 class BinaryExpNode : public ExpNode{
 public:
-	BinaryExpNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: ExpNode(l,c), lhs(left), rhs(right) {}
-
+	BinaryExpNode(NodeKind kind, size_t l, size_t c, ExpNode* left, ExpNode* right)
+	: ExpNode(kind,l,c), myLhs(left), myRhs(right) {}
+	ExpNode* lhs(){ return myLhs; }
+	ExpNode* rhs(){ return myRhs; }
+	/// For passes that rewrite the tree in place (see fold.cpp)
+	void setLhs(ExpNode* lhs){ myLhs = lhs; }
+	void setRhs(ExpNode* rhs){ myRhs = rhs; }
 protected:
-	ExpNode* lhs;
-	ExpNode* rhs;
+	ExpNode* myLhs;
+	ExpNode* myRhs;
 };
 
 class CallExpNode : public ExpNode{
 public:
-	CallExpNode(size_t l, size_t c, IDNode* id, std::list<ExpNode*>* listOfExp)
-	: ExpNode(l,c), myIDNode(id), myListOfExp(listOfExp) {}
-	void unparse(std::ostream& out, int indent) override;
+	CallExpNode(size_t l, size_t c, IDNode* id, NodeList<ExpNode>* listOfExp)
+	: ExpNode(NodeKind::CallExpNode, l,c), myIDNode(id), myListOfExp(*listOfExp) {}
+	/// The function called
+	IDNode* id(){ return myIDNode; }
+	NodeList<ExpNode>& args(){ return myListOfExp; }
 private:
 	IDNode* myIDNode;
-	std::list<ExpNode*>* myListOfExp;
+	NodeList<ExpNode> myListOfExp;
 };
 
 class FalseNode : public ExpNode{
 public:
 	FalseNode(size_t l, size_t c)
-	: ExpNode(l,c) { }
-	void unparse(std::ostream& out, int indent) override;
+	: ExpNode(NodeKind::FalseNode, l,c) { }
 private:
 };
 
 class HavocNode : public ExpNode{
 public:
 	HavocNode(size_t l, size_t c)
-	: ExpNode(l,c) {}
-	void unparse(std::ostream& out, int indent) override;
+	: ExpNode(NodeKind::HavocNode, l,c) {}
 private:
 };
 
 class IntLitNode : public ExpNode{
 public:
 	IntLitNode(size_t l, size_t c, const int src)
-	: ExpNode(l,c), val(src) {}
-	void unparse(std::ostream& out, int indent) override;
+	: ExpNode(NodeKind::IntLitNode, l,c), myVal(src) {}
+	int value(){ return myVal; }
 private:
-	int val;
+	int myVal;
 };
 
 class StrLitNode : public ExpNode{
 public:
-	StrLitNode(size_t l, size_t c, const std::string src)
-	: ExpNode(l,c), val(src) {}
-	void unparse(std::ostream& out, int indent) override;
+	StrLitNode(size_t l, size_t c, StrView src)
+	: ExpNode(NodeKind::StrLitNode, l,c), myVal(src) {}
+	/// The literal as written, quotes and escapes included
+	StrView value(){ return myVal; }
 private:
-	std::string val;
+	StrView myVal;
 };
 
 class TrueNode : public ExpNode{
 public:
 	TrueNode(size_t l, size_t c)
-	: ExpNode(l,c) { }
-	void unparse(std::ostream& out, int indent) override;
+	: ExpNode(NodeKind::TrueNode, l,c) { }
 private:
 };
 
 class UnaryExpNode : public ExpNode{
 public:
-	UnaryExpNode(size_t l, size_t c, ExpNode* src)
-	: ExpNode(l,c), val(src) {}
-
+	UnaryExpNode(NodeKind kind, size_t l, size_t c, ExpNode* src)
+	: ExpNode(kind,l,c), myExp(src) {}
+	/// The operand
+	ExpNode* exp(){ return myExp; }
+	void setExp(ExpNode* exp){ myExp = exp; }
 protected:
-	ExpNode* val;
+	ExpNode* myExp;
 };
 
 ///////BINARYEXPNODE SUBCLASSES//////////////
@@ -292,96 +391,84 @@ protected:
 class AndNode : public BinaryExpNode{
 public:
 	AndNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::AndNode, l,c,left,right){}
 private:
 };
 
 class DivideNode : public BinaryExpNode{
 public:
 	DivideNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::DivideNode, l,c,left,right){}
 private:
 };
 
 class EqualsNode : public BinaryExpNode{
 public:
 	EqualsNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::EqualsNode, l,c,left,right){}
 private:
 };
 
 class GreaterEqNode : public BinaryExpNode{
 public:
 	GreaterEqNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::GreaterEqNode, l,c,left,right){}
 private:
 };
 
 class GreaterNode : public BinaryExpNode{
 public:
 	GreaterNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::GreaterNode, l,c,left,right){}
 private:
 };
 
 class LessEqNode : public BinaryExpNode{
 public:
 	LessEqNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::LessEqNode, l,c,left,right){}
 private:
 };
 
 class LessNode : public BinaryExpNode{
 public:
 	LessNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::LessNode, l,c,left,right){}
 private:
 };
 
 class MinusNode : public BinaryExpNode{
 public:
 	MinusNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::MinusNode, l,c,left,right){}
 private:
 };
 
 class NotEqualsNode : public BinaryExpNode{
 public:
 	NotEqualsNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::NotEqualsNode, l,c,left,right){}
 private:
 };
 
 class OrNode : public BinaryExpNode{
 public:
 	OrNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::OrNode, l,c,left,right){}
 private:
 };
 
 class PlusNode : public BinaryExpNode{
 public:
 	PlusNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::PlusNode, l,c,left,right){}
 private:
 };
 
 class TimesNode : public BinaryExpNode{
 public:
 	TimesNode(size_t l, size_t c, ExpNode* left, ExpNode* right)
-	: BinaryExpNode(l,c,left,right){}
-	void unparse(std::ostream& out, int indent) override;
+	: BinaryExpNode(NodeKind::TimesNode, l,c,left,right){}
 private:
 };
 
@@ -391,16 +478,14 @@ private:
 class NegNode : public UnaryExpNode{
 public:
 	NegNode(size_t l, size_t c, ExpNode* src)
-	: UnaryExpNode(l,c,src) { }
-	void unparse(std::ostream& out, int indent) override;
+	: UnaryExpNode(NodeKind::NegNode, l,c,src) { }
 private:
 };
 
 class NotNode : public UnaryExpNode{
 public:
 	NotNode(size_t l, size_t c, ExpNode* src)
-	: UnaryExpNode(l,c,src) { }
-	void unparse(std::ostream& out, int indent) override;
+	: UnaryExpNode(NodeKind::NotNode, l,c,src) { }
 private:
 };
 
@@ -410,8 +495,8 @@ private:
 class AssignStmtNode : public StmtNode{
 public:
 	AssignStmtNode(size_t line, size_t col, AssignExpNode* assignExp)
-	: StmtNode(line, col), myAssignExp(assignExp) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::AssignStmtNode, line, col), myAssignExp(assignExp) {}
+	AssignExpNode* assignExp(){ return myAssignExp; }
 private:
 	AssignExpNode* myAssignExp;
 };
@@ -419,8 +504,8 @@ private:
 class ReadStmtNode : public StmtNode{
 public:
 	ReadStmtNode(size_t line, size_t col, LValNode* lval)
-	: StmtNode(line, col), myLVal(lval) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::ReadStmtNode, line, col), myLVal(lval) {}
+	LValNode* lval(){ return myLVal; }
 private:
 	LValNode* myLVal;
 };
@@ -428,8 +513,9 @@ private:
 class WriteStmtNode : public StmtNode{
 public:
 	WriteStmtNode(size_t line, size_t col, ExpNode* exp)
-	: StmtNode(line, col), myExp(exp) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::WriteStmtNode, line, col), myExp(exp) {}
+	ExpNode* exp(){ return myExp; }
+	void setExp(ExpNode* exp){ myExp = exp; }
 private:
 	ExpNode* myExp;
 };
@@ -437,8 +523,8 @@ private:
 class PostDecStmtNode : public StmtNode{
 public:
 	PostDecStmtNode(size_t line, size_t col, LValNode* lval)
-	: StmtNode(line, col), myLVal(lval) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::PostDecStmtNode, line, col), myLVal(lval) {}
+	LValNode* lval(){ return myLVal; }
 private:
 	LValNode* myLVal;
 };
@@ -446,48 +532,57 @@ private:
 class PostIncStmtNode : public StmtNode{
 public:
 	PostIncStmtNode(size_t line, size_t col, LValNode* lval)
-	: StmtNode(line, col), myLVal(lval) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::PostIncStmtNode, line, col), myLVal(lval) {}
+	LValNode* lval(){ return myLVal; }
 private:
 	LValNode* myLVal;
 };
 
 class IfStmtNode : public StmtNode{
 public:
-	IfStmtNode(size_t line, size_t col, ExpNode* evalCond, std::list<StmtNode*>* body)
-	: StmtNode(evalCond->line(), evalCond->col()), myCond(evalCond), myBody(body) {}
-	void unparse(std::ostream& out, int indent) override;
+	IfStmtNode(size_t line, size_t col, ExpNode* evalCond, NodeList<StmtNode>* body)
+	: StmtNode(NodeKind::IfStmtNode, evalCond->line(), evalCond->col()), myCond(evalCond), myBody(*body) {}
+	ExpNode* cond(){ return myCond; }
+	void setCond(ExpNode* cond){ myCond = cond; }
+	NodeList<StmtNode>& body(){ return myBody; }
 private:
 	ExpNode* myCond;
-	std::list<StmtNode*>* myBody;
+	NodeList<StmtNode> myBody;
 };
 
 class IfElseStmtNode : public StmtNode{
 public:
-	IfElseStmtNode(size_t line, size_t col, ExpNode* evalCond, std::list<StmtNode*>* trueBranch, std::list<StmtNode*>* falseBranch)
-	: StmtNode(evalCond->line(), evalCond->col()), myCond(evalCond), myTrueBranch(trueBranch), myFalseBranch(falseBranch) {}
-	void unparse(std::ostream& out, int indent) override;
+	IfElseStmtNode(size_t line, size_t col, ExpNode* evalCond, NodeList<StmtNode>* trueBranch, NodeList<StmtNode>* falseBranch)
+	: StmtNode(NodeKind::IfElseStmtNode, evalCond->line(), evalCond->col()), myCond(evalCond), myTrueBranch(*trueBranch), myFalseBranch(*falseBranch) {}
+	ExpNode* cond(){ return myCond; }
+	void setCond(ExpNode* cond){ myCond = cond; }
+	NodeList<StmtNode>& trueBranch(){ return myTrueBranch; }
+	NodeList<StmtNode>& falseBranch(){ return myFalseBranch; }
 private:
 	ExpNode* myCond;
-	std::list<StmtNode*>* myTrueBranch;
-	std::list<StmtNode*>* myFalseBranch;
+	NodeList<StmtNode> myTrueBranch;
+	NodeList<StmtNode> myFalseBranch;
 };
 
 class WhileStmtNode : public StmtNode{
 public:
-	WhileStmtNode(size_t line, size_t col, ExpNode* exp, std::list<StmtNode*>* body)
-	: StmtNode(line, col), myExp(exp), myBody(body) {}
-	void unparse(std::ostream& out, int indent) override;
+	WhileStmtNode(size_t line, size_t col, ExpNode* exp, NodeList<StmtNode>* body)
+	: StmtNode(NodeKind::WhileStmtNode, line, col), myCond(exp), myBody(*body) {}
+	ExpNode* cond(){ return myCond; }
+	void setCond(ExpNode* cond){ myCond = cond; }
+	NodeList<StmtNode>& body(){ return myBody; }
 private:
-	ExpNode* myExp;
-	std::list<StmtNode*>* myBody;
+	ExpNode* myCond;
+	NodeList<StmtNode> myBody;
 };
 
 class ReturnStmtNode : public StmtNode{
 public:
 	ReturnStmtNode(size_t line, size_t col, ExpNode* exp)
-	: StmtNode(line, col), myExp(exp) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::ReturnStmtNode, line, col), myExp(exp) {}
+	/// The value returned, or nullptr for a bare return
+	ExpNode* exp(){ return myExp; }
+	void setExp(ExpNode* exp){ myExp = exp; }
 private:
 	ExpNode* myExp;
 };
@@ -495,8 +590,8 @@ private:
 class CallStmtNode : public StmtNode{
 public:
 	CallStmtNode(size_t line, size_t col, CallExpNode* callExp)
-	: StmtNode(line, col), myCallExp(callExp) {}
-	void unparse(std::ostream& out, int indent) override;
+	: StmtNode(NodeKind::CallStmtNode, line, col), myCallExp(callExp) {}
+	CallExpNode* callExp(){ return myCallExp; }
 private:
 	CallExpNode* myCallExp;
 };
@@ -506,13 +601,26 @@ private:
 class IndexNode : public LValNode{
 public:
 	IndexNode(size_t l, size_t c, IDNode* baseSrc, ExpNode* offsetSrc)
-	:LValNode(l,c), base(baseSrc), offset(offsetSrc){}
-	void unparse(std::ostream& out, int indent) override;
-private:
-	IDNode* base;
-	ExpNode* offset;
-};
-
+	:LValNode(NodeKind::IndexNode,l,c), myBase(baseSrc), myOffset(offsetSrc){}
+	/// The array indexed
+	IDNode* base(){ return myBase; }
+	ExpNode* offset(){ return myOffset; }
+	void setOffset(ExpNode* offset){ myOffset = offset; }
+private:
+	IDNode* myBase;
+	ExpNode* myOffset;
+};
+
+/// NodeKindOf<IDNode>::value == NodeKind::IDNode, and so on
+template <typename T>
+struct NodeKindOf;
+
+#define CRONA_NODE_KIND_OF(name) \
+	template <> struct NodeKindOf<name>{ \
+		static constexpr NodeKind value = NodeKind::name; \
+	};
+CRONA_AST_NODES(CRONA_NODE_KIND_OF)
+#undef CRONA_NODE_KIND_OF
 
 } //End namespace crona
 
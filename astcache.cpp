@@ -0,0 +1,625 @@
+#include <cerrno>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <type_traits>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "astcache.hpp"
+#include "errors.hpp"
+#include "symbols.hpp"
+
+namespace crona{
+
+static const char MAGIC[8] = {'C', 'R', 'O', 'N', 'A', 'A', 'S', 'T'};
+static const uint32_t VERSION = 3;
+
+//A node's tag: its kind, and its change of line if that's 0 to 2
+static const uint8_t KIND_BITS = 0x3f;
+static const uint8_t NO_NODE = KIND_BITS;
+static const unsigned LINE_SHIFT = 6;
+static const uint8_t LINE_FOLLOWS = 3;
+
+static_assert(NUM_NODE_KINDS < NO_NODE, "NodeKind must fit in a tag");
+
+/*
+Entries from another build of cronac are never used: this is when
+this file was compiled, and the makefile recompiles it whenever any
+other part of the compiler changes.
+*/
+static const char BUILD[] = "cronac " __DATE__ " " __TIME__;
+
+struct Header{
+	char magic[8];
+	uint32_t version;
+	uint32_t zero;
+	uint64_t key;
+	uint64_t sourceSize;
+	uint64_t arenaBytes;
+	uint32_t nameCount;
+	uint32_t diagsSize;
+};
+
+static_assert(std::is_trivially_copyable<Header>::value
+	&& sizeof(Header) == 48, "Header is read and written as raw bytes");
+
+static void badCache(const char * why){
+	std::string msg = "Bad AST cache file: ";
+	msg += why;
+	throw new InternalError(msg.c_str());
+}
+
+/*
+Eight bytes at a time in four independent lanes, so that hashing a
+large source runs at memory speed rather than at the latency of a
+multiply per byte.
+*/
+static uint64_t hashBytes(uint64_t seed, const char * data, size_t len){
+	const uint64_t MUL = 0x9e3779b97f4a7c15ull;
+	uint64_t lanes[4] = {seed, seed ^ 1, seed ^ 2, seed ^ 3};
+	size_t i = 0;
+	for (; i + 32 <= len; i += 32){
+		for (size_t k = 0; k < 4; k++){
+			uint64_t word;
+			std::memcpy(&word, data + i + 8 * k, sizeof(word));
+			lanes[k] = (lanes[k] ^ word) * MUL;
+			lanes[k] ^= lanes[k] >> 32;
+		}
+	}
+	uint64_t hash = len * MUL;
+	for (size_t k = 0; k < 4; k++){
+		hash = (hash ^ lanes[k]) * MUL;
+		hash ^= hash >> 29;
+	}
+	for (; i < len; i++){
+		hash = (hash ^ static_cast<unsigned char>(data[i])) * 1099511628211ull;
+	}
+	return hash ^ (hash >> 32);
+}
+
+static uint64_t zigzag(int64_t value){
+	return (static_cast<uint64_t>(value) << 1)
+		^ static_cast<uint64_t>(value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value){
+	return static_cast<int64_t>(value >> 1) ^ -static_cast<int64_t>(value & 1);
+}
+
+static void putVarint(std::string& out, uint64_t value){
+	while (value >= 0x80){
+		out += static_cast<char>((value & 0x7f) | 0x80);
+		value >>= 7;
+	}
+	out += static_cast<char>(value);
+}
+
+ASTWriter::ASTWriter() : myLine(0), myCol(0){
+}
+
+void ASTWriter::varint(uint64_t value){
+	putVarint(myTree, value);
+}
+
+void ASTWriter::node(ASTNode * n){
+	size_t lines = n->line() - myLine;
+	bool small = n->line() >= myLine && lines < LINE_FOLLOWS;
+	myTree += static_cast<char>(static_cast<uint8_t>(n->kind())
+		| (small ? lines : LINE_FOLLOWS) << LINE_SHIFT);
+	if (!small){
+		varint(zigzag(static_cast<int64_t>(n->line())
+			- static_cast<int64_t>(myLine)));
+	}
+	varint(zigzag(static_cast<int64_t>(n->col())
+		- static_cast<int64_t>(myCol)));
+	myLine = n->line();
+	myCol = n->col();
+}
+
+void ASTWriter::save(ASTNode * n){
+	if (n == nullptr){
+		myTree += static_cast<char>(NO_NODE);
+	} else {
+		visit(n);
+	}
+}
+
+void ASTWriter::name(const Symbol * sym){
+	auto found = myNameIndex.find(sym);
+	if (found == myNameIndex.end()){
+		uint32_t index = static_cast<uint32_t>(myNameIndex.size());
+		found = myNameIndex.emplace(sym, index).first;
+		StrView text = sym->name();
+		putVarint(myNames, text.size());
+		myNames.append(text.data(), text.size());
+	}
+	varint(found->second);
+}
+
+void ASTWriter::dataType(const DataType * type){
+	varint(type->kind());
+	if (type->isArray()){
+		dataType(type->element());
+		num(type->size());
+	}
+}
+
+void ASTWriter::num(int value){
+	varint(zigzag(value));
+}
+
+void ASTWriter::str(StrView text){
+	varint(text.size());
+	myTree.append(text.data(), text.size());
+}
+
+/*
+Rebuilds a tree from an encoded one, checking as it goes: anything
+out of place (a truncated file, a node of the wrong class for where
+it sits, ...) throws, and the cache entry is treated as missing.
+*/
+class ASTReader{
+public:
+	ASTReader(const char * data, size_t size, Arena * arena, Stats * stats)
+	: myPos(data), myEnd(data + size), myArena(arena), myStats(stats),
+	  myLine(0), myCol(0){}
+
+	uint64_t varint(){
+		uint64_t value = 0;
+		for (unsigned shift = 0; shift < 64; shift += 7){
+			if (myPos == myEnd){ badCache("truncated"); }
+			uint8_t byte = static_cast<uint8_t>(*myPos++);
+			value |= static_cast<uint64_t>(byte & 0x7f) << shift;
+			if ((byte & 0x80) == 0){ return value; }
+		}
+		badCache("bad number");
+		return 0;
+	}
+
+	StrView bytes(size_t len){
+		if (len > static_cast<size_t>(myEnd - myPos)){ badCache("truncated"); }
+		StrView text(myPos, len);
+		myPos += len;
+		return text;
+	}
+
+	void names(size_t count){
+		myNames.reserve(count);
+		for (size_t i = 0; i < count; i++){
+			StrView text = bytes(static_cast<size_t>(varint()));
+			myNames.push_back(SymbolTable::global().intern(text));
+		}
+	}
+
+	template <typename T>
+	NodeList<T> list(){
+		uint64_t count = varint();
+		//Every node takes at least a byte
+		if (count > static_cast<uint64_t>(myEnd - myPos)){
+			badCache("bad list length");
+		}
+		NodeList<T> items;
+		items.reserve(myArena, static_cast<size_t>(count));
+		for (uint64_t i = 0; i < count; i++){
+			items.push_back(myArena, expect<T>());
+		}
+		return items;
+	}
+
+	bool atEnd() const { return myPos == myEnd; }
+private:
+	template <typename T>
+	T * expect(){
+		T * n = maybe<T>();
+		if (n == nullptr){ badCache("missing node"); }
+		return n;
+	}
+
+	//A node that must be a T, or nothing
+	template <typename T>
+	T * maybe(){
+		NodeKind kind = NodeKind::ProgramNode;
+		ASTNode * n = node(kind);
+		if (n != nullptr && !isA<T>(kind)){ badCache("misplaced node"); }
+		return static_cast<T *>(n);
+	}
+
+	template <typename T>
+	static bool isA(NodeKind kind){
+		static const bool table[NUM_NODE_KINDS] = {
+#define CRONA_IS_A(name) std::is_base_of<T, name>::value,
+			CRONA_AST_NODES(CRONA_IS_A)
+#undef CRONA_IS_A
+		};
+		return table[static_cast<size_t>(kind)];
+	}
+
+	template <typename T, typename... Args>
+	T * make(Args&&... args){
+		if (myStats != nullptr){ myStats->countNode<T>(); }
+		return myArena->make<T>(std::forward<Args>(args)...);
+	}
+
+	const Symbol * name(){
+		uint64_t index = varint();
+		if (index >= myNames.size()){ badCache("bad name"); }
+		return myNames[static_cast<size_t>(index)];
+	}
+
+	int num(){
+		return static_cast<int>(unzigzag(varint()));
+	}
+
+	const DataType * dataType(){
+		uint64_t kind = varint();
+		if (kind < DataType::ARRAY){
+			return TypeTable::global().base(static_cast<DataType::Kind>(kind));
+		}
+		if (kind > DataType::ARRAY){ badCache("bad type"); }
+		const DataType * element = dataType();
+		if (element->isArray()){ badCache("bad type"); }
+		return TypeTable::global().arrayOf(element, num());
+	}
+
+	ASTNode * node(NodeKind& kind);
+
+	const char * myPos;
+	const char * myEnd;
+	Arena * myArena;
+	Stats * myStats;
+	std::vector<const Symbol *> myNames;
+	size_t myLine;
+	size_t myCol;
+};
+
+#define CRONA_BINARY_NODES(X) \
+	X(AndNode) X(DivideNode) X(EqualsNode) X(GreaterEqNode) \
+	X(GreaterNode) X(LessEqNode) X(LessNode) X(MinusNode) \
+	X(NotEqualsNode) X(OrNode) X(PlusNode) X(TimesNode)
+
+#define CRONA_LEAF_NODES(X) \
+	X(FalseNode) X(HavocNode) X(TrueNode)
+
+ASTNode * ASTReader::node(NodeKind& kind){
+	if (myPos == myEnd){ badCache("truncated"); }
+	uint8_t tag = static_cast<uint8_t>(*myPos++);
+	if ((tag & KIND_BITS) == NO_NODE){ return nullptr; }
+	if ((tag & KIND_BITS) >= NUM_NODE_KINDS){ badCache("unknown node kind"); }
+	kind = static_cast<NodeKind>(tag & KIND_BITS);
+	uint8_t lines = static_cast<uint8_t>(tag >> LINE_SHIFT);
+	if (lines == LINE_FOLLOWS){
+		myLine = static_cast<size_t>(static_cast<int64_t>(myLine)
+			+ unzigzag(varint()));
+	} else {
+		myLine += lines;
+	}
+	myCol = static_cast<size_t>(static_cast<int64_t>(myCol)
+		+ unzigzag(varint()));
+	size_t line = myLine;
+	size_t col = myCol;
+
+	//Children are read into locals first: arguments to one call
+	// could be evaluated in any order
+	switch (kind){
+	case NodeKind::VarDeclNode: {
+		const DataType * type = dataType();
+		IDNode * id = expect<IDNode>();
+		return make<VarDeclNode>(line, col, type, id);
+	}
+	case NodeKind::FormalDeclNode: {
+		const DataType * type = dataType();
+		IDNode * id = expect<IDNode>();
+		return make<FormalDeclNode>(line, col, type, id);
+	}
+	case NodeKind::FnDeclNode: {
+		const DataType * type = dataType();
+		IDNode * id = expect<IDNode>();
+		NodeList<FormalDeclNode> formals = list<FormalDeclNode>();
+		NodeList<StmtNode> body = list<StmtNode>();
+		return make<FnDeclNode>(line, col, type, id, &formals, &body);
+	}
+	case NodeKind::IDNode:
+		return make<IDNode>(Token::ident(line, col, name()));
+	case NodeKind::IndexNode: {
+		IDNode * base = expect<IDNode>();
+		ExpNode * offset = expect<ExpNode>();
+		return make<IndexNode>(line, col, base, offset);
+	}
+	case NodeKind::AssignExpNode: {
+		LValNode * dest = expect<LValNode>();
+		ExpNode * src = expect<ExpNode>();
+		return make<AssignExpNode>(line, col, dest, src);
+	}
+	case NodeKind::CallExpNode: {
+		IDNode * id = expect<IDNode>();
+		NodeList<ExpNode> args = list<ExpNode>();
+		return make<CallExpNode>(line, col, id, &args);
+	}
+	case NodeKind::IntLitNode:
+		return make<IntLitNode>(line, col, num());
+	case NodeKind::StrLitNode:
+		return make<StrLitNode>(line, col, bytes(static_cast<size_t>(varint())));
+	case NodeKind::NegNode:
+		return make<NegNode>(line, col, expect<ExpNode>());
+	case NodeKind::NotNode:
+		return make<NotNode>(line, col, expect<ExpNode>());
+	case NodeKind::AssignStmtNode:
+		return make<AssignStmtNode>(line, col, expect<AssignExpNode>());
+	case NodeKind::ReadStmtNode:
+		return make<ReadStmtNode>(line, col, expect<LValNode>());
+	case NodeKind::WriteStmtNode:
+		return make<WriteStmtNode>(line, col, expect<ExpNode>());
+	case NodeKind::PostDecStmtNode:
+		return make<PostDecStmtNode>(line, col, expect<LValNode>());
+	case NodeKind::PostIncStmtNode:
+		return make<PostIncStmtNode>(line, col, expect<LValNode>());
+	case NodeKind::IfStmtNode: {
+		ExpNode * cond = expect<ExpNode>();
+		NodeList<StmtNode> body = list<StmtNode>();
+		return make<IfStmtNode>(line, col, cond, &body);
+	}
+	case NodeKind::IfElseStmtNode: {
+		ExpNode * cond = expect<ExpNode>();
+		NodeList<StmtNode> yes = list<StmtNode>();
+		NodeList<StmtNode> no = list<StmtNode>();
+		return make<IfElseStmtNode>(line, col, cond, &yes, &no);
+	}
+	case NodeKind::WhileStmtNode: {
+		ExpNode * cond = expect<ExpNode>();
+		NodeList<StmtNode> body = list<StmtNode>();
+		return make<WhileStmtNode>(line, col, cond, &body);
+	}
+	case NodeKind::ReturnStmtNode:
+		return make<ReturnStmtNode>(line, col, maybe<ExpNode>());
+	case NodeKind::CallStmtNode:
+		return make<CallStmtNode>(line, col, expect<CallExpNode>());
+#define CRONA_LOAD_BINARY(name) \
+	case NodeKind::name: { \
+		ExpNode * lhs = expect<ExpNode>(); \
+		ExpNode * rhs = expect<ExpNode>(); \
+		return make<name>(line, col, lhs, rhs); \
+	}
+	CRONA_BINARY_NODES(CRONA_LOAD_BINARY)
+#undef CRONA_LOAD_BINARY
+#define CRONA_LOAD_LEAF(name) \
+	case NodeKind::name: \
+		return make<name>(line, col);
+	CRONA_LEAF_NODES(CRONA_LOAD_LEAF)
+#undef CRONA_LOAD_LEAF
+	case NodeKind::ProgramNode:
+		break;
+	}
+	badCache("misplaced program");
+	return nullptr;
+}
+
+ASTCache::ASTCache(const std::string& dir, const SourceFile& source)
+: myDir(dir), mySourceSize(source.size()){
+	uint64_t seed = hashBytes(VERSION, BUILD, sizeof(BUILD) - 1);
+	myKey = hashBytes(seed, source.data(), source.size());
+	char name[32];
+	std::snprintf(name, sizeof(name), "/%016llx.ast",
+		static_cast<unsigned long long>(myKey));
+	myPath = myDir + name;
+}
+
+ProgramNode * ASTCache::load(Stats * stats){
+	if (access(myPath.c_str(), R_OK) != 0){ return nullptr; }
+	std::shared_ptr<SourceFile> file;
+	Arena * arena = nullptr;
+	try {
+		file.reset(new SourceFile(myPath.c_str()));
+		Header header;
+		if (file->size() < sizeof(header)){ badCache("truncated"); }
+		std::memcpy(&header, file->data(), sizeof(header));
+		if (std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0
+		  || header.version != VERSION || header.key != myKey
+		  || header.sourceSize != mySourceSize){
+			badCache("not this source's entry");
+		}
+
+		arena = new Arena();
+		arena->reserve(static_cast<size_t>(header.arenaBytes));
+		arena->make<std::shared_ptr<SourceFile>>(file);
+		ASTReader reader(file->data() + sizeof(header),
+			file->size() - sizeof(header), arena, stats);
+		reader.names(header.nameCount);
+		StrView diags = reader.bytes(header.diagsSize);
+		NodeList<DeclNode> globals = reader.list<DeclNode>();
+		if (!reader.atEnd()){ badCache("trailing bytes"); }
+
+		if (stats != nullptr){ stats->countNode<ProgramNode>(); }
+		ProgramNode * root = new ProgramNode(arena, &globals);
+		Report::stream().write(diags.data(),
+			static_cast<std::streamsize>(diags.size()));
+		return root;
+	} catch (InternalError * e){
+		delete e;
+		delete arena;
+		return nullptr;
+	}
+}
+
+bool ASTCache::store(ProgramNode * ast, const std::string& diagnostics){
+	ASTWriter writer;
+	writer.save(ast);
+
+	Header header;
+	std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+	header.version = VERSION;
+	header.zero = 0;
+	header.key = myKey;
+	header.sourceSize = mySourceSize;
+	header.arenaBytes = ast->arena()->bytesUsed();
+	header.nameCount = static_cast<uint32_t>(writer.nameCount());
+	header.diagsSize = static_cast<uint32_t>(diagnostics.size());
+
+	std::string data(reinterpret_cast<const char *>(&header), sizeof(header));
+	data.reserve(data.size() + writer.names().size() + diagnostics.size()
+		+ writer.tree().size());
+	data += writer.names();
+	data += diagnostics;
+	data += writer.tree();
+
+	if (mkdir(myDir.c_str(), 0777) != 0 && errno != EEXIST){ return false; }
+	std::string temp = myDir + "/.entry.XXXXXX";
+	int fd = mkstemp(&temp[0]);
+	if (fd < 0){ return false; }
+	//mkstemp makes it private; entries are as readable as any output
+	fchmod(fd, 0644);
+	size_t done = 0;
+	while (done < data.size()){
+		ssize_t put = write(fd, data.data() + done, data.size() - done);
+		if (put < 0 && errno == EINTR){ continue; }
+		if (put <= 0){ break; }
+		done += static_cast<size_t>(put);
+	}
+	bool ok = close(fd) == 0 && done == data.size()
+		&& std::rename(temp.c_str(), myPath.c_str()) == 0;
+	if (!ok){ unlink(temp.c_str()); }
+	return ok;
+}
+
+//Each node is written as what its constructor takes, in order
+
+void ASTWriter::visitProgramNode(ProgramNode * n){
+	list(n->globals());
+}
+
+void ASTWriter::visitVarDeclNode(VarDeclNode * n){
+	node(n);
+	dataType(n->type());
+	save(n->id());
+}
+
+void ASTWriter::visitFormalDeclNode(FormalDeclNode * n){
+	node(n);
+	dataType(n->type());
+	save(n->id());
+}
+
+void ASTWriter::visitFnDeclNode(FnDeclNode * n){
+	node(n);
+	dataType(n->type());
+	save(n->id());
+	list(n->formals());
+	list(n->body());
+}
+
+void ASTWriter::visitIDNode(IDNode * n){
+	node(n);
+	name(n->symbol());
+}
+
+void ASTWriter::visitIndexNode(IndexNode * n){
+	node(n);
+	save(n->base());
+	save(n->offset());
+}
+
+void ASTWriter::visitAssignExpNode(AssignExpNode * n){
+	node(n);
+	save(n->dest());
+	save(n->src());
+}
+
+void ASTWriter::visitCallExpNode(CallExpNode * n){
+	node(n);
+	save(n->id());
+	list(n->args());
+}
+
+void ASTWriter::visitIntLitNode(IntLitNode * n){
+	node(n);
+	num(n->value());
+}
+
+void ASTWriter::visitStrLitNode(StrLitNode * n){
+	node(n);
+	str(n->value());
+}
+
+void ASTWriter::visitNegNode(NegNode * n){
+	node(n);
+	save(n->exp());
+}
+
+void ASTWriter::visitNotNode(NotNode * n){
+	node(n);
+	save(n->exp());
+}
+
+void ASTWriter::visitAssignStmtNode(AssignStmtNode * n){
+	node(n);
+	save(n->assignExp());
+}
+
+void ASTWriter::visitReadStmtNode(ReadStmtNode * n){
+	node(n);
+	save(n->lval());
+}
+
+void ASTWriter::visitWriteStmtNode(WriteStmtNode * n){
+	node(n);
+	save(n->exp());
+}
+
+void ASTWriter::visitPostDecStmtNode(PostDecStmtNode * n){
+	node(n);
+	save(n->lval());
+}
+
+void ASTWriter::visitPostIncStmtNode(PostIncStmtNode * n){
+	node(n);
+	save(n->lval());
+}
+
+void ASTWriter::visitIfStmtNode(IfStmtNode * n){
+	node(n);
+	save(n->cond());
+	list(n->body());
+}
+
+void ASTWriter::visitIfElseStmtNode(IfElseStmtNode * n){
+	node(n);
+	save(n->cond());
+	list(n->trueBranch());
+	list(n->falseBranch());
+}
+
+void ASTWriter::visitWhileStmtNode(WhileStmtNode * n){
+	node(n);
+	save(n->cond());
+	list(n->body());
+}
+
+void ASTWriter::visitReturnStmtNode(ReturnStmtNode * n){
+	node(n);
+	save(n->exp());
+}
+
+void ASTWriter::visitCallStmtNode(CallStmtNode * n){
+	node(n);
+	save(n->callExp());
+}
+
+#define CRONA_SAVE_BINARY(name) \
+	void ASTWriter::visit##name(name * n){ \
+		node(n); \
+		save(n->lhs()); \
+		save(n->rhs()); \
+	}
+CRONA_BINARY_NODES(CRONA_SAVE_BINARY)
+#undef CRONA_SAVE_BINARY
+
+#define CRONA_SAVE_LEAF(name) \
+	void ASTWriter::visit##name(name * n){ \
+		node(n); \
+	}
+CRONA_LEAF_NODES(CRONA_SAVE_LEAF)
+#undef CRONA_SAVE_LEAF
+
+} //End namespace crona
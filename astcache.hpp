@@ -0,0 +1,122 @@
+#ifndef CRONA_ASTCACHE_H
+#define CRONA_ASTCACHE_H
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include "ast.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "visitor.hpp"
+
+namespace crona{
+
+/*
+AST cache file format (host byte order):
+
+  header  8 bytes magic "CRONAAST", u32 format version, u32 0,
+          u64 key, u64 source size, u64 arena bytes, u32 name
+          count, u32 diagnostics size
+  names   each distinct identifier: varint length, then the bytes
+  diags   the diagnostics the original parse reported
+  tree    the global declarations: varint count, then each node
+
+A node starts with a tag byte: its NodeKind in the low 6 bits (63
+for an absent child, e.g. the value of a bare return) and in the
+top 2 the change in line number since the previous node, if that
+is 0, 1 or 2. Otherwise they're 3 and the change follows (zigzag
+varint). Next comes the change in column since the previous node
+(zigzag varint), and then the node's fields in constructor order:
+child nodes, child lists (varint count, then the nodes), names
+(varint index into the names), int values (zigzag varint), string
+literals (varint length, then the lexeme) and types (varint
+DataType::Kind, then for an array its element type and size).
+
+The key is a 64-bit hash of the compiler's build and the source
+bytes, and names the file: <dir>/<key in hex>.ast.
+*/
+
+/**
+* \class ASTWriter
+* Encodes a tree for the cache: a pass (see ASTVisitor) with a
+* method per node class that writes what the class's constructor
+* takes, in order.
+**/
+class ASTWriter : public ASTVisitor<ASTWriter>{
+public:
+	ASTWriter();
+
+	/// Encode n, which may be absent, and its subtree
+	void save(ASTNode * n);
+
+	/// The names table and the encoded tree
+	const std::string& names() const { return myNames; }
+	size_t nameCount() const { return myNameIndex.size(); }
+	const std::string& tree() const { return myTree; }
+private:
+	friend class ASTVisitor<ASTWriter>;
+#define CRONA_SAVE_KIND(name) void visit##name(name * n);
+	CRONA_AST_NODES(CRONA_SAVE_KIND)
+#undef CRONA_SAVE_KIND
+
+	/// Start a node: its kind and position
+	void node(ASTNode * n);
+	template <typename T>
+	void list(NodeList<T>& items){
+		varint(items.size());
+		for (T * item : items){ save(item); }
+	}
+	void name(const Symbol * sym);
+	void num(int value);
+	void dataType(const DataType * type);
+	void str(StrView text);
+	void varint(uint64_t value);
+
+	std::string myTree;
+	std::string myNames;
+	std::unordered_map<const Symbol *, uint32_t> myNameIndex;
+	size_t myLine;
+	size_t myCol;
+};
+
+/**
+* \class ASTCache
+* Parsed programs kept on disk between runs, in a directory of
+* cache files keyed by what was parsed (see above), so that an
+* unchanged input skips lexing and parsing. A hit maps the cache
+* file and rebuilds the tree into a single arena chunk of the
+* recorded size; identifiers are interned afresh and string
+* literals point into the mapping, which the tree keeps alive.
+* Nodes keep their original lines and columns, and the original
+* parse's diagnostics are reported again.
+**/
+class ASTCache{
+public:
+	/// The cache entry for source in dir (created if need be)
+	ASTCache(const std::string& dir, const SourceFile& source);
+
+	/**
+	* The cached AST for the source, or nullptr if there is none
+	* (or it is unreadable). Counts the nodes into stats, if given.
+	**/
+	ProgramNode * load(Stats * stats);
+
+	/**
+	* Save ast, whose parse reported diagnostics, as the entry.
+	* The file is written aside and renamed into place, so readers
+	* (and concurrent writers) only ever see a whole entry.
+	* Returns false if it couldn't be written.
+	**/
+	bool store(ProgramNode * ast, const std::string& diagnostics);
+
+	const std::string& path() const { return myPath; }
+private:
+	std::string myDir;
+	std::string myPath;
+	uint64_t myKey;
+	uint64_t mySourceSize;
+};
+
+} //End namespace crona
+
+#endif
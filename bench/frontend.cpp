@@ -0,0 +1,181 @@
+/*
+Front end throughput benchmark.
+
+For each input (normally the synthetic corpus from gencorpus), times
+three phases separately and reports them against the size of the
+input, in MB/s and millions of tokens per second:
+
+  lex      Scanner::yylex until END, no parser attached
+  fastlex  the same with the hand-written scanner (fastscan.hpp)
+  parse    Parser::parse, minus the lex time above (the parser pulls
+           its tokens from the scanner, so the two can't be run apart)
+  unparse  ProgramNode::unparse of the resulting AST to a null stream
+
+Each phase is run several times and the fastest run is kept, so the
+figures are comparable between builds on a quiet machine.
+
+Usage: frontend [-r reps] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include "errors.hpp"
+#include "scanner.hpp"
+
+using namespace crona;
+
+namespace {
+
+class NullBuf : public std::streambuf{
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char *, std::streamsize n) override {
+		return n;
+	}
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+struct Timing{
+	double bytes = 0;
+	double tokens = 0;
+	double lexSecs = 0;
+	double fastLexSecs = 0;
+	double parseSecs = 0;
+	double unparseSecs = 0;
+};
+
+size_t lexOnce(std::shared_ptr<SourceFile> source, LexerKind lexer){
+	Scanner scanner(source);
+	scanner.useLexer(lexer);
+	Parser::semantic_type lval;
+	size_t tokens = 0;
+	while (scanner.yylex(&lval) != TokenKind::END){ tokens++; }
+	return tokens;
+}
+
+ProgramNode * parseOnce(std::shared_ptr<SourceFile> source){
+	Scanner scanner(source);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0){
+		delete root;
+		return nullptr;
+	}
+	return root;
+}
+
+bool measure(const char * path, size_t reps, Timing& t){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	t.bytes = static_cast<double>(source->size());
+
+	double best = 1e30;
+	for (size_t r = 0; r < reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		t.tokens = static_cast<double>(lexOnce(source, LexerKind::FLEX));
+		best = std::min(best, secondsSince(start));
+	}
+	t.lexSecs = best;
+
+	best = 1e30;
+	for (size_t r = 0; r < reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		lexOnce(source, LexerKind::FAST);
+		best = std::min(best, secondsSince(start));
+	}
+	t.fastLexSecs = best;
+
+	best = 1e30;
+	ProgramNode * root = nullptr;
+	for (size_t r = 0; r < reps; r++){
+		delete root;
+		auto start = std::chrono::steady_clock::now();
+		root = parseOnce(source);
+		best = std::min(best, secondsSince(start));
+		if (root == nullptr){
+			std::cerr << path << ": parse failed\n";
+			return false;
+		}
+	}
+	t.parseSecs = std::max(best - t.lexSecs, 0.0);
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	best = 1e30;
+	for (size_t r = 0; r < reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		root->unparse(nullOut, 0);
+		best = std::min(best, secondsSince(start));
+	}
+	t.unparseSecs = best;
+	delete root;
+	return true;
+}
+
+void printPhase(const char * phase, double secs, const Timing& t){
+	char line[128];
+	double mbs = secs > 0 ? t.bytes / secs / 1e6 : 0;
+	double mtoks = secs > 0 ? t.tokens / secs / 1e6 : 0;
+	std::snprintf(line, sizeof(line), "  %-8s %10.3f ms %10.2f MB/s %10.2f Mtok/s\n",
+		phase, secs * 1e3, mbs, mtoks);
+	std::cout << line;
+}
+
+void printTiming(const std::string& name, const Timing& t){
+	std::cout << name << ": " << t.bytes / 1e6 << " MB, "
+		<< static_cast<size_t>(t.tokens) << " tokens\n";
+	printPhase("lex", t.lexSecs, t);
+	printPhase("fastlex", t.fastLexSecs, t);
+	printPhase("parse", t.parseSecs, t);
+	printPhase("unparse", t.unparseSecs, t);
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 5;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty() || reps == 0){
+		std::cerr << "Usage: frontend [-r reps] <file.crona>...\n";
+		return 1;
+	}
+
+	Timing total;
+	try {
+		for (const char * input : inputs){
+			Timing t;
+			if (!measure(input, reps, t)){ return 1; }
+			printTiming(input, t);
+			total.bytes += t.bytes;
+			total.tokens += t.tokens;
+			total.lexSecs += t.lexSecs;
+			total.fastLexSecs += t.fastLexSecs;
+			total.parseSecs += t.parseSecs;
+			total.unparseSecs += t.unparseSecs;
+		}
+	} catch (InternalError * e){
+		std::cerr << "Error: " << e->msg() << std::endl;
+		return 1;
+	}
+	if (inputs.size() > 1){ printTiming("total", total); }
+	std::cout << "fastlex kernels: " << scankernels::level() << "\n";
+	return 0;
+}
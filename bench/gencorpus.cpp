@@ -0,0 +1,394 @@
+/*
+Synthetic Crona corpus generator.
+
+Writes a syntactically valid Crona program of roughly the requested
+size. Every production in crona.yy is reachable from every shape;
+the shape only skews the mix towards one kind of stress:
+
+  mixed    a bit of everything (the default)
+  globals  many global variable declarations
+  long     few functions with very long bodies
+  nested   deeply nested if / if-else / while statements
+  exprs    long expression chains over every operator
+  strings  many string literals, including escapes
+  calls    functions with many formals, calls with large actualsLists
+
+Output is a pure function of the options, so a corpus can be
+regenerated instead of checked in.
+
+Usage: gencorpus [-s shape] [-n bytes] [-r seed] [-o outfile]
+*/
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+namespace {
+
+enum class Shape{ MIXED, GLOBALS, LONG, NESTED, EXPRS, STRINGS, CALLS };
+
+struct ShapeName{
+	const char * name;
+	Shape shape;
+};
+
+const ShapeName shapeNames[] = {
+	{"mixed", Shape::MIXED},
+	{"globals", Shape::GLOBALS},
+	{"long", Shape::LONG},
+	{"nested", Shape::NESTED},
+	{"exprs", Shape::EXPRS},
+	{"strings", Shape::STRINGS},
+	{"calls", Shape::CALLS},
+};
+
+class Generator{
+public:
+	Generator(Shape shape, uint64_t seed)
+	: myShape(shape), myState(seed * 2 + 1), myIndent(0), myNextFn(0) {}
+
+	std::string program(size_t targetBytes){
+		while (myOut.size() < targetBytes){
+			if (myShape == Shape::GLOBALS || chance(5)){
+				globalVar();
+			} else {
+				fnDecl();
+			}
+		}
+		return myOut;
+	}
+
+private:
+	//xorshift64*: fast, and identical output on every platform
+	uint64_t next(){
+		myState ^= myState >> 12;
+		myState ^= myState << 25;
+		myState ^= myState >> 27;
+		return myState * 0x2545F4914F6CDD1DULL;
+	}
+	size_t below(size_t n){ return static_cast<size_t>(next() % n); }
+	size_t between(size_t lo, size_t hi){ return lo + below(hi - lo + 1); }
+	bool chance(size_t percent){ return below(100) < percent; }
+
+	void put(const char * text){ myOut += text; }
+	void put(const std::string& text){ myOut += text; }
+	void newline(){
+		myOut += '\n';
+		myOut.append(myIndent, '\t');
+	}
+
+	void name(){
+		static const char * stems[] = {
+			"a", "b", "i", "n", "x", "y", "count", "flag", "total",
+			"buf", "idx", "value", "result", "tmp", "_scratch", "Acc",
+		};
+		put(stems[below(sizeof(stems) / sizeof(stems[0]))]);
+		put(std::to_string(below(64)));
+	}
+
+	void intLit(){
+		switch (below(4)){
+		case 0: put(std::to_string(below(10))); break;
+		case 1: put(std::to_string(below(1000))); break;
+		case 2: put(std::to_string(below(2147483647))); break;
+		default: put("0"); break;
+		}
+	}
+
+	void strLit(){
+		static const char * words[] = {
+			"hello", "world", "crona", " ", "value:", "\\n", "\\t",
+			"\\\"quoted\\\"", "back\\\\slash", "it's", "x = y + 1",
+		};
+		size_t nWords = sizeof(words) / sizeof(words[0]);
+		size_t len = myShape == Shape::STRINGS ? between(1, 12)
+			: between(0, 3);
+		put("\"");
+		for (size_t i = 0; i < len; i++){ put(words[below(nWords)]); }
+		put("\"");
+	}
+
+	void type(bool allowVoid){
+		switch (below(allowVoid ? 9 : 8)){
+		case 0: put("int"); break;
+		case 1: put("bool"); break;
+		case 2: put("byte"); break;
+		case 3: put("string"); break;
+		case 4: put("int array["); intLit(); put("]"); break;
+		case 5: put("bool array["); intLit(); put("]"); break;
+		case 6: put("byte array["); intLit(); put("]"); break;
+		case 7: put("int"); break;
+		default: put("void"); break;
+		}
+	}
+
+	void lval(size_t depth){
+		name();
+		if (chance(15)){
+			put("[");
+			exp(depth + 1);
+			put("]");
+		}
+	}
+
+	void call(size_t depth){
+		name();
+		put("(");
+		size_t args = 0;
+		if (myShape == Shape::CALLS && depth == 0){
+			args = between(8, 64);
+		} else if (chance(70)){
+			args = between(1, 4);
+		}
+		for (size_t i = 0; i < args; i++){
+			if (i > 0){ put(", "); }
+			exp(depth + 1);
+		}
+		put(")");
+	}
+
+	//A term in the grammar's sense: something DASH can apply to
+	void term(size_t depth){
+		//Past the depth limit only leaves are generated, so
+		// expressions always terminate
+		size_t kinds = depth > maxDepth() ? 6 : 9;
+		switch (below(kinds)){
+		case 0: lval(depth); break;
+		case 1: intLit(); break;
+		case 2: strLit(); break;
+		case 3: put("true"); break;
+		case 4: put("false"); break;
+		case 5: put(chance(20) ? "havoc" : "1"); break;
+		case 6: put("("); exp(depth + 1); put(")"); break;
+		case 7: call(depth); break;
+		default: put("("); lval(depth); put(" = "); exp(depth + 1);
+			put(")"); break;
+		}
+	}
+
+	//A term, possibly under unary NOT or DASH
+	void unary(size_t depth){
+		if (depth <= maxDepth() && chance(10)){
+			if (chance(50)){
+				put("!");
+				unary(depth + 1);
+			} else {
+				//The space keeps "- -1" from lexing as DASHDASH
+				put("- ");
+				term(depth + 1);
+			}
+			return;
+		}
+		term(depth);
+	}
+
+	/*
+	Expressions are built level by level from the precedence table
+	in crona.yy, so that chains can be long and flat without ever
+	putting two (non-associative) comparisons next to each other.
+	*/
+	void arith(size_t depth){
+		static const char * ops[] = {" + ", " - ", " * ", " / "};
+		size_t len = chainLength(depth);
+		unary(depth);
+		for (size_t i = 1; i < len; i++){
+			put(ops[below(4)]);
+			unary(depth);
+		}
+	}
+
+	void compare(size_t depth){
+		static const char * ops[] = {
+			" == ", " != ", " < ", " <= ", " > ", " >= ",
+		};
+		arith(depth);
+		if (chance(40)){
+			put(ops[below(6)]);
+			arith(depth);
+		}
+	}
+
+	void exp(size_t depth){
+		size_t ors = depth > maxDepth() ? 1 : between(1, 2);
+		for (size_t o = 0; o < ors; o++){
+			if (o > 0){ put(" || "); }
+			size_t ands = depth > maxDepth() ? 1 : between(1, 2);
+			for (size_t a = 0; a < ands; a++){
+				if (a > 0){ put(" && "); }
+				compare(depth + 1);
+			}
+		}
+	}
+
+	//Only outermost expressions get the long chains and argument
+	// lists, or the output would grow exponentially with depth
+	size_t chainLength(size_t depth){
+		if (myShape == Shape::EXPRS && depth <= 1){ return between(4, 40); }
+		return between(1, 3);
+	}
+
+	size_t maxDepth(){ return myShape == Shape::EXPRS ? 3 : 2; }
+
+	void varDecl(){
+		name();
+		put(" : ");
+		type(false);
+		put(";");
+	}
+
+	/*
+	In the nested shape exactly one statement of a "deep" block
+	nests further (and only the then-branch of an if-else is deep),
+	so depth grows linearly rather than the tree exponentially.
+	*/
+	void block(size_t nesting, bool deep){
+		put("{");
+		myIndent++;
+		size_t len;
+		size_t deeper;
+		if (myShape == Shape::NESTED){
+			len = between(1, 3);
+			deeper = deep ? below(len) : len;
+		} else {
+			len = between(0, 4);
+			deeper = len;
+		}
+		for (size_t i = 0; i < len; i++){ stmt(nesting + 1, i == deeper); }
+		myIndent--;
+		newline();
+		put("}");
+	}
+
+	void stmt(size_t nesting, bool deep){
+		newline();
+		bool nest;
+		if (myShape == Shape::NESTED){
+			nest = deep && nesting < 40;
+		} else {
+			nest = nesting < 3 && chance(10);
+		}
+		if (nest){
+			switch (below(3)){
+			case 0:
+				put("if ("); exp(0); put(") ");
+				block(nesting, true);
+				break;
+			case 1:
+				put("if ("); exp(0); put(") ");
+				block(nesting, true);
+				put(" else ");
+				block(nesting, false);
+				break;
+			default:
+				put("while ("); exp(0); put(") ");
+				block(nesting, true);
+				break;
+			}
+			return;
+		}
+		switch (below(12)){
+		case 0: varDecl(); break;
+		case 1: case 2: lval(0); put(" = "); exp(0); put(";"); break;
+		case 3: lval(0); put("--;"); break;
+		case 4: lval(0); put("++;"); break;
+		case 5: put("read "); lval(0); put(";"); break;
+		case 6: case 7: put("write "); exp(0); put(";"); break;
+		case 8: put("return "); exp(0); put(";"); break;
+		case 9: put("return;"); break;
+		case 10: call(0); put(";"); break;
+		default:
+			if (chance(50)){ put("// "); strLit(); newline(); }
+			put("write "); strLit(); put(";");
+			break;
+		}
+	}
+
+	void globalVar(){
+		varDecl();
+		put("\n");
+	}
+
+	void fnDecl(){
+		put("fn");
+		put(std::to_string(myNextFn++));
+		put(" : ");
+		type(true);
+		put("(");
+		size_t formals = myShape == Shape::CALLS ? between(8, 64)
+			: between(0, 4);
+		for (size_t i = 0; i < formals; i++){
+			if (i > 0){ put(", "); }
+			name();
+			put(" : ");
+			type(false);
+		}
+		put(")");
+		put("{");
+		myIndent++;
+		size_t len;
+		switch (myShape){
+		case Shape::LONG: len = between(500, 2000); break;
+		case Shape::NESTED: len = between(1, 4); break;
+		default: len = between(2, 20); break;
+		}
+		for (size_t i = 0; i < len; i++){ stmt(0, true); }
+		myIndent--;
+		put("\n}\n");
+	}
+
+	Shape myShape;
+	uint64_t myState;
+	size_t myIndent;
+	size_t myNextFn;
+	std::string myOut;
+};
+
+void usageAndDie(){
+	std::cerr << "Usage: gencorpus [-s shape] [-n bytes] [-r seed]"
+	<< " [-o outfile]\n  shapes:";
+	for (const ShapeName& s : shapeNames){ std::cerr << " " << s.name; }
+	std::cerr << "\n";
+	exit(1);
+}
+
+}
+
+int main(int argc, char * argv[]){
+	Shape shape = Shape::MIXED;
+	size_t bytes = 1 << 20;
+	uint64_t seed = 1;
+	const char * outFile = nullptr;
+	for (int i = 1; i < argc; i++){
+		if (i + 1 >= argc){ usageAndDie(); }
+		if (std::strcmp(argv[i], "-s") == 0){
+			bool found = false;
+			for (const ShapeName& s : shapeNames){
+				if (std::strcmp(argv[i + 1], s.name) == 0){
+					shape = s.shape;
+					found = true;
+				}
+			}
+			if (!found){ usageAndDie(); }
+		} else if (std::strcmp(argv[i], "-n") == 0){
+			bytes = std::strtoul(argv[i + 1], nullptr, 10);
+		} else if (std::strcmp(argv[i], "-r") == 0){
+			seed = std::strtoull(argv[i + 1], nullptr, 10);
+		} else if (std::strcmp(argv[i], "-o") == 0){
+			outFile = argv[i + 1];
+		} else {
+			usageAndDie();
+		}
+		i++;
+	}
+
+	std::string program = Generator(shape, seed).program(bytes);
+	if (outFile == nullptr){
+		std::cout << program;
+		return 0;
+	}
+	std::ofstream out(outFile, std::ios::binary);
+	out << program;
+	return out.good() ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+/*
+SSA IR benchmark.
+
+Generates programs of about the same total size, from many small
+functions to a few huge ones (a loop whose body is a long run of
+assignments and ifs, so each function has many blocks and phis),
+lowers them to bytecode and times building the IR (see ir.hpp) and
+optimizing it, reporting the time per bytecode instruction and the
+heap allocations per function. If the time per instruction holds
+steady as the functions grow, both are linear.
+
+Each is run several times and the fastest run is kept.
+
+Usage: ir [-r reps] [-n statements]
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "ir.hpp"
+#include "names.hpp"
+#include "scanner.hpp"
+#include "stats.hpp"
+
+using namespace crona;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+std::string generate(size_t functions, size_t statements){
+	static const char * shapes[] = {
+		"\t\tx = x + y * 3;\n",
+		"\t\tif (x > y) {\n\t\t\ty = y - x;\n\t\t} else {\n\t\t\tx = x + 1;\n\t\t}\n",
+		"\t\ty = x * 2 + x * 2;\n",
+		"\t\tx = y / 5 + i;\n",
+		"\t\tif (i == 7) {\n\t\t\ty = 0;\n\t\t}\n",
+	};
+	std::string text;
+	for (size_t f = 0; f < functions; f++){
+		std::string name = "f" + std::to_string(f);
+		text += name + " : int (a : int, b : int) {\n"
+			"\tx : int;\n\ty : int;\n\ti : int;\n"
+			"\tx = a;\n\ty = b;\n\ti = 0;\n"
+			"\twhile (i < a) {\n";
+		for (size_t s = 0; s < statements; s++){
+			text += shapes[(s + f) % (sizeof(shapes) / sizeof(shapes[0]))];
+		}
+		text += "\t\ti++;\n\t}\n\treturn x + y;\n}\n\n";
+	}
+	text += "main : void () {\n\twrite f0(3, 4);\n}\n";
+	return text;
+}
+
+struct Timing{
+	size_t instrs = 0;
+	double build = 1e30;
+	double optimize = 1e30;
+	size_t allocs = 0;
+};
+
+bool measure(size_t functions, size_t statements, size_t reps, Timing& t){
+	std::string text = generate(functions, statements);
+	std::shared_ptr<SourceFile> source(new SourceFile(text.data(), text.size()));
+	Scanner scanner(source);
+	scanner.useLexer(LexerKind::FAST);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0 || !analyzeNames(root)){
+		delete root;
+		return false;
+	}
+	Module module;
+	bool lowered = lowerProgram(root, module);
+	delete root;
+	if (!lowered){ return false; }
+	for (const Function& fn : module.functions){ t.instrs += fn.code.size(); }
+
+	for (size_t r = 0; r < reps; r++){
+		IRModule ir;
+		size_t allocs = Stats::threadAllocations();
+		auto start = std::chrono::steady_clock::now();
+		buildIR(module, ir);
+		t.build = std::min(t.build, secondsSince(start));
+		start = std::chrono::steady_clock::now();
+		optimizeIR(ir);
+		t.optimize = std::min(t.optimize, secondsSince(start));
+		t.allocs = Stats::threadAllocations() - allocs;
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 3;
+	size_t total = 40000;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+			total = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			std::cerr << "Usage: ir [-r reps] [-n statements]\n";
+			return 1;
+		}
+	}
+	if (reps == 0 || total < 10){
+		std::cerr << "Usage: ir [-r reps] [-n statements]\n";
+		return 1;
+	}
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "%9s %9s %9s %10s %10s %11s\n",
+		"functions", "each", "instrs", "build", "optimize", "allocs/fn");
+	std::cout << line;
+	for (size_t statements = 10; statements <= total; statements *= 10){
+		size_t functions = total / statements;
+		Timing t;
+		try {
+			if (!measure(functions, statements, reps, t)){
+				std::cerr << "Can't compile the generated program\n";
+				return 1;
+			}
+		} catch (InternalError * e){
+			std::cerr << e->msg() << "\n";
+			return 1;
+		}
+		std::snprintf(line, sizeof(line),
+			"%9zu %9zu %9zu %7.1f ns %7.1f ns %11.1f\n", functions, statements,
+			t.instrs, t.build * 1e9 / static_cast<double>(t.instrs),
+			t.optimize * 1e9 / static_cast<double>(t.instrs),
+			static_cast<double>(t.allocs) / static_cast<double>(functions));
+		std::cout << line;
+	}
+	return 0;
+}
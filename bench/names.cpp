@@ -0,0 +1,136 @@
+/*
+Name analysis benchmark.
+
+Parses each input (normally the synthetic corpus from gencorpus,
+whose globals, nested and calls shapes have tens of thousands of
+declarations and deeply nested blocks) and times resolving its names
+(see names.hpp), reporting the time per identifier. The corpus's
+names are random, so many are undeclared; the reports are discarded.
+If the time per identifier holds steady from shape to shape and
+size to size, resolution is linear.
+
+The analysis is run several times and the fastest run is kept.
+
+Usage: names [-r reps] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include "errors.hpp"
+#include "names.hpp"
+#include "scanner.hpp"
+#include "visitor.hpp"
+
+using namespace crona;
+
+namespace {
+
+class NullBuf : public std::streambuf{
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char *, std::streamsize n) override {
+		return n;
+	}
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+class CountIDs : public ASTVisitor<CountIDs>{
+public:
+	size_t ids = 0;
+	size_t unresolved = 0;
+
+	template <typename T>
+	void visitNode(T * node){ visitChildren(node); }
+
+	void visitIDNode(IDNode * node){
+		ids++;
+		if (node->decl() == nullptr){ unresolved++; }
+	}
+};
+
+struct Timing{
+	size_t ids = 0;
+	size_t unresolved = 0;
+	double secs = 1e30;
+};
+
+bool measure(const char * path, size_t reps, Timing& t){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	Scanner scanner(source);
+	scanner.useLexer(LexerKind::FAST);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0){
+		delete root;
+		return false;
+	}
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	Report::redirect(&nullOut);
+	for (size_t r = 0; r < reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		analyzeNames(root);
+		t.secs = std::min(t.secs, secondsSince(start));
+	}
+	Report::redirect(nullptr);
+	CountIDs count;
+	count.visit(root);
+	t.ids = count.ids;
+	t.unresolved = count.unresolved;
+	delete root;
+	return true;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 5;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty() || reps == 0){
+		std::cerr << "Usage: names [-r reps] <file.crona>...\n";
+		return 1;
+	}
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-24s %9s %11s %9s %9s\n", "input",
+		"ids", "undeclared", "time", "per id");
+	std::cout << line;
+	for (const char * path : inputs){
+		Timing t;
+		try {
+			if (!measure(path, reps, t)){
+				std::cerr << path << ": failed\n";
+				return 1;
+			}
+		} catch (InternalError * e){
+			std::cerr << path << ": " << e->msg() << "\n";
+			return 1;
+		}
+		const char * name = std::strrchr(path, '/');
+		std::snprintf(line, sizeof(line),
+			"%-24s %9zu %11zu %6.1f ms %6.2f ns\n",
+			name == nullptr ? path : name + 1, t.ids, t.unresolved,
+			t.secs * 1e3, t.secs * 1e9 / static_cast<double>(t.ids));
+		std::cout << line;
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+/*
+Native code benchmark.
+
+Compiles each program (normally the ones in bench/programs) to
+x86-64 with the backend in x86.hpp, links it with the runtime
+object, and times running it against running the same bytecode on
+the VM (threaded, with superinstructions, in process). The native
+time is for the whole process, startup included, which is about a
+millisecond. Both must write the same output, which is discarded.
+
+Each is run several times and the fastest run is kept.
+
+Usage: native [-r reps] <cronart.o> <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "names.hpp"
+#include "scanner.hpp"
+#include "vm.hpp"
+#include "x86.hpp"
+
+using namespace crona;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+bool readFile(const std::string& path, std::string& contents){
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good()){ return false; }
+	std::ostringstream buf;
+	buf << in.rdbuf();
+	contents = buf.str();
+	return true;
+}
+
+struct Timing{
+	double vm = 1e30;
+	double native = 1e30;
+	double build = 0;
+};
+
+bool measure(const char * path, const std::string& runtime,
+	const std::string& dir, size_t reps, Timing& t){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	Scanner scanner(source);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0 || !analyzeNames(root)){
+		delete root;
+		return false;
+	}
+	Module module;
+	bool lowered = lowerProgram(root, module);
+	delete root;
+	if (!lowered){ return false; }
+
+	std::string vmOut;
+	for (size_t r = 0; r < reps; r++){
+		std::ostringstream written;
+		std::istringstream in("");
+		OutBuf out(written);
+		VM vm(module, in, out);
+		auto start = std::chrono::steady_clock::now();
+		bool ok = vm.run();
+		t.vm = std::min(t.vm, secondsSince(start));
+		if (!ok){ return false; }
+		vmOut = written.str();
+	}
+
+	std::string asmPath = dir + "/prog.s";
+	std::string exePath = dir + "/prog";
+	std::string outPath = dir + "/out";
+	auto start = std::chrono::steady_clock::now();
+	{
+		std::ofstream file(asmPath);
+		OutBuf out(file);
+		emitX86(module, out);
+	}
+	std::string build = "cc -o " + exePath + " " + asmPath + " " + runtime;
+	if (std::system(build.c_str()) != 0){ return false; }
+	t.build = secondsSince(start);
+	std::string run = exePath + " < /dev/null > " + outPath;
+	for (size_t r = 0; r < reps; r++){
+		start = std::chrono::steady_clock::now();
+		if (std::system(run.c_str()) != 0){ return false; }
+		t.native = std::min(t.native, secondsSince(start));
+	}
+	std::string nativeOut;
+	bool same = readFile(outPath, nativeOut) && nativeOut == vmOut;
+	unlink(asmPath.c_str());
+	unlink(exePath.c_str());
+	unlink(outPath.c_str());
+	if (!same){ std::cerr << path << ": native output differs from the VM's\n"; }
+	return same;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 3;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	if (args.size() < 2 || reps == 0){
+		std::cerr << "Usage: native [-r reps] <cronart.o> <file.crona>...\n";
+		return 1;
+	}
+	std::string runtime = args[0];
+	char dirName[] = "/tmp/crona-bench.XXXXXX";
+	if (mkdtemp(dirName) == nullptr){
+		std::cerr << "Can't create a directory to build in\n";
+		return 1;
+	}
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-14s %9s %9s %9s %8s\n", "program",
+		"vm", "native", "build", "speedup");
+	std::cout << line;
+	int status = 0;
+	for (size_t i = 1; i < args.size(); i++){
+		const char * path = args[i];
+		Timing t;
+		try {
+			if (!measure(path, runtime, dirName, reps, t)){
+				std::cerr << path << ": failed\n";
+				status = 1;
+				break;
+			}
+		} catch (InternalError * e){
+			std::cerr << path << ": " << e->msg() << "\n";
+			status = 1;
+			break;
+		}
+		const char * name = std::strrchr(path, '/');
+		std::snprintf(line, sizeof(line),
+			"%-14s %6.0f ms %6.0f ms %6.0f ms %7.1fx\n",
+			name == nullptr ? path : name + 1, t.vm * 1e3, t.native * 1e3,
+			t.build * 1e3, t.vm / t.native);
+		std::cout << line;
+	}
+	rmdir(dirName);
+	return status;
+}
@@ -0,0 +1,125 @@
+/*
+Parallel unparsing benchmark.
+
+Parses each input (normally the synthetic corpus from gencorpus,
+whose mixed and calls shapes have thousands of functions) and times
+unparsing it serially and with its declarations spread over 1, 2, 4,
+... threads (see ProgramNode::unparseParallel), up to one per core or
+the given maximum, reporting the speedup over serial for each. Output
+goes into memory, and each parallel result must be byte for byte the
+serial one.
+
+Each is run several times and the fastest run is kept.
+
+Usage: parallel [-r reps] [-t max threads] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include "errors.hpp"
+#include "scanner.hpp"
+#include "threadpool.hpp"
+
+using namespace crona;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+bool measure(const char * path, size_t reps, size_t maxThreads){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	Scanner scanner(source);
+	scanner.useLexer(LexerKind::FAST);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0){
+		delete root;
+		return false;
+	}
+
+	std::string serial;
+	double serialSecs = 1e30;
+	for (size_t r = 0; r < reps; r++){
+		serial.clear();
+		auto start = std::chrono::steady_clock::now();
+		{
+			OutBuf out(serial);
+			root->unparse(out, 0);
+		}
+		serialSecs = std::min(serialSecs, secondsSince(start));
+	}
+
+	const char * name = std::strrchr(path, '/');
+	char line[160];
+	std::snprintf(line, sizeof(line), "%-14s %6zu decls %8.1f ms serial",
+		name == nullptr ? path : name + 1, root->globals().size(),
+		serialSecs * 1e3);
+	std::cout << line;
+	bool same = true;
+	for (size_t threads = 1; threads <= maxThreads; threads *= 2){
+		ThreadPool pool(threads);
+		double secs = 1e30;
+		std::string text;
+		for (size_t r = 0; r < reps; r++){
+			text.clear();
+			auto start = std::chrono::steady_clock::now();
+			{
+				OutBuf out(text);
+				root->unparseParallel(out, pool);
+			}
+			secs = std::min(secs, secondsSince(start));
+		}
+		if (text != serial){ same = false; }
+		std::snprintf(line, sizeof(line), "  %zu: %5.2fx", threads,
+			serialSecs / secs);
+		std::cout << line;
+	}
+	std::cout << "\n";
+	delete root;
+	if (!same){ std::cerr << path << ": parallel output differs\n"; }
+	return same;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 5;
+	size_t maxThreads = std::max(1u, std::thread::hardware_concurrency());
+	std::vector<const char *> paths;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else if (std::strcmp(argv[i], "-t") == 0 && i + 1 < argc){
+			maxThreads = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			paths.push_back(argv[i]);
+		}
+	}
+	if (paths.empty() || reps == 0 || maxThreads == 0){
+		std::cerr << "Usage: parallel [-r reps] [-t max threads] <file.crona>...\n";
+		return 1;
+	}
+	int status = 0;
+	for (const char * path : paths){
+		try {
+			if (!measure(path, reps, maxThreads)){
+				std::cerr << path << ": failed\n";
+				status = 1;
+			}
+		} catch (InternalError * e){
+			std::cerr << path << ": " << e->msg() << "\n";
+			status = 1;
+		}
+	}
+	return status;
+}
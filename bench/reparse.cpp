@@ -0,0 +1,126 @@
+/*
+Incremental reparse benchmark.
+
+For each input, compares parsing it from scratch with bringing an
+IncrementalParse up to date after a small edit. The edits are spread
+evenly over the program's declarations: each one inserts a blank
+line in front of a declaration and a second edit takes it out again,
+so every edit shifts the positions of everything after it.
+
+Reports the full parse time, the mean and worst time per edit, and
+how many bytes each edit re-lexed on average.
+
+Usage: reparse [-n edits] [--lexer=<flex|fast>] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "errors.hpp"
+#include "incremental.hpp"
+
+using namespace crona;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+bool measure(const char * path, size_t edits, LexerKind lexer){
+	std::ifstream in(path, std::ios::binary);
+	if (!in){
+		std::cerr << path << ": can't read\n";
+		return false;
+	}
+	std::stringstream text;
+	text << in.rdbuf();
+
+	auto start = std::chrono::steady_clock::now();
+	IncrementalParse inc(text.str(), lexer);
+	double fullSecs = secondsSince(start);
+	if (inc.ast() == nullptr){
+		std::cerr << path << ": parse failed\n";
+		return false;
+	}
+
+	size_t decls = inc.spans().size();
+	size_t done = 0;
+	size_t bytes = 0;
+	double totalSecs = 0;
+	double worstSecs = 0;
+	for (size_t e = 0; e < edits && decls > 0; e++){
+		size_t at = inc.spans()[e * decls / edits].begin;
+		for (int undo = 0; undo < 2; undo++){
+			start = std::chrono::steady_clock::now();
+			bool ok = undo ? inc.edit(at, 1, "") : inc.edit(at, 0, "\n");
+			double secs = secondsSince(start);
+			if (!ok){
+				std::cerr << path << ": edit failed\n";
+				return false;
+			}
+			totalSecs += secs;
+			worstSecs = std::max(worstSecs, secs);
+			bytes += inc.lastBytesParsed();
+			done++;
+		}
+	}
+
+	char line[160];
+	double mean = done > 0 ? totalSecs / static_cast<double>(done) : 0;
+	std::cout << path << ": " << text.str().size() / 1e6 << " MB, "
+		<< decls << " declarations\n";
+	std::snprintf(line, sizeof(line), "  %-10s %12.3f ms\n", "full", fullSecs * 1e3);
+	std::cout << line;
+	std::snprintf(line, sizeof(line),
+		"  %-10s %12.3f us mean, %.3f us worst, %zu bytes re-lexed\n",
+		"edit", mean * 1e6, worstSecs * 1e6, done > 0 ? bytes / done : 0);
+	std::cout << line;
+	std::snprintf(line, sizeof(line), "  %-10s %12.0fx\n", "speedup",
+		mean > 0 ? fullSecs / mean : 0);
+	std::cout << line;
+	return true;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t edits = 1000;
+	LexerKind lexer = LexerKind::FLEX;
+	bool usage = false;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-n") == 0 && i + 1 < argc){
+			edits = std::strtoul(argv[++i], nullptr, 10);
+		} else if (std::strncmp(argv[i], "--lexer=", 8) == 0){
+			usage |= !lexerKindFromString(argv[i] + 8, lexer);
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (usage || inputs.empty() || edits == 0){
+		std::cerr << "Usage: reparse [-n edits] [--lexer=<flex|fast>]"
+			" <file.crona>...\n";
+		return 1;
+	}
+
+	//Nothing in a well-formed corpus is reported; keep it that way
+	std::ostringstream quiet;
+	Report::redirect(&quiet);
+	try {
+		for (const char * input : inputs){
+			if (!measure(input, edits, lexer)){ return 1; }
+		}
+	} catch (InternalError * e){
+		std::cerr << "Error: " << e->msg() << std::endl;
+		return 1;
+	}
+	return 0;
+}
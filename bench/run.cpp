@@ -0,0 +1,140 @@
+/*
+Bytecode VM benchmark.
+
+Runs each program (normally the compute-heavy ones in
+bench/programs: recursion, array loops, nested loops over globals,
+arithmetic in a tight loop) on the VM four ways: dispatching through
+the switch or threaded (computed goto), each with and without
+superinstructions (see bytecode.hpp). Reports the code size of each
+lowering and the time of each way, with the speedup of the fastest
+over the plain switch. All four must write the same output, which
+is discarded.
+
+Each way is run several times and the fastest run is kept.
+
+Usage: run [-r reps] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <vector>
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "names.hpp"
+#include "scanner.hpp"
+#include "vm.hpp"
+
+using namespace crona;
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+size_t codeSize(const Module& module){
+	size_t size = 0;
+	for (const Function& fn : module.functions){ size += fn.code.size(); }
+	return size;
+}
+
+struct Timing{
+	size_t plainCode = 0;
+	size_t superCode = 0;
+	//Switch, threaded; plain, then with superinstructions
+	double secs[4] = {1e30, 1e30, 1e30, 1e30};
+};
+
+bool measure(const char * path, size_t reps, Timing& t){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	Scanner scanner(source);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0 || !analyzeNames(root)){
+		delete root;
+		return false;
+	}
+	Module modules[2];
+	bool lowered = lowerProgram(root, modules[0], false)
+		&& lowerProgram(root, modules[1], true);
+	delete root;
+	if (!lowered){ return false; }
+	t.plainCode = codeSize(modules[0]);
+	t.superCode = codeSize(modules[1]);
+
+	std::string first;
+	for (size_t way = 0; way < 4; way++){
+		bool threaded = way % 2 == 1;
+		if (threaded && !VM::canThread()){ continue; }
+		for (size_t r = 0; r < reps; r++){
+			std::ostringstream written;
+			std::istringstream in("");
+			OutBuf out(written);
+			VM vm(modules[way / 2], in, out);
+			auto start = std::chrono::steady_clock::now();
+			bool ok = vm.run(threaded);
+			t.secs[way] = std::min(t.secs[way], secondsSince(start));
+			if (!ok){ return false; }
+			if (way == 0 && r == 0){
+				first = written.str();
+			} else if (written.str() != first){
+				std::cerr << path << ": output differs between runs\n";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 3;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty() || reps == 0){
+		std::cerr << "Usage: run [-r reps] <file.crona>...\n";
+		return 1;
+	}
+
+	char line[160];
+	std::snprintf(line, sizeof(line), "%-14s %11s %9s %9s %9s %9s %8s\n",
+		"program", "instrs", "switch", "threaded", "sw+super", "th+super",
+		"speedup");
+	std::cout << line;
+	for (const char * path : inputs){
+		Timing t;
+		try {
+			if (!measure(path, reps, t)){
+				std::cerr << path << ": failed\n";
+				return 1;
+			}
+		} catch (InternalError * e){
+			std::cerr << path << ": " << e->msg() << "\n";
+			return 1;
+		}
+		const char * name = std::strrchr(path, '/');
+		char code[32];
+		std::snprintf(code, sizeof(code), "%zu/%zu", t.plainCode, t.superCode);
+		double best = *std::min_element(t.secs, t.secs + 4);
+		std::snprintf(line, sizeof(line),
+			"%-14s %11s %6.0f ms %6.0f ms %6.0f ms %6.0f ms %7.2fx\n",
+			name == nullptr ? path : name + 1, code, t.secs[0] * 1e3,
+			t.secs[1] * 1e3, t.secs[2] * 1e3, t.secs[3] * 1e3,
+			t.secs[0] / best);
+		std::cout << line;
+	}
+	return 0;
+}
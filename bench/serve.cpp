@@ -0,0 +1,166 @@
+/*
+Compile server latency benchmark.
+
+Compares two ways of unparsing the same inputs reps times each:
+
+  cold    run `cronac <file> -u /dev/null` once per input, as a build
+          would, paying process start-up every time
+  serve   send `unparse path` requests to one `cronac --serve` over
+          its stdin and stdout (see server.hpp)
+
+and reports the mean wall time per input for each. Both run the same
+front end, so the difference is what a warm server saves per request.
+
+Usage: serve [-r reps] <cronac> <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+namespace {
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+//Start cronac with args; its stdin and stdout are the given fds
+//(-1: /dev/null), and its stderr is always /dev/null
+pid_t spawn(const std::vector<const char *>& args, int in, int out){
+	pid_t pid = fork();
+	if (pid != 0){ return pid; }
+	int devNull = open("/dev/null", O_RDWR);
+	dup2(in < 0 ? devNull : in, STDIN_FILENO);
+	dup2(out < 0 ? devNull : out, STDOUT_FILENO);
+	dup2(devNull, STDERR_FILENO);
+	std::vector<char *> argv;
+	for (const char * arg : args){ argv.push_back(const_cast<char *>(arg)); }
+	argv.push_back(nullptr);
+	execv(argv[0], argv.data());
+	_exit(127);
+}
+
+bool finished(pid_t pid){
+	int status;
+	return waitpid(pid, &status, 0) == pid && WIFEXITED(status)
+		&& WEXITSTATUS(status) == 0;
+}
+
+bool cold(const char * cronac, const char * input){
+	return finished(spawn({cronac, input, "-u", "/dev/null"}, -1, -1));
+}
+
+bool readAll(int fd, char * buf, size_t len){
+	while (len > 0){
+		ssize_t got = read(fd, buf, len);
+		if (got <= 0){ return false; }
+		buf += got;
+		len -= static_cast<size_t>(got);
+	}
+	return true;
+}
+
+//One request to the server; the reply's header is read a byte at a
+//time so as not to read past it
+bool warm(int toServer, int fromServer, const char * input){
+	std::string request = "unparse path " + std::to_string(std::strlen(input))
+		+ "\n" + input;
+	if (write(toServer, request.data(), request.size())
+	  != static_cast<ssize_t>(request.size())){
+		return false;
+	}
+	std::string header;
+	char ch;
+	while (readAll(fromServer, &ch, 1) && ch != '\n'){ header += ch; }
+	char status[16];
+	size_t outLen;
+	size_t diagLen;
+	if (std::sscanf(header.c_str(), "%15s %zu %zu", status, &outLen,
+	  &diagLen) != 3){
+		return false;
+	}
+	std::vector<char> body(outLen + diagLen);
+	return readAll(fromServer, body.data(), body.size())
+		&& std::strcmp(status, "ok") == 0;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 20;
+	std::vector<const char *> args;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			args.push_back(argv[i]);
+		}
+	}
+	if (args.size() < 2 || reps == 0){
+		std::cerr << "Usage: serve [-r reps] <cronac> <file.crona>...\n";
+		return 1;
+	}
+	const char * cronac = args[0];
+	std::vector<const char *> inputs(args.begin() + 1, args.end());
+	double runs = static_cast<double>(reps * inputs.size());
+
+	auto start = std::chrono::steady_clock::now();
+	for (size_t r = 0; r < reps; r++){
+		for (const char * input : inputs){
+			if (!cold(cronac, input)){
+				std::cerr << input << ": cronac failed\n";
+				return 1;
+			}
+		}
+	}
+	double coldSecs = secondsSince(start) / runs;
+
+	int toServer[2];
+	int fromServer[2];
+	if (pipe(toServer) != 0 || pipe(fromServer) != 0){
+		std::cerr << "Can't create pipes\n";
+		return 1;
+	}
+	//The server mustn't hold our ends open, or it never sees EOF
+	fcntl(toServer[1], F_SETFD, FD_CLOEXEC);
+	fcntl(fromServer[0], F_SETFD, FD_CLOEXEC);
+	pid_t server = spawn({cronac, "--serve"}, toServer[0], fromServer[1]);
+	close(toServer[0]);
+	close(fromServer[1]);
+	//Leave the first request (and the server's own start-up) untimed
+	bool ok = warm(toServer[1], fromServer[0], inputs[0]);
+	start = std::chrono::steady_clock::now();
+	for (size_t r = 0; ok && r < reps; r++){
+		for (const char * input : inputs){
+			ok = ok && warm(toServer[1], fromServer[0], input);
+		}
+	}
+	double warmSecs = secondsSince(start) / runs;
+	close(toServer[1]);
+	ok = finished(server) && ok;
+	close(fromServer[0]);
+	if (!ok){
+		std::cerr << "cronac --serve failed\n";
+		return 1;
+	}
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "  %-6s %10.1f us per input\n", "cold",
+		coldSecs * 1e6);
+	std::cout << inputs.size() << " inputs x " << reps << "\n" << line;
+	std::snprintf(line, sizeof(line), "  %-6s %10.1f us per input\n", "serve",
+		warmSecs * 1e6);
+	std::cout << line;
+	std::snprintf(line, sizeof(line), "  %-6s %10.1fx\n", "speedup",
+		warmSecs > 0 ? coldSecs / warmSecs : 0);
+	std::cout << line;
+	return 0;
+}
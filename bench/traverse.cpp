@@ -0,0 +1,110 @@
+/*
+Traversal benchmark for AST child lists.
+
+Builds the same set of statement nodes twice: once behind a
+std::list<StmtNode *> (one heap node per element, allocated
+interleaved with the AST nodes the way the old grammar actions
+did) and once in an arena-backed NodeList. Each container is then
+walked repeatedly, and finally every statement is unparsed through
+its NodeList to a discarding stream for an end-to-end figure.
+
+Usage: traverse [fns] [stmtsPerFn] [passes]
+*/
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <list>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include "ast.hpp"
+
+using namespace crona;
+
+namespace {
+
+class NullBuf : public std::streambuf{
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char *, std::streamsize n) override {
+		return n;
+	}
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+StmtNode * makeStmt(Arena * arena, size_t line){
+	const size_t stmtCol = 1;
+	const size_t expCol = 7;
+	ExpNode * lit = arena->make<IntLitNode>(
+		line, expCol, static_cast<int>(line));
+	return arena->make<WriteStmtNode>(line, stmtCol, lit);
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t fns = argc > 1 ? std::strtoul(argv[1], nullptr, 10) : 2000;
+	size_t stmts = argc > 2 ? std::strtoul(argv[2], nullptr, 10) : 500;
+	size_t passes = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 20;
+
+	Arena * arena = new Arena();
+	std::vector<std::list<StmtNode *> *> lists;
+	std::vector<NodeList<StmtNode> *> spans;
+	for (size_t f = 0; f < fns; f++){
+		std::list<StmtNode *> * list = new std::list<StmtNode *>();
+		NodeList<StmtNode> * span = arena->make<NodeList<StmtNode>>();
+		for (size_t s = 0; s < stmts; s++){
+			StmtNode * stmt = makeStmt(arena, s + 1);
+			list->push_back(stmt);
+			span->push_back(arena, stmt);
+		}
+		lists.push_back(list);
+		spans.push_back(span);
+	}
+
+	size_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (size_t p = 0; p < passes; p++){
+		for (auto list : lists){
+			for (auto stmt : *list){ sum += stmt->line(); }
+		}
+	}
+	double listSecs = secondsSince(start);
+
+	start = std::chrono::steady_clock::now();
+	for (size_t p = 0; p < passes; p++){
+		for (auto span : spans){
+			for (auto stmt : *span){ sum -= stmt->line(); }
+		}
+	}
+	double spanSecs = secondsSince(start);
+
+	double visits = static_cast<double>(fns * stmts * passes);
+	std::cout << "elements:      " << fns * stmts << " x "
+		<< passes << " passes\n";
+	std::cout << "std::list:     " << listSecs * 1e9 / visits
+		<< " ns/element\n";
+	std::cout << "NodeList:      " << spanSecs * 1e9 / visits
+		<< " ns/element\n";
+	std::cout << "speedup:       " << listSecs / spanSecs << "x\n";
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	start = std::chrono::steady_clock::now();
+	{
+		OutBuf out(nullOut);
+		for (auto span : spans){
+			for (auto stmt : *span){ stmt->unparse(out, 1); }
+		}
+	}
+	std::cout << "unparse:       " << secondsSince(start) * 1e9
+		/ static_cast<double>(fns * stmts) << " ns/stmt\n";
+
+	for (auto list : lists){ delete list; }
+	delete arena;
+	return sum == 0 ? 0 : 1;
+}
@@ -0,0 +1,198 @@
+/*
+AST dispatch benchmark.
+
+Parses each input (normally the synthetic corpus from gencorpus)
+and walks the whole tree three ways, reporting nanoseconds per
+node:
+
+  static   an ASTVisitor: visit switches on the node's kind and
+           calls the pass directly, so the compiler can inline it
+  virtual  the same walk doing the same work at each node, but
+           reaching it through a virtual call per node, as a
+           virtual method in every node class would
+  unparse  ProgramNode::unparse (an ASTVisitor too) to a null
+           stream, for a pass that does real work per node
+
+Each walk is run several times and the fastest run is kept.
+
+Usage: visit [-r reps] <file.crona>...
+*/
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <ostream>
+#include <streambuf>
+#include <vector>
+#include "errors.hpp"
+#include "scanner.hpp"
+#include "visitor.hpp"
+
+using namespace crona;
+
+namespace {
+
+class NullBuf : public std::streambuf{
+protected:
+	int overflow(int c) override { return c; }
+	std::streamsize xsputn(const char *, std::streamsize n) override {
+		return n;
+	}
+};
+
+double secondsSince(std::chrono::steady_clock::time_point start){
+	std::chrono::duration<double> d = std::chrono::steady_clock::now() - start;
+	return d.count();
+}
+
+//The work done at each node, whichever way it's reached
+inline void touch(uint64_t& sum, ASTNode * node){
+	sum = sum * 31 + node->line() + static_cast<uint64_t>(node->kind());
+}
+
+class StaticWalk : public ASTVisitor<StaticWalk>{
+public:
+	uint64_t sum = 0;
+	size_t nodes = 0;
+
+	template <typename T>
+	void visitNode(T * node){
+		touch(sum, node);
+		nodes++;
+		visitChildren(node);
+	}
+};
+
+class VirtualWalk;
+
+class Step{
+public:
+	virtual ~Step(){}
+	virtual void run(VirtualWalk& walk, ASTNode * node) = 0;
+};
+
+//What a virtual method in class T would do
+template <typename T>
+class ClassStep : public Step{
+public:
+	void run(VirtualWalk& walk, ASTNode * node) override;
+};
+
+class VirtualWalk : public ASTVisitor<VirtualWalk>{
+public:
+	uint64_t sum = 0;
+
+	VirtualWalk(){
+		size_t i = 0;
+#define CRONA_MAKE_STEP(name) \
+		mySteps[i++].reset(new ClassStep<name>());
+		CRONA_AST_NODES(CRONA_MAKE_STEP)
+#undef CRONA_MAKE_STEP
+	}
+
+	//Replaces ASTVisitor::visit, for the children too
+	void visit(ASTNode * node){
+		mySteps[static_cast<size_t>(node->kind())]->run(*this, node);
+	}
+private:
+	std::unique_ptr<Step> mySteps[NUM_NODE_KINDS];
+};
+
+template <typename T>
+void ClassStep<T>::run(VirtualWalk& walk, ASTNode * node){
+	touch(walk.sum, node);
+	walk.visitChildren(static_cast<T *>(node));
+}
+
+struct Timing{
+	size_t nodes = 0;
+	double staticSecs = 1e30;
+	double virtualSecs = 1e30;
+	double unparseSecs = 1e30;
+};
+
+bool measure(const char * path, size_t reps, Timing& t){
+	std::shared_ptr<SourceFile> source(new SourceFile(path));
+	Scanner scanner(source);
+	scanner.useLexer(LexerKind::FAST);
+	ProgramNode * root = nullptr;
+	Parser parser(scanner, &root);
+	if (parser.parse() != 0){
+		delete root;
+		return false;
+	}
+
+	NullBuf nullBuf;
+	std::ostream nullOut(&nullBuf);
+	bool same = true;
+	for (size_t r = 0; r < reps; r++){
+		auto start = std::chrono::steady_clock::now();
+		StaticWalk fast;
+		fast.visit(root);
+		t.staticSecs = std::min(t.staticSecs, secondsSince(start));
+		t.nodes = fast.nodes;
+
+		start = std::chrono::steady_clock::now();
+		VirtualWalk slow;
+		slow.visit(root);
+		t.virtualSecs = std::min(t.virtualSecs, secondsSince(start));
+		same = same && slow.sum == fast.sum;
+
+		start = std::chrono::steady_clock::now();
+		root->unparse(nullOut, 0);
+		t.unparseSecs = std::min(t.unparseSecs, secondsSince(start));
+	}
+	delete root;
+	if (!same){
+		std::cerr << path << ": the walks disagree\n";
+	}
+	return same;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	size_t reps = 5;
+	std::vector<const char *> inputs;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-r") == 0 && i + 1 < argc){
+			reps = std::strtoul(argv[++i], nullptr, 10);
+		} else {
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (inputs.empty() || reps == 0){
+		std::cerr << "Usage: visit [-r reps] <file.crona>...\n";
+		return 1;
+	}
+
+	char line[128];
+	std::snprintf(line, sizeof(line), "%-24s %9s %9s %9s %9s\n", "input",
+		"nodes", "static", "virtual", "unparse");
+	std::cout << line;
+	for (const char * path : inputs){
+		Timing t;
+		try {
+			if (!measure(path, reps, t)){
+				std::cerr << path << ": failed\n";
+				return 1;
+			}
+		} catch (InternalError * e){
+			std::cerr << path << ": " << e->msg() << "\n";
+			return 1;
+		}
+		double nodes = static_cast<double>(t.nodes);
+		const char * name = std::strrchr(path, '/');
+		std::snprintf(line, sizeof(line),
+			"%-24s %9zu %6.2f ns %6.2f ns %6.2f ns  (%.2fx)\n",
+			name == nullptr ? path : name + 1, t.nodes,
+			t.staticSecs * 1e9 / nodes, t.virtualSecs * 1e9 / nodes,
+			t.unparseSecs * 1e9 / nodes, t.virtualSecs / t.staticSecs);
+		std::cout << line;
+	}
+	return 0;
+}
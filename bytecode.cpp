@@ -0,0 +1,885 @@
+#include <climits>
+#include <string>
+#include <unordered_map>
+#include "bytecode.hpp"
+#include "errors.hpp"
+#include "visitor.hpp"
+
+namespace crona{
+
+const char * opName(Op op){
+	static const char * names[NUM_OPS] = {
+#define CRONA_OP_NAME(name) #name,
+		CRONA_OPCODES(CRONA_OP_NAME)
+#undef CRONA_OP_NAME
+	};
+	return names[static_cast<size_t>(op)];
+}
+
+void Module::disassemble(std::ostream& out) const{
+	for (size_t f = 0; f < functions.size(); f++){
+		const Function& fn = functions[f];
+		out << f << " " << fn.name->name() << ": " << fn.formals
+			<< " formals, " << fn.registers << " registers, "
+			<< fn.arrayCells << " array cells\n";
+		for (size_t i = 0; i < fn.code.size(); i++){
+			const Instr& in = fn.code[i];
+			out << "\t" << i << "\t" << opName(in.op) << " " << in.a << " "
+				<< in.b << " " << in.c << " " << in.d << "\n";
+		}
+	}
+}
+
+/*
+Lowering is one pass, the Lowerer below. A method for an expression
+class emits code leaving the expression's value in a register, and
+returns the register: the one asked for, or if none was (NO_REG),
+whichever is handiest, which for a local variable is its own. A
+method for a statement emits its code and returns nothing useful.
+
+Registers are handed out like a stack. Each variable in scope holds
+one, below everything else (the "live" registers), and temporaries
+go above them and are given back once the expression (or statement)
+that needed them is done.
+*/
+
+static const uint32_t NO_REG = UINT32_MAX;
+//Register operands are 16 bits
+static const uint32_t MAX_REGISTERS = UINT16_MAX;
+//Memory is addressed with 32-bit ints; these keep well within that
+static const size_t MAX_GLOBAL_CELLS = size_t(1) << 26;
+static const uint32_t MAX_ARRAY_CELLS = uint32_t(1) << 24;
+
+/// Whether evaluating an expression could assign to a variable
+class Assigns : public ASTVisitor<Assigns, bool>{
+private:
+	friend class ASTVisitor<Assigns, bool>;
+	using ASTVisitor<Assigns, bool>::visitNode;
+
+	bool visitAssignExpNode(AssignExpNode *){ return true; }
+	bool visitCallExpNode(CallExpNode * node){
+		for (ExpNode * arg : node->args()){
+			if (visit(arg)){ return true; }
+		}
+		return false;
+	}
+	bool visitIndexNode(IndexNode * node){ return visit(node->offset()); }
+	bool visitNode(BinaryExpNode * node){
+		return visit(node->lhs()) || visit(node->rhs());
+	}
+	bool visitNode(UnaryExpNode * node){ return visit(node->exp()); }
+};
+
+/// Where a variable is kept
+struct Storage{
+	bool global;
+	//Its register, the address of a global scalar (or string), or the
+	// reference to a global array
+	uint32_t where;
+	const DataType * type;
+};
+
+/// A place in the code that jumps go to
+struct Label{
+	static const size_t UNBOUND = SIZE_MAX;
+	size_t at = UNBOUND;
+	std::vector<size_t> jumps; //Waiting for it to be bound
+};
+
+class Lowerer : public ASTVisitor<Lowerer, uint32_t, uint32_t>{
+public:
+	Lowerer(Module& module, bool superinstructions)
+	: myModule(module), mySuper(superinstructions), myOk(true),
+	  myFn(nullptr), myAt(nullptr), myLive(0), myNext(0), myArrayTop(0){}
+	bool ok() const { return myOk; }
+private:
+	friend class ASTVisitor<Lowerer, uint32_t, uint32_t>;
+	using ASTVisitor<Lowerer, uint32_t, uint32_t>::visitNode;
+
+	uint32_t visitProgramNode(ProgramNode * node, uint32_t want);
+	uint32_t visitVarDeclNode(VarDeclNode * node, uint32_t want);
+	uint32_t visitFnDeclNode(FnDeclNode * node, uint32_t want);
+	uint32_t visitIDNode(IDNode * node, uint32_t want);
+	uint32_t visitIndexNode(IndexNode * node, uint32_t want);
+	uint32_t visitAssignExpNode(AssignExpNode * node, uint32_t want);
+	uint32_t visitCallExpNode(CallExpNode * node, uint32_t want);
+	uint32_t visitFalseNode(FalseNode * node, uint32_t want);
+	uint32_t visitHavocNode(HavocNode * node, uint32_t want);
+	uint32_t visitIntLitNode(IntLitNode * node, uint32_t want);
+	uint32_t visitStrLitNode(StrLitNode * node, uint32_t want);
+	uint32_t visitTrueNode(TrueNode * node, uint32_t want);
+	uint32_t visitNode(BinaryExpNode * node, uint32_t want);
+	uint32_t visitNegNode(NegNode * node, uint32_t want);
+	uint32_t visitNotNode(NotNode * node, uint32_t want);
+	uint32_t visitAssignStmtNode(AssignStmtNode * node, uint32_t want);
+	uint32_t visitReadStmtNode(ReadStmtNode * node, uint32_t want);
+	uint32_t visitWriteStmtNode(WriteStmtNode * node, uint32_t want);
+	uint32_t visitPostDecStmtNode(PostDecStmtNode * node, uint32_t want);
+	uint32_t visitPostIncStmtNode(PostIncStmtNode * node, uint32_t want);
+	uint32_t visitIfStmtNode(IfStmtNode * node, uint32_t want);
+	uint32_t visitIfElseStmtNode(IfElseStmtNode * node, uint32_t want);
+	uint32_t visitWhileStmtNode(WhileStmtNode * node, uint32_t want);
+	uint32_t visitReturnStmtNode(ReturnStmtNode * node, uint32_t want);
+	uint32_t visitCallStmtNode(CallStmtNode * node, uint32_t want);
+
+	void error(ASTNode * at, const char * msg);
+	size_t emit(Op op, uint32_t a = 0, uint32_t b = 0, uint32_t c = 0,
+		int32_t d = 0);
+	void jump(Op op, uint32_t a, uint32_t b, Label& to);
+	void bind(Label& label);
+
+	uint32_t temp();
+	uint32_t target(uint32_t want){ return want == NO_REG ? temp() : want; }
+	bool isVariable(uint32_t reg) const { return reg < myLive; }
+	uint32_t copy(uint32_t reg, uint32_t want);
+	/// reg, or a copy of it if it's a variable that later could assign
+	uint32_t stable(uint32_t reg, ExpNode * later);
+
+	const DataType * typeOf(ExpNode * exp);
+	Storage * variable(IDNode * id);
+	bool isByte(const DataType * type){ return type == TypeTable::global().byteType(); }
+	/// Strings are byte arrays with no set length, kept by reference
+	/// like a scalar, so (unlike other arrays) they can be assigned
+	bool isString(const DataType * type){
+		TypeTable& types = TypeTable::global();
+		return type == types.arrayOf(types.byteType(), 0);
+	}
+	/// Arrays whose variables hold their elements
+	bool isFixedArray(const DataType * type){
+		return type != nullptr && type->isArray() && !isString(type);
+	}
+	bool needsByte(const DataType * to, ExpNode * from){
+		return isByte(to) && !isByte(typeOf(from));
+	}
+
+	void block(NodeList<StmtNode>& stmts);
+	/// Jump to to if cond is when, and otherwise fall through
+	void branch(ExpNode * cond, bool when, Label& to);
+	void addConst(uint32_t dst, uint32_t src, int32_t k);
+	/// Add k to a variable or array element in place
+	void bump(LValNode * lval, int32_t k);
+	int32_t stringConstant(StrLitNode * node);
+	int32_t stringRef(const std::string& text);
+
+	Module& myModule;
+	bool mySuper;
+	bool myOk;
+	Function * myFn;
+	ASTNode * myAt; //What's being lowered, for positions
+	uint32_t myLive;
+	uint32_t myNext;
+	uint32_t myArrayTop;
+	std::unordered_map<DeclNode *, Storage> myVars;
+	std::unordered_map<DeclNode *, uint32_t> myFns;
+	std::unordered_map<std::string, int32_t> myStrings;
+};
+
+bool lowerProgram(ProgramNode * ast, Module& module, bool superinstructions){
+	Lowerer lowerer(module, superinstructions);
+	lowerer.visit(ast, NO_REG);
+	return lowerer.ok();
+}
+
+void Lowerer::error(ASTNode * at, const char * msg){
+	Report::fatal(at->line(), at->col(), msg);
+	myOk = false;
+}
+
+size_t Lowerer::emit(Op op, uint32_t a, uint32_t b, uint32_t c, int32_t d){
+	myFn->code.push_back(Instr{op, static_cast<uint16_t>(a),
+		static_cast<uint16_t>(b), static_cast<uint16_t>(c), d});
+	myFn->positions.push_back(SourcePos{static_cast<uint32_t>(myAt->line()),
+		static_cast<uint32_t>(myAt->col())});
+	return myFn->code.size() - 1;
+}
+
+void Lowerer::jump(Op op, uint32_t a, uint32_t b, Label& to){
+	size_t at = emit(op, a, b);
+	if (to.at == Label::UNBOUND){
+		to.jumps.push_back(at);
+	} else {
+		myFn->code[at].d = static_cast<int32_t>(to.at) - static_cast<int32_t>(at);
+	}
+}
+
+void Lowerer::bind(Label& label){
+	label.at = myFn->code.size();
+	for (size_t at : label.jumps){
+		myFn->code[at].d = static_cast<int32_t>(label.at)
+			- static_cast<int32_t>(at);
+	}
+	label.jumps.clear();
+}
+
+uint32_t Lowerer::temp(){
+	if (myNext >= MAX_REGISTERS){
+		if (myNext++ == MAX_REGISTERS){
+			error(myAt, "Function needs too many registers");
+		}
+		return MAX_REGISTERS - 1;
+	}
+	uint32_t reg = myNext++;
+	if (myNext > myFn->registers){ myFn->registers = myNext; }
+	return reg;
+}
+
+uint32_t Lowerer::copy(uint32_t reg, uint32_t want){
+	if (want == NO_REG || want == reg){ return reg; }
+	emit(Op::MOV, want, reg);
+	return want;
+}
+
+uint32_t Lowerer::stable(uint32_t reg, ExpNode * later){
+	if (!isVariable(reg) || !Assigns().visit(later)){ return reg; }
+	uint32_t saved = temp();
+	emit(Op::MOV, saved, reg);
+	return saved;
+}
+
+/*
+There's no type checker, so this works out just enough to lower a
+program that would pass one: nullptr for anything that has no
+value type (a function's name, say).
+*/
+const DataType * Lowerer::typeOf(ExpNode * exp){
+	TypeTable& types = TypeTable::global();
+	switch (exp->kind()){
+	case NodeKind::IDNode: {
+		DeclNode * decl = static_cast<IDNode *>(exp)->decl();
+		if (decl == nullptr || decl->kind() == NodeKind::FnDeclNode){
+			return nullptr;
+		}
+		return static_cast<VarDeclNode *>(decl)->type();
+	}
+	case NodeKind::IndexNode: {
+		const DataType * base = typeOf(static_cast<IndexNode *>(exp)->base());
+		return base != nullptr && base->isArray() ? base->element() : nullptr;
+	}
+	case NodeKind::CallExpNode: {
+		DeclNode * decl = static_cast<CallExpNode *>(exp)->id()->decl();
+		if (decl == nullptr || decl->kind() != NodeKind::FnDeclNode){
+			return nullptr;
+		}
+		return static_cast<FnDeclNode *>(decl)->type();
+	}
+	case NodeKind::AssignExpNode:
+		return typeOf(static_cast<AssignExpNode *>(exp)->dest());
+	case NodeKind::StrLitNode:
+		return types.arrayOf(types.byteType(), 0);
+	case NodeKind::IntLitNode:
+	case NodeKind::PlusNode:
+	case NodeKind::MinusNode:
+	case NodeKind::TimesNode:
+	case NodeKind::DivideNode:
+	case NodeKind::NegNode:
+		return types.intType();
+	default:
+		return types.boolType();
+	}
+}
+
+Storage * Lowerer::variable(IDNode * id){
+	DeclNode * decl = id->decl();
+	if (decl == nullptr){
+		error(id, "Undeclared identifier");
+		return nullptr;
+	}
+	auto found = myVars.find(decl);
+	if (found == myVars.end()){
+		error(id, "Function used as a value");
+		return nullptr;
+	}
+	return &found->second;
+}
+
+/*
+Every global gets its memory up front, so functions can be lowered
+in one go afterwards, each knowing where everything is.
+*/
+uint32_t Lowerer::visitProgramNode(ProgramNode * node, uint32_t want){
+	myAt = node;
+	myModule.functions.clear();
+	myModule.main = 0;
+	myModule.memory.assign(1, 0); //No reference is 0
+	bool haveMain = false;
+	for (DeclNode * global : node->globals()){
+		if (global->kind() == NodeKind::FnDeclNode){
+			FnDeclNode * fn = static_cast<FnDeclNode *>(global);
+			uint32_t index = static_cast<uint32_t>(myModule.functions.size());
+			myFns[fn] = index;
+			myModule.functions.push_back(Function());
+			if (fn->id()->symbol()->name() == StrView("main", 4)){
+				myModule.main = index;
+				haveMain = true;
+				if (fn->formals().size() > 0){
+					error(fn, "main can't take arguments");
+				}
+			}
+			continue;
+		}
+		VarDeclNode * var = static_cast<VarDeclNode *>(global);
+		const DataType * type = var->type();
+		std::vector<int32_t>& memory = myModule.memory;
+		if (type->kind() == DataType::VOID){
+			error(var, "Invalid type in declaration");
+			continue;
+		}
+		if (!isFixedArray(type)){
+			myVars[var] = Storage{true, static_cast<uint32_t>(memory.size()), type};
+			memory.push_back(isString(type) ? stringRef("") : 0);
+			continue;
+		}
+		size_t cells = static_cast<size_t>(type->size()) + 1;
+		if (memory.size() + cells > MAX_GLOBAL_CELLS){
+			error(var, "Global arrays too large");
+			continue;
+		}
+		memory.push_back(type->size());
+		myVars[var] = Storage{true, static_cast<uint32_t>(memory.size()), type};
+		memory.resize(memory.size() + static_cast<size_t>(type->size()), 0);
+	}
+	if (!haveMain){ error(node, "No main function"); }
+	for (DeclNode * global : node->globals()){
+		if (global->kind() == NodeKind::FnDeclNode){ visit(global, NO_REG); }
+	}
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitFnDeclNode(FnDeclNode * node, uint32_t want){
+	myAt = node;
+	myFn = &myModule.functions[myFns[node]];
+	myFn->name = node->id()->symbol();
+	uint32_t formals = static_cast<uint32_t>(node->formals().size());
+	myFn->formals = formals;
+	//r0 takes the result, even without formals
+	myFn->registers = formals > 0 ? formals : 1;
+	myFn->arrayCells = 0;
+	myLive = 0;
+	myNext = 0;
+	myArrayTop = 0;
+	for (FormalDeclNode * formal : node->formals()){
+		uint32_t reg = temp();
+		myVars[formal] = Storage{false, reg, formal->type()};
+		myLive++;
+	}
+	block(node->body());
+	myAt = node;
+	emit(Op::RETV);
+	return NO_REG;
+}
+
+void Lowerer::block(NodeList<StmtNode>& stmts){
+	uint32_t live = myLive;
+	uint32_t arrayTop = myArrayTop;
+	for (StmtNode * stmt : stmts){
+		myAt = stmt;
+		visit(stmt, NO_REG);
+		myNext = myLive;
+	}
+	myLive = live;
+	myNext = live;
+	myArrayTop = arrayTop;
+}
+
+uint32_t Lowerer::visitVarDeclNode(VarDeclNode * node, uint32_t want){
+	const DataType * type = node->type();
+	if (type->kind() == DataType::VOID){
+		error(node, "Invalid type in declaration");
+	}
+	uint32_t reg = temp();
+	myLive++;
+	myVars[node] = Storage{false, reg, type};
+	if (!isFixedArray(type)){
+		emit(Op::CONST, reg, 0, 0, isString(type) ? stringRef("") : 0);
+		return NO_REG;
+	}
+	uint32_t cells = static_cast<uint32_t>(type->size()) + 1;
+	if (cells > MAX_ARRAY_CELLS - myArrayTop){
+		error(node, "Local arrays too large");
+		return NO_REG;
+	}
+	int32_t slot = static_cast<int32_t>(myFn->arrays.size());
+	myFn->arrays.push_back(ArraySlot{myArrayTop, type->size()});
+	myArrayTop += cells;
+	if (myArrayTop > myFn->arrayCells){ myFn->arrayCells = myArrayTop; }
+	emit(Op::ALLOCA, reg, 0, 0, slot);
+	return NO_REG;
+}
+
+///////EXPNODE CLASSES//////////////
+///////////////////////////////////
+
+uint32_t Lowerer::visitIDNode(IDNode * node, uint32_t want){
+	Storage * var = variable(node);
+	if (var == nullptr){ return target(want); }
+	if (!var->global){ return copy(var->where, want); }
+	uint32_t reg = target(want);
+	if (isFixedArray(var->type)){
+		emit(Op::CONST, reg, 0, 0, static_cast<int32_t>(var->where));
+	} else {
+		emit(Op::LOADG, reg, 0, 0, static_cast<int32_t>(var->where));
+	}
+	return reg;
+}
+
+uint32_t Lowerer::visitIndexNode(IndexNode * node, uint32_t want){
+	const DataType * type = typeOf(node->base());
+	if (type != nullptr && !type->isArray()){
+		error(node, "Index applied to a non-array");
+	}
+	uint32_t mark = myNext;
+	uint32_t base = visit(node->base(), NO_REG);
+	uint32_t offset = visit(node->offset(), NO_REG);
+	myNext = mark;
+	uint32_t reg = target(want);
+	myAt = node;
+	emit(Op::LOADX, reg, base, offset);
+	return reg;
+}
+
+uint32_t Lowerer::visitAssignExpNode(AssignExpNode * node, uint32_t want){
+	LValNode * dest = node->dest();
+	ExpNode * src = node->src();
+	const DataType * type = typeOf(dest);
+	if (isFixedArray(type) || (isString(type) && !isString(typeOf(src)))){
+		error(node, "Array assignment");
+		return target(want);
+	}
+	bool toByte = needsByte(type, src);
+	if (dest->kind() == NodeKind::IDNode){
+		Storage * var = variable(static_cast<IDNode *>(dest));
+		if (var == nullptr){ return target(want); }
+		if (!var->global){
+			visit(src, var->where);
+			if (toByte){ emit(Op::BYTE, var->where, var->where); }
+			return copy(var->where, want);
+		}
+		uint32_t value = visit(src, toByte ? target(want) : want);
+		if (toByte){ emit(Op::BYTE, value, value); }
+		emit(Op::STOREG, value, 0, 0, static_cast<int32_t>(var->where));
+		return value;
+	}
+
+	IndexNode * index = static_cast<IndexNode *>(dest);
+	uint32_t base = visit(index->base(), NO_REG);
+	uint32_t offset = stable(visit(index->offset(), NO_REG), src);
+	uint32_t value = visit(src, toByte ? target(want) : want);
+	if (toByte){ emit(Op::BYTE, value, value); }
+	myAt = index;
+	emit(Op::STOREX, value, base, offset);
+	return value;
+}
+
+/*
+The arguments go in consecutive registers at the top of the window,
+which the callee's window then starts at, so nothing is copied.
+*/
+uint32_t Lowerer::visitCallExpNode(CallExpNode * node, uint32_t want){
+	DeclNode * decl = node->id()->decl();
+	if (decl == nullptr || decl->kind() != NodeKind::FnDeclNode){
+		error(node, "Attempt to call a non-function");
+		return target(want);
+	}
+	FnDeclNode * fn = static_cast<FnDeclNode *>(decl);
+	NodeList<ExpNode>& args = node->args();
+	NodeList<FormalDeclNode>& formals = fn->formals();
+	if (args.size() != formals.size()){
+		error(node, "Function call with wrong number of args");
+		return target(want);
+	}
+	//At least one, for the result
+	uint32_t slots = args.size() > 0 ? static_cast<uint32_t>(args.size()) : 1;
+	uint32_t base = myNext;
+	for (uint32_t i = 0; i < slots; i++){ temp(); }
+	for (size_t i = 0; i < args.size(); i++){
+		uint32_t reg = base + static_cast<uint32_t>(i);
+		visit(args[i], reg);
+		if (needsByte(formals[i]->type(), args[i])){
+			emit(Op::BYTE, reg, reg);
+		}
+		myNext = base + slots;
+	}
+	myAt = node;
+	emit(Op::CALL, base, 0, 0, static_cast<int32_t>(myFns[fn]));
+	myNext = base + 1;
+	if (want == NO_REG){ return base; }
+	myNext = base;
+	return copy(base, want);
+}
+
+uint32_t Lowerer::visitFalseNode(FalseNode * node, uint32_t want){
+	uint32_t reg = target(want);
+	emit(Op::CONST, reg, 0, 0, 0);
+	return reg;
+}
+
+uint32_t Lowerer::visitHavocNode(HavocNode * node, uint32_t want){
+	uint32_t reg = target(want);
+	emit(Op::HAVOC, reg);
+	return reg;
+}
+
+uint32_t Lowerer::visitIntLitNode(IntLitNode * node, uint32_t want){
+	uint32_t reg = target(want);
+	emit(Op::CONST, reg, 0, 0, node->value());
+	return reg;
+}
+
+uint32_t Lowerer::visitStrLitNode(StrLitNode * node, uint32_t want){
+	uint32_t reg = target(want);
+	emit(Op::CONST, reg, 0, 0, stringConstant(node));
+	return reg;
+}
+
+uint32_t Lowerer::visitTrueNode(TrueNode * node, uint32_t want){
+	uint32_t reg = target(want);
+	emit(Op::CONST, reg, 0, 0, 1);
+	return reg;
+}
+
+/// A string literal's bytes as a byte array, one per distinct literal
+int32_t Lowerer::stringConstant(StrLitNode * node){
+	StrView lexeme = node->value();
+	std::string text;
+	for (size_t i = 1; i + 1 < lexeme.size(); i++){
+		char ch = lexeme.data()[i];
+		if (ch == '\\' && i + 2 < lexeme.size()){
+			ch = lexeme.data()[++i];
+			if (ch == 'n'){ ch = '\n'; }
+			else if (ch == 't'){ ch = '\t'; }
+		}
+		text += ch;
+	}
+	return stringRef(text);
+}
+
+int32_t Lowerer::stringRef(const std::string& text){
+	auto found = myStrings.find(text);
+	if (found != myStrings.end()){ return found->second; }
+	std::vector<int32_t>& memory = myModule.memory;
+	memory.push_back(static_cast<int32_t>(text.size()));
+	int32_t ref = static_cast<int32_t>(memory.size());
+	for (char ch : text){ memory.push_back(static_cast<unsigned char>(ch)); }
+	myStrings.emplace(text, ref);
+	return ref;
+}
+
+static Op binaryOp(NodeKind kind){
+	switch (kind){
+	case NodeKind::PlusNode: return Op::ADD;
+	case NodeKind::MinusNode: return Op::SUB;
+	case NodeKind::TimesNode: return Op::MUL;
+	case NodeKind::DivideNode: return Op::DIV;
+	case NodeKind::EqualsNode: return Op::EQ;
+	case NodeKind::NotEqualsNode: return Op::NE;
+	case NodeKind::LessNode: return Op::LT;
+	case NodeKind::LessEqNode: return Op::LE;
+	case NodeKind::GreaterNode: return Op::GT;
+	default: return Op::GE;
+	}
+}
+
+uint32_t Lowerer::visitNode(BinaryExpNode * node, uint32_t want){
+	ExpNode * lhs = node->lhs();
+	ExpNode * rhs = node->rhs();
+	uint32_t mark = myNext;
+	if (node->kind() == NodeKind::AndNode || node->kind() == NodeKind::OrNode){
+		//The result is written before rhs is evaluated, so it
+		// mustn't go straight to a variable rhs might read
+		uint32_t reg = want == NO_REG || isVariable(want) ? temp() : want;
+		Label done;
+		visit(lhs, reg);
+		myAt = node;
+		jump(node->kind() == NodeKind::AndNode ? Op::JF : Op::JT, reg, 0, done);
+		visit(rhs, reg);
+		bind(done);
+		myNext = reg == want ? mark : reg + 1;
+		return copy(reg, want);
+	}
+
+	Op op = binaryOp(node->kind());
+	if (mySuper && (op == Op::ADD || op == Op::SUB)
+	  && rhs->kind() == NodeKind::IntLitNode){
+		int32_t k = static_cast<IntLitNode *>(rhs)->value();
+		uint32_t reg = visit(lhs, NO_REG);
+		myNext = mark;
+		uint32_t dst = target(want);
+		emit(Op::ADDI, dst, reg, 0, op == Op::ADD ? k : -k);
+		return dst;
+	}
+	uint32_t left = stable(visit(lhs, NO_REG), rhs);
+	uint32_t right = visit(rhs, NO_REG);
+	myNext = mark;
+	uint32_t dst = target(want);
+	myAt = node;
+	emit(op, dst, left, right);
+	return dst;
+}
+
+uint32_t Lowerer::visitNegNode(NegNode * node, uint32_t want){
+	uint32_t mark = myNext;
+	uint32_t reg = visit(node->exp(), NO_REG);
+	myNext = mark;
+	uint32_t dst = target(want);
+	emit(Op::NEG, dst, reg);
+	return dst;
+}
+
+uint32_t Lowerer::visitNotNode(NotNode * node, uint32_t want){
+	uint32_t mark = myNext;
+	uint32_t reg = visit(node->exp(), NO_REG);
+	myNext = mark;
+	uint32_t dst = target(want);
+	emit(Op::NOT, dst, reg);
+	return dst;
+}
+
+///////STMTNODE CLASSES/////////////
+///////////////////////////////////
+
+uint32_t Lowerer::visitAssignStmtNode(AssignStmtNode * node, uint32_t want){
+	visit(node->assignExp(), NO_REG);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitReadStmtNode(ReadStmtNode * node, uint32_t want){
+	LValNode * lval = node->lval();
+	const DataType * type = typeOf(lval);
+	if (type == nullptr){
+		visit(lval, NO_REG);
+		return NO_REG;
+	}
+	if (type->isArray()){
+		if (isString(type)){
+			error(node, "Attempt to read a string");
+			return NO_REG;
+		}
+		if (!isByte(type->element())){
+			error(node, "Attempt to read an array");
+			return NO_REG;
+		}
+		uint32_t ref = visit(lval, NO_REG);
+		emit(Op::READS, ref);
+		return NO_REG;
+	}
+	uint32_t kind = type->kind();
+	if (lval->kind() == NodeKind::IDNode){
+		Storage * var = variable(static_cast<IDNode *>(lval));
+		if (var == nullptr){ return NO_REG; }
+		if (!var->global){
+			emit(Op::READ, var->where, 0, kind);
+			return NO_REG;
+		}
+		uint32_t reg = temp();
+		emit(Op::READ, reg, 0, kind);
+		emit(Op::STOREG, reg, 0, 0, static_cast<int32_t>(var->where));
+		return NO_REG;
+	}
+	IndexNode * index = static_cast<IndexNode *>(lval);
+	uint32_t base = visit(index->base(), NO_REG);
+	uint32_t offset = visit(index->offset(), NO_REG);
+	uint32_t reg = temp();
+	emit(Op::READ, reg, 0, kind);
+	myAt = index;
+	emit(Op::STOREX, reg, base, offset);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitWriteStmtNode(WriteStmtNode * node, uint32_t want){
+	ExpNode * exp = node->exp();
+	const DataType * type = typeOf(exp);
+	if (type == nullptr){
+		visit(exp, NO_REG);
+		return NO_REG;
+	}
+	if (type->kind() == DataType::VOID){
+		error(node, "Attempt to write void");
+		return NO_REG;
+	}
+	if (type->isArray() && !isByte(type->element())){
+		error(node, "Attempt to write an array");
+		return NO_REG;
+	}
+	uint32_t reg = visit(exp, NO_REG);
+	if (type->isArray()){
+		emit(Op::WRITES, reg);
+	} else {
+		emit(Op::WRITE, reg, 0, type->kind());
+	}
+	return NO_REG;
+}
+
+void Lowerer::addConst(uint32_t dst, uint32_t src, int32_t k){
+	if (mySuper){
+		emit(Op::ADDI, dst, src, 0, k);
+		return;
+	}
+	uint32_t reg = temp();
+	emit(Op::CONST, reg, 0, 0, k);
+	emit(Op::ADD, dst, src, reg);
+}
+
+void Lowerer::bump(LValNode * lval, int32_t k){
+	const DataType * type = typeOf(lval);
+	if (type != nullptr && type->isArray()){
+		error(lval, "Arithmetic on an array");
+		return;
+	}
+	bool toByte = isByte(type);
+	if (lval->kind() == NodeKind::IDNode){
+		Storage * var = variable(static_cast<IDNode *>(lval));
+		if (var == nullptr){ return; }
+		if (!var->global){
+			if (mySuper){
+				emit(k > 0 ? Op::INC : Op::DEC, var->where);
+			} else {
+				addConst(var->where, var->where, k);
+			}
+			if (toByte){ emit(Op::BYTE, var->where, var->where); }
+			return;
+		}
+		int32_t where = static_cast<int32_t>(var->where);
+		if (mySuper && !toByte){
+			emit(k > 0 ? Op::INCG : Op::DECG, 0, 0, 0, where);
+			return;
+		}
+		uint32_t reg = temp();
+		emit(Op::LOADG, reg, 0, 0, where);
+		addConst(reg, reg, k);
+		if (toByte){ emit(Op::BYTE, reg, reg); }
+		emit(Op::STOREG, reg, 0, 0, where);
+		return;
+	}
+	IndexNode * index = static_cast<IndexNode *>(lval);
+	uint32_t base = visit(index->base(), NO_REG);
+	uint32_t offset = visit(index->offset(), NO_REG);
+	uint32_t reg = temp();
+	myAt = index;
+	emit(Op::LOADX, reg, base, offset);
+	addConst(reg, reg, k);
+	if (toByte){ emit(Op::BYTE, reg, reg); }
+	emit(Op::STOREX, reg, base, offset);
+}
+
+uint32_t Lowerer::visitPostDecStmtNode(PostDecStmtNode * node, uint32_t want){
+	bump(node->lval(), -1);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitPostIncStmtNode(PostIncStmtNode * node, uint32_t want){
+	bump(node->lval(), 1);
+	return NO_REG;
+}
+
+/// The jump taken when a comparison is true, or when it's false
+static Op fusedJump(NodeKind kind, bool when){
+	switch (kind){
+	case NodeKind::EqualsNode: return when ? Op::JEQ : Op::JNE;
+	case NodeKind::NotEqualsNode: return when ? Op::JNE : Op::JEQ;
+	case NodeKind::LessNode: return when ? Op::JLT : Op::JGE;
+	case NodeKind::LessEqNode: return when ? Op::JLE : Op::JGT;
+	case NodeKind::GreaterNode: return when ? Op::JGT : Op::JLE;
+	default: return when ? Op::JGE : Op::JLT;
+	}
+}
+
+void Lowerer::branch(ExpNode * cond, bool when, Label& to){
+	uint32_t mark = myNext;
+	switch (cond->kind()){
+	case NodeKind::NotNode:
+		branch(static_cast<NotNode *>(cond)->exp(), !when, to);
+		return;
+	case NodeKind::AndNode:
+	case NodeKind::OrNode: {
+		//a && b is true if both are, a || b is false if both are
+		BinaryExpNode * both = static_cast<BinaryExpNode *>(cond);
+		bool all = cond->kind() == NodeKind::AndNode;
+		if (when == all){
+			Label skip;
+			branch(both->lhs(), !all, skip);
+			branch(both->rhs(), all, to);
+			bind(skip);
+		} else {
+			branch(both->lhs(), !all, to);
+			branch(both->rhs(), !all, to);
+		}
+		return;
+	}
+	case NodeKind::TrueNode:
+	case NodeKind::FalseNode:
+		if ((cond->kind() == NodeKind::TrueNode) == when){
+			jump(Op::JMP, 0, 0, to);
+		}
+		return;
+	case NodeKind::EqualsNode:
+	case NodeKind::NotEqualsNode:
+	case NodeKind::LessNode:
+	case NodeKind::LessEqNode:
+	case NodeKind::GreaterNode:
+	case NodeKind::GreaterEqNode:
+		if (mySuper){
+			BinaryExpNode * test = static_cast<BinaryExpNode *>(cond);
+			uint32_t left = stable(visit(test->lhs(), NO_REG), test->rhs());
+			uint32_t right = visit(test->rhs(), NO_REG);
+			myNext = mark;
+			jump(fusedJump(cond->kind(), when), left, right, to);
+			return;
+		}
+		break;
+	default:
+		break;
+	}
+	uint32_t reg = visit(cond, NO_REG);
+	myNext = mark;
+	jump(when ? Op::JT : Op::JF, reg, 0, to);
+}
+
+uint32_t Lowerer::visitIfStmtNode(IfStmtNode * node, uint32_t want){
+	Label skip;
+	branch(node->cond(), false, skip);
+	block(node->body());
+	bind(skip);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitIfElseStmtNode(IfElseStmtNode * node, uint32_t want){
+	Label otherwise;
+	Label done;
+	branch(node->cond(), false, otherwise);
+	block(node->trueBranch());
+	jump(Op::JMP, 0, 0, done);
+	bind(otherwise);
+	block(node->falseBranch());
+	bind(done);
+	return NO_REG;
+}
+
+//The test goes at the bottom, so each time round takes one branch
+uint32_t Lowerer::visitWhileStmtNode(WhileStmtNode * node, uint32_t want){
+	Label top;
+	Label test;
+	jump(Op::JMP, 0, 0, test);
+	bind(top);
+	block(node->body());
+	myAt = node;
+	bind(test);
+	branch(node->cond(), true, top);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitReturnStmtNode(ReturnStmtNode * node, uint32_t want){
+	if (node->exp() == nullptr){
+		emit(Op::RETV);
+		return NO_REG;
+	}
+	uint32_t reg = visit(node->exp(), NO_REG);
+	emit(Op::RET, reg);
+	return NO_REG;
+}
+
+uint32_t Lowerer::visitCallStmtNode(CallStmtNode * node, uint32_t want){
+	visit(node->callExp(), NO_REG);
+	return NO_REG;
+}
+
+} //End namespace crona
@@ -0,0 +1,146 @@
+#ifndef CRONA_BYTECODE_H
+#define CRONA_BYTECODE_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "ast.hpp"
+
+namespace crona{
+
+/*
+Register bytecode, what cronac --run executes (see vm.hpp).
+
+Each function has a window of 32-bit registers, r0 up: its formals
+come first, then its locals and temporaries. Every value fits in a
+register: ints, bools (0 or 1), bytes (0 to 255) and references to
+arrays. An array is a run of 32-bit cells in the VM's memory, one
+per element, just after a cell holding its length; a reference is
+the index of its first element. Global scalars live in memory too,
+at fixed addresses, while arrays declared in a function are carved
+out of memory for each call. A string variable is a scalar holding
+a reference, to a string literal's bytes (or to no bytes at all).
+
+Instructions have up to three register operands (a, b, c) and a
+32-bit operand d: a constant, a global address, a function index
+or, for jumps, the distance to the target from the jump itself.
+
+  CONST a d       r[a] = d
+  MOV a b         r[a] = r[b]
+  LOADG a d       r[a] = the global at d
+  STOREG a d      the global at d = r[a]
+  ADD a b c       r[a] = r[b] + r[c] (likewise SUB, MUL, DIV;
+                  arithmetic wraps at 32 bits, and DIV fails on a
+                  zero divisor and on INT_MIN / -1)
+  NEG a b         r[a] = -r[b]
+  NOT a b         r[a] = !r[b]
+  BYTE a b        r[a] = r[b] truncated to a byte
+  EQ a b c        r[a] = r[b] == r[c] (likewise NE, LT, LE, GT, GE)
+  JMP d           go to the jump's own index + d
+  JT a d          ... if r[a] is true (JF: if it's false)
+  ALLOCA a d      r[a] = a new zeroed array, the function's d'th
+  LOADX a b c     r[a] = element r[c] of array r[b]
+  STOREX a b c    element r[c] of array r[b] = r[a]
+                  (both fail if the index is out of bounds)
+  CALL a d        call function d with its arguments in r[a] up;
+                  the result comes back in r[a]
+  RET a           return r[a]
+  RETV            return, from a void function (or by falling off
+                  the end of any function, which returns 0)
+  READ a c        r[a] = a value read from input, of DataType::Kind c
+  READS a         read a word of input into byte array r[a]
+  WRITE a c       write r[a] out, as a value of DataType::Kind c
+  WRITES a        write byte array r[a] out as text
+  HAVOC a         r[a] = an arbitrary bool
+
+Superinstructions do the work of a common pair in one dispatch:
+
+  ADDI a b d      r[a] = r[b] + d
+  INC a, DEC a    r[a] += 1, r[a] -= 1
+  INCG d, DECG d  the global at d += 1, -= 1
+  JLT a b d       jump by d if r[a] < r[b] (likewise JEQ, JNE, JLE,
+                  JGT, JGE)
+*/
+#define CRONA_OPCODES(X) \
+	X(CONST) X(MOV) X(LOADG) X(STOREG) \
+	X(ADD) X(SUB) X(MUL) X(DIV) X(NEG) X(NOT) X(BYTE) \
+	X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+	X(JMP) X(JT) X(JF) \
+	X(ALLOCA) X(LOADX) X(STOREX) \
+	X(CALL) X(RET) X(RETV) \
+	X(READ) X(READS) X(WRITE) X(WRITES) X(HAVOC) \
+	X(ADDI) X(INC) X(DEC) X(INCG) X(DECG) \
+	X(JEQ) X(JNE) X(JLT) X(JLE) X(JGT) X(JGE)
+
+enum class Op : uint16_t{
+#define CRONA_OP(name) name,
+	CRONA_OPCODES(CRONA_OP)
+#undef CRONA_OP
+};
+
+#define CRONA_COUNT_OP(name) + 1
+const size_t NUM_OPS = 0 CRONA_OPCODES(CRONA_COUNT_OP);
+#undef CRONA_COUNT_OP
+
+/// The name of an opcode, e.g. "JLT"
+const char * opName(Op op);
+
+struct Instr{
+	Op op;
+	uint16_t a;
+	uint16_t b;
+	uint16_t c;
+	int32_t d;
+};
+
+/// Where in the source an instruction came from, for runtime errors
+struct SourcePos{
+	uint32_t line;
+	uint32_t col;
+};
+
+/// An array declared in a function: where it goes in the memory of
+/// each call (its length cell first), and its length
+struct ArraySlot{
+	uint32_t offset;
+	int32_t length;
+};
+
+struct Function{
+	const Symbol * name;
+	uint32_t formals;
+	/// The size of the register window
+	uint32_t registers;
+	/// The arrays it declares (see ALLOCA), and the memory they take
+	/// at most. Arrays in disjoint blocks share memory.
+	std::vector<ArraySlot> arrays;
+	uint32_t arrayCells;
+	std::vector<Instr> code;
+	std::vector<SourcePos> positions; //One per instruction
+};
+
+struct Module{
+	std::vector<Function> functions;
+	uint32_t main;
+	/// Memory as the program starts: the globals (all zero) and the
+	/// string literals, as byte arrays
+	std::vector<int32_t> memory;
+
+	/// A listing of the code, one instruction per line
+	void disassemble(std::ostream& out) const;
+};
+
+/**
+* Lower ast, whose names must already be resolved (see names.hpp),
+* to module. Execution starts in main, which takes no arguments.
+* Without superinstructions, only the plain instructions are used
+* (to measure what the others save). Anything that can't be run (a
+* function used as a value, an array assigned to, a missing main,
+* ...) is reported, and then the result is false.
+**/
+bool lowerProgram(ProgramNode * ast, Module& module,
+	bool superinstructions = true);
+
+} //End namespace crona
+
+#endif
@@ -9,7 +9,6 @@
 %token-table
 
 %code requires{
-	#include <list>
 	#include "tokens.hpp"
 	#include "ast.hpp"
 	namespace crona {
@@ -46,42 +45,62 @@
   // from a global function
   #undef yylex
   #define yylex scanner.yylex
+
+  //AST nodes (and their child lists) are carved out of the
+  // scanner's arena, which the ProgramNode takes ownership of
+  // once the parse completes
+  #define NEW(T) scanner.make<T>
+  #define LIST(T) scanner.arena()->make<NodeList<T>>
+
+  //Types aren't nodes: every int (say) is the one canonical
+  // DataType, and the declaration keeps where it was written
+  #define TYPES crona::TypeTable::global()
+  static crona::TypeRef typeAt(const crona::Token& tok, const crona::DataType * type){
+	return crona::TypeRef{type, static_cast<uint32_t>(tok.line()),
+		static_cast<uint32_t>(tok.col())};
+  }
+
+  //An error production has skipped past a syntax error to a
+  // ; or }: report the next error straight away (even if it's
+  // the very next token) and drop what was skipped from the
+  // tree, unless there have been too many errors to go on
+  #define RECOVER(x) do { \
+	if (scanner.tooManySyntaxErrors()){ YYABORT; } \
+	yyerrok; \
+	(x) = nullptr; \
+  } while (0)
 }
 
 %union {
-	crona::Token*                         transToken;
-	crona::IDToken*                       transIDToken;
-	crona::IntLitToken*                   transIntToken;
-	crona::StrToken*                      transStrToken;
+	crona::Token                          transToken;
 	crona::ProgramNode*                   transProgram;
-	std::list<crona::DeclNode *> *        transDeclList;
+	crona::NodeList<crona::DeclNode> *    transDeclList;
 	crona::DeclNode *                     transDecl;
 	crona::VarDeclNode *                  transVarDecl;
-	crona::TypeNode *                     transType;
+	crona::TypeRef                        transType;
 	crona::IDNode *                       transID;
 	crona::FnDeclNode*                    transFn;
 	crona::FormalDeclNode*                transFormal;
-	std::list<crona::FormalDeclNode*>*    transFormals;
+	crona::NodeList<crona::FormalDeclNode>* transFormals;
 	crona::FormalDeclNode*                transFormalDecl;
-	std::list<crona::StmtNode*>*          transFnBody;
-	std::list<crona::StmtNode*>*          transStmtList;
+	crona::NodeList<crona::StmtNode>*     transFnBody;
+	crona::NodeList<crona::StmtNode>*     transStmtList;
 	crona::StmtNode*                      transStmt;
 	crona::AssignExpNode*                 transAssignExp;
 	crona::ExpNode*                       transExp;
 	crona::CallExpNode*                   transCallExp;
 	crona::LValNode*                      transLval;
-	std::list<ExpNode*>*                  transActualsList;
+	crona::NodeList<crona::ExpNode>*      transActualsList;
 }
 
 %define parse.assert
 
 /* Terminals
- *  No need to touch these, but do note the translation type
- *  of each node. Most are just "transToken", which is defined in
- *  the %union above to mean that the token translation is an instance
- *  of crona::Token *, and thus has no fields (other than line and column).
- *  Some terminals, like ID, are "transIDToken", meaning the translation
- *  also has a name field.
+ *  Every terminal's translation is "transToken", a crona::Token held
+ *  by value in the %union above: its kind, line and column, plus the
+ *  name (ID), value (INTLITERAL) or lexeme (STRLITERAL) for the
+ *  terminals that carry one. Keep these in this order; the token
+ *  names in tokens.cpp are a table indexed by it.
 */
 %token                   END	   0 "end file"
 %token	<transToken>     AND
@@ -99,10 +118,10 @@
 %token	<transToken>     EQUALS
 %token	<transToken>     FALSE
 %token	<transToken>     HAVOC
-%token	<transIDToken>   ID
+%token	<transToken>     ID
 %token	<transToken>     IF
 %token	<transToken>     INT
-%token	<transIntToken>  INTLITERAL
+%token	<transToken>     INTLITERAL
 %token	<transToken>     GREATER
 %token	<transToken>     GREATEREQ
 %token	<transToken>     LBRACE
@@ -122,7 +141,7 @@
 %token	<transToken>     SLASH
 %token	<transToken>     STRING
 %token	<transToken>     STAR
-%token	<transStrToken>  STRLITERAL
+%token	<transToken>     STRLITERAL
 %token	<transToken>     TRUE
 %token	<transToken>     VOID
 %token	<transToken>     WHILE
@@ -148,7 +167,7 @@
 %type <transFormals>        formals
 %type <transFormals>        formalsList
 %type <transFormal>         formalDecl
-%type <transStmtList>       fnBody
+%type <transStmtList>       block
 %type <transStmtList>       stmtList
 %type <transStmt>      	    stmt
 %type <transAssignExp>      assignExp
@@ -170,171 +189,188 @@
 
 program 	: globals
 		  {
-		  $$ = new ProgramNode($1);
+		  scanner.countNode<ProgramNode>();
+		  $$ = new ProgramNode(scanner.takeArena(), $1);
 		  *root = $$;
+		  //With syntax errors the parse fails, but the tree of
+		  // what did parse is still there for the caller
+		  if (scanner.syntaxErrors() > 0){ YYABORT; }
 		  }
 
 globals 	: globals decl
 	  	  {
 	  	  $$ = $1;
 	  	  DeclNode * declNode = $2;
-		  $$->push_back(declNode);
+		  if (declNode != nullptr){
+		  	$$->push_back(scanner.arena(), declNode);
+		  }
 	  	  }
 		| /* epsilon */
-		  { $$ = new std::list<DeclNode * >(); }
+		  { $$ = LIST(DeclNode)(); }
 
 decl 		: varDecl SEMICOLON { $$ = $1; }
 		| fnDecl { $$ = $1; }
+		| error SEMICOLON { RECOVER($$); }
+		| error block { RECOVER($$); }
 
 varDecl 	: id COLON type
 		  {
-		  size_t line = $1->line();
-		  size_t col = $1->col();
-		  $$ = new VarDeclNode(line, col, $3, $1);
+		  $$ = NEW(VarDeclNode)($1->line(), $1->col(), $3.type, $1);
 		  }
 
-type 		: INT { $$ = new IntTypeNode($1->line(), $1->col()); }
+type 		: INT { $$ = typeAt($1, TYPES.intType()); }
 
 		| INT ARRAY LBRACE INTLITERAL RBRACE
-		  { $$ = new ArrayTypeNode($1->line(), $1->col(), new IntTypeNode($1->line(), $1->col()), $4->num()); }
+		  { $$ = typeAt($1, TYPES.arrayOf(TYPES.intType(), $4.num())); }
 
-		| BOOL {$$ = new BoolTypeNode($1->line(), $1->col()); }
+		| BOOL { $$ = typeAt($1, TYPES.boolType()); }
 
 		| BOOL ARRAY LBRACE INTLITERAL RBRACE
-		  { $$ = new ArrayTypeNode($1->line(), $1->col(), new BoolTypeNode($1->line(), $1->col()), $4->num()); }
+		  { $$ = typeAt($1, TYPES.arrayOf(TYPES.boolType(), $4.num())); }
 
-		| BYTE { $$ = new ByteTypeNode($1->line(), $1->col());}
+		| BYTE { $$ = typeAt($1, TYPES.byteType()); }
 
 		| BYTE ARRAY LBRACE INTLITERAL RBRACE
-		  { $$ = new ArrayTypeNode($1->line(), $1->col(), new ByteTypeNode($1->line(), $1->col()), $4->num()); }
+		  { $$ = typeAt($1, TYPES.arrayOf(TYPES.byteType(), $4.num())); }
 
 		| STRING
-		  { $$ = new ArrayTypeNode($1->line(), $1->col(), new ByteTypeNode($1->line(),$1->col()), 0); }
+		  { $$ = typeAt($1, TYPES.arrayOf(TYPES.byteType(), 0)); }
 
-		| VOID {$$ = new VoidTypeNode($1->line(), $1->col());}
+		| VOID { $$ = typeAt($1, TYPES.voidType()); }
 
-fnDecl 		: id COLON type formals fnBody {$$ = new FnDeclNode($1->line(), $1->col(), $3, $1, $4, $5);}
+fnDecl 		: id COLON type formals block {$$ = NEW(FnDeclNode)($1->line(), $1->col(), $3.type, $1, $4, $5);}
 
-formals 	: LPAREN RPAREN { $$ = new std::list<FormalDeclNode*>(); }
+formals 	: LPAREN RPAREN { $$ = LIST(FormalDeclNode)(); }
 		| LPAREN formalsList RPAREN { $$ = $2; }
 
 
 formalsList	: formalDecl
 		  {
-		  $$ = new std::list<FormalDeclNode*>();
- 		  $$->push_back($1);
+		  $$ = LIST(FormalDeclNode)();
+ 		  $$->push_back(scanner.arena(), $1);
 		  }
-		| formalDecl COMMA formalsList {$$ = $3; $$->push_back($1); }
+		| formalsList COMMA formalDecl {$$ = $1; $$->push_back(scanner.arena(), $3); }
 
-formalDecl 	: id COLON type { $$ = new FormalDeclNode($1->line(), $1->col(), $3, $1); }
+formalDecl 	: id COLON type { $$ = NEW(FormalDeclNode)($1->line(), $1->col(), $3.type, $1); }
 
-fnBody		: LCURLY stmtList RCURLY { $$ = $2;}
+block		: LCURLY stmtList RCURLY { $$ = $2; }
+		| LCURLY stmtList error RCURLY
+		  {
+		  if (scanner.tooManySyntaxErrors()){ YYABORT; }
+		  yyerrok;
+		  $$ = $2;
+		  }
 
 stmtList 	: /* epsilon */
-		  { $$ = new std::list<StmtNode*>();}
+		  { $$ = LIST(StmtNode)();}
 
-		| stmtList stmt {$$ = $1; $$->push_back($2);}
+		| stmtList stmt
+		  {
+		  $$ = $1;
+		  if ($2 != nullptr){ $$->push_back(scanner.arena(), $2); }
+		  }
 
 stmt		: varDecl SEMICOLON {$$ = $1;}
-		| assignExp SEMICOLON { $$ = new AssignStmtNode($1->line(), $1->col(), $1);}
+		| assignExp SEMICOLON { $$ = NEW(AssignStmtNode)($1->line(), $1->col(), $1);}
+
+		| lval DASHDASH SEMICOLON { $$ = NEW(PostDecStmtNode)($1->line(), $1->col(), $1);}
 
-		| lval DASHDASH SEMICOLON { $$ = new PostDecStmtNode($1->line(), $1->col(), $1);}
+		| lval CROSSCROSS SEMICOLON { $$ = NEW(PostIncStmtNode)($1->line(), $1->col(), $1); }
 
-		| lval CROSSCROSS SEMICOLON { $$ = new PostIncStmtNode($1->line(), $1->col(), $1); }
+		| READ lval SEMICOLON { $$ = NEW(ReadStmtNode)($1.line(), $1.col(), $2);}
 
-		| READ lval SEMICOLON { $$ = new ReadStmtNode($1->line(), $1->col(), $2);}
+		| WRITE exp SEMICOLON { $$ = NEW(WriteStmtNode)($1.line(), $1.col(), $2);}
 
-		| WRITE exp SEMICOLON { $$ = new WriteStmtNode($1->line(), $1->col(), $2);}
+		| IF LPAREN exp RPAREN block
+		  { $$ = NEW(IfStmtNode)($1.col(),$1.col(), $3, $5); }
 
-		| IF LPAREN exp RPAREN LCURLY stmtList RCURLY
-		  { $$ = new IfStmtNode($1->col(),$1->col(), $3, $6); }
+		| IF LPAREN exp RPAREN block ELSE block
+		  { $$ = NEW(IfElseStmtNode)($1.line(), $1.col(), $3, $5, $7); }
 
-		| IF LPAREN exp RPAREN LCURLY stmtList RCURLY ELSE LCURLY stmtList RCURLY
-		  { $$ = new IfElseStmtNode($1->line(), $1->col(), $3, $6, $10); }
+		| WHILE LPAREN exp RPAREN block
+		  { $$ = NEW(WhileStmtNode)($1.line(), $1.col(), $3, $5); }
 
-		| WHILE LPAREN exp RPAREN LCURLY stmtList RCURLY
-		  { $$ = new WhileStmtNode($1->line(), $1->col(), $3, $6); }
+		| RETURN exp SEMICOLON { $$ = NEW(ReturnStmtNode)($1.line(), $1.col(), $2);}
 
-		| RETURN exp SEMICOLON { $$ = new ReturnStmtNode($1->line(), $1->col(), $2);}
+		| RETURN SEMICOLON {$$ = NEW(ReturnStmtNode)($1.line(), $1.col(), nullptr);}
 
-		| RETURN SEMICOLON {$$ = new ReturnStmtNode($1->line(), $1->col(), NULL);}
+		| callExp SEMICOLON {$$ = NEW(CallStmtNode)($1->line(), $1->col(), $1); }
 
-		| callExp SEMICOLON {$$ = new CallStmtNode($1->line(), $1->col(), $1); }
+		| error SEMICOLON { RECOVER($$); }
 
 
 exp		: assignExp { $$ = $1; }
 
-		| exp DASH exp { $$ = new MinusNode($1->line(), $1->col(), $1, $3); }
+		| exp DASH exp { $$ = NEW(MinusNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp CROSS exp { $$ = new PlusNode($1->line(), $1->col(), $1, $3); }
+		| exp CROSS exp { $$ = NEW(PlusNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp STAR exp { $$ = new TimesNode($1->line(), $1->col(), $1, $3); }
+		| exp STAR exp { $$ = NEW(TimesNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp SLASH exp { $$ = new DivideNode($1->line(), $1->col(), $1, $3); }
+		| exp SLASH exp { $$ = NEW(DivideNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp AND exp { $$ = new AndNode($1->line(), $1->col(), $1, $3); }
+		| exp AND exp { $$ = NEW(AndNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp OR exp { $$ = new OrNode($1->line(), $1->col(), $1, $3); }
+		| exp OR exp { $$ = NEW(OrNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp EQUALS exp { $$ = new EqualsNode($1->line(), $1->col(), $1, $3); }
+		| exp EQUALS exp { $$ = NEW(EqualsNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp NOTEQUALS exp { $$ = new NotEqualsNode($1->line(), $1->col(), $1, $3); }
+		| exp NOTEQUALS exp { $$ = NEW(NotEqualsNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp GREATER exp { $$ = new GreaterNode($1->line(), $1->col(), $1, $3); }
+		| exp GREATER exp { $$ = NEW(GreaterNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp GREATEREQ exp { $$ = new GreaterEqNode($1->line(), $1->col(), $1, $3); }
+		| exp GREATEREQ exp { $$ = NEW(GreaterEqNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp LESS exp { $$ = new LessNode($1->line(), $1->col(), $1, $3); }
+		| exp LESS exp { $$ = NEW(LessNode)($1->line(), $1->col(), $1, $3); }
 
-		| exp LESSEQ exp { $$ = new LessEqNode($1->line(), $1->col(), $1, $3); }
+		| exp LESSEQ exp { $$ = NEW(LessEqNode)($1->line(), $1->col(), $1, $3); }
 
-		| NOT exp { $$ = new NotNode($1->line(), $1->col(), $2); }
+		| NOT exp { $$ = NEW(NotNode)($1.line(), $1.col(), $2); }
 
-		| DASH term { $$ = new NegNode($1->line(), $1->col(), $2); }
+		| DASH term { $$ = NEW(NegNode)($1.line(), $1.col(), $2); }
 
 		| term { $$ = $1; }
 
-assignExp	: lval ASSIGN exp { $$ = new AssignExpNode($1->line(), $1->col(), $1, $3); }
+assignExp	: lval ASSIGN exp { $$ = NEW(AssignExpNode)($1->line(), $1->col(), $1, $3); }
 
 callExp		: id LPAREN RPAREN
 		  {
-		  std::list<ExpNode*>* listOfExp = new std::list<ExpNode*>();
-		  $$ = new CallExpNode($1->line(), $1->col(), $1, listOfExp);
+		  NodeList<ExpNode>* listOfExp = LIST(ExpNode)();
+		  $$ = NEW(CallExpNode)($1->line(), $1->col(), $1, listOfExp);
 		  }
 
 		| id LPAREN actualsList RPAREN
-		  { $$ = new CallExpNode($1->line(), $1->col(), $1, $3); }
+		  { $$ = NEW(CallExpNode)($1->line(), $1->col(), $1, $3); }
 
 
 actualsList	: exp
 		  {
-		  $$ = new std::list<ExpNode*>();
-		  $$->push_back($1);
+		  $$ = LIST(ExpNode)();
+		  $$->push_back(scanner.arena(), $1);
 		  }
 
 		| actualsList COMMA exp
 		  {
 		  $$ = $1;
-		  $$->push_back($3);
+		  $$->push_back(scanner.arena(), $3);
 		  }
 
 term 		: lval { $$ = $1; }
-		| INTLITERAL { $$ = new IntLitNode($1->line(), $1->col(), $1->num()); }
-		| STRLITERAL { $$ = new StrLitNode($1->line(), $1->col(), $1->str()); }
-		| TRUE { $$ = new TrueNode($1->line(), $1->col()); }
-		| FALSE { $$ = new FalseNode($1->line(), $1->col());}
-		| HAVOC {$$ = new HavocNode($1->line(), $1->col()); }
+		| INTLITERAL { $$ = NEW(IntLitNode)($1.line(), $1.col(), $1.num()); }
+		| STRLITERAL { $$ = NEW(StrLitNode)($1.line(), $1.col(), $1.str()); }
+		| TRUE { $$ = NEW(TrueNode)($1.line(), $1.col()); }
+		| FALSE { $$ = NEW(FalseNode)($1.line(), $1.col());}
+		| HAVOC {$$ = NEW(HavocNode)($1.line(), $1.col()); }
 		| LPAREN exp RPAREN { $$ = $2; }
 		| callExp { $$ = $1; }
 
 lval		: id { $$ = $1; }
-		| id LBRACE exp RBRACE { $$ = new IndexNode($1->line(), $1->col(), $1, $3); }
+		| id LBRACE exp RBRACE { $$ = NEW(IndexNode)($1->line(), $1->col(), $1, $3); }
 
-id		: ID { $$ = new IDNode($1); }
+id		: ID { $$ = NEW(IDNode)($1); }
 
 %%
 
 void crona::Parser::error(const std::string& msg){
-	std::cout << msg << std::endl;
-	std::cerr << "syntax error" << std::endl;
+	scanner.errSyntax(msg);
 }
@@ -7,6 +7,8 @@
 #define TODO(x) throw new ToDoError(CODELOC #x);
 
 #include <iostream>
+#include <sstream>
+#include <string>
 
 namespace crona{
 
@@ -28,12 +30,26 @@ private:
 
 class Report{
 public:
+	/**
+	* The stream diagnostics are written to. Each thread starts out
+	* on std::cerr; batch mode points it at a per-input buffer so
+	* that concurrent compiles don't interleave their messages.
+	**/
+	static std::ostream& stream(){
+		return *current();
+	}
+
+	/// Send this thread's diagnostics to out (nullptr: std::cerr)
+	static void redirect(std::ostream * out){
+		current() = out == nullptr ? &std::cerr : out;
+	}
+
 	static void fatal(
 		size_t l, 
 		size_t c, 
 		const char * msg
 	){
-		std::cerr << "FATAL [" << l << "," << c << "]: " 
+		stream() << "FATAL [" << l << "," << c << "]: " 
 		<< msg  << std::endl;
 	}
 
@@ -50,7 +66,7 @@ public:
 		size_t c,
 		const char * msg
 	){
-		std::cerr << "*WARNING* [" << l << "," << c << "]: " 
+		stream() << "*WARNING* [" << l << "," << c << "]: " 
 		<< msg  << std::endl;
 	}
 
@@ -61,6 +77,33 @@ public:
 	){
 		warn(l,c,msg.c_str());
 	}
+private:
+	static std::ostream *& current(){
+		static thread_local std::ostream * out = &std::cerr;
+		return out;
+	}
+};
+
+/**
+* \class HeldReports
+* Holds back this thread's diagnostics while it lives, e.g. for a
+* reparse that may be abandoned. release() passes them on to where
+* they would have gone; otherwise they are dropped.
+**/
+class HeldReports{
+public:
+	HeldReports() : myPrev(&Report::stream()){
+		Report::redirect(&myHeld);
+	}
+	~HeldReports(){ Report::redirect(myPrev); }
+	HeldReports(const HeldReports&) = delete;
+	HeldReports& operator=(const HeldReports&) = delete;
+
+	std::string text() const { return myHeld.str(); }
+	void release(){ *myPrev << myHeld.str(); }
+private:
+	std::ostream * myPrev;
+	std::ostringstream myHeld;
 };
 
 }
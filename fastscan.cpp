@@ -0,0 +1,539 @@
+#include <climits>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include "fastscan.hpp"
+#include "scanner.hpp"
+#include "symbols.hpp"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define CRONA_SCAN_X86 1
+#include <immintrin.h>
+#else
+#define CRONA_SCAN_X86 0
+#endif
+
+namespace crona{
+
+bool lexerKindFromString(const char * name, LexerKind& kind){
+	if (std::strcmp(name, "flex") == 0){
+		kind = LexerKind::FLEX;
+	} else if (std::strcmp(name, "fast") == 0){
+		kind = LexerKind::FAST;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+namespace scankernels{
+
+/*
+Each character class below knows how to test one byte, and a
+16 (SSE2) or 32 (AVX2) byte vector at a time. run*() scan whole
+vectors until one holds a byte outside the class, and finish with
+the scalar test, so they never read past end.
+*/
+
+static inline bool inRange(char ch, char lo, char hi){
+	return ch >= lo && ch <= hi;
+}
+
+#if CRONA_SCAN_X86
+//Bytewise lo <= v <= hi. There are only signed byte compares, so
+// shift the range down to start at -128 and compare once.
+static inline __m128i inRange(__m128i v, int lo, int hi){
+	__m128i shifted = _mm_sub_epi8(v, _mm_set1_epi8(static_cast<char>(lo - 128)));
+	return _mm_cmplt_epi8(shifted,
+		_mm_set1_epi8(static_cast<char>(hi - lo + 1 - 128)));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i inRange(__m256i v, int lo, int hi){
+	__m256i shifted = _mm256_sub_epi8(v,
+		_mm256_set1_epi8(static_cast<char>(lo - 128)));
+	return _mm256_cmpgt_epi8(
+		_mm256_set1_epi8(static_cast<char>(hi - lo + 1 - 128)), shifted);
+}
+
+static inline __m128i is(__m128i v, char ch){
+	return _mm_cmpeq_epi8(v, _mm_set1_epi8(ch));
+}
+
+__attribute__((target("avx2")))
+static inline __m256i is(__m256i v, char ch){
+	return _mm256_cmpeq_epi8(v, _mm256_set1_epi8(ch));
+}
+#endif
+
+struct Blank{
+	static bool match(char ch){ return ch == ' ' || ch == '\t'; }
+#if CRONA_SCAN_X86
+	static __m128i match(__m128i v){
+		return _mm_or_si128(is(v, ' '), is(v, '\t'));
+	}
+	__attribute__((target("avx2")))
+	static __m256i match(__m256i v){
+		return _mm256_or_si256(is(v, ' '), is(v, '\t'));
+	}
+#endif
+};
+
+struct IdentChar{
+	static bool match(char ch){
+		return inRange(ch, 'a', 'z') || inRange(ch, 'A', 'Z')
+			|| inRange(ch, '0', '9') || ch == '_';
+	}
+#if CRONA_SCAN_X86
+	//Setting bit 5 folds A-Z onto a-z and maps nothing else there
+	static __m128i match(__m128i v){
+		__m128i lower = _mm_or_si128(v, _mm_set1_epi8(0x20));
+		return _mm_or_si128(_mm_or_si128(inRange(lower, 'a', 'z'),
+			inRange(v, '0', '9')), is(v, '_'));
+	}
+	__attribute__((target("avx2")))
+	static __m256i match(__m256i v){
+		__m256i lower = _mm256_or_si256(v, _mm256_set1_epi8(0x20));
+		return _mm256_or_si256(_mm256_or_si256(inRange(lower, 'a', 'z'),
+			inRange(v, '0', '9')), is(v, '_'));
+	}
+#endif
+};
+
+struct Digit{
+	static bool match(char ch){ return inRange(ch, '0', '9'); }
+#if CRONA_SCAN_X86
+	static __m128i match(__m128i v){ return inRange(v, '0', '9'); }
+	__attribute__((target("avx2")))
+	static __m256i match(__m256i v){ return inRange(v, '0', '9'); }
+#endif
+};
+
+struct StringChar{
+	static bool match(char ch){
+		return ch != '"' && ch != '\\' && ch != '\n';
+	}
+#if CRONA_SCAN_X86
+	static __m128i match(__m128i v){
+		__m128i stop = _mm_or_si128(_mm_or_si128(is(v, '"'),
+			is(v, '\\')), is(v, '\n'));
+		return _mm_xor_si128(stop, _mm_set1_epi8(-1));
+	}
+	__attribute__((target("avx2")))
+	static __m256i match(__m256i v){
+		__m256i stop = _mm256_or_si256(_mm256_or_si256(is(v, '"'),
+			is(v, '\\')), is(v, '\n'));
+		return _mm256_xor_si256(stop, _mm256_set1_epi8(-1));
+	}
+#endif
+};
+
+template <typename Class>
+static size_t runScalar(const char * text, const char * end){
+	const char * pos = text;
+	while (pos < end && Class::match(*pos)){ pos++; }
+	return static_cast<size_t>(pos - text);
+}
+
+#if CRONA_SCAN_X86
+template <typename Class>
+static size_t runSSE2(const char * text, const char * end){
+	const char * pos = text;
+	while (end - pos >= 16){
+		__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i *>(pos));
+		unsigned int miss = ~static_cast<unsigned int>(
+			_mm_movemask_epi8(Class::match(v))) & 0xFFFFu;
+		if (miss != 0){
+			return static_cast<size_t>(pos - text)
+				+ static_cast<size_t>(__builtin_ctz(miss));
+		}
+		pos += 16;
+	}
+	return static_cast<size_t>(pos - text) + runScalar<Class>(pos, end);
+}
+
+template <typename Class>
+__attribute__((target("avx2")))
+static size_t runAVX2(const char * text, const char * end){
+	const char * pos = text;
+	while (end - pos >= 32){
+		__m256i v = _mm256_loadu_si256(
+			reinterpret_cast<const __m256i *>(pos));
+		unsigned int miss = ~static_cast<unsigned int>(
+			_mm256_movemask_epi8(Class::match(v)));
+		if (miss != 0){
+			return static_cast<size_t>(pos - text)
+				+ static_cast<size_t>(__builtin_ctz(miss));
+		}
+		pos += 32;
+	}
+	return static_cast<size_t>(pos - text) + runSSE2<Class>(pos, end);
+}
+#endif
+
+typedef size_t (*Kernel)(const char *, const char *);
+
+struct Kernels{
+	const char * level;
+	Kernel blanks;
+	Kernel identChars;
+	Kernel digits;
+	Kernel stringChars;
+};
+
+#define CRONA_KERNELS(name, run) { name, run<Blank>, run<IdentChar>, \
+	run<Digit>, run<StringChar> }
+
+static const Kernels SCALAR = CRONA_KERNELS("scalar", runScalar);
+#if CRONA_SCAN_X86
+static const Kernels SSE2 = CRONA_KERNELS("sse2", runSSE2);
+static const Kernels AVX2 = CRONA_KERNELS("avx2", runAVX2);
+#endif
+#undef CRONA_KERNELS
+
+/*
+The best kernels this CPU runs. Setting CRONA_SCAN_KERNELS to
+"scalar" or "sse2" caps the choice, so the tests can cover every
+level on any machine.
+*/
+static const Kernels * pick(){
+	const char * cap = std::getenv("CRONA_SCAN_KERNELS");
+	bool capScalar = cap != nullptr && std::strcmp(cap, "scalar") == 0;
+	bool capSSE2 = cap != nullptr && std::strcmp(cap, "sse2") == 0;
+	if (capScalar){ return &SCALAR; }
+#if CRONA_SCAN_X86
+	__builtin_cpu_init();
+	if (!capSSE2 && __builtin_cpu_supports("avx2")){ return &AVX2; }
+	return &SSE2;
+#else
+	(void)capSSE2;
+	return &SCALAR;
+#endif
+}
+
+static const Kernels * const ACTIVE = pick();
+
+size_t blanks(const char * text, const char * end){
+	return ACTIVE->blanks(text, end);
+}
+
+size_t identChars(const char * text, const char * end){
+	return ACTIVE->identChars(text, end);
+}
+
+size_t digits(const char * text, const char * end){
+	return ACTIVE->digits(text, end);
+}
+
+size_t stringChars(const char * text, const char * end){
+	return ACTIVE->stringChars(text, end);
+}
+
+//Comments are the one place a libc routine already does the job
+size_t lineChars(const char * text, const char * end){
+	const void * found = std::memchr(text, '\n', static_cast<size_t>(end - text));
+	return found == nullptr ? static_cast<size_t>(end - text)
+		: static_cast<size_t>(static_cast<const char *>(found) - text);
+}
+
+const char * level(){ return ACTIVE->level; }
+
+} //End namespace scankernels
+
+/*
+Keywords are found with a perfect hash: the slot below is different
+for each of the 15 keywords (checked at compile time), so one
+compare against the keyword in an identifier's slot decides it.
+*/
+struct Keyword{
+	const char * text;
+	size_t len;
+	int kind;
+};
+
+static constexpr size_t NUM_KEYWORD_SLOTS = 32;
+
+static constexpr size_t keywordSlot(const char * text, size_t len){
+	return (static_cast<unsigned char>(text[0])
+		+ static_cast<unsigned char>(text[1]) + 17 * len
+		+ 2 * static_cast<unsigned char>(text[len - 1]))
+		& (NUM_KEYWORD_SLOTS - 1);
+}
+
+static constexpr Keyword KEYWORDS[NUM_KEYWORD_SLOTS] = {
+	{nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+	{"read", 4, TokenKind::READ},
+	{"havoc", 5, TokenKind::HAVOC},
+	{nullptr, 0, 0},
+	{"false", 5, TokenKind::FALSE},
+	{nullptr, 0, 0},
+	{"write", 5, TokenKind::WRITE},
+	{"byte", 4, TokenKind::BYTE},
+	{nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+	{"bool", 4, TokenKind::BOOL},
+	{nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+	{"void", 4, TokenKind::VOID},
+	{"int", 3, TokenKind::INT},
+	{nullptr, 0, 0},
+	{"true", 4, TokenKind::TRUE},
+	{nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0}, {nullptr, 0, 0},
+	{"return", 6, TokenKind::RETURN},
+	{"array", 5, TokenKind::ARRAY},
+	{"string", 6, TokenKind::STRING},
+	{nullptr, 0, 0},
+	{"if", 2, TokenKind::IF},
+	{"while", 5, TokenKind::WHILE},
+	{"else", 4, TokenKind::ELSE},
+};
+
+static const size_t MIN_KEYWORD_LEN = 2;
+static const size_t MAX_KEYWORD_LEN = 6;
+
+static constexpr bool keywordsInPlace(){
+	size_t count = 0;
+	for (size_t slot = 0; slot < NUM_KEYWORD_SLOTS; slot++){
+		const Keyword& kw = KEYWORDS[slot];
+		if (kw.text == nullptr){ continue; }
+		if (keywordSlot(kw.text, kw.len) != slot){ return false; }
+		count++;
+	}
+	return count == 15;
+}
+static_assert(keywordsInPlace(), "keyword table is not a perfect hash");
+
+//The keyword's token kind, or ID if text isn't a keyword
+static inline int keywordOrID(const char * text, size_t len){
+	if (len < MIN_KEYWORD_LEN || len > MAX_KEYWORD_LEN){
+		return TokenKind::ID;
+	}
+	const Keyword& kw = KEYWORDS[keywordSlot(text, len)];
+	if (kw.len == len && std::memcmp(kw.text, text, len) == 0){
+		return kw.kind;
+	}
+	return TokenKind::ID;
+}
+
+static inline bool isEscapee(char ch){
+	return ch == 'n' || ch == 't' || ch == '"' || ch == '\\';
+}
+
+/*
+The flex rules for a literal starting with a quote, longest match
+first and earlier rules winning ties:
+
+  1 "STRELT*"                         good literal
+  2 "STRELT*                          unterminated
+  3 "([^"\n]*BADESC[^"\n]*)+(\\")?    bad escape, unterminated
+  4 "([^"\n]*BADESC[^"\n]*)+(\\)?     bad escape, unterminated
+  5 "([^"\n]*BADESC[^"\n]*)+"         bad escape
+
+BADESC may be a lone backslash, so the repeated group of 3-5 is
+just "a run of [^"\n] holding at least one backslash". Returns the
+winning rule and sets len to the length of its match.
+*/
+static int matchString(const char * quote, const char * end, size_t& len){
+	using namespace scankernels;
+	//Well-formed elements: rules 1 and 2
+	const char * good = quote + 1;
+	while (true){
+		good += stringChars(good, end);
+		if (good + 1 < end && *good == '\\' && isEscapee(good[1])){
+			good += 2;
+		} else {
+			break;
+		}
+	}
+	//The run up to the first quote or newline: rules 3-5
+	const char * run = quote + 1;
+	size_t backslashes = 0;
+	while (true){
+		run += stringChars(run, end);
+		if (run < end && *run == '\\'){
+			backslashes++;
+			run++;
+		} else {
+			break;
+		}
+	}
+
+	int rule = 2;
+	len = static_cast<size_t>(good - quote);
+	if (good < end && *good == '"'){
+		rule = 1;
+		len++;
+	}
+	if (backslashes > 0){
+		size_t runLen = static_cast<size_t>(run - quote);
+		bool closed = run < end && *run == '"';
+		size_t len3 = runLen;
+		if (closed && run[-1] == '\\' && backslashes > 1){ len3++; }
+		size_t len5 = closed ? runLen + 1 : 0;
+		if (len3 > len){ rule = 3; len = len3; }
+		//Rule 4 never beats rule 3
+		if (len5 > len){ rule = 5; len = len5; }
+	}
+	return rule;
+}
+
+//As crona.l's {DIGIT}+ rule, without going through a double
+static bool intValue(const char * text, size_t len, int& value){
+	size_t zeros = 0;
+	while (zeros < len && text[zeros] == '0'){ zeros++; }
+	if (len - zeros > 10){ return false; }
+	uint64_t sum = 0;
+	for (size_t i = zeros; i < len; i++){
+		sum = sum * 10 + static_cast<uint64_t>(text[i] - '0');
+	}
+	if (sum > INT_MAX){ return false; }
+	value = static_cast<int>(sum);
+	return true;
+}
+
+/*
+The hand-written scanner: the same tokens, positions and
+diagnostics as the flex rules in crona.l, read straight out of the
+source file. Runs of identifier characters, digits, blanks and
+string contents are measured by the SIMD kernels above.
+*/
+int Scanner::scanFast(crona::Parser::semantic_type * const lval){
+	using namespace scankernels;
+	const char * const base = mySource->data();
+	const char * const end = base + mySource->size();
+	const char * pos = base + myOffset;
+	while (pos < end){
+		size_t line = lineNum;
+		size_t col = colNum;
+		int kind = -1;
+		size_t len = 1;
+		char next = pos + 1 < end ? pos[1] : '\0';
+		switch (*pos){
+		case '\n':
+			pos++;
+			lineNum++;
+			colNum = 1;
+			continue;
+		case '\r':
+			if (next != '\n'){ break; }
+			pos += 2;
+			lineNum++;
+			colNum = 1;
+			continue;
+		case ' ': case '\t':
+			len = blanks(pos, end);
+			pos += len;
+			colNum += len;
+			continue;
+		case '/':
+			if (next == '/'){
+				len = 2 + lineChars(pos + 2, end);
+				pos += len;
+				colNum += len;
+				continue;
+			}
+			kind = TokenKind::SLASH;
+			break;
+		case '"': {
+			int rule = matchString(pos, end, len);
+			if (rule == 1){
+				kind = TokenKind::STRLITERAL;
+				lval->transToken = Token::strLit(line, col, StrView(pos, len));
+				break;
+			}
+			if (rule == 2){
+				errStrUnterm(line, col);
+			} else if (rule == 5){
+				errStrEsc(line, col);
+			} else {
+				errStrEscAndUnterm(line, col);
+			}
+			pos += len;
+			colNum += len;
+			continue;
+		}
+		case '[': kind = TokenKind::LBRACE; break;
+		case ']': kind = TokenKind::RBRACE; break;
+		case '{': kind = TokenKind::LCURLY; break;
+		case '}': kind = TokenKind::RCURLY; break;
+		case '(': kind = TokenKind::LPAREN; break;
+		case ')': kind = TokenKind::RPAREN; break;
+		case ';': kind = TokenKind::SEMICOLON; break;
+		case ':': kind = TokenKind::COLON; break;
+		case ',': kind = TokenKind::COMMA; break;
+		case '*': kind = TokenKind::STAR; break;
+		case '+':
+			kind = TokenKind::CROSS;
+			if (next == '+'){ kind = TokenKind::CROSSCROSS; len = 2; }
+			break;
+		case '-':
+			kind = TokenKind::DASH;
+			if (next == '-'){ kind = TokenKind::DASHDASH; len = 2; }
+			break;
+		case '!':
+			kind = TokenKind::NOT;
+			if (next == '='){ kind = TokenKind::NOTEQUALS; len = 2; }
+			break;
+		case '=':
+			kind = TokenKind::ASSIGN;
+			if (next == '='){ kind = TokenKind::EQUALS; len = 2; }
+			break;
+		case '<':
+			kind = TokenKind::LESS;
+			if (next == '='){ kind = TokenKind::LESSEQ; len = 2; }
+			break;
+		case '>':
+			kind = TokenKind::GREATER;
+			if (next == '='){ kind = TokenKind::GREATEREQ; len = 2; }
+			break;
+		case '&':
+			if (next == '&'){ kind = TokenKind::AND; len = 2; }
+			break;
+		case '|':
+			if (next == '|'){ kind = TokenKind::OR; len = 2; }
+			break;
+		case '0': case '1': case '2': case '3': case '4':
+		case '5': case '6': case '7': case '8': case '9': {
+			len = digits(pos, end);
+			int value;
+			if (!intValue(pos, len, value)){
+				errIntOverflow(line, col);
+				value = INT_MAX;
+			}
+			kind = TokenKind::INTLITERAL;
+			lval->transToken = Token::intLit(line, col, value);
+			break;
+		}
+		default:
+			if (IdentChar::match(*pos)){
+				len = 1 + identChars(pos + 1, end);
+				kind = keywordOrID(pos, len);
+				if (kind == TokenKind::ID){
+					lval->transToken = Token::ident(line, col,
+						SymbolTable::global().intern(StrView(pos, len)));
+				}
+			}
+			break;
+		}
+
+		if (kind < 0){
+			//Like flex's yytext, a NUL byte reads as an empty string
+			errIllegal(line, col, std::string(pos, *pos == '\0' ? 0 : 1));
+			pos++;
+			colNum++;
+			continue;
+		}
+		if (kind != TokenKind::ID && kind != TokenKind::INTLITERAL
+		  && kind != TokenKind::STRLITERAL){
+			lval->transToken = Token::bare(line, col, kind);
+		}
+		myTokenStart = static_cast<size_t>(pos - base);
+		pos += len;
+		colNum += len;
+		myOffset = static_cast<size_t>(pos - base);
+		return kind;
+	}
+	myOffset = static_cast<size_t>(pos - base);
+	return TokenKind::END;
+}
+
+} //End namespace crona
@@ -0,0 +1,47 @@
+#ifndef CRONA_FASTSCAN_H
+#define CRONA_FASTSCAN_H
+
+#include <cstddef>
+
+namespace crona{
+
+/// Which scanner turns source text into tokens. Both produce the
+/// same tokens and diagnostics; FLEX is the reference.
+enum class LexerKind{ FLEX, FAST };
+
+/// Parse a --lexer= argument ("flex" or "fast"). Returns false if
+/// name is neither.
+bool lexerKindFromString(const char * name, LexerKind& kind);
+
+/**
+The character-class kernels behind the hand-written scanner
+(Scanner::scanFast). Each returns the length of the run of matching
+bytes starting at text, stopping at end. They are vectorised with
+SSE2 or AVX2, picked once at startup from what the CPU supports;
+short tails and non-x86 builds fall back to plain loops.
+**/
+namespace scankernels{
+
+/// [ \t]*
+size_t blanks(const char * text, const char * end);
+
+/// [A-Za-z0-9_]*
+size_t identChars(const char * text, const char * end);
+
+/// [0-9]*
+size_t digits(const char * text, const char * end);
+
+/// [^"\\\n]*, the plain part of a string literal
+size_t stringChars(const char * text, const char * end);
+
+/// [^\n]*, the rest of a line (e.g. a comment)
+size_t lineChars(const char * text, const char * end);
+
+/// "avx2", "sse2" or "scalar": the kernels in use
+const char * level();
+
+} //End namespace scankernels
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,380 @@
+#include <climits>
+#include <cstdint>
+#include "fold.hpp"
+#include "visitor.hpp"
+
+namespace crona{
+
+/*
+Folding is one pass, the Folder below. A method for an expression
+class folds the node's children, then returns what should take the
+node's place: the node itself, one of its children or a new
+literal. A method for a statement or declaration folds the
+expressions it holds in place and returns nullptr.
+*/
+
+/// Whether evaluating an expression could have an effect, failing
+/// at run time included (or, for anything else, nothing)
+class Effects : public ASTVisitor<Effects, bool>{
+private:
+	friend class ASTVisitor<Effects, bool>;
+	using ASTVisitor<Effects, bool>::visitNode;
+
+	bool visitAssignExpNode(AssignExpNode *){ return true; }
+	bool visitCallExpNode(CallExpNode *){ return true; }
+	bool visitDivideNode(DivideNode * node);
+	/// The offset may be out of bounds
+	bool visitIndexNode(IndexNode *){ return true; }
+	bool visitNode(BinaryExpNode * node){
+		return visit(node->lhs()) || visit(node->rhs());
+	}
+	bool visitNode(UnaryExpNode * node){ return visit(node->exp()); }
+};
+
+class Folder : public ASTVisitor<Folder, ExpNode *>{
+public:
+	explicit Folder(Arena * arena) : myArena(arena){}
+private:
+	friend class ASTVisitor<Folder, ExpNode *>;
+	using ASTVisitor<Folder, ExpNode *>::visitNode;
+
+	ExpNode * visitProgramNode(ProgramNode * node);
+	ExpNode * visitFnDeclNode(FnDeclNode * node);
+	ExpNode * visitAssignExpNode(AssignExpNode * node);
+	ExpNode * visitCallExpNode(CallExpNode * node);
+	ExpNode * visitIndexNode(IndexNode * node);
+	ExpNode * visitAssignStmtNode(AssignStmtNode * node);
+	ExpNode * visitReadStmtNode(ReadStmtNode * node);
+	ExpNode * visitWriteStmtNode(WriteStmtNode * node);
+	ExpNode * visitPostDecStmtNode(PostDecStmtNode * node);
+	ExpNode * visitPostIncStmtNode(PostIncStmtNode * node);
+	ExpNode * visitIfStmtNode(IfStmtNode * node);
+	ExpNode * visitIfElseStmtNode(IfElseStmtNode * node);
+	ExpNode * visitWhileStmtNode(WhileStmtNode * node);
+	ExpNode * visitReturnStmtNode(ReturnStmtNode * node);
+	ExpNode * visitCallStmtNode(CallStmtNode * node);
+	/// Names and literals stay as they are
+	ExpNode * visitNode(ExpNode * node){ return node; }
+	ExpNode * visitNode(BinaryExpNode * node);
+	ExpNode * visitNode(UnaryExpNode * node);
+
+	/// What replaces node, whose children are already folded
+	ExpNode * simplify(BinaryExpNode * node);
+	ExpNode * reassociate(BinaryExpNode * node);
+	void foldAll(NodeList<StmtNode>& stmts);
+	/// A literal at at's position, or nullptr if value (wrapped to
+	/// 32 bits) is INT_MIN
+	ExpNode * intLit(ASTNode * at, int64_t value);
+	ExpNode * boolLit(ASTNode * at, bool value);
+
+	Arena * myArena;
+};
+
+static bool intValue(ExpNode * node, int& value){
+	if (node->kind() != NodeKind::IntLitNode){ return false; }
+	value = static_cast<IntLitNode *>(node)->value();
+	return true;
+}
+
+static bool isInt(ExpNode * node, int value){
+	int v;
+	return intValue(node, v) && v == value;
+}
+
+/// Only dividing by a literal other than 0 and -1 can't fail
+bool Effects::visitDivideNode(DivideNode * node){
+	int divisor;
+	if (!intValue(node->rhs(), divisor) || divisor == 0 || divisor == -1){
+		return true;
+	}
+	return visit(node->lhs());
+}
+
+static bool boolValue(ExpNode * node, bool& value){
+	if (node->kind() == NodeKind::TrueNode){
+		value = true;
+	} else if (node->kind() == NodeKind::FalseNode){
+		value = false;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+/*
+Whether node is known to be an int, so that it can take the place
+of arithmetic on it: a byte would lose its promotion to int, and
+be written as a character. Names only count once they're resolved.
+*/
+static bool isIntTyped(ExpNode * node){
+	const DataType * intType = TypeTable::global().intType();
+	switch (node->kind()){
+	case NodeKind::IntLitNode:
+	case NodeKind::PlusNode:
+	case NodeKind::MinusNode:
+	case NodeKind::TimesNode:
+	case NodeKind::DivideNode:
+	case NodeKind::NegNode:
+		return true;
+	case NodeKind::IDNode: {
+		DeclNode * decl = static_cast<IDNode *>(node)->decl();
+		return decl != nullptr && decl->kind() != NodeKind::FnDeclNode
+			&& static_cast<VarDeclNode *>(decl)->type() == intType;
+	}
+	case NodeKind::IndexNode: {
+		ExpNode * base = static_cast<IndexNode *>(node)->base();
+		if (base->kind() != NodeKind::IDNode){ return false; }
+		DeclNode * decl = static_cast<IDNode *>(base)->decl();
+		if (decl == nullptr || decl->kind() == NodeKind::FnDeclNode){
+			return false;
+		}
+		const DataType * type = static_cast<VarDeclNode *>(decl)->type();
+		return type != nullptr && type->isArray() && type->element() == intType;
+	}
+	case NodeKind::CallExpNode: {
+		DeclNode * decl = static_cast<CallExpNode *>(node)->id()->decl();
+		return decl != nullptr && decl->kind() == NodeKind::FnDeclNode
+			&& static_cast<FnDeclNode *>(decl)->type() == intType;
+	}
+	case NodeKind::AssignExpNode:
+		return isIntTyped(static_cast<AssignExpNode *>(node)->dest());
+	default:
+		return false;
+	}
+}
+
+static bool hasEffects(ExpNode * node){
+	return Effects().visit(node);
+}
+
+void foldConstants(ProgramNode * ast){
+	Folder(ast->arena()).visit(ast);
+}
+
+ExpNode * Folder::intLit(ASTNode * at, int64_t value){
+	int wrapped = static_cast<int32_t>(static_cast<uint32_t>(value));
+	if (wrapped == INT_MIN){ return nullptr; }
+	return myArena->make<IntLitNode>(at->line(), at->col(), wrapped);
+}
+
+ExpNode * Folder::boolLit(ASTNode * at, bool value){
+	if (value){ return myArena->make<TrueNode>(at->line(), at->col()); }
+	return myArena->make<FalseNode>(at->line(), at->col());
+}
+
+void Folder::foldAll(NodeList<StmtNode>& stmts){
+	for (StmtNode * stmt : stmts){ visit(stmt); }
+}
+
+ExpNode * Folder::visitProgramNode(ProgramNode * node){
+	for (DeclNode * global : node->globals()){ visit(global); }
+	return nullptr;
+}
+
+ExpNode * Folder::visitFnDeclNode(FnDeclNode * node){
+	foldAll(node->body());
+	return nullptr;
+}
+
+///////EXPNODE CLASSES//////////////
+///////////////////////////////////
+
+ExpNode * Folder::visitAssignExpNode(AssignExpNode * node){
+	visit(node->dest());
+	node->setSrc(visit(node->src()));
+	return node;
+}
+
+ExpNode * Folder::visitCallExpNode(CallExpNode * node){
+	NodeList<ExpNode>& args = node->args();
+	for (size_t i = 0; i < args.size(); i++){ args.set(i, visit(args[i])); }
+	return node;
+}
+
+ExpNode * Folder::visitIndexNode(IndexNode * node){
+	node->setOffset(visit(node->offset()));
+	return node;
+}
+
+ExpNode * Folder::visitNode(BinaryExpNode * node){
+	node->setLhs(visit(node->lhs()));
+	node->setRhs(visit(node->rhs()));
+	return simplify(node);
+}
+
+ExpNode * Folder::simplify(BinaryExpNode * node){
+	ExpNode * lhs = node->lhs();
+	ExpNode * rhs = node->rhs();
+	int a = 0;
+	int b = 0;
+	bool ints = intValue(lhs, a) && intValue(rhs, b);
+	bool p = false;
+	bool q = false;
+	bool bools = boolValue(lhs, p) && boolValue(rhs, q);
+	ExpNode * folded = nullptr;
+	switch (node->kind()){
+	case NodeKind::PlusNode:
+		if (ints){ folded = intLit(node, static_cast<int64_t>(a) + b); }
+		else if (isInt(rhs, 0) && isIntTyped(lhs)){ folded = lhs; }
+		else if (isInt(lhs, 0) && isIntTyped(rhs)){ folded = rhs; }
+		else { folded = reassociate(node); }
+		break;
+	case NodeKind::MinusNode:
+		if (ints){ folded = intLit(node, static_cast<int64_t>(a) - b); }
+		else if (isInt(rhs, 0) && isIntTyped(lhs)){ folded = lhs; }
+		break;
+	case NodeKind::TimesNode:
+		if (ints){ folded = intLit(node, static_cast<int64_t>(a) * b); }
+		else if (isInt(rhs, 1) && isIntTyped(lhs)){ folded = lhs; }
+		else if (isInt(lhs, 1) && isIntTyped(rhs)){ folded = rhs; }
+		else if (isInt(rhs, 0) && !hasEffects(lhs)){ folded = rhs; }
+		else if (isInt(lhs, 0) && !hasEffects(rhs)){ folded = lhs; }
+		else { folded = reassociate(node); }
+		break;
+	case NodeKind::DivideNode:
+		//x / 0 and INT_MIN / -1 fail at run time, so they stay
+		if (ints && b != 0 && !(a == INT_MIN && b == -1)){
+			folded = intLit(node, a / b);
+		} else if (isInt(rhs, 1) && isIntTyped(lhs)){
+			folded = lhs;
+		}
+		break;
+	case NodeKind::AndNode:
+		if (boolValue(lhs, p)){ folded = p ? rhs : lhs; }
+		else if (boolValue(rhs, q) && (q || !hasEffects(lhs))){
+			folded = q ? lhs : rhs;
+		}
+		break;
+	case NodeKind::OrNode:
+		if (boolValue(lhs, p)){ folded = p ? lhs : rhs; }
+		else if (boolValue(rhs, q) && (!q || !hasEffects(lhs))){
+			folded = q ? rhs : lhs;
+		}
+		break;
+	case NodeKind::EqualsNode:
+		if (ints){ folded = boolLit(node, a == b); }
+		else if (bools){ folded = boolLit(node, p == q); }
+		break;
+	case NodeKind::NotEqualsNode:
+		if (ints){ folded = boolLit(node, a != b); }
+		else if (bools){ folded = boolLit(node, p != q); }
+		break;
+	case NodeKind::LessNode:
+		if (ints){ folded = boolLit(node, a < b); }
+		break;
+	case NodeKind::LessEqNode:
+		if (ints){ folded = boolLit(node, a <= b); }
+		break;
+	case NodeKind::GreaterNode:
+		if (ints){ folded = boolLit(node, a > b); }
+		break;
+	case NodeKind::GreaterEqNode:
+		if (ints){ folded = boolLit(node, a >= b); }
+		break;
+	default:
+		break;
+	}
+	return folded == nullptr ? node : folded;
+}
+
+//(x op c1) op c2 and (c1 op x) op c2 become x op c, for c = c1 op c2:
+// + and * are still associative and commutative when they wrap, and
+// x is evaluated just as before. The parser groups to the left, so
+// this gathers the constants of x + 1 + 2 or 2 * x * 4.
+ExpNode * Folder::reassociate(BinaryExpNode * node){
+	int outer;
+	if (!intValue(node->rhs(), outer) || node->lhs()->kind() != node->kind()){
+		return nullptr;
+	}
+	BinaryExpNode * sub = static_cast<BinaryExpNode *>(node->lhs());
+	int inner;
+	bool left = intValue(sub->lhs(), inner);
+	if (!left && !intValue(sub->rhs(), inner)){ return nullptr; }
+	int64_t c = node->kind() == NodeKind::PlusNode
+		? static_cast<int64_t>(inner) + outer
+		: static_cast<int64_t>(inner) * outer;
+	ExpNode * lit = intLit(node->rhs(), c);
+	if (lit == nullptr){ return nullptr; }
+	if (left){ sub->setLhs(lit); } else { sub->setRhs(lit); }
+	return simplify(sub);
+}
+
+ExpNode * Folder::visitNode(UnaryExpNode * node){
+	node->setExp(visit(node->exp()));
+	ExpNode * exp = node->exp();
+	//--x is x (an int), even for INT_MIN, and !!b is b
+	if (exp->kind() == node->kind()){
+		ExpNode * inner = static_cast<UnaryExpNode *>(exp)->exp();
+		if (node->kind() == NodeKind::NotNode || isIntTyped(inner)){
+			return inner;
+		}
+	}
+	int v;
+	bool b;
+	ExpNode * folded = nullptr;
+	if (node->kind() == NodeKind::NegNode && intValue(exp, v)){
+		folded = intLit(node, -static_cast<int64_t>(v));
+	} else if (node->kind() == NodeKind::NotNode && boolValue(exp, b)){
+		folded = boolLit(node, !b);
+	}
+	return folded == nullptr ? node : folded;
+}
+
+///////STMTNODE CLASSES/////////////
+///////////////////////////////////
+
+ExpNode * Folder::visitAssignStmtNode(AssignStmtNode * node){
+	visit(node->assignExp());
+	return nullptr;
+}
+
+ExpNode * Folder::visitReadStmtNode(ReadStmtNode * node){
+	visit(node->lval());
+	return nullptr;
+}
+
+ExpNode * Folder::visitWriteStmtNode(WriteStmtNode * node){
+	node->setExp(visit(node->exp()));
+	return nullptr;
+}
+
+ExpNode * Folder::visitPostDecStmtNode(PostDecStmtNode * node){
+	visit(node->lval());
+	return nullptr;
+}
+
+ExpNode * Folder::visitPostIncStmtNode(PostIncStmtNode * node){
+	visit(node->lval());
+	return nullptr;
+}
+
+ExpNode * Folder::visitIfStmtNode(IfStmtNode * node){
+	node->setCond(visit(node->cond()));
+	foldAll(node->body());
+	return nullptr;
+}
+
+ExpNode * Folder::visitIfElseStmtNode(IfElseStmtNode * node){
+	node->setCond(visit(node->cond()));
+	foldAll(node->trueBranch());
+	foldAll(node->falseBranch());
+	return nullptr;
+}
+
+ExpNode * Folder::visitWhileStmtNode(WhileStmtNode * node){
+	node->setCond(visit(node->cond()));
+	foldAll(node->body());
+	return nullptr;
+}
+
+ExpNode * Folder::visitReturnStmtNode(ReturnStmtNode * node){
+	if (node->exp() != nullptr){ node->setExp(visit(node->exp())); }
+	return nullptr;
+}
+
+ExpNode * Folder::visitCallStmtNode(CallStmtNode * node){
+	visit(node->callExp());
+	return nullptr;
+}
+
+} //End namespace crona
@@ -0,0 +1,26 @@
+#ifndef CRONA_FOLD_H
+#define CRONA_FOLD_H
+
+#include "ast.hpp"
+
+namespace crona{
+
+/**
+* Fold constant subexpressions of ast in place, and simplify
+* identities such as x * 1, x + 0, !!b and true && b. Integer
+* arithmetic wraps at 32 bits, as it will at run time; a division
+* by zero, INT_MIN / -1, and any result of INT_MIN (which has no
+* literal: the lexer clamps 2147483648 to INT_MAX) are left for run
+* time. Subexpressions are dropped only if evaluating them can have
+* no effect (no calls, assignments or operations that can fail).
+* Nothing is type checked, so identities assume the program is well
+* typed; those that leave an operand in place of arithmetic on it
+* (x + 0, x * 1, --x, ...) need it to be an int, which for names
+* and calls is only known once names are resolved. New nodes come
+* from ast's arena and take the position of the node they replace.
+**/
+void foldConstants(ProgramNode * ast);
+
+} //End namespace crona
+
+#endif
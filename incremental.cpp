@@ -0,0 +1,237 @@
+#include <algorithm>
+#include "errors.hpp"
+#include "incremental.hpp"
+#include "scanner.hpp"
+
+namespace crona{
+
+using Span = IncrementalParse::Span;
+
+static uint64_t hashText(const char * text, size_t len){
+	//FNV-1a
+	uint64_t hash = 14695981039346656037ull;
+	for (size_t i = 0; i < len; i++){
+		hash ^= static_cast<unsigned char>(text[i]);
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
+static size_t countLines(const std::string& text, size_t begin, size_t end){
+	return static_cast<size_t>(std::count(text.begin()
+		+ static_cast<std::ptrdiff_t>(begin), text.begin()
+		+ static_cast<std::ptrdiff_t>(end), '\n'));
+}
+
+/*
+A scanner that also notes where each global declaration starts and
+ends. The token stream is enough to tell: a declaration ends at a
+semicolon outside any braces, or at the brace closing its function
+body.
+*/
+class SpanScanner : public Scanner{
+public:
+	SpanScanner(std::shared_ptr<SourceFile> source, std::vector<Span>& spans)
+	: Scanner(source), mySpans(spans), myDepth(0), myOpen(false){}
+
+	using Scanner::yylex;
+	int yylex(crona::Parser::semantic_type * const lval) override{
+		int kind = Scanner::yylex(lval);
+		if (kind == TokenKind::END){ return kind; }
+		if (!myOpen){
+			Span span;
+			span.begin = tokenStart();
+			span.end = tokenEnd();
+			span.line = lval->transToken.line();
+			span.col = lval->transToken.col();
+			span.hash = 0;
+			mySpans.push_back(span);
+			myOpen = true;
+		}
+		if (kind == TokenKind::LCURLY){
+			myDepth++;
+		} else if (kind == TokenKind::RCURLY && myDepth > 0){
+			if (--myDepth == 0){ close(); }
+		} else if (kind == TokenKind::SEMICOLON && myDepth == 0){
+			close();
+		}
+		return kind;
+	}
+private:
+	void close(){
+		mySpans.back().end = tokenEnd();
+		myOpen = false;
+	}
+
+	std::vector<Span>& mySpans;
+	size_t myDepth;
+	bool myOpen;
+};
+
+IncrementalParse::IncrementalParse(std::string text, LexerKind lexer)
+: myText(std::move(text)), myLexer(lexer), myRoot(nullptr),
+  myAdopted(0), myLastBytes(0), myLastDecls(0), myLastReused(0){
+	parseAll();
+}
+
+IncrementalParse::~IncrementalParse(){
+	delete myRoot;
+}
+
+bool IncrementalParse::parseRange(size_t begin, size_t end,
+	size_t line, size_t col, std::unique_ptr<ProgramNode>& piece,
+	std::vector<Span>& spans){
+	std::shared_ptr<SourceFile> source(
+		new SourceFile(myText.data() + begin, end - begin));
+	SpanScanner scanner(source, spans);
+	scanner.useLexer(myLexer);
+	scanner.startAt(line, col);
+	ProgramNode * root = nullptr;
+	crona::Parser parser(scanner, &root);
+	bool ok = parser.parse() == 0;
+	piece.reset(root);
+	if (!ok || spans.size() != piece->globals().size()){
+		piece.reset();
+		return false;
+	}
+	for (Span& span : spans){
+		span.begin += begin;
+		span.end += begin;
+		span.hash = hashText(myText.data() + span.begin, span.end - span.begin);
+	}
+	return true;
+}
+
+bool IncrementalParse::parseAll(){
+	delete myRoot;
+	myRoot = nullptr;
+	mySpans.clear();
+	myAdopted = 0;
+	myLastBytes = myText.size();
+	myLastDecls = 0;
+	myLastReused = 0;
+
+	std::unique_ptr<ProgramNode> whole;
+	std::vector<Span> spans;
+	if (!parseRange(0, myText.size(), 1, 1, whole, spans)){ return false; }
+	myRoot = whole.release();
+	mySpans.swap(spans);
+	myLastDecls = mySpans.size();
+	return true;
+}
+
+//The line number at offset, counting from the span before first
+size_t IncrementalParse::lineAt(size_t first, size_t offset) const{
+	if (first == 0){ return 1 + countLines(myText, 0, offset); }
+	const Span& before = mySpans[first - 1];
+	return before.line + countLines(myText, before.begin, offset);
+}
+
+bool IncrementalParse::edit(size_t offset, size_t len,
+	const std::string& replacement){
+	offset = std::min(offset, myText.size());
+	len = std::min(len, myText.size() - offset);
+	size_t oldEnd = offset + len;
+	size_t newEnd = offset + replacement.size();
+	size_t removedLines = countLines(myText, offset, oldEnd);
+	myText.replace(offset, len, replacement);
+	if (myRoot == nullptr){ return parseAll(); }
+
+	//Where an offset from before the edit is now. Offsets inside
+	// the replaced text end up just after the replacement.
+	auto moved = [&](size_t pos){
+		if (pos <= offset){ return pos; }
+		if (pos < oldEnd){ return newEnd; }
+		return pos - len + replacement.size();
+	};
+
+	//Strings and comments never run past a newline, so outside the
+	// lines the edit touched everything lexes as before
+	size_t lo = offset;
+	while (lo > 0 && myText[lo - 1] != '\n'){ lo--; }
+	size_t hi = newEnd;
+	while (hi < myText.size() && myText[hi] != '\n'){ hi++; }
+	if (hi < myText.size()){ hi++; }
+
+	//Declarations on those lines or overlapping the edit get
+	// reparsed whole: spans [i, j)
+	auto first = std::partition_point(mySpans.begin(), mySpans.end(),
+		[&](const Span& span){ return span.end <= lo; });
+	auto last = std::partition_point(first, mySpans.end(),
+		[&](const Span& span){
+			return span.begin < oldEnd || moved(span.begin) < hi;
+		});
+	size_t i = static_cast<size_t>(first - mySpans.begin());
+	size_t j = static_cast<size_t>(last - mySpans.begin());
+
+	size_t begin = lo;
+	size_t end = hi;
+	size_t line;
+	size_t col = 1;
+	if (i < j && mySpans[i].begin <= lo){
+		begin = mySpans[i].begin;
+		line = mySpans[i].line;
+		col = mySpans[i].col;
+	} else {
+		line = lineAt(i, lo);
+	}
+	if (i < j){ end = std::max(end, moved(mySpans[j - 1].end)); }
+
+	std::unique_ptr<ProgramNode> piece;
+	std::vector<Span> spans;
+	//Diagnostics are held back until the reparse is known to have
+	// worked: if it doesn't, the whole program is parsed again and
+	// that parse does the reporting
+	bool parsed;
+	{
+		HeldReports held;
+		parsed = parseRange(begin, end, line, col, piece, spans);
+		if (parsed){ held.release(); }
+	}
+	if (!parsed){ return parseAll(); }
+
+	//A declaration that comes back unchanged, in the same place,
+	// keeps its old node
+	NodeList<DeclNode>& globals = myRoot->globals();
+	std::vector<DeclNode *> decls(piece->globals().begin(),
+		piece->globals().end());
+	size_t reused = 0;
+	for (size_t k = 0; k < spans.size() && i + k < j; k++){
+		const Span& was = mySpans[i + k];
+		const Span& now = spans[k];
+		if (was.hash == now.hash && was.end - was.begin == now.end - now.begin
+		  && was.line == now.line && was.col == now.col){
+			decls[k] = globals[i + k];
+			reused++;
+		}
+	}
+	globals.replace(myRoot->arena(), i, j - i, decls.data(), decls.size());
+
+	size_t addedLines = countLines(myText, offset, newEnd);
+	for (size_t k = j; k < mySpans.size(); k++){
+		Span& span = mySpans[k];
+		span.begin = moved(span.begin);
+		span.end = moved(span.end);
+		span.line = span.line + addedLines - removedLines;
+	}
+	mySpans.erase(first, last);
+	mySpans.insert(mySpans.begin() + static_cast<std::ptrdiff_t>(i),
+		spans.begin(), spans.end());
+
+	//The new nodes live in the piece's arena, which the program
+	// now keeps. Once those outweigh the program's own arena,
+	// start over with everything in one place.
+	myAdopted += piece->arena()->bytesUsed();
+	myRoot->arena()->make<std::unique_ptr<ProgramNode>>(std::move(piece));
+	bool ok = true;
+	if (myAdopted > myRoot->arena()->bytesUsed()){
+		HeldReports quiet;
+		ok = parseAll();
+	}
+	myLastBytes = end - begin;
+	myLastDecls = spans.size();
+	myLastReused = reused;
+	return ok;
+}
+
+} //End namespace crona
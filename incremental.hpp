@@ -0,0 +1,84 @@
+#ifndef CRONA_INCREMENTAL_H
+#define CRONA_INCREMENTAL_H
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+#include "fastscan.hpp"
+
+namespace crona{
+
+/**
+* \class IncrementalParse
+* A program held in memory (e.g. an editor buffer) together with its
+* AST, kept up to date through text edits. Alongside the AST it keeps
+* the byte range, position and content hash of every global
+* declaration. An edit re-lexes and re-parses just the lines it
+* touches plus the declarations overlapping them, and splices the
+* result into the program's globals in place of the old ones. The
+* work done therefore tracks the size of the edit and of the
+* declarations around it, not the size of the program.
+*
+* Declarations a reparse leaves alone keep their nodes, including
+* the line and column recorded in them. An edit that adds or removes
+* lines therefore leaves the positions in the nodes of later
+* declarations behind; span() always has the current ones.
+**/
+class IncrementalParse{
+public:
+	/// Where one global declaration sits in text()
+	struct Span{
+		size_t begin; //Offset of its first token
+		size_t end; //Offset just past its last token
+		size_t line; //Position of its first token
+		size_t col;
+		uint64_t hash; //Of the bytes in [begin, end)
+	};
+
+	explicit IncrementalParse(std::string text,
+		LexerKind lexer = LexerKind::FLEX);
+	~IncrementalParse();
+	IncrementalParse(const IncrementalParse&) = delete;
+	IncrementalParse& operator=(const IncrementalParse&) = delete;
+
+	/**
+	* Replace the len bytes of text() at offset with replacement
+	* and bring the AST up to date. Diagnostics are reported for
+	* the text that was re-lexed. Returns whether the program now
+	* parses; if it doesn't, ast() is nullptr until an edit makes
+	* it parse again.
+	**/
+	bool edit(size_t offset, size_t len, const std::string& replacement);
+
+	/// The AST of text(), or nullptr if it doesn't parse
+	ProgramNode * ast(){ return myRoot; }
+	const std::string& text() const { return myText; }
+	const std::vector<Span>& spans() const { return mySpans; }
+
+	/// How much the last edit (or the initial parse) re-lexed
+	size_t lastBytesParsed() const { return myLastBytes; }
+	/// How many declarations it produced, and how many of those
+	/// were identical to one they replaced and kept the old node
+	size_t lastDeclsParsed() const { return myLastDecls; }
+	size_t lastDeclsReused() const { return myLastReused; }
+private:
+	bool parseAll();
+	bool parseRange(size_t begin, size_t end, size_t line, size_t col,
+		std::unique_ptr<ProgramNode>& piece, std::vector<Span>& spans);
+	size_t lineAt(size_t first, size_t offset) const;
+
+	std::string myText;
+	LexerKind myLexer;
+	ProgramNode * myRoot;
+	std::vector<Span> mySpans;
+	size_t myAdopted; //Arena bytes of the pieces spliced in
+	size_t myLastBytes;
+	size_t myLastDecls;
+	size_t myLastReused;
+};
+
+} //End namespace crona
+
+#endif
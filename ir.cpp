@@ -0,0 +1,1395 @@
+#include <algorithm>
+#include <climits>
+#include "ir.hpp"
+
+namespace crona{
+
+static const uint32_t NONE = UINT32_MAX;
+
+static const char * irOpName(IROp op){
+	static const char * names[] = {
+#define CRONA_IR_NAME(name) #name,
+		CRONA_IR_OPS(CRONA_IR_NAME)
+#undef CRONA_IR_NAME
+	};
+	return names[static_cast<size_t>(op)];
+}
+
+static bool isTerminator(IROp op){
+	return op == IROp::JMP || op == IROp::BR || op == IROp::RET;
+}
+
+/// Whether it defines a value
+static bool hasValue(IROp op){
+	switch (op){
+	case IROp::NOP: case IROp::STOREG: case IROp::STOREX: case IROp::READS:
+	case IROp::WRITE: case IROp::WRITES: case IROp::JMP: case IROp::BR:
+	case IROp::RET:
+		return false;
+	default:
+		return true;
+	}
+}
+
+/*
+Construction follows Braun et al., "Simple and Efficient Construction
+of Static Single Assignment Form" (CC 2013): each bytecode register
+is a variable, the value it has at the end of each block is looked
+up (and remembered) on demand, and a phi goes wherever a lookup
+reaches a join. All the predecessors are known up front, from the
+bytecode's jumps, so a block is sealed as soon as they have all been
+filled in; until then, lookups in it get placeholder phis, which are
+completed when it's sealed. Lookups walk up through single
+predecessors iteratively, and phi operands are filled in from a
+worklist, so nothing recurses.
+
+Trivial phis (all of whose operands are the same, or the phi itself)
+are left for propagateCopies, as are the copies the bytecode's MOVs
+become.
+*/
+class IRBuilder{
+public:
+	IRBuilder(const Module& module, const Function& fn, IRFunction& out)
+	: myModule(module), myFn(fn), myOut(out), myCurrent(0), myUndef(0){}
+	void build();
+private:
+	struct Def{
+		uint64_t key;
+		uint32_t value;
+	};
+	struct Incomplete{
+		uint32_t reg;
+		uint32_t phi;
+		uint32_t next;
+	};
+	struct Pending{
+		uint32_t phi;
+		uint32_t reg;
+	};
+
+	void findBlocks();
+	void fill(uint32_t block, size_t from, size_t to);
+	void seal(uint32_t block);
+	/// Fill in the operands of the phis waiting for them
+	void fillPhis();
+
+	uint32_t instr(IROp op, int32_t imm, const uint32_t * args, uint32_t numArgs,
+		SourcePos pos);
+	uint32_t instr(IROp op, int32_t imm, SourcePos pos){
+		return instr(op, imm, nullptr, 0, pos);
+	}
+	uint32_t unary(IROp op, uint32_t a, SourcePos pos){
+		return instr(op, 0, &a, 1, pos);
+	}
+	uint32_t binary(IROp op, uint32_t a, uint32_t b, SourcePos pos){
+		uint32_t args[2] = {a, b};
+		return instr(op, 0, args, 2, pos);
+	}
+	uint32_t phi(uint32_t block);
+
+	/// The value of reg at the end of block, as far as it's known
+	uint32_t lookup(uint32_t reg, uint32_t block);
+	/// The value of reg here, in the block being filled
+	uint32_t use(uint32_t reg);
+	void def(uint32_t reg, uint32_t value){ setDef(myCurrent, reg, value); }
+	Def * findDef(uint32_t block, uint32_t reg);
+	void setDef(uint32_t block, uint32_t reg, uint32_t value);
+
+	const Module& myModule;
+	const Function& myFn;
+	IRFunction& myOut;
+	uint32_t myCurrent;
+	uint32_t myUndef;
+	//Where each block's code starts and ends
+	std::vector<size_t> myStarts;
+	std::vector<size_t> myEnds;
+	std::vector<uint8_t> mySealed;
+	std::vector<uint32_t> myFilledPreds;
+	std::vector<uint32_t> myIncompleteHead;
+	std::vector<Incomplete> myIncomplete;
+	std::vector<Pending> myPending;
+	std::vector<uint32_t> myPath;
+	std::vector<uint32_t> myArgs;
+	std::vector<Def> myDefs;
+	size_t myNumDefs = 0;
+};
+
+void buildIR(const Module& module, IRModule& ir){
+	ir.source = &module;
+	ir.functions.clear();
+	ir.functions.resize(module.functions.size());
+	for (size_t f = 0; f < module.functions.size(); f++){
+		IRBuilder(module, module.functions[f], ir.functions[f]).build();
+	}
+}
+
+uint32_t IRBuilder::instr(IROp op, int32_t imm, const uint32_t * args,
+	uint32_t numArgs, SourcePos pos){
+	uint32_t first = static_cast<uint32_t>(myOut.operands.size());
+	myOut.operands.insert(myOut.operands.end(), args, args + numArgs);
+	myOut.instrs.push_back(IRInstr{op, myCurrent, imm, first, numArgs, pos});
+	return static_cast<uint32_t>(myOut.instrs.size() - 1);
+}
+
+uint32_t IRBuilder::phi(uint32_t block){
+	const IRBlock& b = myOut.blocks[block];
+	uint32_t first = static_cast<uint32_t>(myOut.operands.size());
+	myOut.operands.resize(myOut.operands.size() + b.numPreds, NONE);
+	SourcePos pos = myFn.positions.empty() ? SourcePos{1, 1}
+		: myFn.positions[std::min(myStarts[block], myFn.positions.size() - 1)];
+	myOut.instrs.push_back(IRInstr{IROp::PHI, block, 0, first, b.numPreds, pos});
+	return static_cast<uint32_t>(myOut.instrs.size() - 1);
+}
+
+static uint64_t defKey(uint32_t block, uint32_t reg){
+	return static_cast<uint64_t>(block) << 32 | reg;
+}
+
+static size_t defHash(uint64_t key){
+	uint64_t h = key * 0x9e3779b97f4a7c15ull;
+	return static_cast<size_t>(h ^ (h >> 31));
+}
+
+IRBuilder::Def * IRBuilder::findDef(uint32_t block, uint32_t reg){
+	uint64_t key = defKey(block, reg);
+	size_t mask = myDefs.size() - 1;
+	for (size_t i = defHash(key) & mask; ; i = (i + 1) & mask){
+		if (myDefs[i].value == NONE){ return nullptr; }
+		if (myDefs[i].key == key){ return &myDefs[i]; }
+	}
+}
+
+void IRBuilder::setDef(uint32_t block, uint32_t reg, uint32_t value){
+	if ((myNumDefs + 1) * 2 > myDefs.size()){
+		std::vector<Def> old(myDefs.size() * 2, Def{0, NONE});
+		old.swap(myDefs);
+		size_t mask = myDefs.size() - 1;
+		for (const Def& d : old){
+			if (d.value == NONE){ continue; }
+			size_t i = defHash(d.key) & mask;
+			while (myDefs[i].value != NONE){ i = (i + 1) & mask; }
+			myDefs[i] = d;
+		}
+	}
+	uint64_t key = defKey(block, reg);
+	size_t mask = myDefs.size() - 1;
+	size_t i = defHash(key) & mask;
+	while (myDefs[i].value != NONE && myDefs[i].key != key){ i = (i + 1) & mask; }
+	if (myDefs[i].value == NONE){ myNumDefs++; }
+	myDefs[i] = Def{key, value};
+}
+
+uint32_t IRBuilder::lookup(uint32_t reg, uint32_t block){
+	myPath.clear();
+	uint32_t value;
+	uint32_t b = block;
+	while (true){
+		if (Def * d = findDef(b, reg)){
+			value = d->value;
+			break;
+		}
+		const IRBlock& info = myOut.blocks[b];
+		if (!mySealed[b]){
+			value = phi(b);
+			myIncomplete.push_back(Incomplete{reg, value, myIncompleteHead[b]});
+			myIncompleteHead[b] = static_cast<uint32_t>(myIncomplete.size() - 1);
+			setDef(b, reg, value);
+			break;
+		}
+		if (info.numPreds == 0){
+			//Only the entry, which defines every register it can
+			value = myUndef;
+			break;
+		}
+		if (info.numPreds == 1){
+			myPath.push_back(b);
+			b = myOut.preds[info.preds];
+			continue;
+		}
+		value = phi(b);
+		setDef(b, reg, value);
+		myPending.push_back(Pending{value, reg});
+		break;
+	}
+	for (uint32_t on : myPath){ setDef(on, reg, value); }
+	return value;
+}
+
+uint32_t IRBuilder::use(uint32_t reg){
+	uint32_t value = lookup(reg, myCurrent);
+	fillPhis();
+	return value;
+}
+
+void IRBuilder::fillPhis(){
+	while (!myPending.empty()){
+		Pending p = myPending.back();
+		myPending.pop_back();
+		const IRInstr& phi = myOut.instrs[p.phi];
+		const IRBlock& b = myOut.blocks[phi.block];
+		uint32_t args = phi.args;
+		for (uint32_t j = 0; j < b.numPreds; j++){
+			uint32_t operand = lookup(p.reg, myOut.preds[b.preds + j]);
+			myOut.operands[args + j] = operand;
+		}
+	}
+}
+
+void IRBuilder::seal(uint32_t block){
+	mySealed[block] = 1;
+	for (uint32_t i = myIncompleteHead[block]; i != NONE; i = myIncomplete[i].next){
+		myPending.push_back(Pending{myIncomplete[i].phi, myIncomplete[i].reg});
+	}
+	myIncompleteHead[block] = NONE;
+	fillPhis();
+}
+
+static bool isJump(Op op){
+	switch (op){
+	case Op::JMP: case Op::JT: case Op::JF:
+	case Op::JEQ: case Op::JNE: case Op::JLT:
+	case Op::JLE: case Op::JGT: case Op::JGE:
+		return true;
+	default:
+		return false;
+	}
+}
+
+/*
+Block 0 is an entry of our own, defining the formals (and the value
+of registers that are read before they're written, which can only be
+temporaries the bytecode never reads, but still), and jumping to the
+block that starts the bytecode.
+*/
+void IRBuilder::findBlocks(){
+	const std::vector<Instr>& code = myFn.code;
+	size_t n = code.size();
+	std::vector<uint8_t> leader(n + 1, 0);
+	leader[0] = 1;
+	for (size_t i = 0; i < n; i++){
+		Op op = code[i].op;
+		if (isJump(op)){
+			leader[static_cast<size_t>(static_cast<int64_t>(i) + code[i].d)] = 1;
+		}
+		if (isJump(op) || op == Op::RET || op == Op::RETV){ leader[i + 1] = 1; }
+	}
+
+	//Blocks in code order, after the entry; then the reachable ones
+	std::vector<size_t> starts;
+	std::vector<uint32_t> blockAt(n + 1, NONE);
+	starts.push_back(0);
+	for (size_t i = 0; i < n; i++){
+		if (leader[i]){
+			blockAt[i] = static_cast<uint32_t>(starts.size());
+			starts.push_back(i);
+		}
+	}
+	size_t numBlocks = starts.size();
+	std::vector<uint32_t> succs(numBlocks * 2, NONE);
+	std::vector<uint32_t> numSuccs(numBlocks, 0);
+	succs[0] = 1;
+	numSuccs[0] = 1;
+	for (size_t b = 1; b < numBlocks; b++){
+		size_t end = b + 1 < numBlocks ? starts[b + 1] : n;
+		const Instr& last = code[end - 1];
+		uint32_t target = isJump(last.op)
+			? blockAt[static_cast<size_t>(static_cast<int64_t>(end - 1) + last.d)] : NONE;
+		uint32_t next = end < n ? blockAt[end] : NONE;
+		uint32_t * s = &succs[b * 2];
+		switch (last.op){
+		case Op::JMP: s[0] = target; numSuccs[b] = 1; break;
+		case Op::RET: case Op::RETV: break;
+		case Op::JF: s[0] = next; s[1] = target; numSuccs[b] = 2; break;
+		default:
+			if (isJump(last.op)){
+				s[0] = target;
+				s[1] = next;
+				numSuccs[b] = 2;
+			} else {
+				//Lowering always ends with RETV, so there's a next
+				s[0] = next;
+				numSuccs[b] = 1;
+			}
+		}
+	}
+
+	std::vector<uint32_t> newId(numBlocks, NONE);
+	std::vector<uint32_t> stack(1, 0);
+	newId[0] = 0;
+	while (!stack.empty()){
+		size_t b = stack.back();
+		stack.pop_back();
+		for (uint32_t k = 0; k < numSuccs[b]; k++){
+			uint32_t s = succs[b * 2 + k];
+			if (newId[s] == NONE){
+				newId[s] = 0;
+				stack.push_back(s);
+			}
+		}
+	}
+	uint32_t count = 0;
+	for (size_t b = 0; b < numBlocks; b++){
+		if (newId[b] != NONE){ newId[b] = count++; }
+	}
+
+	myOut.blocks.assign(count, IRBlock());
+	myStarts.assign(count, 0);
+	myEnds.assign(count, 0);
+	for (size_t b = 0; b < numBlocks; b++){
+		if (newId[b] == NONE){ continue; }
+		IRBlock& block = myOut.blocks[newId[b]];
+		myStarts[newId[b]] = starts[b];
+		myEnds[newId[b]] = b + 1 < numBlocks ? starts[b + 1] : n;
+		block.numSuccs = numSuccs[b];
+		for (uint32_t k = 0; k < numSuccs[b]; k++){
+			block.succs[k] = newId[succs[b * 2 + k]];
+		}
+	}
+	myOut.rebuildCFG();
+}
+
+void IRBuilder::build(){
+	myOut.source = &myFn;
+	size_t n = myFn.code.size();
+	myOut.instrs.reserve(n * 2 + myFn.formals + 2);
+	myOut.operands.reserve(n * 3);
+	size_t defs = 64;
+	while (defs < n * 2){ defs *= 2; }
+	myDefs.assign(defs, Def{0, NONE});
+	findBlocks();
+
+	uint32_t numBlocks = static_cast<uint32_t>(myOut.blocks.size());
+	mySealed.assign(numBlocks, 0);
+	myFilledPreds.assign(numBlocks, 0);
+	myIncompleteHead.assign(numBlocks, NONE);
+
+	//The entry
+	SourcePos start = n > 0 ? myFn.positions[0] : SourcePos{1, 1};
+	myCurrent = 0;
+	mySealed[0] = 1;
+	for (uint32_t k = 0; k < myFn.formals; k++){
+		def(k, instr(IROp::PARAM, static_cast<int32_t>(k), start));
+	}
+	myUndef = instr(IROp::CONST, 0, start);
+	instr(IROp::JMP, 0, start);
+
+	for (uint32_t b = 0; b < numBlocks; b++){
+		const IRBlock& block = myOut.blocks[b];
+		if (b > 0){
+			myCurrent = b;
+			fill(b, myStarts[b], myEnds[b]);
+		}
+		for (uint32_t k = 0; k < block.numSuccs; k++){
+			uint32_t s = block.succs[k];
+			if (++myFilledPreds[s] == myOut.blocks[s].numPreds && !mySealed[s]){
+				seal(s);
+			}
+		}
+	}
+	myOut.layout();
+}
+
+static IROp binaryOp(Op op){
+	switch (op){
+	case Op::ADD: return IROp::ADD;
+	case Op::SUB: return IROp::SUB;
+	case Op::MUL: return IROp::MUL;
+	case Op::DIV: return IROp::DIV;
+	case Op::EQ: case Op::JEQ: return IROp::EQ;
+	case Op::NE: case Op::JNE: return IROp::NE;
+	case Op::LT: case Op::JLT: return IROp::LT;
+	case Op::LE: case Op::JLE: return IROp::LE;
+	case Op::GT: case Op::JGT: return IROp::GT;
+	default: return IROp::GE;
+	}
+}
+
+void IRBuilder::fill(uint32_t block, size_t from, size_t to){
+	const std::vector<Instr>& code = myFn.code;
+	bool ended = false;
+	for (size_t i = from; i < to; i++){
+		const Instr& in = code[i];
+		SourcePos pos = myFn.positions[i];
+		switch (in.op){
+		case Op::CONST:
+			def(in.a, instr(IROp::CONST, in.d, pos));
+			break;
+		case Op::MOV:
+			def(in.a, unary(IROp::COPY, use(in.b), pos));
+			break;
+		case Op::LOADG:
+			def(in.a, instr(IROp::LOADG, in.d, pos));
+			break;
+		case Op::STOREG: {
+			uint32_t v = use(in.a);
+			instr(IROp::STOREG, in.d, &v, 1, pos);
+			break;
+		}
+		case Op::ADD: case Op::SUB: case Op::MUL: case Op::DIV:
+		case Op::EQ: case Op::NE: case Op::LT:
+		case Op::LE: case Op::GT: case Op::GE: {
+			uint32_t b = use(in.b);
+			uint32_t c = use(in.c);
+			def(in.a, binary(binaryOp(in.op), b, c, pos));
+			break;
+		}
+		case Op::NEG:
+		case Op::NOT:
+		case Op::BYTE: {
+			IROp op = in.op == Op::NEG ? IROp::NEG
+				: in.op == Op::NOT ? IROp::NOT : IROp::BYTE;
+			def(in.a, unary(op, use(in.b), pos));
+			break;
+		}
+		case Op::JMP:
+			instr(IROp::JMP, 0, pos);
+			ended = true;
+			break;
+		case Op::JT:
+		case Op::JF:
+			unary(IROp::BR, use(in.a), pos);
+			ended = true;
+			break;
+		case Op::ALLOCA:
+			def(in.a, instr(IROp::ALLOCA, in.d, pos));
+			break;
+		case Op::LOADX: {
+			uint32_t b = use(in.b);
+			uint32_t c = use(in.c);
+			def(in.a, binary(IROp::LOADX, b, c, pos));
+			break;
+		}
+		case Op::STOREX: {
+			uint32_t args[3];
+			args[0] = use(in.b);
+			args[1] = use(in.c);
+			args[2] = use(in.a);
+			instr(IROp::STOREX, 0, args, 3, pos);
+			break;
+		}
+		case Op::CALL: {
+			const Function& callee = myModule.functions[static_cast<size_t>(in.d)];
+			myArgs.clear();
+			for (uint32_t k = 0; k < callee.formals; k++){
+				myArgs.push_back(use(in.a + k));
+			}
+			def(in.a, instr(IROp::CALL, in.d, myArgs.data(), callee.formals, pos));
+			break;
+		}
+		case Op::RET:
+			unary(IROp::RET, use(in.a), pos);
+			ended = true;
+			break;
+		case Op::RETV:
+			instr(IROp::RET, 0, pos);
+			ended = true;
+			break;
+		case Op::READ:
+			def(in.a, instr(IROp::READ, static_cast<int32_t>(in.c), pos));
+			break;
+		case Op::READS:
+		case Op::WRITES: {
+			uint32_t v = use(in.a);
+			instr(in.op == Op::READS ? IROp::READS : IROp::WRITES, 0, &v, 1, pos);
+			break;
+		}
+		case Op::WRITE: {
+			uint32_t v = use(in.a);
+			instr(IROp::WRITE, static_cast<int32_t>(in.c), &v, 1, pos);
+			break;
+		}
+		case Op::HAVOC:
+			def(in.a, instr(IROp::HAVOC, 0, pos));
+			break;
+		case Op::ADDI: {
+			uint32_t b = use(in.b);
+			def(in.a, binary(IROp::ADD, b, instr(IROp::CONST, in.d, pos), pos));
+			break;
+		}
+		case Op::INC:
+		case Op::DEC: {
+			uint32_t a = use(in.a);
+			IROp op = in.op == Op::INC ? IROp::ADD : IROp::SUB;
+			def(in.a, binary(op, a, instr(IROp::CONST, 1, pos), pos));
+			break;
+		}
+		case Op::INCG:
+		case Op::DECG: {
+			uint32_t old = instr(IROp::LOADG, in.d, pos);
+			IROp op = in.op == Op::INCG ? IROp::ADD : IROp::SUB;
+			uint32_t v = binary(op, old, instr(IROp::CONST, 1, pos), pos);
+			instr(IROp::STOREG, in.d, &v, 1, pos);
+			break;
+		}
+		case Op::JEQ: case Op::JNE: case Op::JLT:
+		case Op::JLE: case Op::JGT: case Op::JGE: {
+			uint32_t a = use(in.a);
+			uint32_t b = use(in.b);
+			unary(IROp::BR, binary(binaryOp(in.op), a, b, pos), pos);
+			ended = true;
+			break;
+		}
+		}
+	}
+	if (!ended){
+		instr(IROp::JMP, 0, myFn.positions[to - 1]);
+	}
+}
+
+/*
+Phis first, then everything else in the order it was made (which is
+program order, within a block: passes only ever turn instructions
+into NOPs or rewrite them in place, and add constants to the entry),
+with the terminator last.
+*/
+void IRFunction::layout(){
+	size_t numBlocks = blocks.size();
+	for (IRBlock& b : blocks){ b.count = 0; }
+	uint32_t live = 0;
+	for (const IRInstr& in : instrs){
+		if (in.op != IROp::NOP){
+			blocks[in.block].count++;
+			live++;
+		}
+	}
+	order.assign(live, NONE);
+	std::vector<uint32_t> cursor(numBlocks);
+	uint32_t at = 0;
+	for (size_t b = 0; b < numBlocks; b++){
+		blocks[b].first = at;
+		cursor[b] = at;
+		at += blocks[b].count;
+	}
+	for (int pass = 0; pass < 3; pass++){
+		for (size_t i = 0; i < instrs.size(); i++){
+			const IRInstr& in = instrs[i];
+			if (in.op == IROp::NOP){ continue; }
+			int which = in.op == IROp::PHI ? 0 : isTerminator(in.op) ? 2 : 1;
+			if (which == pass){ order[cursor[in.block]++] = static_cast<uint32_t>(i); }
+		}
+	}
+}
+
+void IRFunction::rebuildCFG(){
+	size_t numBlocks = blocks.size();
+	std::vector<uint32_t> newId(numBlocks, NONE);
+	std::vector<uint32_t> stack(1, 0);
+	newId[0] = 0;
+	while (!stack.empty()){
+		uint32_t b = stack.back();
+		stack.pop_back();
+		for (uint32_t k = 0; k < blocks[b].numSuccs; k++){
+			uint32_t s = blocks[b].succs[k];
+			if (newId[s] == NONE){
+				newId[s] = 0;
+				stack.push_back(s);
+			}
+		}
+	}
+	uint32_t count = 0;
+	for (size_t b = 0; b < numBlocks; b++){
+		if (newId[b] != NONE){ newId[b] = count++; }
+	}
+
+	std::vector<IRBlock> old;
+	old.swap(blocks);
+	blocks.assign(count, IRBlock());
+	for (size_t b = 0; b < numBlocks; b++){
+		if (newId[b] == NONE){ continue; }
+		IRBlock& nb = blocks[newId[b]];
+		nb.numSuccs = old[b].numSuccs;
+		nb.numPreds = 0;
+		for (uint32_t k = 0; k < nb.numSuccs; k++){
+			nb.succs[k] = newId[old[b].succs[k]];
+		}
+	}
+	for (const IRBlock& b : blocks){
+		for (uint32_t k = 0; k < b.numSuccs; k++){ blocks[b.succs[k]].numPreds++; }
+	}
+	uint32_t at = 0;
+	for (IRBlock& b : blocks){
+		b.preds = at;
+		at += b.numPreds;
+		b.numPreds = 0;
+	}
+	//For each new edge, which of its block's predecessors it was
+	std::vector<uint32_t> oldEdge(at, NONE);
+	preds.assign(at, NONE);
+	for (size_t b = 0; b < numBlocks; b++){
+		if (newId[b] == NONE){ continue; }
+		IRBlock& nb = blocks[newId[b]];
+		for (uint32_t k = 0; k < nb.numSuccs; k++){
+			IRBlock& s = blocks[nb.succs[k]];
+			uint32_t j = s.numPreds++;
+			preds[s.preds + j] = newId[b];
+			nb.succEdge[k] = j;
+			oldEdge[s.preds + j] = old[b].succEdge[k];
+		}
+	}
+
+	std::vector<uint32_t> scratch;
+	for (IRInstr& in : instrs){
+		if (in.op == IROp::NOP){ continue; }
+		if (newId[in.block] == NONE){
+			in.op = IROp::NOP;
+			continue;
+		}
+		in.block = newId[in.block];
+		if (in.op != IROp::PHI){ continue; }
+		const IRBlock& b = blocks[in.block];
+		scratch.clear();
+		for (uint32_t j = 0; j < b.numPreds; j++){
+			scratch.push_back(operands[in.args + oldEdge[b.preds + j]]);
+		}
+		std::copy(scratch.begin(), scratch.end(), operands.begin() + in.args);
+		in.numArgs = b.numPreds;
+	}
+	layout();
+}
+
+bool IRFunction::hasEffect(const IRInstr& in) const{
+	switch (in.op){
+	case IROp::STOREG: case IROp::STOREX: case IROp::LOADX: case IROp::CALL:
+	case IROp::READ: case IROp::READS: case IROp::WRITE: case IROp::WRITES:
+	case IROp::HAVOC: case IROp::JMP: case IROp::BR: case IROp::RET:
+		return true;
+	case IROp::DIV: {
+		//Unless it can't fail
+		const IRInstr& divisor = instrs[operands[in.args + 1]];
+		return divisor.op != IROp::CONST || divisor.imm == 0 || divisor.imm == -1;
+	}
+	default:
+		return false;
+	}
+}
+
+bool IRFunction::isPure(const IRInstr& in) const{
+	switch (in.op){
+	case IROp::CONST: case IROp::COPY:
+	case IROp::ADD: case IROp::SUB: case IROp::MUL:
+	case IROp::NEG: case IROp::NOT: case IROp::BYTE:
+	case IROp::EQ: case IROp::NE: case IROp::LT:
+	case IROp::LE: case IROp::GT: case IROp::GE:
+		return true;
+	case IROp::DIV:
+		return !hasEffect(in);
+	default:
+		return false;
+	}
+}
+
+/*
+Cooper, Harvey and Kennedy, "A Simple, Fast Dominance Algorithm":
+iterate over the blocks in reverse postorder until nothing changes,
+which for code from structured source takes a couple of rounds.
+*/
+std::vector<uint32_t> IRFunction::dominators() const{
+	size_t numBlocks = blocks.size();
+	std::vector<uint32_t> rpo;
+	std::vector<uint32_t> number(numBlocks, NONE);
+	{
+		std::vector<uint8_t> seen(numBlocks, 0);
+		//(block, next successor to look at)
+		std::vector<std::pair<uint32_t, uint32_t>> stack;
+		stack.push_back({0, 0});
+		seen[0] = 1;
+		while (!stack.empty()){
+			auto& top = stack.back();
+			const IRBlock& b = blocks[top.first];
+			if (top.second < b.numSuccs){
+				uint32_t s = b.succs[top.second++];
+				if (!seen[s]){
+					seen[s] = 1;
+					stack.push_back({s, 0});
+				}
+			} else {
+				rpo.push_back(top.first);
+				stack.pop_back();
+			}
+		}
+		std::reverse(rpo.begin(), rpo.end());
+		for (size_t i = 0; i < rpo.size(); i++){
+			number[rpo[i]] = static_cast<uint32_t>(i);
+		}
+	}
+
+	std::vector<uint32_t> idom(numBlocks, NONE);
+	idom[0] = 0;
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (size_t i = 1; i < rpo.size(); i++){
+			uint32_t b = rpo[i];
+			const IRBlock& block = blocks[b];
+			uint32_t best = NONE;
+			for (uint32_t j = 0; j < block.numPreds; j++){
+				uint32_t p = preds[block.preds + j];
+				if (idom[p] == NONE){ continue; }
+				if (best == NONE){
+					best = p;
+					continue;
+				}
+				uint32_t x = p;
+				uint32_t y = best;
+				while (x != y){
+					while (number[x] > number[y]){ x = idom[x]; }
+					while (number[y] > number[x]){ y = idom[y]; }
+				}
+				best = x;
+			}
+			if (idom[b] != best){
+				idom[b] = best;
+				changed = true;
+			}
+		}
+	}
+	return idom;
+}
+
+bool IRFunction::verify(std::string& why) const{
+	size_t numBlocks = blocks.size();
+	std::vector<uint32_t> where(instrs.size(), NONE);
+	for (size_t b = 0; b < numBlocks; b++){
+		const IRBlock& block = blocks[b];
+		std::string at = "block " + std::to_string(b) + ": ";
+		if (block.count == 0){
+			why = at + "empty";
+			return false;
+		}
+		for (uint32_t k = 0; k < block.count; k++){
+			uint32_t id = order[block.first + k];
+			const IRInstr& in = instrs[id];
+			where[id] = block.first + k;
+			if (in.block != b){
+				why = at + "holds an instruction of another";
+				return false;
+			}
+			if (isTerminator(in.op) != (k + 1 == block.count)){
+				why = at + "terminator not last";
+				return false;
+			}
+			if (in.op == IROp::PHI && k > 0
+			  && instrs[order[block.first + k - 1]].op != IROp::PHI){
+				why = at + "phi after other instructions";
+				return false;
+			}
+			if (in.op == IROp::PHI && in.numArgs != block.numPreds){
+				why = at + "phi operands don't match predecessors";
+				return false;
+			}
+		}
+		const IRInstr& last = instrs[order[block.first + block.count - 1]];
+		uint32_t expected = last.op == IROp::JMP ? 1 : last.op == IROp::BR ? 2 : 0;
+		if (block.numSuccs != expected){
+			why = at + "successors don't match terminator";
+			return false;
+		}
+		for (uint32_t k = 0; k < block.numSuccs; k++){
+			const IRBlock& s = blocks[block.succs[k]];
+			if (block.succEdge[k] >= s.numPreds
+			  || preds[s.preds + block.succEdge[k]] != b){
+				why = at + "successor doesn't list it as a predecessor";
+				return false;
+			}
+		}
+	}
+
+	//Dominance, by preorder and postorder numbers in the dominator tree
+	std::vector<uint32_t> idom = dominators();
+	std::vector<uint32_t> childStart(numBlocks + 1, 0);
+	for (size_t b = 1; b < numBlocks; b++){
+		if (idom[b] == NONE){
+			why = "block " + std::to_string(b) + ": unreachable";
+			return false;
+		}
+		childStart[idom[b] + 1]++;
+	}
+	for (size_t b = 0; b < numBlocks; b++){ childStart[b + 1] += childStart[b]; }
+	std::vector<uint32_t> children(numBlocks);
+	std::vector<uint32_t> fillAt(childStart.begin(), childStart.end() - 1);
+	for (size_t b = 1; b < numBlocks; b++){
+		children[fillAt[idom[b]]++] = static_cast<uint32_t>(b);
+	}
+	std::vector<uint32_t> pre(numBlocks);
+	std::vector<uint32_t> post(numBlocks);
+	uint32_t clock = 0;
+	std::vector<std::pair<uint32_t, uint32_t>> stack;
+	stack.push_back({0, childStart[0]});
+	pre[0] = clock++;
+	while (!stack.empty()){
+		auto& top = stack.back();
+		if (top.second < childStart[top.first + 1]){
+			uint32_t c = children[top.second++];
+			pre[c] = clock++;
+			stack.push_back({c, childStart[c]});
+		} else {
+			post[top.first] = clock++;
+			stack.pop_back();
+		}
+	}
+	auto dominates = [&](uint32_t a, uint32_t b){
+		return pre[a] <= pre[b] && post[b] <= post[a];
+	};
+
+	for (size_t id = 0; id < instrs.size(); id++){
+		const IRInstr& in = instrs[id];
+		if (in.op == IROp::NOP){ continue; }
+		std::string at = "instruction " + std::to_string(id) + " ("
+			+ irOpName(in.op) + "): ";
+		if (where[id] == NONE){
+			why = at + "not in its block";
+			return false;
+		}
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			uint32_t v = operands[in.args + k];
+			if (v >= instrs.size() || instrs[v].op == IROp::NOP
+			  || !hasValue(instrs[v].op)){
+				why = at + "operand " + std::to_string(k) + " has no value";
+				return false;
+			}
+			uint32_t defBlock = instrs[v].block;
+			bool ok;
+			if (in.op == IROp::PHI){
+				ok = dominates(defBlock, preds[blocks[in.block].preds + k]);
+			} else if (defBlock == in.block){
+				ok = where[v] < where[id];
+			} else {
+				ok = dominates(defBlock, in.block);
+			}
+			if (!ok){
+				why = at + "operand " + std::to_string(k)
+					+ " not dominated by its definition";
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static const char * kindName(int32_t kind){
+	switch (kind){
+	case DataType::BOOL: return "bool";
+	case DataType::BYTE: return "byte";
+	default: return "int";
+	}
+}
+
+static void lowerName(OutBuf& out, IROp op){
+	for (const char * c = irOpName(op); *c != '\0'; c++){
+		out << static_cast<char>(*c - 'A' + 'a');
+	}
+}
+
+/*
+Values are numbered afresh, in layout order, so that the dump of
+an optimized function reads straight through.
+*/
+void IRFunction::dump(OutBuf& out, const Module& module) const{
+	out << "function " << source->name->name() << "\n";
+	std::vector<uint32_t> number(instrs.size(), NONE);
+	int next = 0;
+	for (uint32_t id : order){
+		if (hasValue(instrs[id].op)){ number[id] = static_cast<uint32_t>(next++); }
+	}
+	auto value = [&](uint32_t v){
+		out << "v" << static_cast<int>(number[v]);
+	};
+	for (size_t b = 0; b < blocks.size(); b++){
+		const IRBlock& block = blocks[b];
+		out << "b" << static_cast<int>(b) << ":";
+		for (uint32_t j = 0; j < block.numPreds; j++){
+			out << (j == 0 ? " <- b" : ", b")
+				<< static_cast<int>(preds[block.preds + j]);
+		}
+		out << "\n";
+		for (uint32_t k = 0; k < block.count; k++){
+			uint32_t id = order[block.first + k];
+			const IRInstr& in = instrs[id];
+			const uint32_t * args = operands.data() + in.args;
+			out << "\t";
+			if (hasValue(in.op)){
+				value(id);
+				out << " = ";
+			}
+			lowerName(out, in.op);
+			switch (in.op){
+			case IROp::PARAM: case IROp::CONST: case IROp::LOADG:
+			case IROp::ALLOCA:
+				out << " " << in.imm;
+				break;
+			case IROp::READ:
+				out << " " << kindName(in.imm);
+				break;
+			case IROp::STOREG:
+				out << " " << in.imm << ", ";
+				value(args[0]);
+				break;
+			case IROp::WRITE:
+				out << " ";
+				value(args[0]);
+				out << " " << kindName(in.imm);
+				break;
+			case IROp::CALL:
+				out << " " << module.functions[static_cast<size_t>(in.imm)].name->name()
+					<< "(";
+				for (uint32_t j = 0; j < in.numArgs; j++){
+					if (j > 0){ out << ", "; }
+					value(args[j]);
+				}
+				out << ")";
+				break;
+			case IROp::PHI:
+				for (uint32_t j = 0; j < in.numArgs; j++){
+					out << (j == 0 ? " [" : ", [");
+					value(args[j]);
+					out << ", b" << static_cast<int>(preds[block.preds + j]) << "]";
+				}
+				break;
+			case IROp::JMP:
+				out << " b" << static_cast<int>(block.succs[0]);
+				break;
+			case IROp::BR:
+				out << " ";
+				value(args[0]);
+				out << ", b" << static_cast<int>(block.succs[0])
+					<< ", b" << static_cast<int>(block.succs[1]);
+				break;
+			default:
+				for (uint32_t j = 0; j < in.numArgs; j++){
+					out << (j == 0 ? " " : ", ");
+					value(args[j]);
+				}
+			}
+			out << "\n";
+		}
+	}
+}
+
+void IRModule::dump(OutBuf& out) const{
+	for (size_t f = 0; f < functions.size(); f++){
+		if (f > 0){ out << "\n"; }
+		functions[f].dump(out, *source);
+	}
+}
+
+static Op jumpFor(IROp compare, bool negate){
+	switch (compare){
+	case IROp::EQ: return negate ? Op::JNE : Op::JEQ;
+	case IROp::NE: return negate ? Op::JEQ : Op::JNE;
+	case IROp::LT: return negate ? Op::JGE : Op::JLT;
+	case IROp::LE: return negate ? Op::JGT : Op::JLE;
+	case IROp::GT: return negate ? Op::JLE : Op::JGT;
+	default: return negate ? Op::JLT : Op::JGE;
+	}
+}
+
+static bool isCompare(IROp op){
+	return op >= IROp::EQ && op <= IROp::GE;
+}
+
+/*
+Registers: a formal keeps its own, every other value that's used
+(or that comes from something with an effect) gets the next one up,
+and above them all are the temporaries, which hold call arguments
+(a call's window starts there) and phi copies that have to go
+through somewhere to be done in parallel.
+
+Blocks go out in order, so a jump to the next block falls through.
+Phi copies go at the end of each predecessor, except where it
+branches both ways and both targets need some: then they go in a
+trampoline after the block.
+*/
+class IRLowerer{
+public:
+	IRLowerer(const IRFunction& fn, bool superinstructions)
+	: myFn(fn), mySuper(superinstructions){}
+	/// False if it needs too many registers
+	bool lower(Function& out);
+private:
+	void count();
+	void coalesce();
+	void instr(uint32_t id);
+	void terminator(uint32_t block);
+	bool needsCopies(uint32_t block, uint32_t k);
+	void copies(uint32_t block, uint32_t k, SourcePos pos);
+	void jumpTo(uint32_t target, SourcePos pos);
+	void emit(Op op, uint32_t a, uint32_t b, uint32_t c, int32_t d, SourcePos pos){
+		myCode.push_back(Instr{op, static_cast<uint16_t>(a), static_cast<uint16_t>(b),
+			static_cast<uint16_t>(c), d});
+		myPositions.push_back(pos);
+	}
+	uint32_t reg(uint32_t value) const{ return myReg[value]; }
+	uint32_t arg(const IRInstr& in, uint32_t k) const{
+		return myFn.operands[in.args + k];
+	}
+
+	const IRFunction& myFn;
+	bool mySuper;
+	std::vector<uint32_t> myUses;
+	std::vector<uint32_t> myReg;
+	/// For ADD and SUB, which operand (a constant) goes in ADDI's d
+	std::vector<uint8_t> myImmediate;
+	/// Compares that go into the branch after them
+	std::vector<uint8_t> myFused;
+	/// Values that can go straight into a phi's register, or into
+	/// a call's argument (by index)
+	std::vector<uint32_t> myShare;
+	std::vector<uint32_t> mySlot;
+	uint32_t myTemps = 0;
+	uint32_t myRegisters = 0;
+	std::vector<uint32_t> myStamp;
+	uint32_t myEpoch = 0;
+	std::vector<std::pair<uint32_t, uint32_t>> myCopies;
+	std::vector<Instr> myCode;
+	std::vector<SourcePos> myPositions;
+	std::vector<size_t> myStarts;
+	std::vector<std::pair<size_t, uint32_t>> myFixups;
+};
+
+void lowerIR(const IRModule& ir, Module& module, bool superinstructions){
+	for (size_t f = 0; f < ir.functions.size(); f++){
+		IRLowerer(ir.functions[f], superinstructions).lower(module.functions[f]);
+	}
+}
+
+static const uint8_t NO_IMMEDIATE = 2;
+
+void IRLowerer::count(){
+	size_t n = myFn.instrs.size();
+	myUses.assign(n, 0);
+	myImmediate.assign(n, NO_IMMEDIATE);
+	myFused.assign(n, 0);
+	for (const IRBlock& b : myFn.blocks){
+		for (uint32_t k = 0; k < b.count; k++){
+			const IRInstr& in = myFn.instrs[myFn.order[b.first + k]];
+			for (uint32_t j = 0; j < in.numArgs; j++){ myUses[arg(in, j)]++; }
+		}
+	}
+	coalesce();
+	if (!mySuper){ return; }
+	for (const IRBlock& b : myFn.blocks){
+		const IRInstr& last = myFn.instrs[myFn.order[b.first + b.count - 1]];
+		if (last.op == IROp::BR && b.count >= 2){
+			uint32_t cond = arg(last, 0);
+			if (isCompare(myFn.instrs[cond].op) && myUses[cond] == 1
+			  && myFn.order[b.first + b.count - 2] == cond){
+				myFused[cond] = 1;
+			}
+		}
+		for (uint32_t k = 0; k < b.count; k++){
+			uint32_t id = myFn.order[b.first + k];
+			const IRInstr& in = myFn.instrs[id];
+			if (in.op != IROp::ADD && in.op != IROp::SUB){ continue; }
+			if (myFn.instrs[arg(in, 1)].op == IROp::CONST){
+				myImmediate[id] = 1;
+			} else if (in.op == IROp::ADD
+			  && myFn.instrs[arg(in, 0)].op == IROp::CONST){
+				myImmediate[id] = 0;
+			}
+		}
+	}
+	//Now only count the uses that need the value in a register
+	for (size_t id = 0; id < n; id++){
+		const IRInstr& in = myFn.instrs[id];
+		if (in.op == IROp::NOP){ continue; }
+		if (myImmediate[id] != NO_IMMEDIATE){ myUses[arg(in, myImmediate[id])]--; }
+		if (in.op == IROp::BR && myFused[arg(in, 0)]){ myUses[arg(in, 0)]--; }
+	}
+}
+
+/*
+A value whose one use is a phi, on the way out of the block that
+defines it (which must go nowhere else), can be computed straight
+into the phi's register, provided the phi's old value isn't needed
+after that: by a later instruction in the block, or by another phi
+copy. Likewise, a value whose one use is as an argument to a call
+later in its block, with no other call in between, can be computed
+straight into its place in the call's window.
+*/
+void IRLowerer::coalesce(){
+	size_t n = myFn.instrs.size();
+	myShare.assign(n, NONE);
+	mySlot.assign(n, NONE);
+	std::vector<uint32_t> at(n, 0);
+	std::vector<uint32_t> lastUseBlock(n, NONE);
+	std::vector<uint32_t> lastUse(n, 0);
+	std::vector<uint32_t> onEdge(n, NONE);
+	for (uint32_t b = 0; b < myFn.blocks.size(); b++){
+		const IRBlock& block = myFn.blocks[b];
+		uint32_t afterCall = 0;
+		for (uint32_t k = 0; k < block.count; k++){
+			uint32_t id = myFn.order[block.first + k];
+			const IRInstr& in = myFn.instrs[id];
+			at[id] = k;
+			for (uint32_t j = 0; j < in.numArgs; j++){
+				lastUseBlock[arg(in, j)] = b;
+				lastUse[arg(in, j)] = k;
+			}
+			if (in.op != IROp::CALL){ continue; }
+			for (uint32_t j = 0; j < in.numArgs; j++){
+				uint32_t v = arg(in, j);
+				const IRInstr& def = myFn.instrs[v];
+				if (def.block == b && at[v] >= afterCall && myUses[v] == 1
+				  && def.op != IROp::PHI && def.op != IROp::PARAM){
+					mySlot[v] = j;
+				}
+			}
+			afterCall = k + 1;
+		}
+
+		if (block.numSuccs != 1){ continue; }
+		const IRBlock& s = myFn.blocks[block.succs[0]];
+		uint32_t edge = block.succEdge[0];
+		for (uint32_t k = 0; k < s.count; k++){
+			const IRInstr& phi = myFn.instrs[myFn.order[s.first + k]];
+			if (phi.op != IROp::PHI){ break; }
+			onEdge[arg(phi, edge)] = b;
+		}
+		for (uint32_t k = 0; k < s.count; k++){
+			uint32_t p = myFn.order[s.first + k];
+			const IRInstr& phi = myFn.instrs[p];
+			if (phi.op != IROp::PHI){ break; }
+			uint32_t v = arg(phi, edge);
+			const IRInstr& def = myFn.instrs[v];
+			if (def.block != b || def.op == IROp::PHI || def.op == IROp::PARAM
+			  || myUses[v] != 1 || myUses[p] == 0 || onEdge[p] == b
+			  || (lastUseBlock[p] == b && lastUse[p] > at[v])){
+				continue;
+			}
+			myShare[v] = p;
+		}
+	}
+}
+
+bool IRLowerer::lower(Function& out){
+	count();
+	const Function& source = *myFn.source;
+	size_t n = myFn.instrs.size();
+	myReg.assign(n, NONE);
+	uint32_t next = source.formals;
+	uint32_t temps = 1;
+	for (const IRBlock& b : myFn.blocks){
+		uint32_t phis = 0;
+		for (uint32_t k = 0; k < b.count; k++){
+			uint32_t id = myFn.order[b.first + k];
+			const IRInstr& in = myFn.instrs[id];
+			if (in.op == IROp::PHI){ phis++; }
+			if (in.op == IROp::CALL){ temps = std::max(temps, in.numArgs); }
+			if (in.op == IROp::PARAM){
+				myReg[id] = static_cast<uint32_t>(in.imm);
+			} else if (hasValue(in.op) && !myFused[id] && myShare[id] == NONE
+			  && mySlot[id] == NONE && (myUses[id] > 0 || myFn.hasEffect(in))){
+				myReg[id] = next++;
+			}
+		}
+		temps = std::max(temps, phis);
+	}
+	myTemps = next;
+	for (size_t id = 0; id < n; id++){
+		if (myShare[id] != NONE){ myReg[id] = myReg[myShare[id]]; }
+		if (mySlot[id] != NONE){ myReg[id] = next + mySlot[id]; }
+	}
+	myRegisters = next + temps;
+	if (myRegisters > UINT16_MAX){ return false; }
+	myStamp.assign(myRegisters, 0);
+
+	myCode.reserve(n);
+	myPositions.reserve(n);
+	myStarts.assign(myFn.blocks.size(), 0);
+	for (uint32_t b = 0; b < myFn.blocks.size(); b++){
+		const IRBlock& block = myFn.blocks[b];
+		myStarts[b] = myCode.size();
+		for (uint32_t k = 0; k + 1 < block.count; k++){
+			instr(myFn.order[block.first + k]);
+		}
+		terminator(b);
+	}
+	for (const auto& fix : myFixups){
+		myCode[fix.first].d = static_cast<int32_t>(
+			static_cast<int64_t>(myStarts[fix.second]) - static_cast<int64_t>(fix.first));
+	}
+	out.registers = myRegisters;
+	out.code.swap(myCode);
+	out.positions.swap(myPositions);
+	return true;
+}
+
+void IRLowerer::instr(uint32_t id){
+	const IRInstr& in = myFn.instrs[id];
+	uint32_t r = myReg[id];
+	if (in.op == IROp::PARAM || in.op == IROp::PHI || myFused[id]){ return; }
+	if (r == NONE && !myFn.hasEffect(in)){ return; }
+	SourcePos pos = in.pos;
+	switch (in.op){
+	case IROp::CONST:
+		emit(Op::CONST, r, 0, 0, in.imm, pos);
+		break;
+	case IROp::COPY:
+		emit(Op::MOV, r, reg(arg(in, 0)), 0, 0, pos);
+		break;
+	case IROp::ADD: case IROp::SUB:
+		if (myImmediate[id] != NO_IMMEDIATE){
+			uint8_t k = myImmediate[id];
+			int32_t d = myFn.instrs[arg(in, k)].imm;
+			if (in.op == IROp::SUB){
+				d = static_cast<int32_t>(0u - static_cast<uint32_t>(d));
+			}
+			emit(Op::ADDI, r, reg(arg(in, 1 - k)), 0, d, pos);
+			break;
+		}
+		emit(in.op == IROp::ADD ? Op::ADD : Op::SUB, r, reg(arg(in, 0)),
+			reg(arg(in, 1)), 0, pos);
+		break;
+	case IROp::MUL: case IROp::DIV:
+	case IROp::EQ: case IROp::NE: case IROp::LT:
+	case IROp::LE: case IROp::GT: case IROp::GE: {
+		static const Op ops[] = {Op::MUL, Op::DIV, Op::NEG, Op::NOT, Op::BYTE,
+			Op::EQ, Op::NE, Op::LT, Op::LE, Op::GT, Op::GE};
+		Op op = ops[static_cast<size_t>(in.op) - static_cast<size_t>(IROp::MUL)];
+		emit(op, r, reg(arg(in, 0)), reg(arg(in, 1)), 0, pos);
+		break;
+	}
+	case IROp::NEG: case IROp::NOT: case IROp::BYTE: {
+		Op op = in.op == IROp::NEG ? Op::NEG : in.op == IROp::NOT ? Op::NOT : Op::BYTE;
+		emit(op, r, reg(arg(in, 0)), 0, 0, pos);
+		break;
+	}
+	case IROp::LOADG:
+		emit(Op::LOADG, r, 0, 0, in.imm, pos);
+		break;
+	case IROp::STOREG:
+		emit(Op::STOREG, reg(arg(in, 0)), 0, 0, in.imm, pos);
+		break;
+	case IROp::ALLOCA:
+		emit(Op::ALLOCA, r, 0, 0, in.imm, pos);
+		break;
+	case IROp::LOADX:
+		emit(Op::LOADX, r, reg(arg(in, 0)), reg(arg(in, 1)), 0, pos);
+		break;
+	case IROp::STOREX:
+		emit(Op::STOREX, reg(arg(in, 2)), reg(arg(in, 0)), reg(arg(in, 1)), 0, pos);
+		break;
+	case IROp::CALL:
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			if (reg(arg(in, k)) != myTemps + k){
+				emit(Op::MOV, myTemps + k, reg(arg(in, k)), 0, 0, pos);
+			}
+		}
+		emit(Op::CALL, myTemps, 0, 0, in.imm, pos);
+		if (r != NONE){ emit(Op::MOV, r, myTemps, 0, 0, pos); }
+		break;
+	case IROp::READ:
+		emit(Op::READ, r, 0, static_cast<uint32_t>(in.imm), 0, pos);
+		break;
+	case IROp::READS:
+		emit(Op::READS, reg(arg(in, 0)), 0, 0, 0, pos);
+		break;
+	case IROp::WRITE:
+		emit(Op::WRITE, reg(arg(in, 0)), 0, static_cast<uint32_t>(in.imm), 0, pos);
+		break;
+	case IROp::WRITES:
+		emit(Op::WRITES, reg(arg(in, 0)), 0, 0, 0, pos);
+		break;
+	case IROp::HAVOC:
+		emit(Op::HAVOC, r, 0, 0, 0, pos);
+		break;
+	default:
+		break;
+	}
+}
+
+bool IRLowerer::needsCopies(uint32_t block, uint32_t k){
+	const IRBlock& b = myFn.blocks[block];
+	const IRBlock& s = myFn.blocks[b.succs[k]];
+	for (uint32_t i = 0; i < s.count; i++){
+		const IRInstr& phi = myFn.instrs[myFn.order[s.first + i]];
+		uint32_t r = reg(myFn.order[s.first + i]);
+		if (phi.op != IROp::PHI){ break; }
+		if (r != NONE && r != reg(arg(phi, b.succEdge[k]))){ return true; }
+	}
+	return false;
+}
+
+void IRLowerer::copies(uint32_t block, uint32_t k, SourcePos pos){
+	const IRBlock& b = myFn.blocks[block];
+	const IRBlock& s = myFn.blocks[b.succs[k]];
+	myCopies.clear();
+	myEpoch++;
+	for (uint32_t i = 0; i < s.count; i++){
+		uint32_t id = myFn.order[s.first + i];
+		const IRInstr& phi = myFn.instrs[id];
+		if (phi.op != IROp::PHI){ break; }
+		uint32_t from = reg(arg(phi, b.succEdge[k]));
+		if (reg(id) != NONE && reg(id) != from){
+			myCopies.push_back({reg(id), from});
+			myStamp[from] = myEpoch;
+		}
+	}
+	bool overlap = false;
+	for (const auto& c : myCopies){
+		if (myStamp[c.first] == myEpoch){ overlap = true; }
+	}
+	if (!overlap){
+		for (const auto& c : myCopies){ emit(Op::MOV, c.first, c.second, 0, 0, pos); }
+		return;
+	}
+	for (size_t i = 0; i < myCopies.size(); i++){
+		emit(Op::MOV, myTemps + static_cast<uint32_t>(i), myCopies[i].second, 0, 0, pos);
+	}
+	for (size_t i = 0; i < myCopies.size(); i++){
+		emit(Op::MOV, myCopies[i].first, myTemps + static_cast<uint32_t>(i), 0, 0, pos);
+	}
+}
+
+void IRLowerer::jumpTo(uint32_t target, SourcePos pos){
+	myFixups.push_back({myCode.size(), target});
+	emit(Op::JMP, 0, 0, 0, 0, pos);
+}
+
+void IRLowerer::terminator(uint32_t block){
+	const IRBlock& b = myFn.blocks[block];
+	uint32_t id = myFn.order[b.first + b.count - 1];
+	const IRInstr& in = myFn.instrs[id];
+	SourcePos pos = in.pos;
+	uint32_t next = block + 1;
+	if (in.op == IROp::RET){
+		if (in.numArgs == 0){
+			emit(Op::RETV, 0, 0, 0, 0, pos);
+		} else {
+			emit(Op::RET, reg(arg(in, 0)), 0, 0, 0, pos);
+		}
+		return;
+	}
+	if (in.op == IROp::JMP || b.succs[0] == b.succs[1]){
+		copies(block, 0, pos);
+		if (b.succs[0] != next){ jumpTo(b.succs[0], pos); }
+		return;
+	}
+
+	//Branch to the successor that needs no copies (if either doesn't)
+	uint32_t cond = arg(in, 0);
+	bool copiesTrue = needsCopies(block, 0);
+	bool copiesFalse = needsCopies(block, 1);
+	uint32_t taken = copiesTrue && !copiesFalse ? 1 : 0;
+	bool negate = taken == 1;
+	size_t branch = myCode.size();
+	if (myFused[cond]){
+		const IRInstr& compare = myFn.instrs[cond];
+		emit(jumpFor(compare.op, negate), reg(arg(compare, 0)), reg(arg(compare, 1)),
+			0, 0, pos);
+	} else {
+		emit(negate ? Op::JF : Op::JT, reg(cond), 0, 0, 0, pos);
+	}
+	uint32_t other = 1 - taken;
+	bool trampoline = copiesTrue && copiesFalse;
+	if (!trampoline){ myFixups.push_back({branch, b.succs[taken]}); }
+	copies(block, other, pos);
+	if (b.succs[other] != next || trampoline){ jumpTo(b.succs[other], pos); }
+	if (trampoline){
+		myCode[branch].d = static_cast<int32_t>(myCode.size() - branch);
+		copies(block, taken, pos);
+		if (b.succs[taken] != next){ jumpTo(b.succs[taken], pos); }
+	}
+}
+
+} //End namespace crona
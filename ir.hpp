@@ -0,0 +1,145 @@
+#ifndef CRONA_IR_H
+#define CRONA_IR_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "bytecode.hpp"
+#include "outbuf.hpp"
+
+namespace crona{
+
+class ThreadPool;
+
+/*
+An SSA control-flow graph for each function, built from its bytecode
+(see bytecode.hpp), which has already settled what the AST means:
+short circuits, byte conversions, where arrays and strings live.
+
+Everything is in flat arrays, indexed by 32-bit ids. An instruction
+is identified by its index in instrs, and defines the value of the
+same number (if it defines one). Its operands are a run of value ids
+in operands, and its block's instructions are a run of ids in order:
+phis first, the terminator last. A block's predecessors are a run of
+block ids in preds, and a phi's operands line up with them: operand
+j comes from predecessor j. Passes that delete instructions turn them
+into NOPs, which layout() then drops from the blocks.
+
+  param k             formal k
+  const k
+  copy v
+  phi v...            one operand per predecessor
+  add v w, ...        as the bytecode: sub, mul, div, neg, not, byte,
+                      eq, ne, lt, le, gt, ge
+  loadg k, storeg k v the global at k
+  alloca k            a new zeroed array, the function's k'th
+  loadx r i           element i of array r
+  storex r i v
+  call f v...         call function f
+  read k              read a value of DataType::Kind k
+  reads r, write v k, writes r, havoc
+  jmp, br v, ret [v]  br goes to its first successor if v is true
+*/
+#define CRONA_IR_OPS(X) \
+	X(NOP) X(PARAM) X(CONST) X(COPY) X(PHI) \
+	X(ADD) X(SUB) X(MUL) X(DIV) X(NEG) X(NOT) X(BYTE) \
+	X(EQ) X(NE) X(LT) X(LE) X(GT) X(GE) \
+	X(LOADG) X(STOREG) X(ALLOCA) X(LOADX) X(STOREX) X(CALL) \
+	X(READ) X(READS) X(WRITE) X(WRITES) X(HAVOC) \
+	X(JMP) X(BR) X(RET)
+
+enum class IROp : uint8_t{
+#define CRONA_IR_OP(name) name,
+	CRONA_IR_OPS(CRONA_IR_OP)
+#undef CRONA_IR_OP
+};
+
+struct IRInstr{
+	IROp op;
+	uint32_t block;
+	/// A constant, global address, array slot, function index, kind
+	/// or formal number, as the op needs
+	int32_t imm;
+	uint32_t args;    //First operand, in operands
+	uint32_t numArgs;
+	SourcePos pos;
+};
+
+struct IRBlock{
+	uint32_t first;   //In order
+	uint32_t count;
+	uint32_t preds;   //First predecessor, in preds
+	uint32_t numPreds;
+	/// Successors (from the terminator) and, for each, which of its
+	/// predecessors this block is
+	uint32_t succs[2];
+	uint32_t succEdge[2];
+	uint32_t numSuccs;
+};
+
+struct IRFunction{
+	const Function * source;
+	std::vector<IRInstr> instrs;
+	std::vector<uint32_t> operands;
+	std::vector<IRBlock> blocks; //The entry is block 0
+	std::vector<uint32_t> order;
+	std::vector<uint32_t> preds;
+
+	/// Rebuild order (each block's instructions), dropping NOPs
+	void layout();
+	/// Recompute the predecessors from the terminators, drop blocks
+	/// that can no longer be reached (and their instructions) and
+	/// line phi operands back up with what's left
+	void rebuildCFG();
+	/// Whether dropping the instruction (if its value is unused)
+	/// could change what the program does
+	bool hasEffect(const IRInstr& in) const;
+	/// Whether it computes its value from its operands alone
+	bool isPure(const IRInstr& in) const;
+	/// Immediate dominators, by block (the entry's is itself)
+	std::vector<uint32_t> dominators() const;
+	/// Check the structure is sound and in SSA form (every use
+	/// dominated by its definition); if not, say why
+	bool verify(std::string& why) const;
+	void dump(OutBuf& out, const Module& module) const;
+};
+
+struct IRModule{
+	const Module * source;
+	std::vector<IRFunction> functions;
+
+	void dump(OutBuf& out) const;
+};
+
+/// Build the IR for every function in module, which must outlive it
+void buildIR(const Module& module, IRModule& ir);
+
+/**
+* Optimize each function in place: copy propagation (with trivial
+* phis), sparse conditional constant propagation (which also drops
+* branches that can't be taken), common subexpression elimination
+* over the dominator tree, copy propagation again and dead code
+* elimination. Each pass is linear, or nearly, in the size of the
+* function. Functions are independent, so given a pool, they're
+* spread over its workers.
+**/
+void optimizeIR(IRModule& ir, ThreadPool * pool = nullptr);
+void propagateCopies(IRFunction& fn);
+void propagateConstants(IRFunction& fn);
+void eliminateCommonSubexpressions(IRFunction& fn);
+void eliminateDeadCode(IRFunction& fn);
+
+/**
+* Lower ir back to bytecode, in place of the module it was built
+* from. Each value gets a register of its own (unless it can be
+* computed straight into a phi's, or into a call's arguments); a
+* phi's operands are copied into its register on the way in from
+* each predecessor. A function that would need more registers than
+* an instruction can name keeps the code it had.
+**/
+void lowerIR(const IRModule& ir, Module& module,
+	bool superinstructions = true);
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,530 @@
+#include <algorithm>
+#include <climits>
+#include <numeric>
+#include "ir.hpp"
+#include "threadpool.hpp"
+
+namespace crona{
+
+static const uint32_t NONE = UINT32_MAX;
+
+namespace {
+
+/// Which value to use in place of each, for passes that find values
+/// equal to others; chains are followed (and shortened) as it goes
+class Replacements{
+public:
+	explicit Replacements(size_t size) : myTo(size){
+		std::iota(myTo.begin(), myTo.end(), 0);
+	}
+	void grow(size_t size){
+		size_t old = myTo.size();
+		myTo.resize(size);
+		std::iota(myTo.begin() + static_cast<std::ptrdiff_t>(old), myTo.end(),
+			static_cast<uint32_t>(old));
+	}
+	uint32_t find(uint32_t value){
+		uint32_t root = value;
+		while (myTo[root] != root){ root = myTo[root]; }
+		while (myTo[value] != root){
+			uint32_t next = myTo[value];
+			myTo[value] = root;
+			value = next;
+		}
+		return root;
+	}
+	void set(uint32_t value, uint32_t to){ myTo[value] = to; }
+	/// Rewrite every operand
+	void apply(IRFunction& fn){
+		for (const IRInstr& in : fn.instrs){
+			if (in.op == IROp::NOP){ continue; }
+			for (uint32_t k = 0; k < in.numArgs; k++){
+				uint32_t& operand = fn.operands[in.args + k];
+				operand = find(operand);
+			}
+		}
+	}
+private:
+	std::vector<uint32_t> myTo;
+};
+
+bool isCommutative(IROp op){
+	return op == IROp::ADD || op == IROp::MUL || op == IROp::EQ || op == IROp::NE;
+}
+
+/// What op computes from a and b (b is ignored by unary ops); false
+/// if it would fail at runtime instead
+bool fold(IROp op, int32_t a, int32_t b, int32_t& out){
+	uint32_t ua = static_cast<uint32_t>(a);
+	uint32_t ub = static_cast<uint32_t>(b);
+	switch (op){
+	case IROp::ADD: out = static_cast<int32_t>(ua + ub); return true;
+	case IROp::SUB: out = static_cast<int32_t>(ua - ub); return true;
+	case IROp::MUL: out = static_cast<int32_t>(ua * ub); return true;
+	case IROp::DIV:
+		if (b == 0 || (a == INT32_MIN && b == -1)){ return false; }
+		out = a / b;
+		return true;
+	case IROp::NEG: out = static_cast<int32_t>(0u - ua); return true;
+	case IROp::NOT: out = a == 0; return true;
+	case IROp::BYTE: out = a & 0xff; return true;
+	case IROp::EQ: out = a == b; return true;
+	case IROp::NE: out = a != b; return true;
+	case IROp::LT: out = a < b; return true;
+	case IROp::LE: out = a <= b; return true;
+	case IROp::GT: out = a > b; return true;
+	case IROp::GE: out = a >= b; return true;
+	default: return false;
+	}
+}
+
+/*
+Sparse conditional constant propagation (Wegman and Zadeck, "Constant
+Propagation with Conditional Branches"): values start out unknown
+(TOP) and only ever move down, to one constant and then to BOTTOM
+(not a constant), and a block is only looked at once an edge into
+it is known to be taken. So a value that's constant along every path
+that can actually run is found to be, even through loops, and
+branches on constants lose the side that can't be taken.
+*/
+class ConstantPropagation{
+public:
+	explicit ConstantPropagation(IRFunction& fn) : myFn(fn){}
+	void run();
+private:
+	enum State : uint8_t{ TOP, CONSTANT, BOTTOM };
+
+	void visit(uint32_t block, bool phisOnly);
+	void evaluate(uint32_t id);
+	void markEdge(uint32_t block, uint32_t k);
+	void lower(uint32_t id, State state, int32_t value);
+	void rewrite();
+	uint32_t arg(const IRInstr& in, uint32_t k) const{
+		return myFn.operands[in.args + k];
+	}
+
+	IRFunction& myFn;
+	std::vector<uint8_t> myState;
+	std::vector<int32_t> myValue;
+	std::vector<uint32_t> myUserStart;
+	std::vector<uint32_t> myUsers;
+	std::vector<uint8_t> myVisited;
+	std::vector<uint8_t> myExecutable; //By edge, as in preds
+	std::vector<uint32_t> myBlockWork;
+	std::vector<uint32_t> myValueWork;
+};
+
+void ConstantPropagation::run(){
+	size_t n = myFn.instrs.size();
+	myState.assign(n, TOP);
+	myValue.assign(n, 0);
+	myUserStart.assign(n + 1, 0);
+	for (const IRInstr& in : myFn.instrs){
+		if (in.op == IROp::NOP){ continue; }
+		for (uint32_t k = 0; k < in.numArgs; k++){ myUserStart[arg(in, k) + 1]++; }
+	}
+	for (size_t i = 0; i < n; i++){ myUserStart[i + 1] += myUserStart[i]; }
+	myUsers.resize(myUserStart[n]);
+	{
+		std::vector<uint32_t> at(myUserStart.begin(), myUserStart.end() - 1);
+		for (size_t id = 0; id < n; id++){
+			const IRInstr& in = myFn.instrs[id];
+			if (in.op == IROp::NOP){ continue; }
+			for (uint32_t k = 0; k < in.numArgs; k++){
+				myUsers[at[arg(in, k)]++] = static_cast<uint32_t>(id);
+			}
+		}
+	}
+	myVisited.assign(myFn.blocks.size(), 0);
+	myExecutable.assign(myFn.preds.size(), 0);
+
+	myVisited[0] = 1;
+	visit(0, false);
+	while (!myBlockWork.empty() || !myValueWork.empty()){
+		while (!myBlockWork.empty()){
+			uint32_t b = myBlockWork.back();
+			myBlockWork.pop_back();
+			bool seen = myVisited[b];
+			myVisited[b] = 1;
+			visit(b, seen);
+		}
+		while (!myValueWork.empty()){
+			uint32_t v = myValueWork.back();
+			myValueWork.pop_back();
+			for (uint32_t u = myUserStart[v]; u < myUserStart[v + 1]; u++){
+				uint32_t user = myUsers[u];
+				if (myVisited[myFn.instrs[user].block]){ evaluate(user); }
+			}
+		}
+	}
+	rewrite();
+}
+
+void ConstantPropagation::visit(uint32_t block, bool phisOnly){
+	const IRBlock& b = myFn.blocks[block];
+	for (uint32_t k = 0; k < b.count; k++){
+		uint32_t id = myFn.order[b.first + k];
+		if (phisOnly && myFn.instrs[id].op != IROp::PHI){ break; }
+		evaluate(id);
+	}
+}
+
+void ConstantPropagation::markEdge(uint32_t block, uint32_t k){
+	const IRBlock& b = myFn.blocks[block];
+	uint32_t s = b.succs[k];
+	uint32_t edge = myFn.blocks[s].preds + b.succEdge[k];
+	if (!myExecutable[edge]){
+		myExecutable[edge] = 1;
+		myBlockWork.push_back(s);
+	}
+}
+
+void ConstantPropagation::lower(uint32_t id, State state, int32_t value){
+	State old = static_cast<State>(myState[id]);
+	if (state == TOP || old == BOTTOM){ return; }
+	if (old == CONSTANT && (state == BOTTOM || value != myValue[id])){
+		state = BOTTOM;
+	} else if (old == CONSTANT){
+		return;
+	}
+	myState[id] = state;
+	myValue[id] = value;
+	myValueWork.push_back(id);
+}
+
+void ConstantPropagation::evaluate(uint32_t id){
+	const IRInstr& in = myFn.instrs[id];
+	switch (in.op){
+	case IROp::NOP: case IROp::RET:
+	case IROp::STOREG: case IROp::STOREX: case IROp::READS:
+	case IROp::WRITE: case IROp::WRITES:
+		return;
+	case IROp::JMP:
+		markEdge(in.block, 0);
+		return;
+	case IROp::BR: {
+		uint32_t cond = arg(in, 0);
+		if (myState[cond] == BOTTOM){
+			markEdge(in.block, 0);
+			markEdge(in.block, 1);
+		} else if (myState[cond] == CONSTANT){
+			markEdge(in.block, myValue[cond] != 0 ? 0 : 1);
+		}
+		return;
+	}
+	case IROp::CONST:
+		lower(id, CONSTANT, in.imm);
+		return;
+	case IROp::COPY:
+		lower(id, static_cast<State>(myState[arg(in, 0)]), myValue[arg(in, 0)]);
+		return;
+	case IROp::PHI: {
+		const IRBlock& b = myFn.blocks[in.block];
+		State state = TOP;
+		int32_t value = 0;
+		for (uint32_t j = 0; j < in.numArgs && state != BOTTOM; j++){
+			if (!myExecutable[b.preds + j]){ continue; }
+			uint32_t v = arg(in, j);
+			if (myState[v] == TOP){ continue; }
+			if (myState[v] == BOTTOM || (state == CONSTANT && myValue[v] != value)){
+				state = BOTTOM;
+			} else {
+				state = CONSTANT;
+				value = myValue[v];
+			}
+		}
+		lower(id, state, value);
+		return;
+	}
+	case IROp::ADD: case IROp::SUB: case IROp::MUL: case IROp::DIV:
+	case IROp::NEG: case IROp::NOT: case IROp::BYTE:
+	case IROp::EQ: case IROp::NE: case IROp::LT:
+	case IROp::LE: case IROp::GT: case IROp::GE: {
+		int32_t values[2] = {0, 0};
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			uint32_t v = arg(in, k);
+			if (myState[v] != CONSTANT){
+				lower(id, static_cast<State>(myState[v]), 0);
+				if (myState[v] == BOTTOM){ return; }
+				//TOP: maybe the other is BOTTOM, which decides it
+				continue;
+			}
+			values[k] = myValue[v];
+		}
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			if (myState[arg(in, k)] != CONSTANT){ return; }
+		}
+		int32_t out;
+		if (fold(in.op, values[0], values[1], out)){
+			lower(id, CONSTANT, out);
+		} else {
+			lower(id, BOTTOM, 0);
+		}
+		return;
+	}
+	default:
+		lower(id, BOTTOM, 0);
+		return;
+	}
+}
+
+/*
+Constant values become CONST in place, except phis, which have to
+stay at the top of their blocks: uses of those get a new constant in
+the entry instead (CSE merges any duplicates). Branches on constants
+become jumps, and then whatever they no longer reach is dropped.
+*/
+void ConstantPropagation::rewrite(){
+	size_t n = myFn.instrs.size();
+	Replacements repl(n);
+	for (size_t id = 0; id < n; id++){
+		IRInstr& in = myFn.instrs[id];
+		if (in.op == IROp::NOP || !myVisited[in.block]){ continue; }
+		if (myState[id] == CONSTANT && in.op != IROp::CONST){
+			if (in.op == IROp::PHI){
+				in.op = IROp::NOP;
+				uint32_t c = static_cast<uint32_t>(myFn.instrs.size());
+				myFn.instrs.push_back(IRInstr{IROp::CONST, 0, myValue[id],
+					static_cast<uint32_t>(myFn.operands.size()), 0, in.pos});
+				repl.grow(myFn.instrs.size());
+				repl.set(static_cast<uint32_t>(id), c);
+			} else {
+				in.op = IROp::CONST;
+				in.imm = myValue[id];
+				in.numArgs = 0;
+			}
+		} else if (in.op == IROp::BR && myState[arg(in, 0)] == CONSTANT){
+			IRBlock& b = myFn.blocks[in.block];
+			uint32_t k = myValue[arg(in, 0)] != 0 ? 0 : 1;
+			b.succs[0] = b.succs[k];
+			b.succEdge[0] = b.succEdge[k];
+			b.numSuccs = 1;
+			in.op = IROp::JMP;
+			in.numArgs = 0;
+		}
+	}
+	repl.apply(myFn);
+	myFn.rebuildCFG();
+}
+
+/*
+Common subexpressions, over the dominator tree: walking it in
+preorder, each pure instruction is looked up in a table of those
+that dominate it, and if it's there it's replaced, and if not, it's
+added. Entries are taken back out (last in, first out, which an open
+addressing table allows) on the way back up.
+*/
+class CommonSubexpressions{
+public:
+	explicit CommonSubexpressions(IRFunction& fn)
+	: myFn(fn), myRepl(fn.instrs.size()){}
+	void run();
+private:
+	void visit(uint32_t block);
+	size_t hash(const IRInstr& in) const;
+	bool same(const IRInstr& a, const IRInstr& b) const;
+	uint32_t arg(const IRInstr& in, uint32_t k) const{
+		return myFn.operands[in.args + k];
+	}
+
+	IRFunction& myFn;
+	Replacements myRepl;
+	std::vector<uint32_t> myTable;
+	std::vector<size_t> myUndo;
+};
+
+size_t CommonSubexpressions::hash(const IRInstr& in) const{
+	uint64_t h = static_cast<uint64_t>(in.op) * 0x100000001b3ull
+		^ static_cast<uint32_t>(in.imm);
+	if (in.numArgs == 2 && isCommutative(in.op)){
+		uint32_t a = std::min(arg(in, 0), arg(in, 1));
+		uint32_t b = std::max(arg(in, 0), arg(in, 1));
+		h = (h * 0x9e3779b97f4a7c15ull ^ a) * 0x9e3779b97f4a7c15ull ^ b;
+	} else {
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			h = h * 0x9e3779b97f4a7c15ull ^ arg(in, k);
+		}
+	}
+	h *= 0x9e3779b97f4a7c15ull;
+	return static_cast<size_t>(h ^ (h >> 29));
+}
+
+bool CommonSubexpressions::same(const IRInstr& a, const IRInstr& b) const{
+	if (a.op != b.op || a.imm != b.imm || a.numArgs != b.numArgs){ return false; }
+	bool straight = true;
+	for (uint32_t k = 0; k < a.numArgs; k++){
+		if (arg(a, k) != arg(b, k)){ straight = false; }
+	}
+	if (straight){ return true; }
+	return a.numArgs == 2 && isCommutative(a.op)
+		&& arg(a, 0) == arg(b, 1) && arg(a, 1) == arg(b, 0);
+}
+
+void CommonSubexpressions::visit(uint32_t block){
+	const IRBlock& b = myFn.blocks[block];
+	size_t mask = myTable.size() - 1;
+	for (uint32_t k = 0; k < b.count; k++){
+		uint32_t id = myFn.order[b.first + k];
+		IRInstr& in = myFn.instrs[id];
+		for (uint32_t j = 0; j < in.numArgs; j++){
+			uint32_t& operand = myFn.operands[in.args + j];
+			operand = myRepl.find(operand);
+		}
+		if (!myFn.isPure(in) || in.op == IROp::COPY){ continue; }
+		for (size_t i = hash(in) & mask; ; i = (i + 1) & mask){
+			if (myTable[i] == NONE){
+				myTable[i] = id;
+				myUndo.push_back(i);
+				break;
+			}
+			if (same(myFn.instrs[myTable[i]], in)){
+				myRepl.set(id, myTable[i]);
+				in.op = IROp::NOP;
+				break;
+			}
+		}
+	}
+}
+
+void CommonSubexpressions::run(){
+	size_t numBlocks = myFn.blocks.size();
+	size_t size = 16;
+	while (size < myFn.instrs.size() * 2){ size *= 2; }
+	myTable.assign(size, NONE);
+
+	std::vector<uint32_t> idom = myFn.dominators();
+	std::vector<uint32_t> childStart(numBlocks + 1, 0);
+	for (size_t b = 1; b < numBlocks; b++){ childStart[idom[b] + 1]++; }
+	for (size_t b = 0; b < numBlocks; b++){ childStart[b + 1] += childStart[b]; }
+	std::vector<uint32_t> children(numBlocks);
+	{
+		std::vector<uint32_t> at(childStart.begin(), childStart.end() - 1);
+		for (size_t b = 1; b < numBlocks; b++){
+			children[at[idom[b]]++] = static_cast<uint32_t>(b);
+		}
+	}
+
+	struct Frame{
+		uint32_t block;
+		uint32_t child;
+		size_t undo;
+	};
+	std::vector<Frame> stack;
+	stack.push_back(Frame{0, childStart[0], 0});
+	visit(0);
+	while (!stack.empty()){
+		Frame& top = stack.back();
+		if (top.child < childStart[top.block + 1]){
+			uint32_t c = children[top.child++];
+			stack.push_back(Frame{c, childStart[c], myUndo.size()});
+			visit(c);
+			continue;
+		}
+		while (myUndo.size() > top.undo){
+			myTable[myUndo.back()] = NONE;
+			myUndo.pop_back();
+		}
+		stack.pop_back();
+	}
+	//Phis can use values from blocks visited after them
+	myRepl.apply(myFn);
+	myFn.layout();
+}
+
+}
+
+void propagateCopies(IRFunction& fn){
+	Replacements repl(fn.instrs.size());
+	for (size_t id = 0; id < fn.instrs.size(); id++){
+		IRInstr& in = fn.instrs[id];
+		if (in.op == IROp::COPY){
+			repl.set(static_cast<uint32_t>(id), fn.operands[in.args]);
+			in.op = IROp::NOP;
+		}
+	}
+	//A phi whose operands are all the same value (or itself) is that
+	//value, and replacing it can make others so
+	bool changed = true;
+	while (changed){
+		changed = false;
+		for (size_t id = 0; id < fn.instrs.size(); id++){
+			IRInstr& in = fn.instrs[id];
+			if (in.op != IROp::PHI){ continue; }
+			uint32_t same = NONE;
+			bool trivial = true;
+			for (uint32_t k = 0; k < in.numArgs && trivial; k++){
+				uint32_t v = repl.find(fn.operands[in.args + k]);
+				if (v == id || v == same){ continue; }
+				if (same == NONE){
+					same = v;
+				} else {
+					trivial = false;
+				}
+			}
+			if (trivial && same != NONE){
+				repl.set(static_cast<uint32_t>(id), same);
+				in.op = IROp::NOP;
+				changed = true;
+			}
+		}
+	}
+	repl.apply(fn);
+	fn.layout();
+}
+
+void propagateConstants(IRFunction& fn){
+	ConstantPropagation(fn).run();
+}
+
+void eliminateCommonSubexpressions(IRFunction& fn){
+	CommonSubexpressions(fn).run();
+}
+
+void eliminateDeadCode(IRFunction& fn){
+	std::vector<uint8_t> live(fn.instrs.size(), 0);
+	std::vector<uint32_t> work;
+	for (size_t id = 0; id < fn.instrs.size(); id++){
+		const IRInstr& in = fn.instrs[id];
+		if (in.op != IROp::NOP && fn.hasEffect(in)){
+			live[id] = 1;
+			work.push_back(static_cast<uint32_t>(id));
+		}
+	}
+	while (!work.empty()){
+		const IRInstr& in = fn.instrs[work.back()];
+		work.pop_back();
+		for (uint32_t k = 0; k < in.numArgs; k++){
+			uint32_t v = fn.operands[in.args + k];
+			if (!live[v]){
+				live[v] = 1;
+				work.push_back(v);
+			}
+		}
+	}
+	for (size_t id = 0; id < fn.instrs.size(); id++){
+		if (!live[id]){ fn.instrs[id].op = IROp::NOP; }
+	}
+	fn.layout();
+}
+
+static void optimize(IRFunction& fn){
+	propagateCopies(fn);
+	propagateConstants(fn);
+	eliminateCommonSubexpressions(fn);
+	propagateCopies(fn);
+	eliminateDeadCode(fn);
+}
+
+void optimizeIR(IRModule& ir, ThreadPool * pool){
+	if (pool == nullptr){
+		for (IRFunction& fn : ir.functions){ optimize(fn); }
+		return;
+	}
+	for (IRFunction& fn : ir.functions){
+		IRFunction * each = &fn;
+		pool->submit([each]{ optimize(*each); });
+	}
+	pool->wait();
+}
+
+} //End namespace crona
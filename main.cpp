@@ -2,8 +2,22 @@
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
 #include "errors.hpp"
-#include "scanner.hpp"
+#include "fold.hpp"
+#include "ir.hpp"
+#include "names.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "threadpool.hpp"
+#include "vm.hpp"
+#include "x86.hpp"
 
 using namespace crona;
 
@@ -11,128 +25,528 @@ static void usageAndDie(){
 	std::cerr << "Usage: cronac <infile>"
 	<< " [-u <unparseFile>]: Output canonical program form\n"
 	<< " [-p]: Parse the input to check syntax\n"
+	<< " [-n]: Resolve names, reporting undeclared and multiply"
+	<< " declared identifiers\n"
 	<< " [-t <tokensFile>]: Output tokens to <tokensFile>\n"
+	<< " [-S <asmFile>]: Output x86-64 assembly to <asmFile>, to be"
+	<< " linked with\n   runtime/cronart.c\n"
+	<< " [-I <irFile>]: Output the SSA form of each function to"
+	<< " <irFile>\n"
+	<< " [-O]: Optimize (in SSA form) what -I, -S and --run get\n"
+	<< " [-T <tokensFile>]: Output tokens to <tokensFile> as a binary"
+	<< " token dump,\n   which can be given back to cronac as"
+	<< " <infile>\n"
+	<< " [--lexer=<flex|fast>]: Scan with flex (the default) or the"
+	<< " hand-written\n   SIMD scanner\n"
+	<< " [--stats[=<statsFile>]]: Report time and memory statistics"
+	<< " as JSON, to stderr\n   or <statsFile>\n"
+	<< " [--ast-cache=<dir>]: Reuse the AST of an unchanged input"
+	<< " from <dir>, and\n   save new ones there\n"
+	<< " [--fold]: Fold constant expressions (and simplify x * 1 and"
+	<< " the like)\n   before unparsing\n"
+	<< " [--run]: Run the program (from main, reading stdin and writing"
+	<< " stdout) on\n   the bytecode VM\n"
+	<< " [--parallel[=<threads>]]: Unparse the global declarations, and"
+	<< " optimize the\n   functions, on <threads> threads (default: one"
+	<< " per core)\n"
+	<< "Batch mode: cronac <infile>... | @<manifest>"
+	<< " [-j <threads>] [-p] [-n] [-u <suffix>] [-t <suffix>] [-T <suffix>]\n"
+	<< "  [-S <suffix>] [-I <suffix>] [-O]\n"
+	<< "  Compiles every input (a manifest lists one per line)."
+	<< " Outputs go to the input path\n"
+	<< "  with .crona replaced by <suffix>, or to stdout in input"
+	<< " order for --\n"
+	<< "Server mode: cronac --serve[=<socket>] [-j <threads>]"
+	<< " [--lexer=<flex|fast>]\n"
+	<< "  Answers parse, unparse and tokens requests on stdin and"
+	<< " stdout, or on a Unix\n"
+	<< "  socket, without restarting (see server.hpp)\n"
 	;
 	exit(1);
 }
 
-static void writeTokenStream(const char * inPath, const char * outPath){
-	std::ifstream inStream(inPath);
-	if (!inStream.good()){
-		std::string msg = "Bad input stream";
-		msg += inPath;
-		throw new InternalError(msg.c_str());
+/*
+Everything to produce for one input file. Output paths are the
+command-line arguments (or, in batch mode, derived from them);
+empty means "not requested". Output sent to "--" goes to stdOut.
+*/
+struct Job{
+	std::string inFile;
+	std::string tokensFile;
+	std::string binTokensFile;
+	std::string unparseFile;
+	std::string asmFile;
+	std::string irFile;
+	bool checkParse = false;
+	bool checkNames = false;
+	bool showStats = false;
+	bool fold = false;
+	bool run = false;
+	bool optimize = false;
+	//Unparse and optimize per declaration on a thread pool
+	bool parallel = false;
+	//Spread the declarations over this many threads (0: one per core)
+	size_t threads = 0;
+	LexerKind lexer = LexerKind::FLEX;
+	std::string cacheDir;
+	std::ostream * stdOut = &std::cout;
+	bool ok = true;
+	std::string statsJSON;
+
+	//Batch mode buffers, flushed in input order
+	std::ostringstream outBuf;
+	std::ostringstream errBuf;
+};
+
+static std::ostream * openOutput(const std::string& outPath,
+	std::ofstream& outStream, std::ostream * stdOut){
+	if (outPath == "--"){
+		return stdOut;
 	}
-	if (outPath == nullptr){
-		std::string msg = "No tokens output file given";
+	outStream.open(outPath);
+	if (!outStream.good()){
+		std::string msg = "Bad output file ";
+		msg += outPath;
 		throw new InternalError(msg.c_str());
 	}
+	return &outStream;
+}
 
-	Scanner scanner(&inStream);
-	if (strcmp(outPath, "--") == 0){
-		scanner.outputTokens(std::cout);
-	} else {
-		std::ofstream outStream(outPath);
-		if (!outStream.good()){
+/*
+Open path for one of the raw (file descriptor) writers: -1 means
+"use the stream instead", which is only the case for "--" in
+batch mode.
+*/
+static int openOutputFd(const std::string& path, const Job& job){
+	if (path != "--"){
+		int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0){
 			std::string msg = "Bad output file ";
-			msg += outPath;
+			msg += path;
 			throw new InternalError(msg.c_str());
 		}
-		scanner.outputTokens(outStream);
-		outStream.close();
+		return fd;
 	}
+	if (job.stdOut != &std::cout){ return -1; }
+	std::cout.flush();
+	return STDOUT_FILENO;
 }
 
-static crona::ProgramNode * parse(const char * inFile){
-	std::ifstream inStream(inFile);
-	if (!inStream.good()){
-		std::string msg = "Bad input stream ";
-		msg += inFile;
+static void closeOutputFd(int fd, bool ok, const std::string& path){
+	if (fd >= 0 && fd != STDOUT_FILENO){ ok = close(fd) == 0 && ok; }
+	if (!ok){
+		std::string msg = "Bad output file ";
+		msg += path;
 		throw new InternalError(msg.c_str());
 	}
+}
 
-	//This pointer will be set to the root of the
-	// AST after parsing
-	crona::ProgramNode * root = nullptr;
+static void unparseTo(OutBuf& out, ProgramNode * ast, ThreadPool * pool){
+	if (pool != nullptr){
+		ast->unparseParallel(out, *pool);
+	} else {
+		ast->unparse(out, 0);
+	}
+}
 
-	crona::Scanner scanner(&inStream);
-	crona::Parser parser(scanner, &root);
+/*
+Unparse output goes straight to the file descriptor through an
+OutBuf, except in batch mode, where "--" output is collected in a
+per-input buffer.
+*/
+static void outputAST(ProgramNode * ast, const Job& job, ThreadPool * pool){
+	int fd = openOutputFd(job.unparseFile, job);
+	if (fd < 0){
+		OutBuf out(*job.stdOut);
+		unparseTo(out, ast, pool);
+		return;
+	}
+	OutBuf out(fd);
+	unparseTo(out, ast, pool);
+	closeOutputFd(fd, out.flush(), job.unparseFile);
+}
 
-	int errCode = parser.parse();
-	if (errCode != 0){ return nullptr; }
+static void outputIR(const IRModule& ir, const Job& job){
+	int fd = openOutputFd(job.irFile, job);
+	if (fd < 0){
+		OutBuf out(*job.stdOut);
+		ir.dump(out);
+		return;
+	}
+	OutBuf out(fd);
+	ir.dump(out);
+	closeOutputFd(fd, out.flush(), job.irFile);
+}
 
-	return root;
+static void outputAssembly(const Module& module, const Job& job){
+	int fd = openOutputFd(job.asmFile, job);
+	if (fd < 0){
+		OutBuf out(*job.stdOut);
+		emitX86(module, out);
+		return;
+	}
+	OutBuf out(fd);
+	emitX86(module, out);
+	closeOutputFd(fd, out.flush(), job.asmFile);
 }
 
-static void outputAST(ASTNode * ast, const char * outPath){
-	if (strcmp(outPath, "--") == 0){
-		ast->unparse(std::cout, 0);
-	} else {
-		std::ofstream outStream(outPath);
-		if (!outStream.good()){
-			std::string msg = "Bad output file ";
-			msg += outPath;
-			throw new crona::InternalError(msg.c_str());
+/*
+Run the program, with the terminal as its input and output. Only
+single-file mode gets here.
+*/
+static bool runProgram(const Module& module){
+	std::cout.flush();
+	OutBuf out(STDOUT_FILENO);
+	VM vm(module, std::cin, out);
+	return vm.run();
+}
+
+/*
+Statistics are one JSON object per input, one per line, written
+after everything else (in input order in batch mode) to stderr
+or, with --stats=<file>, to that file.
+*/
+static void reportStats(const std::vector<Job *>& jobs,
+	const char * statsFile){
+	std::ofstream statsStream;
+	std::ostream * out = &std::cerr;
+	if (statsFile != nullptr){
+		try {
+			out = openOutput(statsFile, statsStream, &std::cout);
+		} catch (InternalError * e){
+			std::cerr << "Error: " << e->msg() << std::endl;
+			return;
 		}
-		ast->unparse(outStream, 0);
+	}
+	for (Job * job : jobs){ *out << job->statsJSON; }
+}
+
+/*
+Every requested output is produced from a single pass over the
+input: tokens are tee'd to the -t file while the parser consumes
+them, and the one AST serves both -p and -u.
+*/
+static void compile(Job& job){
+	Stats stats;
+	std::unique_ptr<ThreadPool> pool;
+	if (job.parallel){ pool.reset(new ThreadPool(job.threads)); }
+	Pipeline pipeline(job.inFile.c_str());
+	pipeline.useLexer(job.lexer);
+	if (job.showStats){ pipeline.keepStats(&stats); }
+	if (!job.cacheDir.empty()){ pipeline.useCache(job.cacheDir); }
+
+	std::ofstream tokensStream;
+	if (!job.tokensFile.empty()){
+		try {
+			pipeline.teeTokens(openOutput(job.tokensFile,
+				tokensStream, job.stdOut));
+		} catch (InternalError * e){
+			Report::stream() << "Error: " << e->msg() << std::endl;
+			job.ok = false;
+		}
+	}
+
+	int dumpFd = -1;
+	std::unique_ptr<TokenWriter> dump;
+	if (!job.binTokensFile.empty()){
+		try {
+			dumpFd = openOutputFd(job.binTokensFile, job);
+			dump.reset(dumpFd < 0 ? new TokenWriter(*job.stdOut)
+				: new TokenWriter(dumpFd));
+			pipeline.dumpTokens(dump.get());
+		} catch (InternalError * e){
+			Report::stream() << "Error: " << e->msg() << std::endl;
+			job.ok = false;
+		}
+	}
+
+	bool native = !job.asmFile.empty();
+	bool backEnd = job.run || native || !job.irFile.empty();
+	bool wantAST = job.checkParse || job.checkNames || backEnd
+		|| !job.unparseFile.empty();
+	bool parsed = pipeline.run(wantAST);
+	if (dump){
+		closeOutputFd(dumpFd, dump->finish(), job.binTokensFile);
+	}
+	if (job.checkParse && !parsed){
+		Report::stream() << "Parse failed" << std::endl;
+	}
+
+	//Names are checked even after syntax errors, in what did parse
+	bool resolved = false;
+	if ((job.checkNames || backEnd) && pipeline.ast() != nullptr){
+		Stats::Clock clock;
+		resolved = analyzeNames(pipeline.ast());
+		if (!resolved){ job.ok = false; }
+		stats.addTime(Stats::NAMES, clock);
+	}
+
+	if (parsed && job.fold){
+		Stats::Clock clock;
+		foldConstants(pipeline.ast());
+		stats.addTime(Stats::FOLD, clock);
+	}
+
+	if (!job.unparseFile.empty()){
+		if (parsed){
+			Stats::Clock clock;
+			outputAST(pipeline.ast(), job, pool.get());
+			stats.addTime(Stats::UNPARSE, clock);
+		} else {
+			Report::stream() << "No AST built\n";
+		}
+	}
+	if (!parsed){ job.ok = false; }
+
+	//The bytecode is lowered once, for everything that needs it
+	Module module;
+	bool lowered = false;
+	if (backEnd && parsed && resolved){
+		Stats::Clock clock;
+		lowered = lowerProgram(pipeline.ast(), module);
+		if (!lowered){ job.ok = false; }
+		stats.addTime(Stats::LOWER, clock);
+	}
+
+	if (lowered && (job.optimize || !job.irFile.empty())){
+		Stats::Clock clock;
+		IRModule ir;
+		buildIR(module, ir);
+		if (job.optimize){ optimizeIR(ir, pool.get()); }
+		if (!job.irFile.empty()){ outputIR(ir, job); }
+		if (job.optimize){ lowerIR(ir, module); }
+		stats.addTime(Stats::IR, clock);
+	}
+
+	if (lowered && native){
+		Stats::Clock clock;
+		outputAssembly(module, job);
+		stats.addTime(Stats::CODEGEN, clock);
+	}
+
+	if (lowered && job.run){
+		Stats::Clock clock;
+		if (!runProgram(module)){ job.ok = false; }
+		stats.addTime(Stats::RUN, clock);
+	}
+
+	if (job.showStats){
+		std::ostringstream json;
+		stats.writeJSON(json, job.inFile);
+		job.statsJSON = json.str();
 	}
 }
 
-static bool doUnparsing(const char * inputPath, const char * outPath){
-	crona::ProgramNode * ast = parse(inputPath);
-	if (ast == nullptr){ 
-		std::cerr << "No AST built\n";
-		return false;
+static std::string batchOutput(const std::string& inFile,
+	const char * suffix){
+	if (suffix == nullptr){ return ""; }
+	if (strcmp(suffix, "--") == 0){ return "--"; }
+	std::string stem = inFile;
+	const std::string ext = ".crona";
+	if (stem.size() > ext.size()
+	  && stem.compare(stem.size() - ext.size(), ext.size(), ext) == 0){
+		stem.erase(stem.size() - ext.size());
 	}
+	return stem + suffix;
+}
 
-	outputAST(ast, outPath);
-	return true;
+static void readManifest(const char * path,
+	std::vector<std::string>& inputs){
+	std::ifstream manifest(path);
+	if (!manifest.good()){
+		std::cerr << "Bad manifest file " << path << std::endl;
+		usageAndDie();
+	}
+	std::string line;
+	while (std::getline(manifest, line)){
+		if (!line.empty() && line.back() == '\r'){ line.pop_back(); }
+		if (line.empty() || line[0] == '#'){ continue; }
+		inputs.push_back(line);
+	}
 }
 
-int 
+/*
+Compile every input on a thread pool. Each input gets its own
+Pipeline (scanner, parser and arena) and its own diagnostics
+buffer; buffers and "--" output are written out in input order
+once everything has finished, so the results don't depend on
+scheduling.
+*/
+static int runBatch(const std::vector<std::string>& inputs,
+	const Job& options, const char * tokensSuffix,
+	const char * binTokensSuffix, const char * unparseSuffix,
+	const char * asmSuffix, const char * irSuffix,
+	const char * statsFile, size_t threads){
+	std::vector<std::unique_ptr<Job>> jobs;
+	for (const std::string& input : inputs){
+		std::unique_ptr<Job> job(new Job());
+		job->inFile = input;
+		job->tokensFile = batchOutput(input, tokensSuffix);
+		job->binTokensFile = batchOutput(input, binTokensSuffix);
+		job->unparseFile = batchOutput(input, unparseSuffix);
+		job->asmFile = batchOutput(input, asmSuffix);
+		job->irFile = batchOutput(input, irSuffix);
+		job->checkParse = options.checkParse;
+		job->checkNames = options.checkNames;
+		job->showStats = options.showStats;
+		job->fold = options.fold;
+		job->optimize = options.optimize;
+		job->lexer = options.lexer;
+		job->cacheDir = options.cacheDir;
+		job->stdOut = &job->outBuf;
+		jobs.push_back(std::move(job));
+	}
+
+	{
+		ThreadPool pool(threads);
+		for (auto& owned : jobs){
+			Job * job = owned.get();
+			pool.submit([job]{
+				Report::redirect(&job->errBuf);
+				try {
+					compile(*job);
+				} catch (ToDoError * e){
+					Report::stream() << "ToDo: " << e->msg() << std::endl;
+					job->ok = false;
+				} catch (InternalError * e){
+					Report::stream() << "Error: " << e->msg() << std::endl;
+					job->ok = false;
+				}
+				Report::redirect(nullptr);
+			});
+		}
+		pool.wait();
+	}
+
+	int status = 0;
+	std::vector<Job *> finished;
+	for (auto& job : jobs){
+		std::cout << job->outBuf.str();
+		std::string errs = job->errBuf.str();
+		if (!errs.empty()){
+			std::cerr << job->inFile << ":\n" << errs;
+		}
+		if (!job->ok){ status = 1; }
+		finished.push_back(job.get());
+	}
+	if (options.showStats){ reportStats(finished, statsFile); }
+	return status;
+}
+
+int
 main( const int argc, const char **argv )
 {
 	if (argc == 0){
 		usageAndDie();
 	}
-	const char * inFile = NULL;
+	std::vector<std::string> inputs;
+	bool batch = false;
+	size_t threads = 0;
 	const char * tokensFile = NULL;
-	bool checkParse = false;
+	const char * binTokensFile = NULL;
 	const char * unparseFile = NULL;
+	const char * asmFile = NULL;
+	const char * irFile = NULL;
+	const char * statsFile = NULL;
+	const char * socketPath = NULL;
+	bool serve = false;
+	Job options;
 
 	bool useful = false;
-	int i = 1;
 	for (int i = 1 ; i < argc ; i++){
-		if (argv[i][0] == '-'){
+		if (strcmp(argv[i], "--stats") == 0){
+			options.showStats = true;
+		} else if (strncmp(argv[i], "--stats=", 8) == 0){
+			options.showStats = true;
+			statsFile = argv[i] + 8;
+		} else if (strncmp(argv[i], "--ast-cache=", 12) == 0){
+			options.cacheDir = argv[i] + 12;
+			if (options.cacheDir.empty()){ usageAndDie(); }
+		} else if (strcmp(argv[i], "--fold") == 0){
+			options.fold = true;
+		} else if (strcmp(argv[i], "--run") == 0){
+			options.run = true;
+			useful = true;
+		} else if (strcmp(argv[i], "--parallel") == 0){
+			options.parallel = true;
+		} else if (strncmp(argv[i], "--parallel=", 11) == 0){
+			options.parallel = true;
+			options.threads = std::strtoul(argv[i] + 11, nullptr, 10);
+		} else if (strcmp(argv[i], "--serve") == 0){
+			serve = true;
+		} else if (strncmp(argv[i], "--serve=", 8) == 0){
+			serve = true;
+			socketPath = argv[i] + 8;
+		} else if (strncmp(argv[i], "--lexer=", 8) == 0){
+			if (!lexerKindFromString(argv[i] + 8, options.lexer)){
+				std::cerr << "Unknown lexer " << argv[i] + 8 << std::endl;
+				usageAndDie();
+			}
+		} else if (argv[i][0] == '-'){
 			if (argv[i][1] == 't'){
 				i++;
+				if (i >= argc){ usageAndDie(); }
 				tokensFile = argv[i];
 				useful = true;
-			} else if (argv[i][1] == 'p'){
+			} else if (argv[i][1] == 'S'){
 				i++;
-				checkParse = true;
+				if (i >= argc){ usageAndDie(); }
+				asmFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'I'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				irFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'O'){
+				options.optimize = true;
+			} else if (argv[i][1] == 'T'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				binTokensFile = argv[i];
+				useful = true;
+			} else if (argv[i][1] == 'p'){
+				options.checkParse = true;
+				useful = true;
+			} else if (argv[i][1] == 'n'){
+				options.checkNames = true;
 				useful = true;
 			} else if (argv[i][1] == 'u'){
 				i++;
 				if (i >= argc){ usageAndDie(); }
 				unparseFile = argv[i];
 				useful = true;
+			} else if (argv[i][1] == 'j'){
+				i++;
+				if (i >= argc){ usageAndDie(); }
+				threads = std::strtoul(argv[i], nullptr, 10);
+				batch = true;
 			} else {
 				std::cerr << "Unrecognized argument: ";
 				std::cerr << argv[i] << std::endl;
 				usageAndDie();
 			}
+		} else if (argv[i][0] == '@'){
+			readManifest(argv[i] + 1, inputs);
+			batch = true;
 		} else {
-			if (inFile == NULL){
-				inFile = argv[i];
-			} else {
-				std::cerr << "Only 1 input file allowed";
-				std::cerr << argv[i] << std::endl;
-				usageAndDie();
-			}
+			inputs.push_back(argv[i]);
+		}
+	}
+	if (serve){
+		if (!inputs.empty() || useful){ usageAndDie(); }
+		try {
+			return socketPath == NULL ? serveStdio(options.lexer)
+				: serveSocket(socketPath, options.lexer, threads);
+		} catch (InternalError * e){
+			std::cerr << "Error: " << e->msg() << std::endl;
+			exit(1);
 		}
 	}
-	if (inFile == NULL){
+	if (inputs.size() > 1){
+		batch = true;
+	}
+	if (inputs.empty() && !batch){
 		usageAndDie();
 	}
 	if (!useful){
@@ -140,28 +554,35 @@ main( const int argc, const char **argv )
 		usageAndDie();
 	}
 
-	if (tokensFile != NULL){
-		try {
-			writeTokenStream(inFile, tokensFile);
-		} catch (InternalError * e){
-			std::cerr << "Error: " << e->msg() << std::endl;
-		}
+	if (batch){
+		//Programs would be fighting over stdin and stdout
+		if (options.run){ usageAndDie(); }
+		//Inputs are already spread over the threads
+		if (options.parallel){ usageAndDie(); }
+		return runBatch(inputs, options, tokensFile, binTokensFile,
+			unparseFile, asmFile, irFile, statsFile, threads);
 	}
 
-	if (checkParse){
-		try {
-			if (!parse(inFile)){
-				std::cerr << "Parse failed" << std::endl;
-			}
-		} catch (ToDoError * e){
-			std::cerr << "ToDo: " << e->msg() << std::endl;
-			exit(1);
-		}
+	options.inFile = inputs[0];
+	if (tokensFile != NULL){ options.tokensFile = tokensFile; }
+	if (binTokensFile != NULL){ options.binTokensFile = binTokensFile; }
+	if (unparseFile != NULL){ options.unparseFile = unparseFile; }
+	if (asmFile != NULL){ options.asmFile = asmFile; }
+	if (irFile != NULL){ options.irFile = irFile; }
+	try {
+		compile(options);
+	} catch (ToDoError * e){
+		std::cerr << "ToDo: " << e->msg() << std::endl;
+		exit(1);
+	} catch (InternalError * e){
+		std::cerr << "Error: " << e->msg() << std::endl;
+		exit(1);
 	}
-
-	if (unparseFile != nullptr){
-		doUnparsing(inFile, unparseFile);
+	if (options.showStats){
+		reportStats(std::vector<Job *>{&options}, statsFile);
 	}
-	
-	return 0;
+
+	//A program that failed (or never ran or built) is an error;
+	// anything else is reported but, as ever, not the exit status
+	return (options.run || asmFile != NULL) && !options.ok ? 1 : 0;
 }
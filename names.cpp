@@ -0,0 +1,171 @@
+#include "errors.hpp"
+#include "names.hpp"
+#include "visitor.hpp"
+
+namespace crona{
+
+static const size_t FIRST_SLOTS = 256;
+
+ScopeTable::ScopeTable() : mySlots(FIRST_SLOTS, Slot{nullptr, NONE}),
+  myUsed(0){
+}
+
+void ScopeTable::enterScope(){
+	myScopes.push_back(static_cast<uint32_t>(myBindings.size()));
+}
+
+void ScopeTable::exitScope(){
+	size_t start = myScopes.back();
+	myScopes.pop_back();
+	while (myBindings.size() > start){
+		const Binding& b = myBindings.back();
+		mySlots[find(b.sym)].top = b.shadowed;
+		myBindings.pop_back();
+	}
+}
+
+size_t ScopeTable::find(const Symbol * sym) const{
+	size_t mask = mySlots.size() - 1;
+	size_t i = static_cast<size_t>(sym->hash()) & mask;
+	while (mySlots[i].sym != nullptr && mySlots[i].sym != sym){
+		i = (i + 1) & mask;
+	}
+	return i;
+}
+
+/*
+A slot stays with its name once the name has been seen, even when
+no binding of it is left in scope, so the table only ever holds as
+many names as the program uses and nothing is deleted.
+*/
+DeclNode * ScopeTable::declare(const Symbol * sym, DeclNode * decl){
+	uint32_t depth = static_cast<uint32_t>(myScopes.size());
+	size_t i = find(sym);
+	if (mySlots[i].sym == nullptr){
+		mySlots[i].sym = sym;
+		if (++myUsed * 2 > mySlots.size()){
+			grow();
+			i = find(sym);
+		}
+	}
+	Slot& slot = mySlots[i];
+	if (slot.top != NONE && myBindings[slot.top].depth == depth){
+		return myBindings[slot.top].decl;
+	}
+	myBindings.push_back(Binding{sym, decl, slot.top, depth});
+	slot.top = static_cast<uint32_t>(myBindings.size() - 1);
+	return nullptr;
+}
+
+DeclNode * ScopeTable::lookup(const Symbol * sym) const{
+	const Slot& slot = mySlots[find(sym)];
+	return slot.top == NONE ? nullptr : myBindings[slot.top].decl;
+}
+
+void ScopeTable::grow(){
+	std::vector<Slot> old(mySlots.size() * 2, Slot{nullptr, NONE});
+	old.swap(mySlots);
+	for (const Slot& slot : old){
+		if (slot.sym != nullptr){ mySlots[find(slot.sym)] = slot; }
+	}
+}
+
+/*
+Name analysis is one pass, the NameAnalysis below: declarations bind
+their names on the way down and every other identifier is looked up,
+in source order, so a name is only visible after its declaration.
+*/
+class NameAnalysis : public ASTVisitor<NameAnalysis>{
+public:
+	NameAnalysis() : myOk(true){}
+	bool ok() const { return myOk; }
+private:
+	friend class ASTVisitor<NameAnalysis>;
+
+	void visitProgramNode(ProgramNode * node);
+	void visitVarDeclNode(VarDeclNode * node);
+	void visitFormalDeclNode(FormalDeclNode * node);
+	void visitFnDeclNode(FnDeclNode * node);
+	void visitIDNode(IDNode * node);
+	void visitIfStmtNode(IfStmtNode * node);
+	void visitIfElseStmtNode(IfElseStmtNode * node);
+	void visitWhileStmtNode(WhileStmtNode * node);
+	/// Anything else just has its children resolved
+	template <typename T>
+	void visitNode(T * node){ visitChildren(node); }
+
+	void declare(IDNode * id, DeclNode * decl);
+	void block(NodeList<StmtNode>& stmts);
+
+	ScopeTable myScopes;
+	bool myOk;
+};
+
+bool analyzeNames(ProgramNode * ast){
+	NameAnalysis pass;
+	pass.visit(ast);
+	return pass.ok();
+}
+
+void NameAnalysis::declare(IDNode * id, DeclNode * decl){
+	id->setDecl(decl);
+	if (myScopes.declare(id->symbol(), decl) != nullptr){
+		Report::fatal(id->line(), id->col(), "Multiply declared identifier");
+		myOk = false;
+	}
+}
+
+void NameAnalysis::block(NodeList<StmtNode>& stmts){
+	myScopes.enterScope();
+	visitAll(stmts);
+	myScopes.exitScope();
+}
+
+void NameAnalysis::visitProgramNode(ProgramNode * node){
+	myScopes.enterScope();
+	visitAll(node->globals());
+	myScopes.exitScope();
+}
+
+void NameAnalysis::visitVarDeclNode(VarDeclNode * node){
+	declare(node->id(), node);
+}
+
+void NameAnalysis::visitFormalDeclNode(FormalDeclNode * node){
+	declare(node->id(), node);
+}
+
+void NameAnalysis::visitFnDeclNode(FnDeclNode * node){
+	declare(node->id(), node);
+	myScopes.enterScope();
+	visitAll(node->formals());
+	visitAll(node->body());
+	myScopes.exitScope();
+}
+
+void NameAnalysis::visitIDNode(IDNode * node){
+	DeclNode * decl = myScopes.lookup(node->symbol());
+	if (decl == nullptr){
+		Report::fatal(node->line(), node->col(), "Undeclared identifier");
+		myOk = false;
+	}
+	node->setDecl(decl);
+}
+
+void NameAnalysis::visitIfStmtNode(IfStmtNode * node){
+	visit(node->cond());
+	block(node->body());
+}
+
+void NameAnalysis::visitIfElseStmtNode(IfElseStmtNode * node){
+	visit(node->cond());
+	block(node->trueBranch());
+	block(node->falseBranch());
+}
+
+void NameAnalysis::visitWhileStmtNode(WhileStmtNode * node){
+	visit(node->cond());
+	block(node->body());
+}
+
+} //End namespace crona
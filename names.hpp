@@ -0,0 +1,75 @@
+#ifndef CRONA_NAMES_H
+#define CRONA_NAMES_H
+
+#include <cstdint>
+#include <vector>
+#include "ast.hpp"
+
+namespace crona{
+
+/**
+* \class ScopeTable
+* The declarations in scope at a point in the program, as one flat
+* hash table keyed by Symbol (interned names compare by pointer)
+* rather than a table per scope. Each slot holds the innermost
+* binding of its name, and each binding links to the one it shadows,
+* so a lookup is a single probe however deep the scopes are nested.
+* Leaving a scope pops the bindings made in it off a stack and puts
+* back what they shadowed. Every operation is expected O(1), so
+* resolving a program takes time linear in its size.
+**/
+class ScopeTable{
+public:
+	ScopeTable();
+
+	void enterScope();
+	void exitScope();
+
+	/**
+	* Bind sym to decl in the innermost scope. Returns what sym was
+	* already bound to in that scope, if anything, in which case the
+	* earlier binding is kept.
+	**/
+	DeclNode * declare(const Symbol * sym, DeclNode * decl);
+
+	/// What sym means here, or nullptr if it isn't declared
+	DeclNode * lookup(const Symbol * sym) const;
+private:
+	static const uint32_t NONE = UINT32_MAX;
+	struct Slot{
+		const Symbol * sym;
+		uint32_t top; //Index of sym's innermost binding, or NONE
+	};
+	struct Binding{
+		const Symbol * sym;
+		DeclNode * decl;
+		uint32_t shadowed; //The binding this one hides, or NONE
+		uint32_t depth;
+	};
+
+	/// The slot holding sym, or the empty slot where it would go
+	size_t find(const Symbol * sym) const;
+	void grow();
+
+	std::vector<Slot> mySlots;
+	size_t myUsed;
+	std::vector<Binding> myBindings;
+	std::vector<uint32_t> myScopes; //myBindings.size() on entry to each
+};
+
+/**
+* Resolve every identifier in ast: each IDNode's decl() is set to the
+* VarDeclNode, FormalDeclNode or FnDeclNode it names. Globals and
+* functions are in one scope, a function's formals and body in one
+* of its own, and each if, else and while body is a scope too. A name
+* is in scope from its declaration to the end of the enclosing scope,
+* so a function can call itself and those declared before it.
+* Undeclared and multiply declared identifiers are reported, and
+* then left unresolved and unbound respectively. Returns false if
+* anything was reported.
+**/
+bool analyzeNames(ProgramNode * ast);
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,101 @@
+#include <cerrno>
+#include <unistd.h>
+#include "outbuf.hpp"
+
+namespace crona{
+
+//Deep enough for any sane program; deeper nesting takes more writes
+static const char TABS[] =
+	"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t"
+	"\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t\t";
+static const size_t NUM_TABS = sizeof(TABS) - 1;
+
+OutBuf::OutBuf(int fd)
+: myBuf(new char[CAPACITY]), myLen(0), myFd(fd), myStream(nullptr),
+  myString(nullptr), myFailed(false){
+}
+
+OutBuf::OutBuf(std::ostream& out)
+: myBuf(new char[CAPACITY]), myLen(0), myFd(-1), myStream(&out),
+  myString(nullptr), myFailed(false){
+}
+
+OutBuf::OutBuf(std::string& out)
+: myBuf(new char[CAPACITY]), myLen(0), myFd(-1), myStream(nullptr),
+  myString(&out), myFailed(false){
+}
+
+OutBuf::~OutBuf(){
+	flush();
+	delete [] myBuf;
+}
+
+OutBuf& OutBuf::operator<<(int value){
+	char digits[16];
+	size_t pos = sizeof(digits);
+	//Work in unsigned so that INT_MIN negates cleanly
+	unsigned int mag = value < 0 ? 0u - static_cast<unsigned int>(value)
+		: static_cast<unsigned int>(value);
+	do {
+		digits[--pos] = static_cast<char>('0' + mag % 10);
+		mag /= 10;
+	} while (mag != 0);
+	if (value < 0){ digits[--pos] = '-'; }
+	return write(digits + pos, sizeof(digits) - pos);
+}
+
+OutBuf& OutBuf::indent(int depth){
+	size_t left = depth < 0 ? 0 : static_cast<size_t>(depth);
+	while (left > 0){
+		size_t len = left < NUM_TABS ? left : NUM_TABS;
+		write(TABS, len);
+		left -= len;
+	}
+	return *this;
+}
+
+bool OutBuf::flush(){
+	drain();
+	if (myStream != nullptr){ myStream->flush(); }
+	return !myFailed;
+}
+
+void OutBuf::writeLong(const char * text, size_t len){
+	drain();
+	if (len >= CAPACITY){
+		emit(text, len);
+	} else {
+		std::memcpy(myBuf, text, len);
+		myLen = len;
+	}
+}
+
+void OutBuf::drain(){
+	emit(myBuf, myLen);
+	myLen = 0;
+}
+
+void OutBuf::emit(const char * text, size_t len){
+	if (len == 0 || myFailed){ return; }
+	if (myString != nullptr){
+		myString->append(text, len);
+		return;
+	}
+	if (myStream != nullptr){
+		myStream->write(text, static_cast<std::streamsize>(len));
+		if (!myStream->good()){ myFailed = true; }
+		return;
+	}
+	while (len > 0){
+		ssize_t wrote = ::write(myFd, text, len);
+		if (wrote < 0){
+			if (errno == EINTR){ continue; }
+			myFailed = true;
+			return;
+		}
+		text += wrote;
+		len -= static_cast<size_t>(wrote);
+	}
+}
+
+} //End namespace crona
@@ -0,0 +1,80 @@
+#ifndef CRONA_OUTBUF_H
+#define CRONA_OUTBUF_H
+
+#include <cstddef>
+#include <cstring>
+#include <ostream>
+#include <string>
+#include "tokens.hpp"
+
+namespace crona{
+
+/**
+* \class OutBuf
+* Output sink for unparsing. Text is appended to one large buffer
+* with plain memcpys, and the buffer is handed on in big blocks:
+* straight to a file descriptor with write(2), or into a
+* std::ostream when that's where the output has to go. This skips
+* the per-fragment sentry and locale work of ostream::operator<<,
+* which dominates unparsing large programs. It can also append to a
+* string, for output that has to be put together before it goes out.
+**/
+class OutBuf{
+public:
+	/// Write to fd (which the OutBuf does not own or close)
+	explicit OutBuf(int fd);
+	/// Write into out
+	explicit OutBuf(std::ostream& out);
+	/// Append to out
+	explicit OutBuf(std::string& out);
+	~OutBuf();
+	OutBuf(const OutBuf&) = delete;
+	OutBuf& operator=(const OutBuf&) = delete;
+
+	OutBuf& write(const char * text, size_t len){
+		if (len <= CAPACITY - myLen){
+			std::memcpy(myBuf + myLen, text, len);
+			myLen += len;
+		} else {
+			writeLong(text, len);
+		}
+		return *this;
+	}
+
+	OutBuf& operator<<(const char * text){
+		return write(text, std::strlen(text));
+	}
+	OutBuf& operator<<(StrView text){
+		return write(text.data(), text.size());
+	}
+	OutBuf& operator<<(char ch){
+		if (myLen == CAPACITY){ drain(); }
+		myBuf[myLen++] = ch;
+		return *this;
+	}
+	OutBuf& operator<<(int value);
+
+	/// Start a line at the given depth (one tab per level)
+	OutBuf& indent(int depth);
+
+	/// Hand everything buffered so far to the destination.
+	/// Returns false if any write has failed.
+	bool flush();
+private:
+	static const size_t CAPACITY = 64 * 1024;
+
+	void writeLong(const char * text, size_t len);
+	void drain();
+	void emit(const char * text, size_t len);
+
+	char * myBuf;
+	size_t myLen;
+	int myFd;
+	std::ostream * myStream;
+	std::string * myString;
+	bool myFailed;
+};
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,726 @@
+/*
+In-process golden test runner.
+
+For every X.crona in the given directory (default: .), compiles it
+the way `cronac X.crona -u X.unparse 2> X.err` would, but inside
+this process and on a thread pool, then compares the unparse output
+and the diagnostics against X.unparse.expected and X.err.expected.
+Comparison follows `diff -B --ignore-all-space`: whitespace within
+lines and blank lines don't matter. The actual output of a failing
+test is written to X.unparse / X.err for inspection.
+
+Every input is also lexed by both scanners (flex and the
+hand-written one, see fastscan.hpp), which must agree token for
+token, position for position, and on every diagnostic. Setting
+CRONA_SCAN_KERNELS picks which SIMD kernels the latter uses.
+
+Every input is also compiled twice through an AST cache: the
+second run must load the tree from the cache, with the same output,
+diagnostics and node positions as the first.
+
+Each worker also keeps a CompileServer (cronac --serve) across the
+tests it runs, which must give the same output and diagnostics as
+a fresh compile for every test.
+
+Finally, every input that parses is put through a series of edits
+(each declaration deleted and put back, lines inserted above it and
+removed, ...) with IncrementalParse, which after each one must have
+the same AST (by unparse) and declaration spans as parsing the
+edited text from scratch.
+
+Every input that parses is also unparsed with its declarations
+spread over threads (cronac --parallel), which must give exactly
+what unparsing serially does.
+
+Every input that parses is also constant folded, once its names are
+resolved (cronac -n --fold), which must give X.fold.expected where
+there is one, and must leave nothing to fold: parsing and folding
+the folded unparse again changes nothing.
+
+Name analysis (cronac -n) runs on every input that builds an AST,
+and must report X.names.expected where there is one. Every
+identifier it resolves must be linked to a declaration of that
+name.
+
+Where there is an X.run.expected, the program is run (cronac --run)
+with X.in, if there is one, as its input, and what it writes, then
+any runtime error, must match it exactly. It is run three ways, all
+of which must agree: with threaded dispatch, with the switch, and
+without superinstructions. Given --native, it is also compiled to
+x86-64 (cronac -S), assembled and linked with the runtime object
+(by cc) and run, and must write exactly what it did on the VM.
+
+Those programs are also put into SSA form (cronac -I), which must be
+sound after each optimization pass, and must match X.ir.expected
+once optimized (cronac -O -I) where there is one, whether the
+functions are optimized one by one or in parallel. The optimized
+program, lowered back to bytecode (cronac -O --run, and -O -S given
+--native), must write exactly what the original did.
+
+Last, they are constant folded and run again (cronac --fold --run),
+which must also write exactly what the original did.
+
+Usage: runner [-j threads] [--native=<cronart.o>] [dir]
+*/
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <unistd.h>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "astcache.hpp"
+#include "errors.hpp"
+#include "fold.hpp"
+#include "incremental.hpp"
+#include "ir.hpp"
+#include "names.hpp"
+#include "pipeline.hpp"
+#include "server.hpp"
+#include "threadpool.hpp"
+#include "visitor.hpp"
+#include "vm.hpp"
+#include "x86.hpp"
+
+using namespace crona;
+
+namespace {
+
+//The runtime to link compiled programs with, if they're to be run
+std::string nativeRuntime;
+
+struct TestCase{
+	std::string name;
+	std::string dir;
+	bool passed = false;
+	std::string failure;
+	std::string unparsed;
+	std::string errs;
+	double millis = 0;
+};
+
+std::string pathOf(const TestCase& test, const char * ext){
+	return test.dir + "/" + test.name + ext;
+}
+
+bool readFile(const std::string& path, std::string& contents){
+	std::ifstream in(path, std::ios::binary);
+	if (!in.good()){ return false; }
+	std::ostringstream buf;
+	buf << in.rdbuf();
+	contents = buf.str();
+	return true;
+}
+
+void writeFile(const std::string& path, const std::string& contents){
+	std::ofstream out(path, std::ios::binary);
+	out << contents;
+}
+
+//The lines of text with all whitespace removed, minus blank lines
+std::vector<std::string> normalize(const std::string& text){
+	std::vector<std::string> lines;
+	std::string line;
+	for (char ch : text){
+		if (ch == '\n'){
+			if (!line.empty()){ lines.push_back(line); }
+			line.clear();
+		} else if (!std::isspace(static_cast<unsigned char>(ch))){
+			line += ch;
+		}
+	}
+	if (!line.empty()){ lines.push_back(line); }
+	return lines;
+}
+
+bool sameText(const std::string& actual, const std::string& expected,
+	const char * what, std::string& failure){
+	std::vector<std::string> a = normalize(actual);
+	std::vector<std::string> e = normalize(expected);
+	if (a == e){ return true; }
+	size_t i = 0;
+	while (i < a.size() && i < e.size() && a[i] == e[i]){ i++; }
+	failure += std::string(what) + " differs at line " + std::to_string(i + 1)
+		+ " (ignoring whitespace)\n"
+		+ "  expected: " + (i < e.size() ? e[i] : "<end>") + "\n"
+		+ "  actual:   " + (i < a.size() ? a[i] : "<end>") + "\n";
+	return false;
+}
+
+//The token dump and diagnostics from lexing test with one scanner
+std::string lexWith(const TestCase& test, LexerKind lexer){
+	std::ostringstream out;
+	Report::redirect(&out);
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		pipeline.useLexer(lexer);
+		pipeline.teeTokens(&out);
+		pipeline.run(false);
+	} catch (InternalError * e){
+		out << "Error: " << e->msg() << std::endl;
+	}
+	Report::redirect(nullptr);
+	return out.str();
+}
+
+void compareLexers(TestCase& test){
+	std::string flex = lexWith(test, LexerKind::FLEX);
+	std::string fast = lexWith(test, LexerKind::FAST);
+	if (flex == fast){ return; }
+	std::istringstream flexLines(flex);
+	std::istringstream fastLines(fast);
+	std::string flexLine;
+	std::string fastLine;
+	size_t line = 0;
+	do {
+		line++;
+		if (!std::getline(flexLines, flexLine)){ flexLine = "<end>"; }
+		if (!std::getline(fastLines, fastLine)){ fastLine = "<end>"; }
+	} while (flexLine == fastLine);
+	test.failure += "lexers differ at token line " + std::to_string(line)
+		+ "\n  flex: " + flexLine + "\n  fast: " + fastLine + "\n";
+}
+
+void compareCache(TestCase& test){
+	char dirName[] = "/tmp/crona-cache.XXXXXX";
+	if (mkdtemp(dirName) == nullptr){
+		test.failure += "can't create an AST cache directory\n";
+		return;
+	}
+	std::string path = pathOf(test, ".crona");
+	std::string trees[2];
+	for (int run = 0; run < 2; run++){
+		std::ostringstream out;
+		std::ostringstream errs;
+		Report::redirect(&errs);
+		try {
+			Pipeline pipeline(path.c_str());
+			pipeline.useCache(dirName);
+			if (pipeline.run(true)){
+				pipeline.ast()->unparse(out, 0);
+				ASTWriter writer;
+				writer.save(pipeline.ast());
+				trees[run] = writer.names() + writer.tree();
+				if (run == 1 && !pipeline.cached()){
+					test.failure += "AST cache missed on the second run\n";
+				}
+			} else {
+				Report::stream() << "No AST built\n";
+			}
+		} catch (InternalError * e){
+			errs << "Error: " << e->msg() << std::endl;
+		}
+		Report::redirect(nullptr);
+		if (out.str() != test.unparsed || errs.str() != test.errs){
+			test.failure += "AST cache run " + std::to_string(run + 1)
+				+ " differs from a plain compile\n";
+		}
+		if (run == 1 && trees[0] != trees[1]){
+			test.failure += "AST loaded from the cache differs\n";
+		}
+	}
+	SourceFile source(path.c_str());
+	unlink(ASTCache(dirName, source).path().c_str());
+	rmdir(dirName);
+}
+
+void compareServer(TestCase& test){
+	static thread_local CompileServer server(LexerKind::FLEX);
+	std::string text;
+	if (!readFile(pathOf(test, ".crona"), text)){ return; }
+	std::string out;
+	std::string errs;
+	server.compile(CompileServer::Command::UNPARSE,
+		CompileServer::Input::TEXT, text, out, errs);
+	if (out != test.unparsed || errs != test.errs){
+		test.failure += "server unparse differs from a fresh compile\n";
+	}
+	server.compile(CompileServer::Command::TOKENS,
+		CompileServer::Input::PATH, pathOf(test, ".crona"), out, errs);
+	std::ostringstream tokens;
+	std::ostringstream lexErrs;
+	Report::redirect(&lexErrs);
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		pipeline.teeTokens(&tokens);
+		pipeline.run(false);
+	} catch (InternalError * e){
+		lexErrs << "Error: " << e->msg() << std::endl;
+	}
+	Report::redirect(nullptr);
+	if (out != tokens.str() || errs != lexErrs.str()){
+		test.failure += "server tokens differ from a fresh compile\n";
+	}
+}
+
+std::string unparsed(ProgramNode * ast){
+	std::ostringstream out;
+	if (ast != nullptr){ ast->unparse(out, 0); }
+	return out.str();
+}
+
+bool sameSpans(const IncrementalParse& a, const IncrementalParse& b){
+	if (a.spans().size() != b.spans().size()){ return false; }
+	for (size_t i = 0; i < a.spans().size(); i++){
+		const IncrementalParse::Span& x = a.spans()[i];
+		const IncrementalParse::Span& y = b.spans()[i];
+		if (x.begin != y.begin || x.end != y.end || x.line != y.line
+		  || x.col != y.col || x.hash != y.hash){
+			return false;
+		}
+	}
+	return true;
+}
+
+//Apply one edit, then compare against a parse from scratch
+bool editMatches(IncrementalParse& inc, size_t offset, size_t len,
+	const std::string& text, const std::string& what, TestCase& test){
+	inc.edit(offset, len, text);
+	IncrementalParse fresh(inc.text());
+	if ((inc.ast() == nullptr) == (fresh.ast() == nullptr)
+	  && unparsed(inc.ast()) == unparsed(fresh.ast())
+	  && sameSpans(inc, fresh)){
+		return true;
+	}
+	test.failure += "incremental reparse differs from a full parse after "
+		+ what + "\n";
+	return false;
+}
+
+void compareIncremental(TestCase& test){
+	std::string text;
+	if (!readFile(pathOf(test, ".crona"), text)){ return; }
+	std::ostringstream quiet;
+	Report::redirect(&quiet);
+	IncrementalParse inc(text);
+	size_t decls = inc.spans().size();
+	for (size_t k = 0; inc.ast() != nullptr && k < decls; k++){
+		IncrementalParse::Span span = inc.spans()[k];
+		std::string decl = inc.text().substr(span.begin, span.end - span.begin);
+		std::string at = " declaration " + std::to_string(k + 1);
+		bool ok = editMatches(inc, span.begin, decl.size(), "",
+			  "deleting" + at, test)
+			&& editMatches(inc, span.begin, 0, decl, "restoring" + at, test)
+			&& editMatches(inc, span.begin, 0, "\n\n", "adding lines above" + at, test)
+			&& editMatches(inc, span.begin, 2, "", "removing them again", test)
+			&& editMatches(inc, span.begin, 0, "// ", "commenting out" + at, test)
+			&& editMatches(inc, span.begin, 3, "", "uncommenting" + at, test)
+			&& editMatches(inc, span.end - 1, 1, "", "truncating" + at, test)
+			&& editMatches(inc, span.end - 1, 0, decl.substr(decl.size() - 1),
+			  "completing" + at, test);
+		if (!ok){ break; }
+	}
+	Report::redirect(nullptr);
+}
+
+void compareFold(TestCase& test){
+	std::ostringstream quiet;
+	Report::redirect(&quiet);
+	std::string folded;
+	std::string refolded;
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		if (pipeline.run(true)){
+			analyzeNames(pipeline.ast());
+			foldConstants(pipeline.ast());
+			folded = unparsed(pipeline.ast());
+			IncrementalParse again(folded);
+			if (again.ast() != nullptr){
+				analyzeNames(again.ast());
+				foldConstants(again.ast());
+			}
+			refolded = unparsed(again.ast());
+		}
+	} catch (InternalError * e){
+		test.failure += "folding failed: " + e->msg() + "\n";
+	}
+	Report::redirect(nullptr);
+	std::string expected;
+	if (readFile(pathOf(test, ".fold.expected"), expected)){
+		sameText(folded, expected, "folded unparse", test.failure);
+	}
+	if (refolded != folded){
+		test.failure += "folding the folded unparse changes it\n";
+	}
+}
+
+//Counts the identifiers linked to a declaration of another name
+class LinkCheck : public ASTVisitor<LinkCheck>{
+public:
+	size_t wrong = 0;
+
+	template <typename T>
+	void visitNode(T * node){ visitChildren(node); }
+
+	void visitIDNode(IDNode * node){
+		DeclNode * decl = node->decl();
+		if (decl == nullptr){ return; }
+		IDNode * declared = decl->kind() == NodeKind::FnDeclNode
+			? static_cast<FnDeclNode *>(decl)->id()
+			: static_cast<VarDeclNode *>(decl)->id();
+		if (declared->symbol() != node->symbol()){ wrong++; }
+	}
+};
+
+void compareNames(TestCase& test){
+	std::ostringstream quiet;
+	std::ostringstream errs;
+	Report::redirect(&quiet);
+	LinkCheck links;
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		pipeline.run(true);
+		if (pipeline.ast() != nullptr){
+			Report::redirect(&errs);
+			analyzeNames(pipeline.ast());
+			links.visit(pipeline.ast());
+		}
+	} catch (InternalError * e){
+		test.failure += "name analysis failed: " + e->msg() + "\n";
+	}
+	Report::redirect(nullptr);
+	std::string expected;
+	if (readFile(pathOf(test, ".names.expected"), expected)){
+		sameText(errs.str(), expected, "name analysis", test.failure);
+	}
+	if (links.wrong > 0){
+		test.failure += std::to_string(links.wrong)
+			+ " identifiers linked to the wrong declaration\n";
+	}
+}
+
+//What the program writes, then any error
+std::string runModule(const Module& module, const std::string& input,
+	bool threaded){
+	std::ostringstream out;
+	Report::redirect(&out);
+	std::istringstream in(input);
+	OutBuf buf(out);
+	VM vm(module, in, buf);
+	vm.run(threaded);
+	buf.flush();
+	Report::redirect(nullptr);
+	return out.str();
+}
+
+//The same, run one way
+std::string runWith(ProgramNode * ast, const std::string& input,
+	bool threaded, bool superinstructions){
+	std::ostringstream errs;
+	Report::redirect(&errs);
+	Module module;
+	bool lowered = lowerProgram(ast, module, superinstructions);
+	Report::redirect(nullptr);
+	if (!lowered){ return errs.str(); }
+	return runModule(module, input, threaded);
+}
+
+void compareNative(TestCase& test, const Module& module, const char * how,
+	const std::string& ran){
+	char dirName[] = "/tmp/crona-native.XXXXXX";
+	if (mkdtemp(dirName) == nullptr){
+		test.failure += "can't create a directory to build in\n";
+		return;
+	}
+	std::string dir = dirName;
+	std::string asmPath = dir + "/" + test.name + ".s";
+	std::string exePath = dir + "/" + test.name;
+	std::string outPath = dir + "/out";
+	std::string errPath = dir + "/cc.err";
+	{
+		std::ofstream file(asmPath);
+		OutBuf out(file);
+		emitX86(module, out);
+	}
+	std::string build = "cc -o " + exePath + " " + asmPath + " "
+		+ nativeRuntime + " 2> " + errPath;
+	std::string in;
+	std::string input = pathOf(test, ".in");
+	std::string run = exePath + " < "
+		+ (readFile(input, in) ? input : std::string("/dev/null"))
+		+ " > " + outPath + " 2>&1";
+	std::string written;
+	std::string prefix = std::string(how) + ": ";
+	if (std::system(build.c_str()) != 0){
+		std::string errs;
+		readFile(errPath, errs);
+		test.failure += prefix + "assembly doesn't build:\n" + errs;
+	} else if (std::system(run.c_str()) == -1 || !readFile(outPath, written)){
+		test.failure += prefix + "can't run the program\n";
+	} else if (written != ran){
+		test.failure += prefix + "output differs from the VM's\n";
+		sameText(written, ran, "native output", test.failure);
+	}
+	for (const std::string& path : {asmPath, exePath, outPath, errPath}){
+		unlink(path.c_str());
+	}
+	rmdir(dirName);
+}
+
+/*
+Build the IR of the lowered program, checking it after each pass,
+compare the optimized IR with X.ir.expected (if any), then lower it
+back to bytecode and run that, which must write what the program
+did before.
+*/
+void compareIR(TestCase& test, const Module& module, const std::string& input,
+	const std::string& ran){
+	IRModule ir;
+	buildIR(module, ir);
+	void (* const passes[])(IRFunction&) = {propagateCopies, propagateConstants,
+		eliminateCommonSubexpressions, propagateCopies, eliminateDeadCode};
+	const char * names[] = {"building", "copy propagation",
+		"constant propagation", "CSE", "copy propagation", "DCE"};
+	for (IRFunction& fn : ir.functions){
+		for (size_t p = 0; p <= sizeof(passes) / sizeof(passes[0]); p++){
+			if (p > 0){ passes[p - 1](fn); }
+			std::string why;
+			if (!fn.verify(why)){
+				test.failure += std::string("IR after ") + names[p] + " in "
+					+ std::string(fn.source->name->name().data(),
+						fn.source->name->name().size())
+					+ ": " + why + "\n";
+				return;
+			}
+		}
+	}
+	std::string dumped;
+	{
+		OutBuf out(dumped);
+		ir.dump(out);
+	}
+	std::string expected;
+	if (readFile(pathOf(test, ".ir.expected"), expected)){
+		sameText(dumped, expected, "optimized IR", test.failure);
+	}
+	IRModule parallel;
+	buildIR(module, parallel);
+	{
+		ThreadPool pool(3);
+		optimizeIR(parallel, &pool);
+	}
+	std::string parallelDump;
+	{
+		OutBuf out(parallelDump);
+		parallel.dump(out);
+	}
+	if (parallelDump != dumped){
+		test.failure += "optimizing functions in parallel differs\n";
+	}
+	for (bool superinstructions : {true, false}){
+		Module optimized = module;
+		lowerIR(ir, optimized, superinstructions);
+		if (runModule(optimized, input, true) != ran){
+			test.failure += superinstructions ? "optimized program differs\n"
+				: "optimized program without superinstructions differs\n";
+		}
+		if (superinstructions && !nativeRuntime.empty()){
+			compareNative(test, optimized, "optimized native", ran);
+		}
+	}
+}
+
+void compareRun(TestCase& test){
+	std::string expected;
+	if (!readFile(pathOf(test, ".run.expected"), expected)){ return; }
+	std::string input;
+	readFile(pathOf(test, ".in"), input);
+	std::ostringstream quiet;
+	Report::redirect(&quiet);
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		if (!pipeline.run(true) || !analyzeNames(pipeline.ast())){
+			Report::redirect(nullptr);
+			test.failure += "can't run a program that doesn't resolve\n";
+			return;
+		}
+		Report::redirect(nullptr);
+		std::string ran = runWith(pipeline.ast(), input, true, true);
+		if (ran != expected
+		  && sameText(ran, expected, "run output", test.failure)){
+			test.failure += "run output differs in whitespace\n";
+		}
+		if (runWith(pipeline.ast(), input, false, true) != ran){
+			test.failure += "switch dispatch differs from threaded\n";
+		}
+		if (runWith(pipeline.ast(), input, true, false) != ran){
+			test.failure += "running without superinstructions differs\n";
+		}
+		Module module;
+		Report::redirect(&quiet);
+		bool lowered = lowerProgram(pipeline.ast(), module);
+		Report::redirect(nullptr);
+		if (!lowered){
+			test.failure += "can't lower the program\n";
+			return;
+		}
+		if (!nativeRuntime.empty()){ compareNative(test, module, "native", ran); }
+		compareIR(test, module, input, ran);
+		foldConstants(pipeline.ast());
+		if (runWith(pipeline.ast(), input, true, true) != ran){
+			test.failure += "running the folded program differs\n";
+		}
+	} catch (InternalError * e){
+		Report::redirect(nullptr);
+		test.failure += "running failed: " + e->msg() + "\n";
+	}
+}
+
+//Unparsing with the declarations spread over threads changes nothing
+void compareParallel(TestCase& test){
+	std::ostringstream quiet;
+	Report::redirect(&quiet);
+	Pipeline pipeline(pathOf(test, ".crona").c_str());
+	bool parsed = pipeline.run(true);
+	Report::redirect(nullptr);
+	if (!parsed){ return; }
+	std::string serial;
+	std::string parallel;
+	{
+		OutBuf out(serial);
+		pipeline.ast()->unparse(out, 0);
+	}
+	{
+		ThreadPool pool(3);
+		OutBuf out(parallel);
+		pipeline.ast()->unparseParallel(out, pool);
+	}
+	if (parallel != serial){
+		test.failure += "parallel unparse differs from serial\n";
+	}
+}
+
+void runTest(TestCase& test){
+	auto start = std::chrono::steady_clock::now();
+
+	std::ostringstream out;
+	std::ostringstream errs;
+	Report::redirect(&errs);
+	bool crashed = false;
+	try {
+		Pipeline pipeline(pathOf(test, ".crona").c_str());
+		if (pipeline.run(true)){
+			pipeline.ast()->unparse(out, 0);
+		} else {
+			Report::stream() << "No AST built\n";
+		}
+	} catch (ToDoError * e){
+		errs << "ToDo: " << e->msg() << std::endl;
+		crashed = true;
+	} catch (InternalError * e){
+		errs << "Error: " << e->msg() << std::endl;
+		crashed = true;
+	}
+	Report::redirect(nullptr);
+
+	test.unparsed = out.str();
+	test.errs = errs.str();
+	if (crashed){
+		test.failure = "cronac error:\n" + test.errs;
+	} else {
+		std::string expectedOut;
+		std::string expectedErr;
+		if (!readFile(pathOf(test, ".unparse.expected"), expectedOut)){
+			test.failure += "missing " + test.name + ".unparse.expected\n";
+		} else {
+			sameText(test.unparsed, expectedOut, "unparse", test.failure);
+		}
+		if (!readFile(pathOf(test, ".err.expected"), expectedErr)){
+			test.failure += "missing " + test.name + ".err.expected\n";
+		} else {
+			sameText(test.errs, expectedErr, "stderr", test.failure);
+		}
+		compareLexers(test);
+		compareCache(test);
+		compareServer(test);
+		compareIncremental(test);
+		compareParallel(test);
+		compareFold(test);
+		compareNames(test);
+		compareRun(test);
+	}
+	test.passed = test.failure.empty();
+
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - start;
+	test.millis = elapsed.count();
+}
+
+std::vector<std::string> findTests(const std::string& dir){
+	std::vector<std::string> names;
+	DIR * handle = opendir(dir.c_str());
+	if (handle == nullptr){ return names; }
+	const std::string ext = ".crona";
+	while (struct dirent * entry = readdir(handle)){
+		std::string file = entry->d_name;
+		if (file.size() > ext.size()
+		  && file.compare(file.size() - ext.size(), ext.size(), ext) == 0){
+			names.push_back(file.substr(0, file.size() - ext.size()));
+		}
+	}
+	closedir(handle);
+	std::sort(names.begin(), names.end());
+	return names;
+}
+
+}
+
+int main(int argc, char * argv[]){
+	std::string dir = ".";
+	size_t threads = 0;
+	for (int i = 1; i < argc; i++){
+		if (std::strcmp(argv[i], "-j") == 0 && i + 1 < argc){
+			threads = std::strtoul(argv[++i], nullptr, 10);
+		} else if (std::strncmp(argv[i], "--native=", 9) == 0){
+			nativeRuntime = argv[i] + 9;
+		} else {
+			dir = argv[i];
+		}
+	}
+
+	std::vector<std::unique_ptr<TestCase>> tests;
+	for (const std::string& name : findTests(dir)){
+		std::unique_ptr<TestCase> test(new TestCase());
+		test->name = name;
+		test->dir = dir;
+		tests.push_back(std::move(test));
+	}
+	if (tests.empty()){
+		std::cerr << "No .crona tests found in " << dir << "\n";
+		return 1;
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	{
+		ThreadPool pool(threads);
+		for (auto& test : tests){
+			TestCase * current = test.get();
+			pool.submit([current]{ runTest(*current); });
+		}
+		pool.wait();
+	}
+	std::chrono::duration<double, std::milli> elapsed =
+		std::chrono::steady_clock::now() - start;
+
+	size_t failed = 0;
+	for (auto& test : tests){
+		std::cout << "TEST " << test->name << " "
+			<< (test->passed ? "ok" : "FAILED")
+			<< " (" << test->millis << " ms)\n";
+		if (!test->passed){
+			failed++;
+			std::cout << test->failure;
+			writeFile(pathOf(*test, ".unparse"), test->unparsed);
+			writeFile(pathOf(*test, ".err"), test->errs);
+		}
+	}
+	std::cout << tests.size() - failed << "/" << tests.size()
+		<< " passed in " << elapsed.count() << " ms\n";
+	return failed == 0 ? 0 : 1;
+}
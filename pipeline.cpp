@@ -0,0 +1,91 @@
+#include "astcache.hpp"
+#include "errors.hpp"
+#include "pipeline.hpp"
+#include "scanner.hpp"
+
+namespace crona{
+
+Pipeline::Pipeline(const char * inPath)
+: mySource(new SourceFile(inPath)), myScanner(nullptr),
+  myRoot(nullptr), myStats(nullptr), myWantTokens(false),
+  myCached(false), myParsed(false), myRan(false){
+	myScanner = new Scanner(mySource);
+}
+
+Pipeline::~Pipeline(){
+	delete myRoot;
+	delete myScanner;
+}
+
+void Pipeline::teeTokens(std::ostream * out){
+	myScanner->teeTokens(out);
+	myWantTokens = true;
+}
+
+void Pipeline::dumpTokens(TokenWriter * out){
+	myScanner->dumpTokens(out);
+	myWantTokens = true;
+}
+
+void Pipeline::useLexer(LexerKind kind){
+	myScanner->useLexer(kind);
+}
+
+void Pipeline::keepStats(Stats * stats){
+	myStats = stats;
+	myScanner->keepStats(stats);
+}
+
+void Pipeline::useCache(const std::string& dir){
+	myCacheDir = dir;
+}
+
+bool Pipeline::run(bool wantAST){
+	if (myRan){ return !wantAST || myParsed; }
+	myRan = true;
+
+	Stats::Clock clock;
+	std::unique_ptr<ASTCache> cache;
+	if (wantAST && !myCacheDir.empty()){
+		cache.reset(new ASTCache(myCacheDir, *mySource));
+		if (!myWantTokens){ myRoot = cache->load(myStats); }
+		if (myRoot != nullptr){
+			myCached = true;
+			myParsed = true;
+			if (myStats != nullptr){
+				myStats->frontEnd(clock);
+				myStats->noteAST(myRoot);
+			}
+			return true;
+		}
+	}
+
+	bool ok = true;
+	if (wantAST){
+		//A cache entry records the diagnostics, to report them
+		// again whenever it is used
+		std::unique_ptr<HeldReports> held;
+		if (cache){ held.reset(new HeldReports()); }
+		crona::Parser parser(*myScanner, &myRoot);
+		//After syntax errors, myRoot may still hold what did parse
+		ok = parser.parse() == 0;
+		myParsed = ok;
+		if (held){
+			if (ok){ cache->store(myRoot, held->text()); }
+			held->release();
+		}
+	}
+
+	//The parser may give up on a badly broken input (and never
+	// needs to look past END), so finish off any token dump
+	// ourselves
+	myScanner->drainTokens();
+
+	if (myStats != nullptr){
+		myStats->frontEnd(clock);
+		myStats->noteAST(myRoot);
+	}
+	return ok;
+}
+
+} //End namespace crona
@@ -0,0 +1,83 @@
+#ifndef CRONA_PIPELINE_H
+#define CRONA_PIPELINE_H
+
+#include <memory>
+#include <ostream>
+#include <string>
+#include "ast.hpp"
+#include "fastscan.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "tokdump.hpp"
+
+namespace crona{
+
+class Scanner;
+
+/**
+* \class Pipeline
+* Drives the front end over one input file exactly once. The source
+* is mapped and lexed a single time: when a token sink is set, every
+* token the parser pulls is written there too, and the AST built by
+* that one parse is shared by every later phase (parse check, unparse,
+* ...). The pipeline owns the AST. The input may also be a binary
+* token dump, whose tokens are then fed to the parser as they are.
+* With an AST cache, an input parsed before comes straight from the
+* cache and isn't lexed at all (unless its tokens are wanted).
+**/
+class Pipeline{
+public:
+	Pipeline(const char * inPath);
+	~Pipeline();
+	Pipeline(const Pipeline&) = delete;
+	Pipeline& operator=(const Pipeline&) = delete;
+
+	/// Also write the token stream to out as the input is lexed
+	void teeTokens(std::ostream * out);
+
+	/// Also write a binary token dump to out (see tokdump.hpp)
+	void dumpTokens(TokenWriter * out);
+
+	/// Lex with the given scanner (flex unless told otherwise)
+	void useLexer(LexerKind kind);
+
+	/// Record scan and parse statistics for the run into stats
+	void keepStats(Stats * stats);
+
+	/// Look the AST up in, and save it to, the cache in dir (see
+	/// astcache.hpp)
+	void useCache(const std::string& dir);
+
+	/**
+	* Lex the whole input, parsing it as well if wantAST is set.
+	* Returns false if a parse was requested and failed. The parser
+	* recovers from most syntax errors, reporting each, so one run
+	* reports them all.
+	**/
+	bool run(bool wantAST);
+
+	/**
+	* The AST from run(true), or nullptr if there isn't one. After
+	* syntax errors it is what did parse: the declarations and
+	* statements the errors were in are left out, so the tree is
+	* whole as far as later passes can tell.
+	**/
+	ProgramNode * ast(){ return myRoot; }
+
+	/// Whether the AST came from the cache
+	bool cached() const { return myCached; }
+private:
+	std::shared_ptr<SourceFile> mySource;
+	Scanner * myScanner;
+	ProgramNode * myRoot;
+	Stats * myStats;
+	std::string myCacheDir;
+	bool myWantTokens;
+	bool myCached;
+	bool myParsed; //Whether the parse succeeded
+	bool myRan;
+};
+
+} //End namespace crona
+
+#endif
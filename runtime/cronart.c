@@ -0,0 +1,152 @@
+/*
+The runtime for programs compiled to x86-64 by cronac -S (see
+x86.hpp): it sets up memory, calls the compiled main through
+crona_run, and does the input and output, which behave exactly as
+they do on the VM (see vm.hpp), down to the havoc sequence and the
+wording of runtime errors.
+
+Build a program with
+	cronac prog.crona -S prog.s && cc -o prog prog.s runtime/cronart.c
+*/
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+/* Room for the locals and arrays of every call in progress, as on
+   the VM */
+#define REGISTER_CELLS ((size_t)1 << 22)
+#define STACK_CELLS ((size_t)1 << 24)
+
+#define HAVOC_SEED 0x9e3779b97f4a7c15ull
+
+/* From the compiled program: memory as the program starts, and the
+   entry point, which runs main with the given registers and memory
+   (arrays going after the first top cells) */
+extern const int32_t crona_image[];
+extern const uint64_t crona_image_cells;
+void crona_run(int32_t * registers, int32_t * memory, uint64_t top);
+
+/* Limits the compiled code checks calls against */
+int32_t * cronart_registers_end;
+uint64_t cronart_memory_cells;
+
+static uint64_t havocState = HAVOC_SEED;
+
+enum Kind{ INT, BOOL, BYTE };
+
+void cronart_fail(uint32_t line, uint32_t col, const char * msg){
+	fflush(stdout);
+	fprintf(stderr, "FATAL [%u,%u]: %s\n", line, col, msg);
+	exit(1);
+}
+
+/* xorshift64*, top bit */
+int32_t cronart_havoc(void){
+	havocState ^= havocState >> 12;
+	havocState ^= havocState << 25;
+	havocState ^= havocState >> 27;
+	return (int32_t)((havocState * 0x2545f4914f6cdd1dull) >> 63);
+}
+
+/* The next whitespace-separated word of input, or NULL at the end */
+static char * word(void){
+	static char * text = NULL;
+	static size_t capacity = 0;
+	size_t len = 0;
+	int ch = getchar();
+	while (ch != EOF && isspace(ch)){ ch = getchar(); }
+	if (ch == EOF){ return NULL; }
+	while (ch != EOF && !isspace(ch)){
+		if (len + 1 >= capacity){
+			capacity = capacity == 0 ? 64 : capacity * 2;
+			text = realloc(text, capacity);
+			if (text == NULL){
+				fputs("Error: out of memory\n", stderr);
+				exit(1);
+			}
+		}
+		text[len++] = (char)ch;
+		ch = getchar();
+	}
+	/* The VM leaves the character after a word unread */
+	if (ch != EOF){ ungetc(ch, stdin); }
+	text[len] = '\0';
+	return text;
+}
+
+int32_t cronart_read(uint32_t kind, uint32_t line, uint32_t col){
+	char * text;
+	char * end;
+	long long number;
+	fflush(stdout);
+	if (kind == BYTE){
+		int ch = getchar();
+		while (ch != EOF && isspace(ch)){ ch = getchar(); }
+		if (ch == EOF){ cronart_fail(line, col, "Read past the end of input"); }
+		return (unsigned char)ch;
+	}
+	text = word();
+	if (text == NULL){ cronart_fail(line, col, "Read past the end of input"); }
+	if (kind == BOOL){
+		if (strcmp(text, "true") == 0 || strcmp(text, "1") == 0){ return 1; }
+		if (strcmp(text, "false") == 0 || strcmp(text, "0") == 0){ return 0; }
+		cronart_fail(line, col, "Bad input for a bool");
+	}
+	errno = 0;
+	number = strtoll(text, &end, 10);
+	if (*end != '\0' || errno != 0){
+		cronart_fail(line, col, "Bad input for an int");
+	}
+	return (int32_t)(uint32_t)number;
+}
+
+void cronart_read_string(int32_t * cells, uint32_t line, uint32_t col){
+	size_t length = (size_t)cells[-1];
+	size_t textLen;
+	size_t i;
+	char * text;
+	fflush(stdout);
+	text = word();
+	if (text == NULL){ cronart_fail(line, col, "Read past the end of input"); }
+	textLen = strlen(text);
+	for (i = 0; i < length; i++){
+		cells[i] = i < textLen ? (unsigned char)text[i] : 0;
+	}
+}
+
+void cronart_write(int32_t value, uint32_t kind){
+	if (kind == BOOL){
+		fputs(value != 0 ? "true" : "false", stdout);
+	} else if (kind == BYTE){
+		putchar((char)value);
+	} else {
+		printf("%d", value);
+	}
+}
+
+void cronart_write_string(const int32_t * cells){
+	int32_t length = cells[-1];
+	int32_t i;
+	for (i = 0; i < length && cells[i] != 0; i++){
+		putchar((char)cells[i]);
+	}
+}
+
+int main(void){
+	size_t cells = (size_t)crona_image_cells + STACK_CELLS;
+	int32_t * registers = malloc(REGISTER_CELLS * sizeof(int32_t));
+	int32_t * memory = malloc(cells * sizeof(int32_t));
+	if (registers == NULL || memory == NULL){
+		fputs("Error: out of memory\n", stderr);
+		return 1;
+	}
+	memcpy(memory, crona_image, (size_t)crona_image_cells * sizeof(int32_t));
+	cronart_registers_end = registers + REGISTER_CELLS;
+	cronart_memory_cells = cells;
+	crona_run(registers, memory, crona_image_cells);
+	fflush(stdout);
+	return 0;
+}
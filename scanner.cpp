@@ -6,20 +6,152 @@ using namespace crona;
 using TokenKind = crona::Parser::token;
 using Lexeme = crona::Parser::semantic_type;
 
-void Scanner::outputTokens(std::ostream& outstream){
-	Lexeme lex;
+/*
+When scanning a SourceFile, feed flex straight from the mapped
+bytes rather than through an istream. Flex still copies into its
+own buffer, but the lexemes we keep point back into the mapping
+(see Scanner::lexeme), so myOffset must track flex's progress;
+YY_USER_ACTION in crona.l takes care of that.
+*/
+int Scanner::LexerInput(char * buf, int max_size){
+	if (!mySource){
+		return yyFlexLexer::LexerInput(buf, max_size);
+	}
+	size_t avail = mySource->size() - myInputPos;
+	size_t len = static_cast<size_t>(max_size);
+	if (len > avail){ len = avail; }
+	std::memcpy(buf, mySource->data() + myInputPos, len);
+	myInputPos += len;
+	return static_cast<int>(len);
+}
+
+void Scanner::reset(std::shared_ptr<SourceFile> source){
+	std::unique_ptr<TokenReader> replay;
+	if (TokenReader::isDump(*source)){
+		replay.reset(new TokenReader(source));
+	}
+	mySource = source;
+	myReplay = std::move(replay);
+	lineNum = 1;
+	colNum = 1;
+	myOffset = 0;
+	myTokenStart = 0;
+	myInputPos = 0;
+	myAtEnd = false;
+	myTokenLine = 1;
+	myTokenCol = 1;
+	mySyntaxErrors = 0;
+	//Drop whatever flex has buffered from the old input
+	yyrestart(yyin);
+	delete myArena;
+	myArena = newArena();
+}
+
+int Scanner::yylex(crona::Parser::semantic_type * const lval){
+	double start = myStats == nullptr ? 0 : Stats::wallNow();
 	int tokenKind;
-	while(true){
-		tokenKind = this->yylex(&lex);
+	if (myReplay){
+		tokenKind = replay(lval);
+	} else if (myFast){
+		tokenKind = scanFast(lval);
+	} else {
+		tokenKind = scan(lval);
+	}
+	if (tokenKind == TokenKind::END){
+		myAtEnd = true;
+		myTokenLine = lineNum;
+		myTokenCol = colNum;
+	} else {
+		myTokenLine = lval->transToken.line();
+		myTokenCol = lval->transToken.col();
+	}
+	if (myTokenSink != nullptr){
+		writeToken(*myTokenSink, tokenKind, lval);
+	}
+	if (myTokenDump != nullptr){
 		if (tokenKind == TokenKind::END){
-			outstream << "EOF" 
-			  << " [" << this->lineNum 
-			  << "," << this->colNum << "]"
-			  << std::endl;
-			return;
+			myTokenDump->add(tokenKind, lineNum, colNum, lval);
 		} else {
-			outstream << lex.transToken->toString()
-			  << std::endl;
+			const Token& token = lval->transToken;
+			myTokenDump->add(tokenKind, token.line(), token.col(), lval);
 		}
 	}
+	if (myStats != nullptr){
+		myStats->addScanWall(Stats::wallNow() - start);
+		myStats->countToken(tokenKind);
+	}
+	return tokenKind;
+}
+
+int Scanner::replay(crona::Parser::semantic_type * const lval){
+	const TokenRecord * rec = myReplay->next();
+	if (rec == nullptr){ return TokenKind::END; }
+	int kind = static_cast<int>(rec->kind);
+	size_t line = rec->line;
+	size_t col = rec->col;
+	size_t len;
+	const char * text;
+	switch (kind){
+	case TokenKind::END:
+		//Where the scanner was at EOF, for the token dump
+		lineNum = line;
+		colNum = col;
+		break;
+	case TokenKind::ID:
+		text = myReplay->string(rec->payload, len);
+		lval->transToken = Token::ident(line, col,
+			SymbolTable::global().intern(StrView(text, len)));
+		break;
+	case TokenKind::STRLITERAL:
+		text = myReplay->string(rec->payload, len);
+		lval->transToken = Token::strLit(line, col, StrView(text, len));
+		break;
+	case TokenKind::INTLITERAL:
+		lval->transToken = Token::intLit(line, col,
+			static_cast<int>(rec->payload));
+		break;
+	default:
+		lval->transToken = Token::bare(line, col, kind);
+		break;
+	}
+	return kind;
+}
+
+void Scanner::errSyntax(const std::string& msg){
+	mySyntaxErrors++;
+	if (mySyntaxErrors > MAX_SYNTAX_ERRORS){ return; }
+	Report::fatal(myTokenLine, myTokenCol, msg);
+	if (mySyntaxErrors == MAX_SYNTAX_ERRORS){
+		Report::fatal(myTokenLine, myTokenCol,
+			"Too many syntax errors; giving up");
+	}
+}
+
+std::string Scanner::tokenKindString(int tokenKind){
+	return crona::tokenKindString(tokenKind);
+}
+
+void Scanner::writeToken(std::ostream& out, int tokenKind,
+	crona::Parser::semantic_type * const lval){
+	if (tokenKind == TokenKind::END){
+		out << "EOF" 
+		  << " [" << this->lineNum 
+		  << "," << this->colNum << "]"
+		  << std::endl;
+	} else {
+		out << lval->transToken.toString()
+		  << std::endl;
+	}
+}
+
+void Scanner::drainTokens(){
+	Lexeme lex;
+	while (!myAtEnd){ this->yylex(&lex); }
+}
+
+void Scanner::outputTokens(std::ostream& outstream){
+	std::ostream * oldSink = myTokenSink;
+	myTokenSink = &outstream;
+	drainTokens();
+	myTokenSink = oldSink;
 }
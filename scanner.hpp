@@ -6,7 +6,14 @@
 #endif
 
 #include "grammar.hh"
+#include <cstring>
+#include <memory>
 #include "errors.hpp"
+#include "arena.hpp"
+#include "fastscan.hpp"
+#include "source.hpp"
+#include "stats.hpp"
+#include "tokdump.hpp"
 
 using TokenKind = crona::Parser::token;
 
@@ -19,18 +26,133 @@ public:
    {
 	lineNum = 1;
 	colNum = 1;
+	myOffset = 0;
+	myTokenStart = 0;
+	myInputPos = 0;
+	myTokenSink = nullptr;
+	myTokenDump = nullptr;
+	myStats = nullptr;
+	myAtEnd = false;
+	myFast = false;
+	myTokenLine = 1;
+	myTokenCol = 1;
+	mySyntaxErrors = 0;
+	myArena = newArena();
+   };
+
+   // Scan a source file in place. Identifier and string
+   // lexemes become views into the file's bytes, which stay
+   // mapped for as long as any arena from this scanner lives.
+   // If the file is a binary token dump (see tokdump.hpp), its
+   // tokens are replayed instead of lexing anything.
+   Scanner(std::shared_ptr<SourceFile> source)
+   : yyFlexLexer(nullptr), mySource(source)
+   {
+	if (TokenReader::isDump(*source)){
+		myReplay.reset(new TokenReader(source));
+	}
+	lineNum = 1;
+	colNum = 1;
+	myOffset = 0;
+	myTokenStart = 0;
+	myInputPos = 0;
+	myTokenSink = nullptr;
+	myTokenDump = nullptr;
+	myStats = nullptr;
+	myAtEnd = false;
+	myFast = false;
+	myTokenLine = 1;
+	myTokenCol = 1;
+	mySyntaxErrors = 0;
+	myArena = newArena();
    };
    virtual ~Scanner() {
+	delete myArena;
    };
 
+   // Start over on another source file, keeping the flex
+   // buffer, lexer choice and the rest of the scanner's setup
+   // (so that one scanner can serve many inputs). Anything
+   // still in the scanner's own arena is freed.
+   void reset(std::shared_ptr<SourceFile> source);
+
    //get rid of override virtual function warning
    using FlexLexer::yylex;
 
-   // YY_DECL defined in the flex crona.l
+   // Produce the next token for the parser, echoing it to
+   // the token sink if one is set (see teeTokens)
    virtual int yylex( crona::Parser::semantic_type * const lval);
 
+   // Write every token returned by yylex to out as well, so
+   // that a token dump can ride along with a parse
+   void teeTokens(std::ostream * out){ myTokenSink = out; }
+
+   // Likewise, but as a binary token dump
+   void dumpTokens(TokenWriter * out){ myTokenDump = out; }
+
+   // Pick the flex scanner or the hand-written one (see
+   // fastscan.hpp). The hand-written scanner needs a
+   // SourceFile; other input always goes through flex.
+   void useLexer(LexerKind kind){
+	myFast = kind == LexerKind::FAST && mySource;
+   }
+
+   // Count tokens, AST nodes and scan time into stats
+   void keepStats(Stats * stats){ myStats = stats; }
+
+   // Number lines and columns from here rather than 1,1 (for
+   // input that is a piece cut out of a larger file)
+   void startAt(size_t line, size_t col){
+	lineNum = line;
+	colNum = col;
+   }
+
+   // Byte offsets in the input of the start and end of the
+   // token yylex returned last
+   size_t tokenStart() const { return myTokenStart; }
+   size_t tokenEnd() const { return myOffset; }
+
+   // Tokens and AST nodes built from this scanner's input
+   // are allocated out of this arena
+   Arena * arena(){ return myArena; }
+
+   // Allocate an AST node in the arena (counting it if
+   // stats are being kept)
+   template <typename T, typename... Args>
+   T * make(Args&&... args){
+	countNode<T>();
+	return myArena->make<T>(std::forward<Args>(args)...);
+   }
+
+   template <typename T>
+   void countNode(){
+	if (myStats != nullptr){ myStats->countNode<T>(); }
+   }
+
+   // Hand the arena (and everything allocated so far) over
+   // to the caller, e.g. the ProgramNode at the end of a
+   // parse. The scanner continues with a fresh arena.
+   Arena * takeArena(){
+	Arena * taken = myArena;
+	myArena = newArena();
+	return taken;
+   }
+
+   // The text of the current match as a view that lives as
+   // long as the arena: straight into the source file when
+   // scanning one, otherwise copied once into the arena
+   StrView lexeme(){
+	size_t len = static_cast<size_t>(yyleng);
+	if (mySource){
+		return StrView(mySource->data() + myOffset - len, len);
+	}
+	char * copy = static_cast<char *>(myArena->alloc(len, 1));
+	std::memcpy(copy, yytext, len);
+	return StrView(copy, len);
+   }
+
    int makeBareToken(int tagIn){
-        this->yylval->transToken = new Token(
+        this->yylval->transToken = Token::bare(
 	  this->lineNum, this->colNum, tagIn);
         colNum += static_cast<size_t>(yyleng);
         return tagIn;
@@ -61,13 +183,28 @@ public:
 	" using max value");
    }
 
+   // Report a syntax error at the token yylex returned last
+   // (the parser's lookahead). Past MAX_SYNTAX_ERRORS, errors
+   // are only counted.
+   void errSyntax(const std::string& msg);
+
+   // Syntax errors reported so far in this input
+   size_t syntaxErrors() const { return mySyntaxErrors; }
+
+   // Whether the parser should give up rather than recover
+   bool tooManySyntaxErrors() const {
+	return mySyntaxErrors >= MAX_SYNTAX_ERRORS;
+   }
+
+   static const size_t MAX_SYNTAX_ERRORS = 25;
+
    void warn(int lineNumIn, int colNumIn, std::string msg){
-	std::cerr << lineNumIn << ":" << colNumIn 
+	crona::Report::stream() << lineNumIn << ":" << colNumIn 
 		<< " ***WARNING*** " << msg << std::endl;
    }
 
    void error(int lineNumIn, int colNumIn, std::string msg){
-	std::cerr << lineNumIn << ":" << colNumIn 
+	crona::Report::stream() << lineNumIn << ":" << colNumIn 
 		<< " ***ERROR*** " << msg << std::endl;
    }
 
@@ -75,8 +212,49 @@ public:
 
    void outputTokens(std::ostream& outstream);
 
+   // Consume the rest of the input (e.g. after the parser has
+   // stopped early), so a tee'd token dump is always complete
+   void drainTokens();
+
+protected:
+   int LexerInput(char * buf, int max_size) override;
+
 private:
+   // YY_DECL defined in the flex crona.l
+   int scan( crona::Parser::semantic_type * const lval);
+
+   // Hand-written equivalent of scan, in fastscan.cpp
+   int scanFast( crona::Parser::semantic_type * const lval);
+
+   // The next token from myReplay
+   int replay( crona::Parser::semantic_type * const lval);
+
+   void writeToken(std::ostream& out, int tokenKind,
+	crona::Parser::semantic_type * const lval);
+
+   Arena * newArena(){
+	Arena * arena = new Arena();
+	if (mySource){
+		arena->make<std::shared_ptr<SourceFile>>(mySource);
+	}
+	return arena;
+   }
+
    crona::Parser::semantic_type *yylval = nullptr;
+   Arena * myArena;
+   std::shared_ptr<SourceFile> mySource;
+   size_t myOffset; //Bytes of input consumed by matched rules
+   size_t myTokenStart; //Where the last match started
+   size_t myInputPos; //Bytes of the source handed to flex so far
+   std::ostream * myTokenSink;
+   TokenWriter * myTokenDump;
+   std::unique_ptr<TokenReader> myReplay;
+   Stats * myStats;
+   bool myAtEnd; //Whether END has been returned
+   bool myFast; //Whether to use scanFast rather than scan
+   size_t myTokenLine; //Where the token yylex returned last starts
+   size_t myTokenCol;
+   size_t mySyntaxErrors;
    size_t lineNum;
    size_t colNum;
 };
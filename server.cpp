@@ -0,0 +1,302 @@
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include "errors.hpp"
+#include "outbuf.hpp"
+#include "scanner.hpp"
+#include "server.hpp"
+#include "threadpool.hpp"
+
+namespace crona{
+
+//Longer than any well-formed request header
+static const size_t MAX_HEADER = 256;
+
+/*
+Buffered reads from a file descriptor: request headers a line at a
+time, bodies by length.
+*/
+class FdReader{
+public:
+	explicit FdReader(int fd) : myFd(fd), myPos(0), myTooLong(false){}
+
+	//The next line, without its '\n'. False at the end of the
+	// input, or if no '\n' turns up within max bytes.
+	bool line(std::string& out, size_t max){
+		while (true){
+			size_t nl = myBuf.find('\n', myPos);
+			if (nl != std::string::npos){
+				out.assign(myBuf, myPos, nl - myPos);
+				myPos = nl + 1;
+				return true;
+			}
+			if (myBuf.size() - myPos > max){
+				myTooLong = true;
+				return false;
+			}
+			if (!fill()){ return false; }
+		}
+	}
+
+	bool bytes(size_t len, std::string& out){
+		while (myBuf.size() - myPos < len){
+			if (!fill()){ return false; }
+		}
+		out.assign(myBuf, myPos, len);
+		myPos += len;
+		return true;
+	}
+
+	bool tooLong() const { return myTooLong; }
+private:
+	bool fill(){
+		myBuf.erase(0, myPos);
+		myPos = 0;
+		char chunk[64 * 1024];
+		ssize_t got;
+		do {
+			got = read(myFd, chunk, sizeof(chunk));
+		} while (got < 0 && errno == EINTR);
+		if (got <= 0){ return false; }
+		myBuf.append(chunk, static_cast<size_t>(got));
+		return true;
+	}
+
+	int myFd;
+	std::string myBuf;
+	size_t myPos;
+	bool myTooLong;
+};
+
+static bool writeAll(int fd, const std::string& data){
+	size_t done = 0;
+	while (done < data.size()){
+		ssize_t put = write(fd, data.data() + done, data.size() - done);
+		if (put < 0){
+			if (errno == EINTR){ continue; }
+			return false;
+		}
+		done += static_cast<size_t>(put);
+	}
+	return true;
+}
+
+static bool reply(int fd, const char * status, const std::string& output,
+	const std::string& diagnostics){
+	std::string msg = status;
+	msg += " " + std::to_string(output.size())
+		+ " " + std::to_string(diagnostics.size()) + "\n";
+	msg.reserve(msg.size() + output.size() + diagnostics.size());
+	msg += output;
+	msg += diagnostics;
+	return writeAll(fd, msg);
+}
+
+//A request length: decimal digits only, and not absurdly many
+static bool readLength(const std::string& field, size_t& len){
+	if (field.empty() || field.size() > 18){ return false; }
+	len = 0;
+	for (char ch : field){
+		if (ch < '0' || ch > '9'){ return false; }
+		len = len * 10 + static_cast<size_t>(ch - '0');
+	}
+	return true;
+}
+
+CompileServer::CompileServer(LexerKind lexer)
+: myLexer(lexer), myRoot(nullptr){
+}
+
+CompileServer::~CompileServer(){
+	delete myRoot;
+}
+
+bool CompileServer::run(Command command, Input input,
+	const std::string& bytes, std::ostream& out){
+	std::shared_ptr<SourceFile> source(input == Input::PATH
+		? new SourceFile(bytes.c_str())
+		: new SourceFile(bytes.data(), bytes.size()));
+	if (!myScanner){
+		myScanner.reset(new Scanner(source));
+		myParser.reset(new Parser(*myScanner, &myRoot));
+	} else {
+		myScanner->reset(source);
+	}
+	myScanner->useLexer(myLexer);
+
+	if (command == Command::TOKENS){
+		myScanner->teeTokens(&out);
+		myScanner->drainTokens();
+		return true;
+	}
+
+	if (myParser->parse() != 0){
+		delete myRoot;
+		myRoot = nullptr;
+		Report::stream() << (command == Command::PARSE
+			? "Parse failed\n" : "No AST built\n");
+		return false;
+	}
+	if (command == Command::UNPARSE){
+		OutBuf buf(out);
+		myRoot->unparse(buf, 0);
+		buf.flush();
+	}
+	return true;
+}
+
+bool CompileServer::compile(Command command, Input input,
+	const std::string& bytes, std::string& output,
+	std::string& diagnostics){
+	std::ostringstream out;
+	std::ostringstream diags;
+	std::ostream * prevDiags = &Report::stream();
+	Report::redirect(&diags);
+	bool ok = false;
+	try {
+		ok = run(command, input, bytes, out);
+	} catch (ToDoError * e){
+		diags << "ToDo: " << e->msg() << std::endl;
+		delete e;
+	} catch (InternalError * e){
+		diags << "Error: " << e->msg() << std::endl;
+		delete e;
+	}
+	Report::redirect(prevDiags);
+	if (myScanner){ myScanner->teeTokens(nullptr); }
+	delete myRoot;
+	myRoot = nullptr;
+	output = out.str();
+	diagnostics = diags.str();
+	return ok;
+}
+
+bool CompileServer::serve(int inFd, int outFd){
+	FdReader in(inFd);
+	std::string header;
+	std::string bytes;
+	std::string output;
+	std::string diagnostics;
+	while (in.line(header, MAX_HEADER)){
+		std::istringstream fields(header);
+		std::string commandName;
+		std::string inputName;
+		std::string lengthField;
+		std::string extra;
+		fields >> commandName >> inputName >> lengthField >> extra;
+		size_t len;
+		if (!readLength(lengthField, len) || !extra.empty()){
+			reply(outFd, "bad", "", "Malformed request header\n");
+			return false;
+		}
+		if (!in.bytes(len, bytes)){ return false; }
+
+		Command command = Command::PARSE;
+		Input input = Input::PATH;
+		bool known = true;
+		if (commandName == "parse"){
+			command = Command::PARSE;
+		} else if (commandName == "unparse"){
+			command = Command::UNPARSE;
+		} else if (commandName == "tokens"){
+			command = Command::TOKENS;
+		} else {
+			known = false;
+		}
+		if (inputName == "path"){
+			input = Input::PATH;
+		} else if (inputName == "text"){
+			input = Input::TEXT;
+		} else {
+			known = false;
+		}
+		if (!known){
+			if (!reply(outFd, "bad", "", "Unknown request " + commandName
+			  + " " + inputName + "\n")){
+				return false;
+			}
+			continue;
+		}
+
+		bool ok = compile(command, input, bytes, output, diagnostics);
+		if (!reply(outFd, ok ? "ok" : "failed", output, diagnostics)){
+			return false;
+		}
+	}
+	if (in.tooLong()){
+		reply(outFd, "bad", "", "Request header too long\n");
+		return false;
+	}
+	return true;
+}
+
+int serveStdio(LexerKind lexer){
+	//A client that goes away shows up as a failed write
+	signal(SIGPIPE, SIG_IGN);
+	CompileServer server(lexer);
+	return server.serve(STDIN_FILENO, STDOUT_FILENO) ? 0 : 1;
+}
+
+static void badSocket(const char * what, const char * path){
+	std::string msg = what;
+	msg += " ";
+	msg += path;
+	msg += ": ";
+	msg += std::strerror(errno);
+	throw new InternalError(msg.c_str());
+}
+
+int serveSocket(const char * path, LexerKind lexer, size_t threads){
+	signal(SIGPIPE, SIG_IGN);
+	struct sockaddr_un addr;
+	std::memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	if (std::strlen(path) >= sizeof(addr.sun_path)){
+		errno = ENAMETOOLONG;
+		badSocket("Bad socket path", path);
+	}
+	std::strcpy(addr.sun_path, path);
+
+	//Replace the socket of a server that has gone, but nothing else
+	struct stat info;
+	if (lstat(path, &info) == 0 && S_ISSOCK(info.st_mode)){
+		unlink(path);
+	}
+
+	int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (listener < 0){ badSocket("Can't create socket", path); }
+	if (bind(listener, reinterpret_cast<struct sockaddr *>(&addr),
+	  sizeof(addr)) != 0 || listen(listener, SOMAXCONN) != 0){
+		int err = errno;
+		close(listener);
+		errno = err;
+		badSocket("Can't listen on", path);
+	}
+
+	ThreadPool pool(threads);
+	while (true){
+		int conn = accept(listener, nullptr, nullptr);
+		if (conn < 0){
+			if (errno == EINTR || errno == ECONNABORTED){ continue; }
+			break;
+		}
+		pool.submit([conn, lexer]{
+			static thread_local CompileServer server(lexer);
+			server.serve(conn, conn);
+			close(conn);
+		});
+	}
+	int err = errno;
+	close(listener);
+	errno = err;
+	badSocket("Can't accept connections on", path);
+	return 1;
+}
+
+} //End namespace crona
@@ -0,0 +1,91 @@
+#ifndef CRONA_SERVER_H
+#define CRONA_SERVER_H
+
+#include <memory>
+#include <string>
+#include "ast.hpp"
+#include "fastscan.hpp"
+
+namespace crona{
+
+class Scanner;
+class Parser;
+
+/**
+* \class CompileServer
+* The front end kept warm for a stream of small compiles (cronac
+* --serve). One Scanner and one Parser are built for the first
+* request and reset for every later one, so a request only pays for
+* lexing and parsing its input: no process start-up, no iostream or
+* flex setup, and flex's buffer and the parser's stack are reused.
+*
+* Requests and replies are framed the same way on a pipe (stdin and
+* stdout) or a Unix socket. A request is a header line
+*
+*     <command> <input> <length>\n
+*
+* followed by length bytes. command is parse, unparse or tokens,
+* which do what cronac's -p, -u and -t do, and input says whether
+* the bytes are the path of the program (path) or the program
+* itself (text). The reply is a header line
+*
+*     <status> <outputLength> <diagnosticsLength>\n
+*
+* followed by the output (the unparsed program or the token
+* listing) and then the diagnostics cronac would have written to
+* stderr. status is ok, failed (the program didn't parse or couldn't
+* be read) or bad (the request was malformed; if its length was
+* unreadable too, the server hangs up).
+*
+* Identifiers stay interned in the global SymbolTable between
+* requests, so memory grows with the number of distinct names seen.
+**/
+class CompileServer{
+public:
+	enum class Command{ PARSE, UNPARSE, TOKENS };
+	/// Whether a request's bytes name the program or are the program
+	enum class Input{ PATH, TEXT };
+
+	explicit CompileServer(LexerKind lexer);
+	~CompileServer();
+	CompileServer(const CompileServer&) = delete;
+	CompileServer& operator=(const CompileServer&) = delete;
+
+	/**
+	* Carry out one request: output and diagnostics are replaced
+	* with what it produced. Returns false if it failed.
+	**/
+	bool compile(Command command, Input input, const std::string& bytes,
+		std::string& output, std::string& diagnostics);
+
+	/**
+	* Answer requests read from inFd on outFd until inFd ends.
+	* Returns false if a read or write failed or a request
+	* couldn't be framed.
+	**/
+	bool serve(int inFd, int outFd);
+private:
+	bool run(Command command, Input input, const std::string& bytes,
+		std::ostream& out);
+
+	LexerKind myLexer;
+	std::unique_ptr<Scanner> myScanner;
+	std::unique_ptr<Parser> myParser;
+	ProgramNode * myRoot;
+};
+
+/// Serve requests on stdin, replying on stdout. Returns the exit status.
+int serveStdio(LexerKind lexer);
+
+/**
+* Listen on a Unix socket at path and serve each connection on a
+* pool of threads (0: one per hardware thread), each of which
+* keeps one CompileServer warm across the connections it takes.
+* A stale socket left at path is replaced. Only returns if
+* accepting a connection fails.
+**/
+int serveSocket(const char * path, LexerKind lexer, size_t threads);
+
+} //End namespace crona
+
+#endif
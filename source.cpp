@@ -0,0 +1,68 @@
+#include <cstring>
+#include <string>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "errors.hpp"
+#include "source.hpp"
+
+namespace crona{
+
+static void badInput(const char * path){
+	std::string msg = "Bad input stream ";
+	msg += path;
+	throw new InternalError(msg.c_str());
+}
+
+SourceFile::SourceFile(const char * path)
+: myData(nullptr), mySize(0), myMapped(false){
+	int fd = open(path, O_RDONLY);
+	if (fd < 0){ badInput(path); }
+
+	struct stat info;
+	if (fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0){
+		size_t len = static_cast<size_t>(info.st_size);
+		void * map = mmap(nullptr, len, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (map != MAP_FAILED){
+			madvise(map, len, MADV_SEQUENTIAL);
+			myData = static_cast<const char *>(map);
+			mySize = len;
+			myMapped = true;
+			close(fd);
+			return;
+		}
+	}
+
+	//Fall back to slurping the input into memory
+	std::string contents;
+	char buf[64 * 1024];
+	ssize_t got;
+	while ((got = read(fd, buf, sizeof(buf))) > 0){
+		contents.append(buf, static_cast<size_t>(got));
+	}
+	close(fd);
+	if (got < 0){ badInput(path); }
+
+	char * copy = new char[contents.size() + 1];
+	std::memcpy(copy, contents.data(), contents.size());
+	myData = copy;
+	mySize = contents.size();
+}
+
+SourceFile::SourceFile(const char * data, size_t size)
+: myData(nullptr), mySize(size), myMapped(false){
+	char * copy = new char[size + 1];
+	std::memcpy(copy, data, size);
+	myData = copy;
+}
+
+SourceFile::~SourceFile(){
+	if (myMapped){
+		munmap(const_cast<char *>(myData), mySize);
+	} else {
+		delete [] myData;
+	}
+}
+
+} //End namespace crona
@@ -0,0 +1,36 @@
+#ifndef CRONA_SOURCE_H
+#define CRONA_SOURCE_H
+
+#include <cstddef>
+
+namespace crona{
+
+/**
+* \class SourceFile
+* The bytes of an input file, memory-mapped read-only so the scanner
+* can read them in place. Inputs that can't be mapped (pipes, empty
+* files) are read into a heap buffer instead. Identifier and string
+* lexemes point straight into these bytes, so a SourceFile is kept
+* alive by every arena built from it.
+**/
+class SourceFile{
+public:
+	SourceFile(const char * path);
+	/// A copy of the size bytes at data (e.g. part of an editor buffer)
+	SourceFile(const char * data, size_t size);
+	~SourceFile();
+	SourceFile(const SourceFile&) = delete;
+	SourceFile& operator=(const SourceFile&) = delete;
+
+	const char * data() const { return myData; }
+	size_t size() const { return mySize; }
+	bool mapped() const { return myMapped; }
+private:
+	const char * myData;
+	size_t mySize;
+	bool myMapped;
+};
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,209 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <sys/resource.h>
+#include <time.h>
+#include "stats.hpp"
+#include "symbols.hpp"
+#include "tokens.hpp"
+
+/*
+Count heap allocations by replacing the global allocation functions.
+The counters are per thread and plain (no atomics, no constructors),
+so they cost next to nothing and are safe to touch from inside
+operator new.
+*/
+static thread_local size_t threadAllocs = 0;
+static thread_local size_t threadAllocBytes = 0;
+
+void * operator new(std::size_t size){
+	threadAllocs++;
+	threadAllocBytes += size;
+	if (size == 0){ size = 1; }
+	while (true){
+		void * mem = std::malloc(size);
+		if (mem != nullptr){ return mem; }
+		std::new_handler handler = std::get_new_handler();
+		if (handler == nullptr){ throw std::bad_alloc(); }
+		handler();
+	}
+}
+
+void * operator new[](std::size_t size){
+	return operator new(size);
+}
+
+void * operator new(std::size_t size, const std::nothrow_t&) noexcept{
+	try {
+		return operator new(size);
+	} catch (std::bad_alloc&){
+		return nullptr;
+	}
+}
+
+void * operator new[](std::size_t size, const std::nothrow_t&) noexcept{
+	return operator new(size, std::nothrow);
+}
+
+void operator delete(void * mem) noexcept{ std::free(mem); }
+void operator delete[](void * mem) noexcept{ std::free(mem); }
+void operator delete(void * mem, const std::nothrow_t&) noexcept{
+	std::free(mem);
+}
+void operator delete[](void * mem, const std::nothrow_t&) noexcept{
+	std::free(mem);
+}
+#ifdef __cpp_sized_deallocation
+void operator delete(void * mem, std::size_t) noexcept{ std::free(mem); }
+void operator delete[](void * mem, std::size_t) noexcept{ std::free(mem); }
+#endif
+
+namespace crona{
+
+const char * nodeKindString(NodeKind kind){
+	switch (kind){
+#define CRONA_NODE_NAME(name) case NodeKind::name: return #name;
+	CRONA_AST_NODES(CRONA_NODE_NAME)
+#undef CRONA_NODE_NAME
+	}
+	return "OTHER";
+}
+
+Stats::Clock::Clock() : myWall(wallNow()), myCpu(cpuNow()) {}
+
+double Stats::Clock::wall() const { return wallNow() - myWall; }
+
+double Stats::Clock::cpu() const { return cpuNow() - myCpu; }
+
+Stats::Stats()
+: myScanWall(0),
+  myAllocsAtStart(threadAllocations()),
+  myBytesAtStart(threadAllocatedBytes()),
+  myArenaUsed(0), myArenaReserved(0){
+	for (size_t i = 0; i < NUM_NODE_KINDS; i++){ myNodes[i] = 0; }
+	for (size_t i = 0; i < NUM_PHASES; i++){
+		myWall[i] = 0;
+		myCpu[i] = 0;
+	}
+}
+
+void Stats::frontEnd(const Clock& clock){
+	double wall = clock.wall();
+	double cpu = clock.cpu();
+	double scanWall = myScanWall < wall ? myScanWall : wall;
+	double scanShare = wall > 0 ? scanWall / wall : 1;
+	myWall[SCAN] += scanWall;
+	myCpu[SCAN] += cpu * scanShare;
+	myWall[PARSE] += wall - scanWall;
+	myCpu[PARSE] += cpu * (1 - scanShare);
+	myScanWall = 0;
+}
+
+void Stats::addTime(Phase phase, const Clock& clock){
+	myWall[phase] += clock.wall();
+	myCpu[phase] += clock.cpu();
+}
+
+void Stats::noteAST(ProgramNode * ast){
+	if (ast == nullptr){ return; }
+	myArenaUsed = ast->arena()->bytesUsed();
+	myArenaReserved = ast->arena()->bytesReserved();
+}
+
+double Stats::wallNow(){
+	std::chrono::duration<double> since =
+		std::chrono::steady_clock::now().time_since_epoch();
+	return since.count();
+}
+
+double Stats::cpuNow(){
+	struct timespec now;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now) != 0){ return 0; }
+	return static_cast<double>(now.tv_sec)
+		+ static_cast<double>(now.tv_nsec) * 1e-9;
+}
+
+size_t Stats::threadAllocations(){ return threadAllocs; }
+
+size_t Stats::threadAllocatedBytes(){ return threadAllocBytes; }
+
+size_t Stats::peakRSSKB(){
+	struct rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0){ return 0; }
+	return static_cast<size_t>(usage.ru_maxrss);
+}
+
+static void writeJSONString(std::ostream& out, const std::string& str){
+	out << '"';
+	for (char ch : str){
+		if (ch == '"' || ch == '\\'){
+			out << '\\' << ch;
+		} else if (static_cast<unsigned char>(ch) < 0x20){
+			char esc[8];
+			std::snprintf(esc, sizeof(esc), "\\u%04x", ch);
+			out << esc;
+		} else {
+			out << ch;
+		}
+	}
+	out << '"';
+}
+
+void Stats::writeJSON(std::ostream& out, const std::string& input) const{
+	static const char * phaseNames[NUM_PHASES] = {
+		"scan", "parse", "names", "fold", "unparse", "lower", "ir", "codegen",
+		"run"
+	};
+
+	out << "{\"input\":";
+	writeJSONString(out, input);
+
+	out << ",\"phases\":{";
+	for (size_t p = 0; p < NUM_PHASES; p++){
+		if (p > 0){ out << ","; }
+		out << "\"" << phaseNames[p] << "\":{\"wall_ms\":"
+			<< myWall[p] * 1e3 << ",\"cpu_ms\":" << myCpu[p] * 1e3 << "}";
+	}
+	out << "}";
+
+	size_t total = 0;
+	for (size_t count : myTokens){ total += count; }
+	out << ",\"tokens\":{\"total\":" << total << ",\"by_kind\":{";
+	bool first = true;
+	for (size_t k = 0; k < myTokens.size(); k++){
+		if (myTokens[k] == 0){ continue; }
+		if (!first){ out << ","; }
+		first = false;
+		writeJSONString(out, tokenKindString(static_cast<int>(k)));
+		out << ":" << myTokens[k];
+	}
+	out << "}}";
+
+	total = 0;
+	for (size_t count : myNodes){ total += count; }
+	out << ",\"ast_nodes\":{\"total\":" << total << ",\"by_class\":{";
+	first = true;
+	for (size_t k = 0; k < NUM_NODE_KINDS; k++){
+		if (myNodes[k] == 0){ continue; }
+		if (!first){ out << ","; }
+		first = false;
+		out << "\"" << nodeKindString(static_cast<NodeKind>(k)) << "\":"
+			<< myNodes[k];
+	}
+	out << "}}";
+
+	out << ",\"heap\":{\"allocations\":"
+		<< threadAllocations() - myAllocsAtStart
+		<< ",\"bytes\":" << threadAllocatedBytes() - myBytesAtStart << "}";
+	out << ",\"arena\":{\"bytes_used\":" << myArenaUsed
+		<< ",\"bytes_reserved\":" << myArenaReserved << "}";
+
+	SymbolTable& symbols = SymbolTable::global();
+	out << ",\"symbols\":{\"lookups\":" << symbols.lookups()
+		<< ",\"hits\":" << symbols.hits()
+		<< ",\"distinct\":" << symbols.size() << "}";
+	out << ",\"peak_rss_kb\":" << peakRSSKB() << "}\n";
+}
+
+} //End namespace crona
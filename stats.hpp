@@ -0,0 +1,89 @@
+#ifndef CRONA_STATS_H
+#define CRONA_STATS_H
+
+#include <cstddef>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "ast.hpp"
+
+namespace crona{
+
+/**
+* \class Stats
+* What one compilation cost: time per phase, tokens by kind, AST
+* nodes by class and heap traffic. The scanner and parser fill it in
+* only when one is attached (see Scanner::keepStats), so a normal run
+* pays nothing for it. Heap figures are for the calling thread, which
+* in batch mode is exactly the one input being compiled.
+**/
+class Stats{
+public:
+	enum Phase{ SCAN, PARSE, NAMES, FOLD, UNPARSE, LOWER, IR, CODEGEN, RUN,
+		NUM_PHASES };
+
+	/// Wall and (thread) CPU time elapsed since construction
+	class Clock{
+	public:
+		Clock();
+		double wall() const;
+		double cpu() const;
+	private:
+		double myWall;
+		double myCpu;
+	};
+
+	Stats();
+
+	void countToken(int kind){
+		size_t k = static_cast<size_t>(kind);
+		if (k >= myTokens.size()){ myTokens.resize(k + 1, 0); }
+		myTokens[k]++;
+	}
+
+	template <typename T>
+	void countNode(){
+		myNodes[static_cast<size_t>(NodeKindOf<T>::value)]++;
+	}
+
+	/// Wall time spent inside Scanner::yylex
+	void addScanWall(double secs){ myScanWall += secs; }
+
+	/**
+	* Record the time for lexing and parsing together. The scan share
+	* was accumulated token by token; reading the thread CPU clock
+	* that often would cost more than the scan itself, so CPU time is
+	* split between the two phases in proportion to their wall time.
+	**/
+	void frontEnd(const Clock& clock);
+
+	void addTime(Phase phase, const Clock& clock);
+
+	/// Arena and symbol table figures for the finished AST
+	void noteAST(ProgramNode * ast);
+
+	/// The statistics as a single-line JSON object
+	void writeJSON(std::ostream& out, const std::string& input) const;
+
+	static double wallNow();
+	static double cpuNow();
+	/// Heap allocations made (and bytes requested) by this thread
+	static size_t threadAllocations();
+	static size_t threadAllocatedBytes();
+	/// High-water mark of the process's resident set, in KB
+	static size_t peakRSSKB();
+private:
+	std::vector<size_t> myTokens;
+	size_t myNodes[NUM_NODE_KINDS];
+	double myScanWall;
+	double myWall[NUM_PHASES];
+	double myCpu[NUM_PHASES];
+	size_t myAllocsAtStart;
+	size_t myBytesAtStart;
+	size_t myArenaUsed;
+	size_t myArenaReserved;
+};
+
+} //End namespace crona
+
+#endif
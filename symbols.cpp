@@ -0,0 +1,103 @@
+#include <cstring>
+#include "symbols.hpp"
+
+namespace crona{
+
+static const size_t FIRST_SLOTS = 256;
+
+//FNV-1a; identifiers are short so this beats anything fancier
+static uint64_t hashName(StrView text){
+	uint64_t h = 14695981039346656037ULL;
+	const unsigned char * bytes =
+		reinterpret_cast<const unsigned char *>(text.data());
+	for (size_t i = 0; i < text.size(); i++){
+		h ^= bytes[i];
+		h *= 1099511628211ULL;
+	}
+	return h;
+}
+
+SymbolTable::SymbolTable() : myNextId(0){
+	for (size_t i = 0; i < SHARDS; i++){
+		myShards[i].slots.assign(FIRST_SLOTS, nullptr);
+	}
+}
+
+SymbolTable& SymbolTable::global(){
+	static SymbolTable table;
+	return table;
+}
+
+/*
+The top bits of the hash pick the shard and the low bits pick the
+slot within it, so the two choices stay independent.
+*/
+const Symbol * SymbolTable::intern(StrView text){
+	uint64_t h = hashName(text);
+	Shard& shard = myShards[h >> 60];
+	std::lock_guard<std::mutex> guard(shard.lock);
+	shard.lookups++;
+
+	size_t mask = shard.slots.size() - 1;
+	size_t i = static_cast<size_t>(h) & mask;
+	while (const Symbol * sym = shard.slots[i]){
+		if (sym->hash() == h && sym->name() == text){
+			shard.hits++;
+			return sym;
+		}
+		i = (i + 1) & mask;
+	}
+
+	char * chars = static_cast<char *>(shard.arena.alloc(text.size(), 1));
+	if (text.size() > 0){
+		std::memcpy(chars, text.data(), text.size());
+	}
+	const Symbol * sym = shard.arena.make<Symbol>(
+		StrView(chars, text.size()), myNextId++, h);
+	shard.slots[i] = sym;
+	shard.count++;
+	if (shard.count * 2 > shard.slots.size()){ rehash(shard); }
+	return sym;
+}
+
+void SymbolTable::rehash(Shard& shard){
+	std::vector<const Symbol *> old;
+	old.swap(shard.slots);
+	shard.slots.assign(old.size() * 2, nullptr);
+	size_t mask = shard.slots.size() - 1;
+	for (const Symbol * sym : old){
+		if (sym == nullptr){ continue; }
+		size_t i = static_cast<size_t>(sym->hash()) & mask;
+		while (shard.slots[i] != nullptr){ i = (i + 1) & mask; }
+		shard.slots[i] = sym;
+	}
+}
+
+size_t SymbolTable::size() const {
+	size_t total = 0;
+	for (size_t i = 0; i < SHARDS; i++){
+		std::lock_guard<std::mutex> guard(myShards[i].lock);
+		total += myShards[i].count;
+	}
+	return total;
+}
+
+size_t SymbolTable::lookups() const {
+	size_t total = 0;
+	for (size_t i = 0; i < SHARDS; i++){
+		std::lock_guard<std::mutex> guard(myShards[i].lock);
+		total += myShards[i].lookups;
+	}
+	return total;
+}
+
+size_t SymbolTable::hits() const {
+	size_t total = 0;
+	for (size_t i = 0; i < SHARDS; i++){
+		std::lock_guard<std::mutex> guard(myShards[i].lock);
+		total += myShards[i].hits;
+	}
+	return total;
+}
+
+} //End namespace crona
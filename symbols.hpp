@@ -0,0 +1,74 @@
+#ifndef CRONA_SYMBOLS_H
+#define CRONA_SYMBOLS_H
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "arena.hpp"
+#include "tokens.hpp"
+
+namespace crona{
+
+/**
+* \class Symbol
+* One distinct identifier spelling. Symbols are created only by a
+* SymbolTable and are never freed, so a const Symbol * is a stable
+* handle: two identifiers are the same name iff their Symbols are the
+* same pointer.
+**/
+class Symbol{
+public:
+	Symbol(StrView nameIn, uint32_t idIn, uint64_t hashIn)
+	: myName(nameIn), myId(idIn), myHash(hashIn) {}
+	StrView name() const { return myName; }
+	uint32_t id() const { return myId; }
+	uint64_t hash() const { return myHash; }
+private:
+	StrView myName;
+	uint32_t myId;
+	uint64_t myHash;
+};
+
+/**
+* \class SymbolTable
+* Interns identifier spellings into Symbols. The table is split into
+* independently locked shards, so scanners running on different
+* threads can share one table (see SymbolTable::global) with little
+* contention. Each shard is an open-addressing hash table whose
+* Symbols and name bytes live in the shard's own arena.
+**/
+class SymbolTable{
+public:
+	SymbolTable();
+	SymbolTable(const SymbolTable&) = delete;
+	SymbolTable& operator=(const SymbolTable&) = delete;
+
+	/// The process-wide table used by the scanner
+	static SymbolTable& global();
+
+	const Symbol * intern(StrView text);
+
+	size_t size() const;
+	size_t lookups() const;
+	size_t hits() const;
+private:
+	static const size_t SHARDS = 16;
+	struct Shard{
+		Shard() : count(0), lookups(0), hits(0) {}
+		std::mutex lock;
+		Arena arena;
+		std::vector<const Symbol *> slots;
+		size_t count;
+		size_t lookups;
+		size_t hits;
+	};
+	void rehash(Shard& shard);
+
+	mutable Shard myShards[SHARDS];
+	std::atomic<uint32_t> myNextId;
+};
+
+} //End namespace crona
+
+#endif
@@ -0,0 +1,104 @@
+#include "threadpool.hpp"
+
+namespace crona{
+
+//Which pool (and which of its workers) the current thread is, if any
+static thread_local ThreadPool * currentPool = nullptr;
+static thread_local size_t currentWorker = 0;
+
+ThreadPool::ThreadPool(size_t threads)
+: myQueued(0), myUnfinished(0), myNextQueue(0), myStopping(false){
+	if (threads == 0){ threads = std::thread::hardware_concurrency(); }
+	if (threads == 0){ threads = 1; }
+	for (size_t i = 0; i < threads; i++){
+		myQueues.emplace_back(new Queue());
+	}
+	for (size_t i = 0; i < threads; i++){
+		myThreads.emplace_back(&ThreadPool::work, this, i);
+	}
+}
+
+ThreadPool::~ThreadPool(){
+	wait();
+	{
+		std::lock_guard<std::mutex> guard(myLock);
+		myStopping = true;
+	}
+	myWake.notify_all();
+	for (auto& thread : myThreads){ thread.join(); }
+}
+
+void ThreadPool::submit(std::function<void()> task){
+	size_t target;
+	{
+		std::lock_guard<std::mutex> guard(myLock);
+		if (currentPool == this){
+			target = currentWorker;
+		} else {
+			target = myNextQueue;
+			myNextQueue = (myNextQueue + 1) % myQueues.size();
+		}
+		myUnfinished++;
+	}
+
+	Queue& queue = *myQueues[target];
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.tasks.push_back(std::move(task));
+	}
+
+	{
+		std::lock_guard<std::mutex> guard(myLock);
+		myQueued++;
+	}
+	myWake.notify_one();
+}
+
+void ThreadPool::wait(){
+	std::unique_lock<std::mutex> guard(myLock);
+	myIdle.wait(guard, [this]{ return myUnfinished == 0; });
+}
+
+bool ThreadPool::take(size_t self, std::function<void()>& task){
+	size_t count = myQueues.size();
+	for (size_t n = 0; n < count; n++){
+		size_t victim = (self + n) % count;
+		Queue& queue = *myQueues[victim];
+		std::lock_guard<std::mutex> guard(queue.lock);
+		if (queue.tasks.empty()){ continue; }
+		if (victim == self){
+			task = std::move(queue.tasks.back());
+			queue.tasks.pop_back();
+		} else {
+			task = std::move(queue.tasks.front());
+			queue.tasks.pop_front();
+		}
+		return true;
+	}
+	return false;
+}
+
+void ThreadPool::work(size_t self){
+	currentPool = this;
+	currentWorker = self;
+	while (true){
+		{
+			std::unique_lock<std::mutex> guard(myLock);
+			myWake.wait(guard, [this]{
+				return myStopping || myQueued > 0;
+			});
+			if (myQueued == 0){ return; }
+			myQueued--;
+		}
+
+		//A task is reserved for us, but it may sit on any queue
+		std::function<void()> task;
+		while (!take(self, task)){ std::this_thread::yield(); }
+		task();
+
+		std::lock_guard<std::mutex> guard(myLock);
+		if (--myUnfinished == 0){ myIdle.notify_all(); }
+	}
+}
+
+} //End namespace crona
@@ -0,0 +1,58 @@
+#ifndef CRONA_THREADPOOL_H
+#define CRONA_THREADPOOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace crona{
+
+/**
+* \class ThreadPool
+* Fixed set of worker threads with one task deque each. Tasks
+* submitted from outside the pool are dealt round-robin to the
+* workers; tasks submitted by a running task go on that worker's own
+* deque. A worker takes its newest task first and, when it runs dry,
+* steals the oldest task from another worker.
+**/
+class ThreadPool{
+public:
+	/// threads == 0 means one per hardware thread
+	ThreadPool(size_t threads);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	void submit(std::function<void()> task);
+
+	/// Block until every task submitted so far has finished
+	void wait();
+
+	size_t size() const { return myThreads.size(); }
+private:
+	struct Queue{
+		std::mutex lock;
+		std::deque<std::function<void()>> tasks;
+	};
+
+	void work(size_t self);
+	bool take(size_t self, std::function<void()>& task);
+
+	std::vector<std::unique_ptr<Queue>> myQueues;
+	std::vector<std::thread> myThreads;
+	std::mutex myLock;
+	std::condition_variable myWake;
+	std::condition_variable myIdle;
+	size_t myQueued;   //Submitted but not yet taken
+	size_t myUnfinished; //Submitted but not yet finished
+	size_t myNextQueue;
+	bool myStopping;
+};
+
+} //End namespace crona
+
+#endif
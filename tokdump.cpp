@@ -0,0 +1,123 @@
+#include <cstring>
+#include "errors.hpp"
+#include "symbols.hpp"
+#include "tokdump.hpp"
+#include "tokens.hpp"
+
+namespace crona{
+
+using TokenKind = crona::Parser::token;
+
+static const char MAGIC[8] = {'\x7f', 'C', 'R', 'T', 'O', 'K', '\0', '\0'};
+static const uint32_t VERSION = 1;
+static const size_t HEADER_SIZE = sizeof(MAGIC) + 2 * sizeof(uint32_t);
+static const size_t FOOTER_SIZE = 2 * sizeof(uint64_t);
+
+static void badDump(const char * why){
+	std::string msg = "Bad token dump: ";
+	msg += why;
+	throw new InternalError(msg.c_str());
+}
+
+TokenWriter::TokenWriter(int fd) : myOut(fd), myCount(0){
+	header();
+}
+
+TokenWriter::TokenWriter(std::ostream& out) : myOut(out), myCount(0){
+	header();
+}
+
+void TokenWriter::header(){
+	uint32_t fields[2] = {VERSION, sizeof(TokenRecord)};
+	myOut.write(MAGIC, sizeof(MAGIC));
+	myOut.write(reinterpret_cast<const char *>(fields), sizeof(fields));
+}
+
+uint32_t TokenWriter::addString(const char * text, size_t len){
+	uint32_t offset = static_cast<uint32_t>(myStrings.size());
+	uint32_t len32 = static_cast<uint32_t>(len);
+	myStrings.append(reinterpret_cast<const char *>(&len32), sizeof(len32));
+	myStrings.append(text, len);
+	return offset;
+}
+
+void TokenWriter::add(int kind, size_t line, size_t col,
+	const Parser::semantic_type * lval){
+	TokenRecord rec;
+	rec.kind = static_cast<uint32_t>(kind);
+	rec.line = static_cast<uint32_t>(line);
+	rec.col = static_cast<uint32_t>(col);
+	rec.payload = 0;
+	if (kind == TokenKind::ID){
+		const Symbol * sym = lval->transToken.symbol();
+		auto found = myNames.find(sym);
+		if (found == myNames.end()){
+			StrView name = sym->name();
+			uint32_t offset = addString(name.data(), name.size());
+			found = myNames.emplace(sym, offset).first;
+		}
+		rec.payload = found->second;
+	} else if (kind == TokenKind::STRLITERAL){
+		StrView str = lval->transToken.str();
+		rec.payload = addString(str.data(), str.size());
+	} else if (kind == TokenKind::INTLITERAL){
+		rec.payload = static_cast<uint32_t>(lval->transToken.num());
+	}
+	myOut.write(reinterpret_cast<const char *>(&rec), sizeof(rec));
+	myCount++;
+}
+
+bool TokenWriter::finish(){
+	uint64_t footer[2] = {myCount, myStrings.size()};
+	myOut.write(myStrings.data(), myStrings.size());
+	myOut.write(reinterpret_cast<const char *>(footer), sizeof(footer));
+	return myOut.flush();
+}
+
+bool TokenReader::isDump(const SourceFile& source){
+	return source.size() >= sizeof(MAGIC)
+	  && std::memcmp(source.data(), MAGIC, sizeof(MAGIC)) == 0;
+}
+
+TokenReader::TokenReader(std::shared_ptr<SourceFile> source)
+: mySource(source), myNext(nullptr), myEnd(nullptr),
+  myStrings(nullptr), myStringsSize(0){
+	const char * data = source->data();
+	size_t size = source->size();
+	if (!isDump(*source) || size < HEADER_SIZE + FOOTER_SIZE){
+		badDump("truncated header");
+	}
+	uint32_t fields[2];
+	std::memcpy(fields, data + sizeof(MAGIC), sizeof(fields));
+	if (fields[0] != VERSION || fields[1] != sizeof(TokenRecord)){
+		badDump("unsupported version");
+	}
+	uint64_t footer[2];
+	std::memcpy(footer, data + size - FOOTER_SIZE, sizeof(footer));
+	size_t body = size - HEADER_SIZE - FOOTER_SIZE;
+	if (footer[0] > body / sizeof(TokenRecord)
+	  || footer[0] * sizeof(TokenRecord) + footer[1] != body){
+		badDump("sizes don't match the file");
+	}
+	size_t count = static_cast<size_t>(footer[0]);
+	myNext = reinterpret_cast<const TokenRecord *>(data + HEADER_SIZE);
+	myEnd = myNext + count;
+	myStrings = data + HEADER_SIZE + count * sizeof(TokenRecord);
+	myStringsSize = static_cast<size_t>(footer[1]);
+}
+
+const char * TokenReader::string(uint32_t offset, size_t& len) const{
+	uint32_t len32;
+	if (offset > myStringsSize
+	  || myStringsSize - offset < sizeof(len32)){
+		badDump("string offset out of range");
+	}
+	std::memcpy(&len32, myStrings + offset, sizeof(len32));
+	if (myStringsSize - offset - sizeof(len32) < len32){
+		badDump("string length out of range");
+	}
+	len = len32;
+	return myStrings + offset + sizeof(len32);
+}
+
+} //End namespace crona
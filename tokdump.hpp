@@ -0,0 +1,100 @@
+#ifndef CRONA_TOKDUMP_H
+#define CRONA_TOKDUMP_H
+
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <unordered_map>
+#include "grammar.hh"
+#include "outbuf.hpp"
+#include "source.hpp"
+
+namespace crona{
+
+class Symbol;
+
+/*
+Binary token dump format (host byte order):
+
+  header   8 bytes magic "\x7fCRTOK\0\0", u32 version, u32 record size
+  records  one TokenRecord per token, END last
+  strings  the string table: each entry is a u32 length followed
+           by that many bytes, no terminator
+  footer   u64 record count, u64 string table size
+
+A record's payload is the token's value for INTLITERAL, the offset
+of its entry in the string table for ID (the name, each distinct
+name stored once) and STRLITERAL (the lexeme, quotes and all), and
+0 for every other kind.
+
+A dump is told from source by its magic, whose first byte can't
+begin a Crona program.
+*/
+struct TokenRecord{
+	uint32_t kind;
+	uint32_t line;
+	uint32_t col;
+	uint32_t payload;
+};
+
+/**
+* \class TokenWriter
+* Writes a binary token dump. Records are streamed out through an
+* OutBuf as the tokens arrive; the string table is collected in
+* memory and written by finish().
+**/
+class TokenWriter{
+public:
+	explicit TokenWriter(int fd);
+	explicit TokenWriter(std::ostream& out);
+	TokenWriter(const TokenWriter&) = delete;
+	TokenWriter& operator=(const TokenWriter&) = delete;
+
+	void add(int kind, size_t line, size_t col,
+		const Parser::semantic_type * lval);
+
+	/// Write the string table and footer. Returns false if any
+	/// write failed.
+	bool finish();
+private:
+	void header();
+	uint32_t addString(const char * text, size_t len);
+
+	OutBuf myOut;
+	std::string myStrings;
+	std::unordered_map<const Symbol *, uint32_t> myNames;
+	uint64_t myCount;
+};
+
+/**
+* \class TokenReader
+* Replays a binary token dump held in a (mapped) SourceFile. The
+* names and string literals it hands out point into the file.
+**/
+class TokenReader{
+public:
+	/// Whether source starts like a token dump
+	static bool isDump(const SourceFile& source);
+
+	/// Throws an InternalError if source is not a well-formed dump
+	explicit TokenReader(std::shared_ptr<SourceFile> source);
+
+	/// The next record, or nullptr past the END record
+	const TokenRecord * next(){
+		return myNext == myEnd ? nullptr : myNext++;
+	}
+
+	/// The string table entry at offset
+	const char * string(uint32_t offset, size_t& len) const;
+private:
+	std::shared_ptr<SourceFile> mySource;
+	const TokenRecord * myNext;
+	const TokenRecord * myEnd;
+	const char * myStrings;
+	size_t myStringsSize;
+};
+
+} //End namespace crona
+
+#endif
@@ -1,4 +1,6 @@
+#include <ostream>
 #include "tokens.hpp" // Get the class declarations
+#include "symbols.hpp"
 #include "grammar.hh" // Get the TokenKind definitions
 
 namespace crona{
@@ -6,122 +8,91 @@ namespace crona{
 using TokenKind = crona::Parser::token;
 using Lexeme = crona::Parser::semantic_type;
 
-static std::string tokenKindString(int tokKind){
-	switch(tokKind){
-		case TokenKind::END: return "EOF";
-		case TokenKind::AND: return "AND";
-		case TokenKind::ARRAY: return "ARRAY";
-		case TokenKind::ASSIGN: return "ASSIGN";
-		case TokenKind::BOOL: return "BOOL";
-		case TokenKind::BYTE: return "BYTE";
-		case TokenKind::COLON: return "COLON";
-		case TokenKind::COMMA: return "COMMA";
-		case TokenKind::CROSS: return "CROSS";
-		case TokenKind::CROSSCROSS: return "CROSSCROSS";
-		case TokenKind::DASH: return "DASH";
-		case TokenKind::DASHDASH: return "DASHDASH";
-		case TokenKind::ELSE: return "ELSE";
-		case TokenKind::EQUALS: return "EQUALS";
-		case TokenKind::FALSE: return "FALSE";
-		case TokenKind::HAVOC: return "HAVOC";
-		case TokenKind::ID: return "ID";
-		case TokenKind::IF: return "IF";
-		case TokenKind::INT: return "INT";
-		case TokenKind::INTLITERAL: return "INTLIT";
-		case TokenKind::GREATER: return "GREATER";
-		case TokenKind::GREATEREQ: return "GREATEREQ";
-		case TokenKind::LBRACE: return "LBRACE";
-		case TokenKind::LCURLY: return "LCURLY";
-		case TokenKind::LESS: return "LESS";
-		case TokenKind::LESSEQ: return "LESSEQ";
-		case TokenKind::LPAREN: return "LPAREN";
-		case TokenKind::NOT: return "NOT";
-		case TokenKind::NOTEQUALS: return "NOTEQUALS";
-		case TokenKind::OR: return "OR";
-		case TokenKind::RBRACE: return "RBRACE";
-		case TokenKind::RCURLY: return "RCURLY";
-		case TokenKind::READ: return "READ";
-		case TokenKind::RETURN: return "RETURN";
-		case TokenKind::RPAREN: return "RPAREN";
-		case TokenKind::SEMICOLON: return "SEMICOLON";
-		case TokenKind::SLASH: return "SLASH";
-		case TokenKind::STRING: return "STRING";
-		case TokenKind::STAR: return "STAR";
-		case TokenKind::STRLITERAL: return "STRINGLIT";
-		case TokenKind::TRUE: return "TRUE";
-		case TokenKind::VOID: return "VOID";
-		case TokenKind::WHILE: return "WHILE";
-		case TokenKind::WRITE: return "WRITE";
-		default:	
-			return "OTHER";
-	}
-	
-}
-
-Token::Token(size_t lineIn, size_t columnIn, int kindIn)
-  : myLine(lineIn), myCol(columnIn), myKind(kindIn){
-}
-
-std::string Token::toString(){
-	return tokenKindString(kind())
-	+ " [" + std::to_string(line()) 
-	+ "," + std::to_string(col()) + "]";
-}
-
-size_t Token::line() const { 
-	return this->myLine; 
-}
-
-size_t Token::col() const { 
-	return this->myCol; 
+/*
+Token names, indexed by kind. Bison numbers the terminals from 258
+in their %token order in crona.yy; the asserts below catch the
+table and the grammar falling out of step.
+*/
+static constexpr const char * KIND_NAMES[] = {
+	"AND", "ARRAY", "ASSIGN", "BOOL", "BYTE", "COLON", "COMMA",
+	"CROSS", "CROSSCROSS", "DASH", "DASHDASH", "ELSE", "EQUALS",
+	"FALSE", "HAVOC", "ID", "IF", "INT", "INTLIT", "GREATER",
+	"GREATEREQ", "LBRACE", "LCURLY", "LESS", "LESSEQ", "LPAREN",
+	"NOT", "NOTEQUALS", "OR", "RBRACE", "RCURLY", "READ", "RETURN",
+	"RPAREN", "SEMICOLON", "SLASH", "STRING", "STAR", "STRINGLIT",
+	"TRUE", "VOID", "WHILE", "WRITE",
+};
+static constexpr int FIRST_KIND = TokenKind::AND;
+static constexpr int NUM_KINDS = sizeof(KIND_NAMES) / sizeof(KIND_NAMES[0]);
+
+static_assert(TokenKind::WRITE - FIRST_KIND + 1 == NUM_KINDS,
+	"KIND_NAMES must list every token in crona.yy");
+static_assert(TokenKind::ID - FIRST_KIND == 15
+	&& TokenKind::INTLITERAL - FIRST_KIND == 18
+	&& TokenKind::STRLITERAL - FIRST_KIND == 38,
+	"KIND_NAMES must follow the %token order in crona.yy");
+
+const char * tokenKindString(int tokKind){
+	if (tokKind == TokenKind::END){ return "EOF"; }
+	int index = tokKind - FIRST_KIND;
+	if (index < 0 || index >= NUM_KINDS){ return "OTHER"; }
+	return KIND_NAMES[index];
 }
 
-int Token::kind() const { 
-	return this->myKind; 
+std::ostream& operator<<(std::ostream& out, const StrView& view){
+	return out.write(view.data(), static_cast<std::streamsize>(view.size()));
 }
 
-IDToken::IDToken(size_t lIn, size_t cIn, std::string vIn)
-  : Token(lIn, cIn, TokenKind::ID), myValue(vIn){ 
+Token Token::bare(size_t lineIn, size_t colIn, int kindIn){
+	Token tok;
+	tok.myKind = kindIn;
+	tok.myLine = static_cast<uint32_t>(lineIn);
+	tok.myCol = static_cast<uint32_t>(colIn);
+	tok.myLen = 0;
+	tok.myPayload.text = nullptr;
+	return tok;
 }
 
-std::string IDToken::toString(){
-	return tokenKindString(kind()) + ":"
-	+ this->myValue
-	+ " [" + std::to_string(line()) 
-	+ "," + std::to_string(col()) + "]";
+Token Token::ident(size_t lineIn, size_t colIn, const Symbol * symIn){
+	Token tok = bare(lineIn, colIn, TokenKind::ID);
+	tok.myPayload.symbol = symIn;
+	return tok;
 }
 
-const std::string IDToken::value() const { 
-	return this->myValue; 
+Token Token::strLit(size_t lineIn, size_t colIn, StrView textIn){
+	Token tok = bare(lineIn, colIn, TokenKind::STRLITERAL);
+	tok.myPayload.text = textIn.data();
+	tok.myLen = static_cast<uint32_t>(textIn.size());
+	return tok;
 }
 
-StrToken::StrToken(size_t lIn, size_t cIn, std::string sIn)
-  : Token(lIn, cIn, TokenKind::STRLITERAL), myStr(sIn){
-}
-
-std::string StrToken::toString(){
-	return tokenKindString(kind()) + ":"
-	+ this->myStr
-	+ " [" + std::to_string(line()) 
-	+ "," + std::to_string(col()) + "]";
+Token Token::intLit(size_t lineIn, size_t colIn, int numIn){
+	Token tok = bare(lineIn, colIn, TokenKind::INTLITERAL);
+	tok.myPayload.num = numIn;
+	return tok;
 }
 
-const std::string StrToken::str() const {
-	return this->myStr;
+StrView Token::value() const {
+	return this->myPayload.symbol->name();
 }
 
-IntLitToken::IntLitToken(size_t lIn, size_t cIn, int numIn)
-  : Token(lIn, cIn, TokenKind::INTLITERAL), myNum(numIn){}
-
-std::string IntLitToken::toString(){
-	return tokenKindString(kind()) + ":"
-	+ std::to_string(this->myNum)
-	+ " [" + std::to_string(line()) 
+std::string Token::toString() const {
+	std::string result = tokenKindString(kind());
+	switch (kind()){
+	case TokenKind::ID:
+		result += ":" + value().str();
+		break;
+	case TokenKind::STRLITERAL:
+		result += ":" + str().str();
+		break;
+	case TokenKind::INTLITERAL:
+		result += ":" + std::to_string(num());
+		break;
+	default:
+		break;
+	}
+	return result + " [" + std::to_string(line())
 	+ "," + std::to_string(col()) + "]";
 }
 
-int IntLitToken::num() const {
-	return this->myNum;
-}
-
 } //End namespace crona
@@ -1,60 +1,91 @@
 #ifndef CRONA_TOKEN_H
 #define CRONA_TOKEN_H
 
+#include <cstdint>
+#include <cstring>
+#include <iosfwd>
 #include <string>
+#include <type_traits>
 
 namespace crona{
 
-class Token{
+/**
+* A non-owning view of a lexeme's text. The bytes live either in the
+* memory-mapped source file or in the parse arena, both of which
+* outlive the tokens and AST nodes that refer to them.
+**/
+class StrView{
 public:
-	Token(size_t lineIn, size_t columnIn, int kindIn);
-	virtual std::string toString();
-	size_t line() const;
-	size_t col() const;
-	int kind() const;
+	StrView() : myPtr(nullptr), myLen(0) {}
+	StrView(const char * ptrIn, size_t lenIn)
+	: myPtr(ptrIn), myLen(lenIn) {}
+	const char * data() const { return myPtr; }
+	size_t size() const { return myLen; }
+	std::string str() const { return std::string(myPtr, myLen); }
+	bool operator==(const StrView& other) const {
+		return myLen == other.myLen
+		  && (myLen == 0 || std::memcmp(myPtr, other.myPtr, myLen) == 0);
+	}
+	bool operator!=(const StrView& other) const {
+		return !(*this == other);
+	}
 private:
-	const size_t myLine;
-	const size_t myCol;
-	const int myKind;
+	const char * myPtr;
+	size_t myLen;
 };
 
-class IDToken : public Token{
-public:
-	IDToken(size_t lIn, size_t cIn, std::string valIn);
-	const std::string value() const;
-	virtual std::string toString() override;
-private:
-	const std::string myValue;
-	
-};
+std::ostream& operator<<(std::ostream& out, const StrView& view);
 
-class StrToken : public Token{
-public:
-	StrToken(size_t lIn, size_t cIn, std::string valIn);
-	virtual std::string toString() override;
-	const std::string str() const;
-private:
-	const std::string myStr;
-};
+class Symbol;
 
-class CharLitToken : public Token{
+/**
+* \class Token
+* A token as the scanner hands it to the parser. Tokens are small,
+* trivially copyable values that travel by value through the
+* parser's %union, so producing one (even an identifier or a
+* literal) never allocates. What the payload holds depends on the
+* kind: the interned name of an ID, the value of an INTLITERAL, or
+* the lexeme of a STRLITERAL (a view into the source or the arena).
+**/
+class Token{
 public:
-	CharLitToken(size_t lIn, size_t cIn, char valIn);
-	virtual std::string toString() override;
-	char val() const;
-private:
-	const char myVal;
-};
+	Token() = default;
 
-class IntLitToken : public Token{
-public:
-	IntLitToken(size_t lIn, size_t cIn, int numIn);
-	virtual std::string toString() override;
-	int num() const;
+	static Token bare(size_t lineIn, size_t colIn, int kindIn);
+	static Token ident(size_t lineIn, size_t colIn, const Symbol * symIn);
+	static Token strLit(size_t lineIn, size_t colIn, StrView textIn);
+	static Token intLit(size_t lineIn, size_t colIn, int numIn);
+
+	std::string toString() const;
+	int kind() const { return myKind; }
+	size_t line() const { return myLine; }
+	size_t col() const { return myCol; }
+
+	/// ID: the interned name
+	const Symbol * symbol() const { return myPayload.symbol; }
+	StrView value() const;
+	/// STRLITERAL: the lexeme, quotes and all
+	StrView str() const { return StrView(myPayload.text, myLen); }
+	/// INTLITERAL: the value
+	int num() const { return myPayload.num; }
 private:
-	const int myNum;
+	int myKind;
+	uint32_t myLine;
+	uint32_t myCol;
+	uint32_t myLen;
+	union{
+		const Symbol * symbol;
+		const char * text;
+		int num;
+	} myPayload;
 };
 
+static_assert(std::is_trivially_copyable<Token>::value,
+	"Tokens are passed by value through the parser's %union");
+
+/// The name of a token kind as it appears in token dumps, e.g. "ID"
+const char * tokenKindString(int tokKind);
+
 }
 
 #endif
@@ -0,0 +1,92 @@
+#include <cstdio>
+#include <cstring>
+#include "errors.hpp"
+#include "types.hpp"
+
+namespace crona{
+
+static const uint32_t NUM_BASE_TYPES = 4;
+static const size_t FIRST_SLOTS = 64;
+
+static StrView literal(const char * text){
+	return StrView(text, std::strlen(text));
+}
+
+TypeTable::TypeTable()
+: myInt(DataType::INT, nullptr, 0, 0, literal("int")),
+  myBool(DataType::BOOL, nullptr, 0, 1, literal("bool")),
+  myByte(DataType::BYTE, nullptr, 0, 2, literal("byte")),
+  myVoid(DataType::VOID, nullptr, 0, 3, literal("void")),
+  mySlots(FIRST_SLOTS, nullptr), myNextId(NUM_BASE_TYPES){
+}
+
+TypeTable& TypeTable::global(){
+	static TypeTable table;
+	return table;
+}
+
+const DataType * TypeTable::base(DataType::Kind kind) const{
+	switch (kind){
+	case DataType::INT: return &myInt;
+	case DataType::BOOL: return &myBool;
+	case DataType::BYTE: return &myByte;
+	case DataType::VOID: return &myVoid;
+	case DataType::ARRAY: break;
+	}
+	throw new InternalError("Array is not a base type");
+}
+
+static size_t arrayHash(const DataType * element, int size){
+	uint64_t h = (static_cast<uint64_t>(element->id()) << 32
+		| static_cast<uint32_t>(size)) * 0x9e3779b97f4a7c15ull;
+	return static_cast<size_t>(h ^ (h >> 29));
+}
+
+/*
+Most declarations are of base types, which never get here, so one
+lock for the whole table is plenty.
+*/
+const DataType * TypeTable::arrayOf(const DataType * element, int size){
+	std::lock_guard<std::mutex> guard(myLock);
+	size_t mask = mySlots.size() - 1;
+	size_t i = arrayHash(element, size) & mask;
+	while (const DataType * type = mySlots[i]){
+		if (type->element() == element && type->size() == size){
+			return type;
+		}
+		i = (i + 1) & mask;
+	}
+
+	char suffix[32];
+	int len = std::snprintf(suffix, sizeof(suffix), " array[%d]", size);
+	StrView elementName = element->name();
+	size_t nameLen = elementName.size() + static_cast<size_t>(len);
+	char * name = static_cast<char *>(myArena.alloc(nameLen, 1));
+	std::memcpy(name, elementName.data(), elementName.size());
+	std::memcpy(name + elementName.size(), suffix, static_cast<size_t>(len));
+	const DataType * type = myArena.make<DataType>(DataType::ARRAY,
+		element, size, myNextId++, StrView(name, nameLen));
+	mySlots[i] = type;
+	if ((myNextId - NUM_BASE_TYPES) * 2 > mySlots.size()){ rehash(); }
+	return type;
+}
+
+void TypeTable::rehash(){
+	std::vector<const DataType *> old;
+	old.swap(mySlots);
+	mySlots.assign(old.size() * 2, nullptr);
+	size_t mask = mySlots.size() - 1;
+	for (const DataType * type : old){
+		if (type == nullptr){ continue; }
+		size_t i = arrayHash(type->element(), type->size()) & mask;
+		while (mySlots[i] != nullptr){ i = (i + 1) & mask; }
+		mySlots[i] = type;
+	}
+}
+
+size_t TypeTable::size() const{
+	std::lock_guard<std::mutex> guard(myLock);
+	return myNextId;
+}
+
+} //End namespace crona
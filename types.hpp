@@ -0,0 +1,102 @@
+#ifndef CRONA_TYPES_H
+#define CRONA_TYPES_H
+
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include "arena.hpp"
+#include "tokens.hpp"
+
+namespace crona{
+
+/**
+* \class DataType
+* A Crona type: int, bool, byte, void, or an array of one of those.
+* DataTypes are created only by a TypeTable and are never freed, and
+* the table makes just one of each, so a const DataType * is a stable
+* handle: two types are the same iff they are the same pointer.
+**/
+class DataType{
+public:
+	enum Kind : unsigned char{ INT, BOOL, BYTE, VOID, ARRAY };
+
+	DataType(Kind kindIn, const DataType * elementIn, int sizeIn,
+	  uint32_t idIn, StrView nameIn)
+	: myKind(kindIn), myElement(elementIn), mySize(sizeIn), myId(idIn),
+	  myName(nameIn) {}
+
+	Kind kind() const { return myKind; }
+	bool isArray() const { return myKind == ARRAY; }
+	/// For an array, the type of its elements (otherwise nullptr)
+	const DataType * element() const { return myElement; }
+	/// For an array, how many elements it has
+	int size() const { return mySize; }
+	/// As written in Crona source, e.g. "bool array[10]"
+	StrView name() const { return myName; }
+	/// Dense, in order of creation: the base types are 0 to 3
+	uint32_t id() const { return myId; }
+private:
+	Kind myKind;
+	const DataType * myElement;
+	int mySize;
+	uint32_t myId;
+	StrView myName;
+};
+
+/**
+* A type where the source spells it out: what the parser passes from
+* a type production up to the declaration it belongs to, the
+* canonical DataType and where it was written.
+**/
+struct TypeRef{
+	const DataType * type;
+	uint32_t line;
+	uint32_t col;
+};
+
+/**
+* \class TypeTable
+* Hash-conses DataTypes. The base types are made up front; an array
+* type is made the first time it's asked for, and the same one is
+* handed out from then on. Array types (and their names) live in the
+* table's arena and are found through an open-addressing table, so
+* a program that declares arrays of many sizes costs no allocation
+* per type. The table is locked, so parsers running on different
+* threads can share one (see TypeTable::global).
+**/
+class TypeTable{
+public:
+	TypeTable();
+	TypeTable(const TypeTable&) = delete;
+	TypeTable& operator=(const TypeTable&) = delete;
+
+	/// The process-wide table used by the parser
+	static TypeTable& global();
+
+	const DataType * intType() const { return &myInt; }
+	const DataType * boolType() const { return &myBool; }
+	const DataType * byteType() const { return &myByte; }
+	const DataType * voidType() const { return &myVoid; }
+	/// One of the above, by kind (which must not be ARRAY)
+	const DataType * base(DataType::Kind kind) const;
+	/// The type of an array of size elements of type element
+	const DataType * arrayOf(const DataType * element, int size);
+
+	/// How many distinct types there are
+	size_t size() const;
+private:
+	void rehash();
+
+	DataType myInt;
+	DataType myBool;
+	DataType myByte;
+	DataType myVoid;
+	mutable std::mutex myLock;
+	Arena myArena;
+	std::vector<const DataType *> mySlots;
+	uint32_t myNextId;
+};
+
+} //End namespace crona
+
+#endif
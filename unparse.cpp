@@ -1,410 +1,422 @@
+#include <algorithm>
+#include <string>
+#include <vector>
 #include "ast.hpp"
+#include "threadpool.hpp"
+#include "visitor.hpp"
 
 namespace crona{
 
 /*
-doIndent is declared static, which means that it can
-only be called in this file (its symbol is not exported).
+Unparsing is one pass, the Unparser below: a method per node class
+(visitIDNode, ...), each writing its node at the given indentation
+and reaching its children with static dispatch (see ASTVisitor).
 */
-static void doIndent(std::ostream& out, int indent){
-	for (int k = 0 ; k < indent; k++){ out << "\t"; }
+class Unparser : public ASTVisitor<Unparser, void, int>{
+public:
+	explicit Unparser(OutBuf& out) : myOut(out){}
+private:
+	friend class ASTVisitor<Unparser, void, int>;
+#define CRONA_UNPARSE_KIND(name) void visit##name(name * node, int indent);
+	CRONA_AST_NODES(CRONA_UNPARSE_KIND)
+#undef CRONA_UNPARSE_KIND
+
+	OutBuf& myOut;
+};
+
+void ASTNode::unparse(OutBuf& out, int indent){
+	Unparser(out).visit(this, indent);
+}
+
+void ASTNode::unparse(std::ostream& out, int indent){
+	OutBuf buf(out);
+	unparse(buf, indent);
 }
 
 /*
-In this code, the intention is that functions are grouped
-into files by purpose, rather than by class.
-If you're used to having all of the functions of a class
-defined in the same file, this style may be a bit disorienting,
-though it is legal. Thus, we can have
-ProgramNode::unparse, which is the unparse method of ProgramNodes
-defined in the same file as DeclNode::unparse, the unparse method
-of DeclNodes.
+Declarations are unparsed independently, so the globals are dealt
+out in contiguous runs, each unparsed into a string of its own, and
+the strings go out in source order. There are several runs per
+worker, so that a run of big functions doesn't hold the rest up,
+but not many more: each run has its own OutBuf.
 */
+void ProgramNode::unparseParallel(OutBuf& out, ThreadPool& pool){
+	const size_t RUNS_PER_THREAD = 8;
+	size_t count = myGlobals.size();
+	size_t runs = std::min(count, pool.size() * RUNS_PER_THREAD);
+	if (runs <= 1){
+		unparse(out, 0);
+		return;
+	}
+	std::vector<std::string> texts(runs);
+	for (size_t r = 0; r < runs; r++){
+		size_t begin = r * count / runs;
+		size_t end = (r + 1) * count / runs;
+		std::string * text = &texts[r];
+		pool.submit([this, text, begin, end]{
+			OutBuf buf(*text);
+			Unparser unparser(buf);
+			for (size_t i = begin; i < end; i++){ unparser.visit(myGlobals[i], 0); }
+		});
+	}
+	pool.wait();
+	for (const std::string& text : texts){ out.write(text.data(), text.size()); }
+}
 
-
-void ProgramNode::unparse(std::ostream& out, int indent){
+void Unparser::visitProgramNode(ProgramNode * node, int indent){
 	/* Oh, hey it's a for-each loop in C++!
 	   The loop iterates over each element in a collection
 	   without that gross i++ nonsense.
 	 */
-	for (auto global : *myGlobals){
+	for (auto global : node->globals()){
 		/* The auto keyword tells the compiler
 		   to (try to) figure out what the
 		   type of a variable should be from
 		   context. here, since we're iterating
-		   over a list of DeclNode *s, it's
+		   over a NodeList of DeclNode *s, it's
 		   pretty clear that global is of
 		   type DeclNode *.
 		*/
-		global->unparse(out, indent);
+		visit(global, indent);
 	}
 }
 
-void VarDeclNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	this->myId->unparse(out, 0);
-	out << " : ";
-	this->myType->unparse(out, 0);
-	out << ";\n";
+void Unparser::visitVarDeclNode(VarDeclNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->id(), 0);
+	myOut << " : ";
+	myOut << node->type()->name();
+	myOut << ";\n";
 }
 
-void FormalDeclNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	this->myId->unparse(out,0);
-	out << " : ";
-	this ->myType->unparse(out,0);
+void Unparser::visitFormalDeclNode(FormalDeclNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->id(), 0);
+	myOut << " : ";
+	myOut << node->type()->name();
 }
 
-void FnDeclNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	this->myId->unparse(out,0);
-	out << " : ";
-	this ->myType->unparse(out,0);
-	out << "(";
+void Unparser::visitFnDeclNode(FnDeclNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->id(), 0);
+	myOut << " : ";
+	myOut << node->type()->name();
+	myOut << "(";
 
 	bool firstFormal = true;
-	for(auto fm : *formals){
+	for(auto fm : node->formals()){
 		if(firstFormal){
 			firstFormal = false;
 		}
 		else{
-			out << ", ";
+			myOut << ", ";
 		}
-		fm->unparse(out, 0);
+		visit(fm, 0);
 	}
 
-	out << "){\n";
+	myOut << "){\n";
 
-	for(auto stmt : *this->bodyVal){
-		stmt->unparse(out, indent+1);
+	for(auto stmt : node->body()){
+		visit(stmt, indent+1);
 	}
 
-	doIndent(out, indent);
-	out << "}\n";
-}
-
-///////TYPENODE CLASSES////////////
-///////////////////////////////////
-
-void ArrayTypeNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	this->myType->unparse(out,0);
-	out << " array[" <<this->mySize << "]";
-}
-
-void BoolTypeNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "bool";
-}
-
-void ByteTypeNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "byte";
-}
-
-void IntTypeNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "int";
-}
-
-void VoidTypeNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "void";
+	myOut.indent(indent);
+	myOut << "}\n";
 }
 
 ///////EXPNODE CLASSES//////////////
 ///////////////////////////////////
 
-void AssignExpNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	dest->unparse(out, 0);
-	out << " = ";
-	src->unparse(out, 0);
+void Unparser::visitAssignExpNode(AssignExpNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->dest(), 0);
+	myOut << " = ";
+	visit(node->src(), 0);
 }
 
-void CallExpNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	myIDNode->unparse(out, 0);
-	out << "(";
+void Unparser::visitCallExpNode(CallExpNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->id(), 0);
+	myOut << "(";
 	bool firstExpInList = true;
-	for(auto exp : *myListOfExp){
+	for(auto exp : node->args()){
 		if(firstExpInList){
 			firstExpInList = false;
 		}
 		else{
-			out << ", ";
+			myOut << ", ";
 		}
-		exp->unparse(out, 0);
+		visit(exp, 0);
 	}
-	out << ")";
+	myOut << ")";
 }
 
-void FalseNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "false";
+void Unparser::visitFalseNode(FalseNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "false";
 }
 
-void HavocNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "havoc";
+void Unparser::visitHavocNode(HavocNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "havoc";
 }
 
-void IntLitNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << val;
+void Unparser::visitIntLitNode(IntLitNode * node, int indent){
+	myOut.indent(indent);
+	myOut << node->value();
 }
 
-void StrLitNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << val;
+void Unparser::visitStrLitNode(StrLitNode * node, int indent){
+	myOut.indent(indent);
+	myOut << node->value();
 }
 
-void TrueNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "true";
+void Unparser::visitTrueNode(TrueNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "true";
 }
 
-void IDNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << this->myStrVal;
+void Unparser::visitIDNode(IDNode * node, int indent){
+	myOut.indent(indent);
+	myOut << node->symbol()->name();
 }
 
 ///////BINARYEXPNODE SUBCLASSES//////////////
 ////////////////////////////////////////////
 
-void AndNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " && ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void DivideNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " / ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void EqualsNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " == ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void GreaterEqNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " >= ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void GreaterNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " > ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void LessEqNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " <= ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void LessNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " < ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void MinusNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " - ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void NotEqualsNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " != ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void OrNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " || ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void PlusNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " + ";
-	rhs->unparse(out, 0);
-	out << ")";
-}
-
-void TimesNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	lhs->unparse(out, 0);
-	out << " * ";
-	rhs->unparse(out, 0);
-	out << ")";
+void Unparser::visitAndNode(AndNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " && ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitDivideNode(DivideNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " / ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitEqualsNode(EqualsNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " == ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitGreaterEqNode(GreaterEqNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " >= ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitGreaterNode(GreaterNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " > ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitLessEqNode(LessEqNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " <= ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitLessNode(LessNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " < ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitMinusNode(MinusNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " - ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitNotEqualsNode(NotEqualsNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " != ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitOrNode(OrNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " || ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitPlusNode(PlusNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " + ";
+	visit(node->rhs(), 0);
+	myOut << ")";
+}
+
+void Unparser::visitTimesNode(TimesNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	visit(node->lhs(), 0);
+	myOut << " * ";
+	visit(node->rhs(), 0);
+	myOut << ")";
 }
 
 ///////UNARYEXPNODE SUBCLASSES//////////////
 ////////////////////////////////////////////
 
-void NegNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	out << "-";
-	val->unparse(out, 0);
-	out << ")";
+void Unparser::visitNegNode(NegNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	myOut << "-";
+	visit(node->exp(), 0);
+	myOut << ")";
 }
 
-void NotNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "(";
-	out << "!";
-	val->unparse(out, 0);
-	out << ")";
+void Unparser::visitNotNode(NotNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "(";
+	myOut << "!";
+	visit(node->exp(), 0);
+	myOut << ")";
 }
 
 ///////STMTNODE CLASSES/////////////
 ///////////////////////////////////
 
-void AssignStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	myAssignExp->unparse(out,0);
-	out << ";\n";
+void Unparser::visitAssignStmtNode(AssignStmtNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->assignExp(), 0);
+	myOut << ";\n";
 }
 
-void ReadStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "read ";
-	myLVal->unparse(out,0);
-	out << ";\n";
+void Unparser::visitReadStmtNode(ReadStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "read ";
+	visit(node->lval(), 0);
+	myOut << ";\n";
 }
 
-void WriteStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "write ";
-	myExp->unparse(out,0);
-	out << ";\n";
+void Unparser::visitWriteStmtNode(WriteStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "write ";
+	visit(node->exp(), 0);
+	myOut << ";\n";
 }
 
-void PostDecStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	myLVal->unparse(out,0);
-	out << "--;\n";
+void Unparser::visitPostDecStmtNode(PostDecStmtNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->lval(), 0);
+	myOut << "--;\n";
 }
 
-void PostIncStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	myLVal->unparse(out,0);
-	out << "++;\n";
+void Unparser::visitPostIncStmtNode(PostIncStmtNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->lval(), 0);
+	myOut << "++;\n";
 }
 
-void IfStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "if ( ";
-	myCond->unparse(out,0);
-	out << ") {\n";
-	for(auto state : *myBody)
+void Unparser::visitIfStmtNode(IfStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "if ( ";
+	visit(node->cond(), 0);
+	myOut << ") {\n";
+	for(auto state : node->body())
 	{
-		state->unparse(out, indent+1);
+		visit(state, indent+1);
 	}
-	doIndent(out, indent);
-	out << "}\n";
+	myOut.indent(indent);
+	myOut << "}\n";
 }
 
-void IfElseStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "if (";
-	myCond->unparse(out,0);
-	out << ") {\n";
-	for(auto state : *myTrueBranch)
+void Unparser::visitIfElseStmtNode(IfElseStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "if (";
+	visit(node->cond(), 0);
+	myOut << ") {\n";
+	for(auto state : node->trueBranch())
 	{
-		state->unparse(out, indent+1);
+		visit(state, indent+1);
 	}
-	doIndent(out,indent);
-	out << "} else {\n";
-	for(auto state : *myFalseBranch)
+	myOut.indent(indent);
+	myOut << "} else {\n";
+	for(auto state : node->falseBranch())
 	{
-		state->unparse(out, indent+1);
+		visit(state, indent+1);
 	}
-	doIndent(out, indent);
-	out << "}\n";
+	myOut.indent(indent);
+	myOut << "}\n";
 }
 
-void WhileStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out,indent);
-	out << "while (";
-	myExp->unparse(out,0);
-	out << ") {\n";
-	for(auto state : *myBody)
+void Unparser::visitWhileStmtNode(WhileStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "while (";
+	visit(node->cond(), 0);
+	myOut << ") {\n";
+	for(auto state : node->body())
 	{
-		state->unparse(out, indent+1);
+		visit(state, indent+1);
 	}
-	doIndent(out, indent);
-	out << "}\n";
+	myOut.indent(indent);
+	myOut << "}\n";
 }
 
-void ReturnStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	out << "return ";
-	if(myExp != NULL)
+void Unparser::visitReturnStmtNode(ReturnStmtNode * node, int indent){
+	myOut.indent(indent);
+	myOut << "return ";
+	if(node->exp() != NULL)
 	{
-		out << " ";
-		myExp->unparse(out,0);
+		myOut << " ";
+		visit(node->exp(), 0);
 	}
-	out << ";\n";
+	myOut << ";\n";
 }
 
-void CallStmtNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	myCallExp->unparse(out,0);
-	out << ";\n";
+void Unparser::visitCallStmtNode(CallStmtNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->callExp(), 0);
+	myOut << ";\n";
 }
 
 ///////LValNode SUBCLASSES//////////////
 ////////////////////////////////////////
 
-void IndexNode::unparse(std::ostream& out, int indent){
-	doIndent(out, indent);
-	base->unparse(out, 0);
-	out << "[";
-	offset->unparse(out, 0);
-	out << "]";
+void Unparser::visitIndexNode(IndexNode * node, int indent){
+	myOut.indent(indent);
+	visit(node->base(), 0);
+	myOut << "[";
+	visit(node->offset(), 0);
+	myOut << "]";
 }
 
 } // End namespace crona
@@ -0,0 +1,156 @@
+#ifndef CRONA_VISITOR_H
+#define CRONA_VISITOR_H
+
+#include "ast.hpp"
+
+namespace crona{
+
+/**
+* \class ASTVisitor
+* Statically dispatched traversals, so that a pass over the tree is
+* one class rather than another virtual method in every node class.
+* A pass derives from ASTVisitor<Pass, Result, Args...> and defines
+* a method for each node class it handles, named after the class:
+*
+*     Result visitIDNode(IDNode * node, Args... args);
+*
+* visit(node, args...) switches on node->kind() and calls the
+* pass's method for the node's class directly, with no virtual
+* call, so the compiler is free to inline it. A class the pass has
+* no method for goes to visitNode(node, args...), with node typed
+* as its own class: a pass can overload visitNode for, say,
+* BinaryExpNode * to handle a whole family of classes at once. The
+* default visitNode does nothing (it returns Result()); a pass that
+* overloads it must bring the default in with a using-declaration
+* if it still wants it.
+*
+* Children are only visited when a pass asks: visitChildren(node,
+* args...) visits each of node's children in source order, and
+* discards their results. Given a node typed as its own class (as
+* the default visitNode is), it goes straight to that class's
+* children; given an ASTNode * or the like, it switches on the kind
+* first. A visitNode written as a template over the node's type
+* keeps the class all the way down. Both visitChildren and visit
+* dispatch through self().visit, so a pass may also wrap visit.
+*
+* The pass's methods must be accessible to ASTVisitor: public, or
+* private with ASTVisitor a friend. See Unparser (unparse.cpp) and
+* ASTWriter (astcache.hpp).
+**/
+template <typename Derived, typename Result = void, typename... Args>
+class ASTVisitor{
+public:
+	Result visit(ASTNode * node, Args... args){
+		switch (node->kind()){
+#define CRONA_VISIT_KIND(name) \
+		case NodeKind::name: \
+			return self().visit##name(static_cast<name *>(node), args...);
+		CRONA_AST_NODES(CRONA_VISIT_KIND)
+#undef CRONA_VISIT_KIND
+		}
+		return Result();
+	}
+
+	/// Visit each node of a child list, in order
+	template <typename T>
+	void visitAll(NodeList<T>& nodes, Args... args){
+		for (T * n : nodes){ self().visit(n, args...); }
+	}
+
+	void visitChildren(ASTNode * node, Args... args){
+		switch (node->kind()){
+#define CRONA_VISIT_CHILDREN(name) \
+		case NodeKind::name: \
+			visitChildren(static_cast<name *>(node), args...); \
+			return;
+		CRONA_AST_NODES(CRONA_VISIT_CHILDREN)
+#undef CRONA_VISIT_CHILDREN
+		}
+	}
+
+	//The children of a node whose class is known, without a switch
+	void visitChildren(ProgramNode * node, Args... args){
+		visitAll(node->globals(), args...);
+	}
+	void visitChildren(VarDeclNode * node, Args... args){
+		self().visit(node->id(), args...);
+	}
+	void visitChildren(FnDeclNode * node, Args... args){
+		self().visit(node->id(), args...);
+		visitAll(node->formals(), args...);
+		visitAll(node->body(), args...);
+	}
+	void visitChildren(IndexNode * node, Args... args){
+		self().visit(node->base(), args...);
+		self().visit(node->offset(), args...);
+	}
+	void visitChildren(AssignExpNode * node, Args... args){
+		self().visit(node->dest(), args...);
+		self().visit(node->src(), args...);
+	}
+	void visitChildren(CallExpNode * node, Args... args){
+		self().visit(node->id(), args...);
+		visitAll(node->args(), args...);
+	}
+	void visitChildren(BinaryExpNode * node, Args... args){
+		self().visit(node->lhs(), args...);
+		self().visit(node->rhs(), args...);
+	}
+	void visitChildren(UnaryExpNode * node, Args... args){
+		self().visit(node->exp(), args...);
+	}
+	void visitChildren(AssignStmtNode * node, Args... args){
+		self().visit(node->assignExp(), args...);
+	}
+	void visitChildren(ReadStmtNode * node, Args... args){
+		self().visit(node->lval(), args...);
+	}
+	void visitChildren(WriteStmtNode * node, Args... args){
+		self().visit(node->exp(), args...);
+	}
+	void visitChildren(PostDecStmtNode * node, Args... args){
+		self().visit(node->lval(), args...);
+	}
+	void visitChildren(PostIncStmtNode * node, Args... args){
+		self().visit(node->lval(), args...);
+	}
+	void visitChildren(IfStmtNode * node, Args... args){
+		self().visit(node->cond(), args...);
+		visitAll(node->body(), args...);
+	}
+	void visitChildren(IfElseStmtNode * node, Args... args){
+		self().visit(node->cond(), args...);
+		visitAll(node->trueBranch(), args...);
+		visitAll(node->falseBranch(), args...);
+	}
+	void visitChildren(WhileStmtNode * node, Args... args){
+		self().visit(node->cond(), args...);
+		visitAll(node->body(), args...);
+	}
+	void visitChildren(ReturnStmtNode * node, Args... args){
+		if (node->exp() != nullptr){ self().visit(node->exp(), args...); }
+	}
+	void visitChildren(CallStmtNode * node, Args... args){
+		self().visit(node->callExp(), args...);
+	}
+#define CRONA_NO_CHILDREN(name) void visitChildren(name *, Args...){}
+	CRONA_NO_CHILDREN(IDNode) CRONA_NO_CHILDREN(FalseNode)
+	CRONA_NO_CHILDREN(HavocNode) CRONA_NO_CHILDREN(IntLitNode)
+	CRONA_NO_CHILDREN(StrLitNode) CRONA_NO_CHILDREN(TrueNode)
+#undef CRONA_NO_CHILDREN
+
+#define CRONA_VISIT_DEFAULT(name) \
+	Result visit##name(name * node, Args... args){ \
+		return self().visitNode(node, args...); \
+	}
+	CRONA_AST_NODES(CRONA_VISIT_DEFAULT)
+#undef CRONA_VISIT_DEFAULT
+
+	Result visitNode(ASTNode * node, Args... args){ return Result(); }
+protected:
+	Derived& self(){ return static_cast<Derived&>(*this); }
+};
+
+} //End namespace crona
+
+#endif
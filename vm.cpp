@@ -0,0 +1,331 @@
+#include <cctype>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include "errors.hpp"
+#include "vm.hpp"
+
+namespace crona{
+
+//Room for the locals and arrays of every call in progress
+static const size_t REGISTER_CELLS = size_t(1) << 22;
+static const size_t STACK_CELLS = size_t(1) << 24;
+static const size_t MAX_DEPTH = size_t(1) << 18;
+
+static const uint64_t HAVOC_SEED = 0x9e3779b97f4a7c15ull;
+
+//Arithmetic wraps, as it would in 32-bit registers
+static inline int32_t wrapAdd(int32_t a, int32_t b){
+	return static_cast<int32_t>(static_cast<uint32_t>(a) + static_cast<uint32_t>(b));
+}
+
+static inline int32_t wrapSub(int32_t a, int32_t b){
+	return static_cast<int32_t>(static_cast<uint32_t>(a) - static_cast<uint32_t>(b));
+}
+
+static inline int32_t wrapMul(int32_t a, int32_t b){
+	return static_cast<int32_t>(static_cast<uint32_t>(a) * static_cast<uint32_t>(b));
+}
+
+VM::VM(const Module& module, std::istream& in, OutBuf& out)
+: myModule(module), myIn(in), myOut(out),
+  myMemorySize(module.memory.size() + STACK_CELLS),
+  myMemory(new int32_t[myMemorySize]),
+  myRegisters(new int32_t[REGISTER_CELLS]),
+  myFrames(new Frame[MAX_DEPTH]), myHavoc(HAVOC_SEED){
+}
+
+bool VM::canThread(){
+#ifdef CRONA_COMPUTED_GOTO
+	return true;
+#else
+	return false;
+#endif
+}
+
+bool VM::run(bool threaded){
+	std::memcpy(myMemory.get(), myModule.memory.data(),
+		myModule.memory.size() * sizeof(int32_t));
+	myHavoc = HAVOC_SEED;
+	bool ok;
+#ifdef CRONA_COMPUTED_GOTO
+	ok = threaded ? execute<true>() : execute<false>();
+#else
+	ok = execute<false>();
+#endif
+	myOut.flush();
+	return ok;
+}
+
+bool VM::fail(const Function * fn, const Instr * ip, const char * msg){
+	myOut.flush();
+	const SourcePos& pos = fn->positions[static_cast<size_t>(ip - fn->code.data())];
+	Report::fatal(pos.line, pos.col, msg);
+	return false;
+}
+
+//xorshift64*, top bit
+bool VM::havoc(){
+	myHavoc ^= myHavoc >> 12;
+	myHavoc ^= myHavoc << 25;
+	myHavoc ^= myHavoc >> 27;
+	return (myHavoc * 0x2545f4914f6cdd1dull) >> 63;
+}
+
+bool VM::word(std::string& text){
+	typedef std::char_traits<char> traits;
+	std::streambuf * in = myIn.rdbuf();
+	int ch = in->sgetc();
+	while (ch != traits::eof() && std::isspace(ch)){ ch = in->snextc(); }
+	if (ch == traits::eof()){ return false; }
+	text.clear();
+	while (ch != traits::eof() && !std::isspace(ch)){
+		text += static_cast<char>(ch);
+		ch = in->snextc();
+	}
+	return true;
+}
+
+bool VM::read(int32_t& value, uint32_t kind, const char *& why){
+	myOut.flush();
+	std::string text;
+	if (kind == DataType::BYTE){
+		typedef std::char_traits<char> traits;
+		std::streambuf * in = myIn.rdbuf();
+		int ch = in->sbumpc();
+		while (ch != traits::eof() && std::isspace(ch)){ ch = in->sbumpc(); }
+		if (ch == traits::eof()){
+			why = "Read past the end of input";
+			return false;
+		}
+		value = static_cast<unsigned char>(ch);
+		return true;
+	}
+	if (!word(text)){
+		why = "Read past the end of input";
+		return false;
+	}
+	if (kind == DataType::BOOL){
+		if (text == "true" || text == "1"){
+			value = 1;
+		} else if (text == "false" || text == "0"){
+			value = 0;
+		} else {
+			why = "Bad input for a bool";
+			return false;
+		}
+		return true;
+	}
+	char * end;
+	errno = 0;
+	long long number = std::strtoll(text.c_str(), &end, 10);
+	if (*end != '\0' || errno != 0){
+		why = "Bad input for an int";
+		return false;
+	}
+	value = static_cast<int32_t>(static_cast<uint32_t>(number));
+	return true;
+}
+
+bool VM::readString(int32_t ref, const char *& why){
+	myOut.flush();
+	std::string text;
+	if (!word(text)){
+		why = "Read past the end of input";
+		return false;
+	}
+	int32_t * cells = myMemory.get() + ref;
+	size_t length = static_cast<size_t>(cells[-1]);
+	for (size_t i = 0; i < length; i++){
+		cells[i] = i < text.size() ? static_cast<unsigned char>(text[i]) : 0;
+	}
+	return true;
+}
+
+void VM::write(int32_t value, uint32_t kind){
+	if (kind == DataType::BOOL){
+		myOut << (value != 0 ? "true" : "false");
+	} else if (kind == DataType::BYTE){
+		myOut << static_cast<char>(value);
+	} else {
+		myOut << value;
+	}
+}
+
+void VM::writeString(int32_t ref){
+	const int32_t * cells = myMemory.get() + ref;
+	int32_t length = cells[-1];
+	for (int32_t i = 0; i < length && cells[i] != 0; i++){
+		myOut << static_cast<char>(cells[i]);
+	}
+}
+
+/*
+The interpreter proper. Each handler is a label, op_<name>, and ends
+with NEXT() (or JUMP(), or a call or return), which DISPATCH()es on
+the instruction now at ip: threaded, it goes straight to the handler
+through LABELS; otherwise, through the switch at dispatch.
+*/
+#ifdef CRONA_COMPUTED_GOTO
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#define DISPATCH() do { \
+		if (THREADED){ goto *LABELS[static_cast<size_t>(ip->op)]; } \
+		goto dispatch; \
+	} while (0)
+#else
+#define DISPATCH() goto dispatch
+#endif
+#define NEXT() do { ip++; DISPATCH(); } while (0)
+#define JUMP() do { ip += ip->d; DISPATCH(); } while (0)
+#define R(x) r[ip->x]
+
+template <bool THREADED>
+bool VM::execute(){
+#ifdef CRONA_COMPUTED_GOTO
+	static const void * const LABELS[NUM_OPS] = {
+#define CRONA_LABEL(name) &&op_##name,
+		CRONA_OPCODES(CRONA_LABEL)
+#undef CRONA_LABEL
+	};
+#endif
+	const Function * fns = myModule.functions.data();
+	int32_t * mem = myMemory.get();
+	int32_t * regsEnd = myRegisters.get() + REGISTER_CELLS;
+	Frame * frames = myFrames.get();
+	Frame * framesEnd = frames + MAX_DEPTH;
+	Frame * sp = frames;
+
+	const Function * fn = &fns[myModule.main];
+	int32_t * r = myRegisters.get();
+	//Where the current call's arrays start, and where the next's will
+	uint32_t arrays = static_cast<uint32_t>(myModule.memory.size());
+	uint32_t top = arrays + fn->arrayCells;
+	int32_t result;
+	const char * why;
+	const Instr * ip = fn->code.data();
+	if (top > myMemorySize){ return fail(fn, ip, "Stack overflow"); }
+	DISPATCH();
+
+dispatch:
+	switch (ip->op){
+#define CRONA_CASE(name) case Op::name: goto op_##name;
+	CRONA_OPCODES(CRONA_CASE)
+#undef CRONA_CASE
+	}
+
+op_CONST: R(a) = ip->d; NEXT();
+op_MOV: R(a) = R(b); NEXT();
+op_LOADG: R(a) = mem[ip->d]; NEXT();
+op_STOREG: mem[ip->d] = R(a); NEXT();
+op_ADD: R(a) = wrapAdd(R(b), R(c)); NEXT();
+op_SUB: R(a) = wrapSub(R(b), R(c)); NEXT();
+op_MUL: R(a) = wrapMul(R(b), R(c)); NEXT();
+op_DIV: {
+	int32_t x = R(b);
+	int32_t y = R(c);
+	if (y == 0){ return fail(fn, ip, "Division by zero"); }
+	if (y == -1 && x == INT32_MIN){ return fail(fn, ip, "Division overflow"); }
+	R(a) = x / y;
+	NEXT();
+}
+op_NEG: R(a) = wrapSub(0, R(b)); NEXT();
+op_NOT: R(a) = R(b) == 0; NEXT();
+op_BYTE: R(a) = R(b) & 0xff; NEXT();
+op_EQ: R(a) = R(b) == R(c); NEXT();
+op_NE: R(a) = R(b) != R(c); NEXT();
+op_LT: R(a) = R(b) < R(c); NEXT();
+op_LE: R(a) = R(b) <= R(c); NEXT();
+op_GT: R(a) = R(b) > R(c); NEXT();
+op_GE: R(a) = R(b) >= R(c); NEXT();
+op_JMP: JUMP();
+op_JT: if (R(a) != 0){ JUMP(); } NEXT();
+op_JF: if (R(a) == 0){ JUMP(); } NEXT();
+op_ALLOCA: {
+	const ArraySlot& slot = fn->arrays[static_cast<size_t>(ip->d)];
+	int32_t * cells = mem + arrays + slot.offset;
+	cells[0] = slot.length;
+	std::memset(cells + 1, 0, static_cast<size_t>(slot.length) * sizeof(int32_t));
+	R(a) = static_cast<int32_t>(cells + 1 - mem);
+	NEXT();
+}
+op_LOADX: {
+	int32_t * cells = mem + R(b);
+	int32_t i = R(c);
+	if (static_cast<uint32_t>(i) >= static_cast<uint32_t>(cells[-1])){
+		return fail(fn, ip, "Array index out of bounds");
+	}
+	R(a) = cells[i];
+	NEXT();
+}
+op_STOREX: {
+	int32_t * cells = mem + R(b);
+	int32_t i = R(c);
+	if (static_cast<uint32_t>(i) >= static_cast<uint32_t>(cells[-1])){
+		return fail(fn, ip, "Array index out of bounds");
+	}
+	cells[i] = R(a);
+	NEXT();
+}
+op_CALL: {
+	const Function * callee = &fns[ip->d];
+	int32_t * window = r + ip->a;
+	if (sp == framesEnd || window + callee->registers > regsEnd
+	  || top + callee->arrayCells > myMemorySize){
+		return fail(fn, ip, "Stack overflow");
+	}
+	*sp++ = Frame{fn, ip + 1, r, arrays};
+	fn = callee;
+	r = window;
+	arrays = top;
+	top += fn->arrayCells;
+	ip = fn->code.data();
+	DISPATCH();
+}
+op_RET:
+	result = R(a);
+	goto ret;
+op_RETV:
+	result = 0;
+ret:
+	//The callee's r0 is the caller's r[a] for the CALL
+	r[0] = result;
+	if (sp == frames){ return true; }
+	sp--;
+	top = arrays;
+	fn = sp->fn;
+	ip = sp->ret;
+	r = sp->regs;
+	arrays = sp->arrays;
+	DISPATCH();
+op_READ:
+	if (!read(R(a), ip->c, why)){ return fail(fn, ip, why); }
+	NEXT();
+op_READS:
+	if (!readString(R(a), why)){ return fail(fn, ip, why); }
+	NEXT();
+op_WRITE: write(R(a), ip->c); NEXT();
+op_WRITES: writeString(R(a)); NEXT();
+op_HAVOC: R(a) = havoc(); NEXT();
+op_ADDI: R(a) = wrapAdd(R(b), ip->d); NEXT();
+op_INC: R(a) = wrapAdd(R(a), 1); NEXT();
+op_DEC: R(a) = wrapSub(R(a), 1); NEXT();
+op_INCG: mem[ip->d] = wrapAdd(mem[ip->d], 1); NEXT();
+op_DECG: mem[ip->d] = wrapSub(mem[ip->d], 1); NEXT();
+op_JEQ: if (R(a) == R(b)){ JUMP(); } NEXT();
+op_JNE: if (R(a) != R(b)){ JUMP(); } NEXT();
+op_JLT: if (R(a) < R(b)){ JUMP(); } NEXT();
+op_JLE: if (R(a) <= R(b)){ JUMP(); } NEXT();
+op_JGT: if (R(a) > R(b)){ JUMP(); } NEXT();
+op_JGE: if (R(a) >= R(b)){ JUMP(); } NEXT();
+}
+
+#undef R
+#undef JUMP
+#undef NEXT
+#undef DISPATCH
+#ifdef CRONA_COMPUTED_GOTO
+#pragma GCC diagnostic pop
+#endif
+
+} //End namespace crona
@@ -0,0 +1,80 @@
+#ifndef CRONA_VM_H
+#define CRONA_VM_H
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <string>
+#include "bytecode.hpp"
+#include "outbuf.hpp"
+
+//Threaded dispatch needs GCC's labels as values (Clang has them too)
+#if defined(__GNUC__) && !defined(CRONA_NO_COMPUTED_GOTO)
+#define CRONA_COMPUTED_GOTO 1
+#endif
+
+namespace crona{
+
+/**
+* \class VM
+* Runs a Module (see bytecode.hpp) from its main function. Where the
+* compiler has computed goto, dispatch is threaded: every handler
+* ends by jumping through a table straight to the next instruction's
+* handler, so each has its own indirect branch for the CPU to
+* predict, rather than all sharing the one at the top of a switch.
+* The switch is still there for builds without it (and to compare).
+*
+* A program reads whitespace-separated words: an int in decimal, a
+* bool as true or false (or 1 or 0), a byte as a single character
+* and, into a byte array, a whole word (cut to fit). It writes ints
+* in decimal, bools as true or false, bytes as characters and byte
+* arrays as text, up to the first zero byte. havoc is a fixed
+* pseudo-random sequence, so runs are repeatable.
+**/
+class VM{
+public:
+	VM(const Module& module, std::istream& in, OutBuf& out);
+	VM(const VM&) = delete;
+	VM& operator=(const VM&) = delete;
+
+	/**
+	* Run the program from the start. Returns false, having reported
+	* where and why, if it failed at run time: a division by zero, an
+	* index out of bounds, recursion too deep, bad input, ...
+	**/
+	bool run(bool threaded = true);
+
+	/// Whether this build has threaded dispatch
+	static bool canThread();
+private:
+	/// A call in progress: the caller's state, to go back to
+	struct Frame{
+		const Function * fn;
+		const Instr * ret;
+		int32_t * regs;
+		uint32_t arrays;
+	};
+
+	template <bool THREADED>
+	bool execute();
+	bool fail(const Function * fn, const Instr * ip, const char * msg);
+	bool word(std::string& text);
+	bool read(int32_t& value, uint32_t kind, const char *& why);
+	bool readString(int32_t ref, const char *& why);
+	void write(int32_t value, uint32_t kind);
+	void writeString(int32_t ref);
+	bool havoc();
+
+	const Module& myModule;
+	std::istream& myIn;
+	OutBuf& myOut;
+	size_t myMemorySize;
+	std::unique_ptr<int32_t[]> myMemory;
+	std::unique_ptr<int32_t[]> myRegisters;
+	std::unique_ptr<Frame[]> myFrames;
+	uint64_t myHavoc;
+};
+
+} //End namespace crona
+
+#endif
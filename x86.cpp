@@ -0,0 +1,432 @@
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "x86.hpp"
+
+namespace crona{
+
+//Calls in progress at once, as on the VM
+static const int MAX_DEPTH = 1 << 18;
+//Image cells per .long line
+static const size_t CELLS_PER_LINE = 16;
+
+/*
+Each bytecode instruction becomes a fixed sequence of machine
+instructions, working through %eax, %ecx and %edx, with registers
+loaded from and stored back to the window. Checks that fail (a
+zero divisor, an index out of bounds, a call too deep) jump to a
+stub after the function that reports the source position.
+*/
+class X86Writer{
+public:
+	X86Writer(const Module& module, OutBuf& out)
+	: myModule(module), myOut(out), myFn(0){}
+
+	void write();
+private:
+	struct Failure{
+		size_t label;
+		SourcePos pos;
+		size_t msg;
+	};
+
+	void function(size_t index);
+	void instr(const Function& fn, size_t at);
+	void image();
+
+	//The operand for register r of the window
+	void reg(uint32_t r){ myOut << static_cast<int>(r * 4) << "(%r12)"; }
+	void label(size_t at){
+		myOut << ".L" << static_cast<int>(myFn) << "_"
+			<< static_cast<int>(at);
+	}
+	void fnName(size_t index){
+		myOut << "crona_fn_" << myModule.functions[index].name->name();
+	}
+	/// A jump (jcc) to the stub reporting msg at pos
+	void fail(const char * jcc, SourcePos pos, const char * msg);
+	void load(const char * dst, uint32_t r){
+		myOut << "\tmovl "; reg(r); myOut << ", " << dst << "\n";
+	}
+	void store(const char * src, uint32_t r){
+		myOut << "\tmovl " << src << ", "; reg(r); myOut << "\n";
+	}
+	void position(SourcePos pos, const char * line, const char * col){
+		myOut << "\tmovl $" << static_cast<int>(pos.line) << ", " << line
+			<< "\n\tmovl $" << static_cast<int>(pos.col) << ", " << col << "\n";
+	}
+	void callRuntime(const char * name){
+		myOut << "\tcall " << name << "\n";
+	}
+	void epilogue(){
+		myOut << "\tmovq %rbx, %r14\n\tpopq %rbx\n\tret\n";
+	}
+	/// Check there's room for a call of fn, at pos
+	void roomFor(const Function& fn, SourcePos pos);
+
+	const Module& myModule;
+	OutBuf& myOut;
+	size_t myFn;
+	std::vector<bool> myTargets;
+	std::vector<Failure> myFailures;
+	size_t myNextFailure = 0;
+	std::vector<std::string> myMessages;
+	std::unordered_map<std::string, size_t> myMessageIndex;
+};
+
+void emitX86(const Module& module, OutBuf& out){
+	X86Writer(module, out).write();
+}
+
+void X86Writer::write(){
+	myOut << "# Generated by cronac; link with runtime/cronart.c\n"
+		<< "\t.text\n";
+	for (size_t f = 0; f < myModule.functions.size(); f++){
+		function(f);
+	}
+
+	//The entry point, called by the runtime's main
+	const Function& main = myModule.functions[myModule.main];
+	myFn = myModule.functions.size();
+	myFailures.clear();
+	myOut << "\t.globl crona_run\n"
+		<< "\t.type crona_run, @function\n"
+		<< "crona_run:\n"
+		<< "\tpushq %rbx\n\tpushq %r12\n\tpushq %r13\n"
+		<< "\tpushq %r14\n\tpushq %r15\n"
+		<< "\tmovq %rdi, %r12\n\tmovq %rsi, %r13\n\tmovq %rdx, %r14\n"
+		<< "\tmovl $" << MAX_DEPTH << ", %r15d\n";
+	SourcePos start = main.positions.empty() ? SourcePos{1, 1}
+		: main.positions[0];
+	myOut << "\tleaq " << static_cast<int>(main.arrayCells) << "(%r14), %rax\n"
+		<< "\tcmpq cronart_memory_cells(%rip), %rax\n";
+	fail("ja", start, "Stack overflow");
+	myOut << "\tcall ";
+	fnName(myModule.main);
+	myOut << "\n\tpopq %r15\n\tpopq %r14\n\tpopq %r13\n"
+		<< "\tpopq %r12\n\tpopq %rbx\n\tret\n";
+	for (const Failure& failure : myFailures){
+		myOut << ".Lfail" << static_cast<int>(failure.label) << ":\n";
+		position(failure.pos, "%edi", "%esi");
+		myOut << "\tleaq .Lmsg" << static_cast<int>(failure.msg)
+			<< "(%rip), %rdx\n";
+		callRuntime("cronart_fail");
+	}
+	myOut << "\t.size crona_run, .-crona_run\n";
+
+	myOut << "\t.section .rodata\n";
+	for (size_t m = 0; m < myMessages.size(); m++){
+		myOut << ".Lmsg" << static_cast<int>(m) << ":\n\t.string \""
+			<< myMessages[m].c_str() << "\"\n";
+	}
+	image();
+	myOut << "\t.section .note.GNU-stack,\"\",@progbits\n";
+}
+
+void X86Writer::fail(const char * jcc, SourcePos pos, const char * msg){
+	auto found = myMessageIndex.find(msg);
+	size_t index;
+	if (found == myMessageIndex.end()){
+		index = myMessages.size();
+		myMessages.push_back(msg);
+		myMessageIndex.emplace(msg, index);
+	} else {
+		index = found->second;
+	}
+	size_t label = myNextFailure++;
+	myFailures.push_back(Failure{label, pos, index});
+	myOut << "\t" << jcc << " .Lfail" << static_cast<int>(label) << "\n";
+}
+
+/// Runs of zeros, which is most of memory, take one directive each
+void X86Writer::image(){
+	const std::vector<int32_t>& memory = myModule.memory;
+	myOut << "\t.data\n\t.globl crona_image\n\t.p2align 2\ncrona_image:\n";
+	size_t i = 0;
+	while (i < memory.size()){
+		size_t end = i;
+		while (end < memory.size() && memory[end] == 0){ end++; }
+		if (end > i){
+			myOut << "\t.zero " << static_cast<int>((end - i) * 4) << "\n";
+			i = end;
+			continue;
+		}
+		myOut << "\t.long ";
+		for (size_t n = 0; n < CELLS_PER_LINE && i < memory.size()
+		  && memory[i] != 0; n++, i++){
+			if (n > 0){ myOut << ","; }
+			myOut << static_cast<int>(memory[i]);
+		}
+		myOut << "\n";
+	}
+	myOut << "\t.globl crona_image_cells\n\t.p2align 3\ncrona_image_cells:\n"
+		<< "\t.quad " << static_cast<int>(memory.size()) << "\n";
+}
+
+void X86Writer::function(size_t index){
+	const Function& fn = myModule.functions[index];
+	myFn = index;
+	myFailures.clear();
+	myTargets.assign(fn.code.size() + 1, false);
+	for (size_t at = 0; at < fn.code.size(); at++){
+		const Instr& in = fn.code[at];
+		switch (in.op){
+		case Op::JMP: case Op::JT: case Op::JF:
+		case Op::JEQ: case Op::JNE: case Op::JLT:
+		case Op::JLE: case Op::JGT: case Op::JGE:
+			myTargets[static_cast<size_t>(static_cast<int64_t>(at) + in.d)] = true;
+			break;
+		default:
+			break;
+		}
+	}
+
+	myOut << "\t.type ";
+	fnName(index);
+	myOut << ", @function\n";
+	fnName(index);
+	myOut << ":\n\tpushq %rbx\n\tmovq %r14, %rbx\n";
+	if (fn.arrayCells > 0){
+		myOut << "\taddq $" << static_cast<int>(fn.arrayCells) << ", %r14\n";
+	}
+	for (size_t at = 0; at < fn.code.size(); at++){
+		if (myTargets[at]){
+			label(at);
+			myOut << ":\n";
+		}
+		instr(fn, at);
+	}
+	for (const Failure& failure : myFailures){
+		myOut << ".Lfail" << static_cast<int>(failure.label) << ":\n";
+		position(failure.pos, "%edi", "%esi");
+		myOut << "\tleaq .Lmsg" << static_cast<int>(failure.msg)
+			<< "(%rip), %rdx\n";
+		callRuntime("cronart_fail");
+	}
+	myOut << "\t.size ";
+	fnName(index);
+	myOut << ", .-";
+	fnName(index);
+	myOut << "\n";
+}
+
+void X86Writer::roomFor(const Function& fn, SourcePos pos){
+	myOut << "\tsubl $1, %r15d\n";
+	fail("jb", pos, "Stack overflow");
+	myOut << "\tleaq " << static_cast<int>(fn.registers * 4) << "(%r12), %rax\n"
+		<< "\tcmpq cronart_registers_end(%rip), %rax\n";
+	fail("ja", pos, "Stack overflow");
+	myOut << "\tleaq " << static_cast<int>(fn.arrayCells) << "(%r14), %rax\n"
+		<< "\tcmpq cronart_memory_cells(%rip), %rax\n";
+	fail("ja", pos, "Stack overflow");
+}
+
+static const char * compareSet(Op op){
+	switch (op){
+	case Op::EQ: return "sete";
+	case Op::NE: return "setne";
+	case Op::LT: return "setl";
+	case Op::LE: return "setle";
+	case Op::GT: return "setg";
+	default: return "setge";
+	}
+}
+
+static const char * compareJump(Op op){
+	switch (op){
+	case Op::JEQ: return "je";
+	case Op::JNE: return "jne";
+	case Op::JLT: return "jl";
+	case Op::JLE: return "jle";
+	case Op::JGT: return "jg";
+	default: return "jge";
+	}
+}
+
+void X86Writer::instr(const Function& fn, size_t at){
+	const Instr& in = fn.code[at];
+	SourcePos pos = fn.positions[at];
+	size_t target = static_cast<size_t>(static_cast<int64_t>(at) + in.d);
+	switch (in.op){
+	case Op::CONST:
+		myOut << "\tmovl $" << in.d << ", "; reg(in.a); myOut << "\n";
+		break;
+	case Op::MOV:
+		load("%eax", in.b);
+		store("%eax", in.a);
+		break;
+	case Op::LOADG:
+		myOut << "\tmovl " << in.d * 4 << "(%r13), %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::STOREG:
+		load("%eax", in.a);
+		myOut << "\tmovl %eax, " << in.d * 4 << "(%r13)\n";
+		break;
+	case Op::ADD:
+	case Op::SUB:
+	case Op::MUL:
+		load("%eax", in.b);
+		myOut << (in.op == Op::ADD ? "\taddl " : in.op == Op::SUB ? "\tsubl "
+			: "\timull ");
+		reg(in.c);
+		myOut << ", %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::DIV:
+		load("%eax", in.b);
+		load("%ecx", in.c);
+		myOut << "\ttestl %ecx, %ecx\n";
+		fail("je", pos, "Division by zero");
+		myOut << "\tcmpl $-1, %ecx\n\tjne .Ldiv" << static_cast<int>(myFn)
+			<< "_" << static_cast<int>(at) << "\n"
+			<< "\tcmpl $-2147483648, %eax\n";
+		fail("je", pos, "Division overflow");
+		myOut << ".Ldiv" << static_cast<int>(myFn) << "_"
+			<< static_cast<int>(at) << ":\n\tcltd\n\tidivl %ecx\n";
+		store("%eax", in.a);
+		break;
+	case Op::NEG:
+		load("%eax", in.b);
+		myOut << "\tnegl %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::NOT:
+		myOut << "\tcmpl $0, "; reg(in.b);
+		myOut << "\n\tsete %al\n\tmovzbl %al, %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::BYTE:
+		myOut << "\tmovzbl "; reg(in.b); myOut << ", %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::EQ:
+	case Op::NE:
+	case Op::LT:
+	case Op::LE:
+	case Op::GT:
+	case Op::GE:
+		load("%eax", in.b);
+		myOut << "\tcmpl "; reg(in.c);
+		myOut << ", %eax\n\t" << compareSet(in.op) << " %al\n"
+			<< "\tmovzbl %al, %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::JMP:
+		myOut << "\tjmp "; label(target); myOut << "\n";
+		break;
+	case Op::JT:
+	case Op::JF:
+		myOut << "\tcmpl $0, "; reg(in.a);
+		myOut << "\n\t" << (in.op == Op::JT ? "jne " : "je ");
+		label(target);
+		myOut << "\n";
+		break;
+	case Op::ALLOCA: {
+		const ArraySlot& slot = fn.arrays[static_cast<size_t>(in.d)];
+		myOut << "\tleal " << static_cast<int>(slot.offset) << "(%rbx), %eax\n"
+			<< "\tmovl $" << slot.length << ", (%r13,%rax,4)\n"
+			<< "\tleal 1(%rax), %edx\n";
+		store("%edx", in.a);
+		if (slot.length > 0){
+			myOut << "\tleaq 4(%r13,%rax,4), %rdi\n"
+				<< "\tmovl $" << slot.length << ", %ecx\n"
+				<< "\txorl %eax, %eax\n\trep stosl\n";
+		}
+		break;
+	}
+	case Op::LOADX:
+	case Op::STOREX:
+		load("%eax", in.b);
+		load("%ecx", in.c);
+		myOut << "\tcmpl -4(%r13,%rax,4), %ecx\n";
+		fail("jae", pos, "Array index out of bounds");
+		myOut << "\taddl %ecx, %eax\n";
+		if (in.op == Op::LOADX){
+			myOut << "\tmovl (%r13,%rax,4), %eax\n";
+			store("%eax", in.a);
+		} else {
+			load("%edx", in.a);
+			myOut << "\tmovl %edx, (%r13,%rax,4)\n";
+		}
+		break;
+	case Op::CALL: {
+		size_t callee = static_cast<size_t>(in.d);
+		int window = static_cast<int>(in.a) * 4;
+		myOut << "\tleaq " << window << "(%r12), %r12\n";
+		roomFor(myModule.functions[callee], pos);
+		myOut << "\tcall ";
+		fnName(callee);
+		myOut << "\n\taddl $1, %r15d\n"
+			<< "\tleaq " << -window << "(%r12), %r12\n";
+		break;
+	}
+	case Op::RET:
+		if (in.a != 0){
+			load("%eax", in.a);
+			store("%eax", 0);
+		}
+		epilogue();
+		break;
+	case Op::RETV:
+		myOut << "\tmovl $0, (%r12)\n";
+		epilogue();
+		break;
+	case Op::READ:
+		myOut << "\tmovl $" << static_cast<int>(in.c) << ", %edi\n";
+		position(pos, "%esi", "%edx");
+		callRuntime("cronart_read");
+		store("%eax", in.a);
+		break;
+	case Op::READS:
+		load("%eax", in.a);
+		myOut << "\tleaq (%r13,%rax,4), %rdi\n";
+		position(pos, "%esi", "%edx");
+		callRuntime("cronart_read_string");
+		break;
+	case Op::WRITE:
+		load("%edi", in.a);
+		myOut << "\tmovl $" << static_cast<int>(in.c) << ", %esi\n";
+		callRuntime("cronart_write");
+		break;
+	case Op::WRITES:
+		load("%eax", in.a);
+		myOut << "\tleaq (%r13,%rax,4), %rdi\n";
+		callRuntime("cronart_write_string");
+		break;
+	case Op::HAVOC:
+		callRuntime("cronart_havoc");
+		store("%eax", in.a);
+		break;
+	case Op::ADDI:
+		load("%eax", in.b);
+		myOut << "\taddl $" << in.d << ", %eax\n";
+		store("%eax", in.a);
+		break;
+	case Op::INC:
+	case Op::DEC:
+		myOut << (in.op == Op::INC ? "\taddl $1, " : "\tsubl $1, ");
+		reg(in.a);
+		myOut << "\n";
+		break;
+	case Op::INCG:
+	case Op::DECG:
+		myOut << (in.op == Op::INCG ? "\taddl $1, " : "\tsubl $1, ")
+			<< in.d * 4 << "(%r13)\n";
+		break;
+	case Op::JEQ:
+	case Op::JNE:
+	case Op::JLT:
+	case Op::JLE:
+	case Op::JGT:
+	case Op::JGE:
+		load("%eax", in.a);
+		myOut << "\tcmpl "; reg(in.b);
+		myOut << ", %eax\n\t" << compareJump(in.op) << " ";
+		label(target);
+		myOut << "\n";
+		break;
+	}
+}
+
+} //End namespace crona
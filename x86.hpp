@@ -0,0 +1,29 @@
+#ifndef CRONA_X86_H
+#define CRONA_X86_H
+
+#include "bytecode.hpp"
+#include "outbuf.hpp"
+
+namespace crona{
+
+/**
+* Write module (see bytecode.hpp) out as x86-64 assembly for the GNU
+* assembler, System V ABI, to be linked with the C runtime in
+* runtime/cronart.c, which does the input and output:
+*
+*	cronac prog.crona -S prog.s && cc -o prog prog.s runtime/cronart.c
+*
+* The program keeps the VM's model, so it behaves exactly as it
+* would there. Each function's register window is in memory, at
+* %r12 (a call moves %r12 up to the arguments, as the VM moves its
+* window); %r13 is the base of memory, which array references and
+* global addresses index in 32-bit cells; %r14 is where the next
+* call's arrays go, and %rbx where the current call's went; %r15
+* counts down the calls that can still be made. All of them are
+* callee-saved, so they survive the calls into the runtime.
+**/
+void emitX86(const Module& module, OutBuf& out);
+
+} //End namespace crona
+
+#endif